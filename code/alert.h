@@ -2,9 +2,9 @@
  * @file alert.h
  * @brief Defines the Alert system for raising and resetting device alerts.
  *
- * The Alert class manages critical notifications such as low battery, low insulin,
- * CGM disconnection, and glucose extremes. Alerts are displayed through the UserInterface
- * and logged into the DataLogger for history tracking.
+ * The Alert class displays critical notifications such as low battery, low insulin,
+ * CGM disconnection, and glucose extremes through the UserInterface. Which alerts are
+ * active, and their logging, is tracked by the widget-free AlertMonitor.
  */
 
 #ifndef ALERT_H
@@ -12,7 +12,7 @@
 
 #include <QWidget>
 #include "userinterface.h"
-#include "datalogger.h"
+#include "alertmonitor.h"
 
 namespace Ui {
 class Alert;
@@ -37,32 +37,26 @@ public:
     ~Alert();
 
     /// Predefined alert types
-    static constexpr int BATTERY_LOW = 1;
-    static constexpr int INSULIN_LOW = 2;
-    static constexpr int CGM_DISCONNECTED = 3;
-    static constexpr int PUMP_OCCLUSION = 6;
-    static constexpr int GLUCOSE_LOW = 4;
-    static constexpr int GLUCOSE_HIGH = 5;
+    static constexpr int BATTERY_LOW = AlertMonitor::BATTERY_LOW;
+    static constexpr int INSULIN_LOW = AlertMonitor::INSULIN_LOW;
+    static constexpr int CGM_DISCONNECTED = AlertMonitor::CGM_DISCONNECTED;
+    static constexpr int PUMP_OCCLUSION = AlertMonitor::PUMP_OCCLUSION;
+    static constexpr int GLUCOSE_LOW = AlertMonitor::GLUCOSE_LOW;
+    static constexpr int GLUCOSE_HIGH = AlertMonitor::GLUCOSE_HIGH;
+    static constexpr int GLUCOSE_PREDICTED_LOW = AlertMonitor::GLUCOSE_PREDICTED_LOW;
 
     /**
-     * @brief Raises a new alert of a specific type.
+     * @brief Displays a new alert of a specific type.
+     *
+     * Called when the AlertMonitor reports a newly raised alert.
+     *
      * @param type Type of the alert.
      * @param interface Pointer to the user interface.
-     * @param logger Pointer to the event logger.
      */
-    static void raise(int type, UserInterface *interface, DataLogger *logger);
-
-    /**
-     * @brief Resets and clears a specific alert type.
-     * @param type Type of the alert to reset.
-     */
-    static void reset(int type);
+    static void raise(int type, UserInterface *interface);
 
 private:
     Ui::Alert *ui;
-
-    /// Keeps track of which alerts are currently active.
-    static QHash<int, bool> raisedAlerts;
 };
 
 #endif // ALERT_H
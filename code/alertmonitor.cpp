@@ -0,0 +1,78 @@
+#include "alertmonitor.h"
+#include "datalogger.h"
+#include <QDataStream>
+#include <QList>
+#include <algorithm>
+
+AlertMonitor::AlertMonitor(DataLogger *logger, QObject *parent)
+    : QObject(parent)
+    , logger(logger)
+{
+}
+
+bool AlertMonitor::raise(int type) {
+    if (raisedAlerts.value(type)) {
+        return false;
+    }
+    raisedAlerts[type] = true;
+
+    if (logger) {
+        switch(type){
+            case BATTERY_LOW:
+                logger->logEvent("Warning", QString("Low Battery"));
+                break;
+            case INSULIN_LOW:
+                logger->logEvent("Warning", QString("Low Insulin"));
+                break;
+            case CGM_DISCONNECTED:
+                logger->logEvent("Warning", QString("CGM disconnected"));
+                break;
+            case PUMP_OCCLUSION:
+                logger->logEvent("Warning", QString("Pump occluded"));
+                break;
+            case GLUCOSE_LOW:
+                logger->logEvent("Warning", QString("Glucose went below minimum safe level"));
+                break;
+            case GLUCOSE_HIGH:
+                logger->logEvent("Warning", QString("Glucose went above maximum safe level"));
+                break;
+            case GLUCOSE_PREDICTED_LOW:
+                logger->logEvent("Warning", QString("Glucose predicted to go below minimum safe level"));
+                break;
+        }
+    }
+
+    emit alertRaised(type);
+    return true;
+}
+
+void AlertMonitor::reset(int type) {
+    raisedAlerts[type] = false;
+}
+
+bool AlertMonitor::isRaised(int type) const {
+    return raisedAlerts.value(type);
+}
+
+void AlertMonitor::saveState(QDataStream &out) const {
+    QList<int> raised;
+    for (int type : raisedAlerts.keys()) {
+        if (raisedAlerts.value(type)) raised.append(type);
+    }
+    std::sort(raised.begin(), raised.end()); // Hash order is not stable across runs
+    out << qint32(raised.size());
+    for (int type : raised) {
+        out << qint32(type);
+    }
+}
+
+void AlertMonitor::restoreState(QDataStream &in) {
+    qint32 count = 0;
+    in >> count;
+    raisedAlerts.clear();
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        qint32 type = 0;
+        in >> type;
+        raisedAlerts[type] = true;
+    }
+}
@@ -0,0 +1,91 @@
+/**
+ * @file alertmonitor.h
+ * @brief Defines the AlertMonitor class for tracking which device alerts are active.
+ *
+ * The AlertMonitor keeps the raised/reset state of every alert type, logs newly
+ * raised alerts to the DataLogger and emits a signal so that a view (the Alert
+ * screen in the GUI) can display them. It has no widget dependencies and is used
+ * by the headless SimulationEngine.
+ */
+
+#ifndef ALERTMONITOR_H
+#define ALERTMONITOR_H
+
+#include <QObject>
+#include <QHash>
+
+class QDataStream;
+class DataLogger;
+
+/**
+ * @class AlertMonitor
+ * @brief Widget-free bookkeeping for device alerts.
+ *
+ * An alert is only reported once until it is reset, which prevents the same
+ * condition from flooding the user and the log on every tick.
+ */
+class AlertMonitor : public QObject
+{
+    Q_OBJECT
+public:
+    /// Predefined alert types
+    static constexpr int BATTERY_LOW = 1;
+    static constexpr int INSULIN_LOW = 2;
+    static constexpr int CGM_DISCONNECTED = 3;
+    static constexpr int PUMP_OCCLUSION = 6;
+    static constexpr int GLUCOSE_LOW = 4;
+    static constexpr int GLUCOSE_HIGH = 5;
+    static constexpr int GLUCOSE_PREDICTED_LOW = 7;
+
+    /**
+     * @brief Constructs an AlertMonitor with no active alerts.
+     * @param logger Logger used to record raised alerts (may be nullptr).
+     * @param parent Optional parent QObject.
+     */
+    explicit AlertMonitor(DataLogger *logger = nullptr, QObject *parent = nullptr);
+
+    /**
+     * @brief Raises an alert if it is not already active.
+     * @param type Type of the alert.
+     * @return True if the alert was newly raised, false if it was already active.
+     */
+    bool raise(int type);
+
+    /**
+     * @brief Resets and clears a specific alert type.
+     * @param type Type of the alert to reset.
+     */
+    void reset(int type);
+
+    /**
+     * @brief Checks whether an alert type is currently active.
+     * @param type Type of the alert.
+     * @return True if the alert has been raised and not reset.
+     */
+    bool isRaised(int type) const;
+
+    /**
+     * @brief Writes which alerts are raised to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the raised alerts without emitting alertRaised().
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
+signals:
+    /**
+     * @brief Emitted when an alert is newly raised.
+     * @param type Type of the alert.
+     */
+    void alertRaised(int type);
+
+private:
+    DataLogger *logger; ///< Event logger (may be nullptr for silent runs).
+    QHash<int, bool> raisedAlerts; ///< Keeps track of which alerts are currently active.
+};
+
+#endif // ALERTMONITOR_H
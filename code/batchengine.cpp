@@ -0,0 +1,538 @@
+#include "batchengine.h"
+#include "bloodstream.h"
+#include "glucosemodel.h"
+#include "insulinreserve.h"
+#include "pumpcontroller.h"
+#include "simulationengine.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BATCH_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// Every kernel below evaluates the scalar model's expressions in the model's order, with
+// no fused multiply-add (simcore.pri builds with -ffp-contract=off), and reproduces
+// std::min/std::max operand order with min/max instructions, so all kernels agree bit for bit.
+
+namespace {
+
+struct Lanes {
+    double *glucose;
+    double *iob;
+    double *reservoir;
+    double *bolusRemaining;
+    const double *basalRate;
+    const double *bolusRate;
+    const double *increasePerHour;
+    const double *driftVariance;
+    const double *insulinUsageRate;
+    const double *correctionFactor;
+};
+
+// CGMReader::advance() followed by PumpController::pump(), one patient at a time
+void stepScalar(const Lanes &lanes, int begin, int end, double hours) {
+    for (int i = begin; i < end; i++) {
+        double iob = lanes.iob[i];
+        double absorbed = GlucoseModel::absorption(lanes.insulinUsageRate[i], iob, hours);
+        lanes.glucose[i] += GlucoseModel::glucoseChange(lanes.increasePerHour[i], lanes.driftVariance[i],
+                                                        lanes.insulinUsageRate[i], iob, lanes.correctionFactor[i], hours);
+        iob = GlucoseModel::afterAbsorption(iob, absorbed);
+
+        double reservoir = lanes.reservoir[i];
+        if (lanes.bolusRemaining[i] > 0) {
+            double delivered = GlucoseModel::bolusDelivered(lanes.bolusRemaining[i], lanes.bolusRate[i], hours);
+            lanes.bolusRemaining[i] -= delivered;
+            iob += delivered;
+            reservoir = GlucoseModel::afterUse(reservoir, delivered);
+        }
+        double basal = lanes.basalRate[i] * hours;
+        iob += basal;
+        lanes.iob[i] = iob;
+        lanes.reservoir[i] = GlucoseModel::afterUse(reservoir, basal);
+    }
+}
+
+struct SensorLanes {
+    double *interstitial;
+    double *noise;
+    double *gain;
+    double *reading;
+    const double *glucose;
+    const double *innovation;
+    const double *lagWeight;
+    const double *lagCarry;
+    const double *noiseCarry;
+    const double *gainStep;
+};
+
+// SensorModel::sample() after its random draws, one patient at a time
+void sensorScalar(const SensorLanes &lanes, int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        lanes.interstitial[i] = GlucoseModel::lagged(lanes.lagWeight[i], lanes.lagCarry[i], lanes.glucose[i],
+                                                     lanes.interstitial[i]);
+        lanes.noise[i] = lanes.noiseCarry[i] * lanes.noise[i] + lanes.innovation[i];
+        lanes.gain[i] += lanes.gainStep[i];
+        lanes.reading[i] = GlucoseModel::sensorReading(lanes.interstitial[i], lanes.gain[i], lanes.noise[i]);
+    }
+}
+
+#ifdef BATCH_X86_KERNELS
+
+// Patients without an active bolus get delivered = +0.0, which leaves IOB (never -0.0),
+// the remaining bolus and the reservoir bit-identical to skipping the bolus branch.
+
+__attribute__((target("sse2")))
+int stepSSE2(const Lanes &lanes, int end, double hours) {
+    const __m128d h = _mm_set1_pd(hours);
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d zero = _mm_setzero_pd();
+
+    int i = 0;
+    for (; i + 2 <= end; i += 2) {
+        __m128d iob = _mm_loadu_pd(lanes.iob + i);
+        __m128d usage = _mm_mul_pd(_mm_loadu_pd(lanes.insulinUsageRate + i), h);
+        __m128d absorbed = _mm_max_pd(_mm_min_pd(iob, usage), zero);
+        __m128d drift = _mm_mul_pd(_mm_mul_pd(_mm_loadu_pd(lanes.increasePerHour + i), h),
+                                   _mm_add_pd(one, _mm_loadu_pd(lanes.driftVariance + i)));
+        __m128d change = _mm_sub_pd(drift, _mm_mul_pd(absorbed, _mm_loadu_pd(lanes.correctionFactor + i)));
+        _mm_storeu_pd(lanes.glucose + i, _mm_add_pd(_mm_loadu_pd(lanes.glucose + i), change));
+        iob = _mm_max_pd(_mm_sub_pd(iob, absorbed), zero);
+
+        __m128d reservoir = _mm_loadu_pd(lanes.reservoir + i);
+        __m128d remaining = _mm_loadu_pd(lanes.bolusRemaining + i);
+        __m128d unitsPerTick = _mm_mul_pd(_mm_loadu_pd(lanes.bolusRate + i), h);
+        __m128d delivered = _mm_and_pd(_mm_min_pd(remaining, unitsPerTick), _mm_cmpgt_pd(remaining, zero));
+        _mm_storeu_pd(lanes.bolusRemaining + i, _mm_sub_pd(remaining, delivered));
+        iob = _mm_add_pd(iob, delivered);
+        reservoir = _mm_and_pd(_mm_sub_pd(reservoir, delivered), _mm_cmple_pd(delivered, reservoir));
+
+        __m128d basal = _mm_mul_pd(_mm_loadu_pd(lanes.basalRate + i), h);
+        _mm_storeu_pd(lanes.iob + i, _mm_add_pd(iob, basal));
+        _mm_storeu_pd(lanes.reservoir + i, _mm_and_pd(_mm_sub_pd(reservoir, basal), _mm_cmple_pd(basal, reservoir)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+int stepAVX2(const Lanes &lanes, int end, double hours) {
+    const __m256d h = _mm256_set1_pd(hours);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d zero = _mm256_setzero_pd();
+
+    int i = 0;
+    for (; i + 4 <= end; i += 4) {
+        __m256d iob = _mm256_loadu_pd(lanes.iob + i);
+        __m256d usage = _mm256_mul_pd(_mm256_loadu_pd(lanes.insulinUsageRate + i), h);
+        __m256d absorbed = _mm256_max_pd(_mm256_min_pd(iob, usage), zero);
+        __m256d drift = _mm256_mul_pd(_mm256_mul_pd(_mm256_loadu_pd(lanes.increasePerHour + i), h),
+                                      _mm256_add_pd(one, _mm256_loadu_pd(lanes.driftVariance + i)));
+        __m256d change = _mm256_sub_pd(drift, _mm256_mul_pd(absorbed, _mm256_loadu_pd(lanes.correctionFactor + i)));
+        _mm256_storeu_pd(lanes.glucose + i, _mm256_add_pd(_mm256_loadu_pd(lanes.glucose + i), change));
+        iob = _mm256_max_pd(_mm256_sub_pd(iob, absorbed), zero);
+
+        __m256d reservoir = _mm256_loadu_pd(lanes.reservoir + i);
+        __m256d remaining = _mm256_loadu_pd(lanes.bolusRemaining + i);
+        __m256d unitsPerTick = _mm256_mul_pd(_mm256_loadu_pd(lanes.bolusRate + i), h);
+        __m256d delivered = _mm256_and_pd(_mm256_min_pd(remaining, unitsPerTick),
+                                          _mm256_cmp_pd(remaining, zero, _CMP_GT_OQ));
+        _mm256_storeu_pd(lanes.bolusRemaining + i, _mm256_sub_pd(remaining, delivered));
+        iob = _mm256_add_pd(iob, delivered);
+        reservoir = _mm256_and_pd(_mm256_sub_pd(reservoir, delivered), _mm256_cmp_pd(delivered, reservoir, _CMP_LE_OQ));
+
+        __m256d basal = _mm256_mul_pd(_mm256_loadu_pd(lanes.basalRate + i), h);
+        _mm256_storeu_pd(lanes.iob + i, _mm256_add_pd(iob, basal));
+        _mm256_storeu_pd(lanes.reservoir + i, _mm256_and_pd(_mm256_sub_pd(reservoir, basal),
+                                                            _mm256_cmp_pd(basal, reservoir, _CMP_LE_OQ)));
+    }
+    return i;
+}
+
+// Sensors without noise have innovation +0.0 and noise +0.0, which stays +0.0 as
+// SensorModel leaves it; the reading is then interstitial * gain exactly.
+
+__attribute__((target("sse2")))
+int sensorSSE2(const SensorLanes &lanes, int end) {
+    int i = 0;
+    for (; i + 2 <= end; i += 2) {
+        __m128d interstitial = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(lanes.lagWeight + i), _mm_loadu_pd(lanes.glucose + i)),
+                                          _mm_mul_pd(_mm_loadu_pd(lanes.lagCarry + i), _mm_loadu_pd(lanes.interstitial + i)));
+        __m128d noise = _mm_add_pd(_mm_mul_pd(_mm_loadu_pd(lanes.noiseCarry + i), _mm_loadu_pd(lanes.noise + i)),
+                                   _mm_loadu_pd(lanes.innovation + i));
+        __m128d gain = _mm_add_pd(_mm_loadu_pd(lanes.gain + i), _mm_loadu_pd(lanes.gainStep + i));
+        _mm_storeu_pd(lanes.interstitial + i, interstitial);
+        _mm_storeu_pd(lanes.noise + i, noise);
+        _mm_storeu_pd(lanes.gain + i, gain);
+        _mm_storeu_pd(lanes.reading + i, _mm_add_pd(_mm_mul_pd(interstitial, gain), noise));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+int sensorAVX2(const SensorLanes &lanes, int end) {
+    int i = 0;
+    for (; i + 4 <= end; i += 4) {
+        __m256d interstitial = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(lanes.lagWeight + i), _mm256_loadu_pd(lanes.glucose + i)),
+                                             _mm256_mul_pd(_mm256_loadu_pd(lanes.lagCarry + i), _mm256_loadu_pd(lanes.interstitial + i)));
+        __m256d noise = _mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(lanes.noiseCarry + i), _mm256_loadu_pd(lanes.noise + i)),
+                                      _mm256_loadu_pd(lanes.innovation + i));
+        __m256d gain = _mm256_add_pd(_mm256_loadu_pd(lanes.gain + i), _mm256_loadu_pd(lanes.gainStep + i));
+        _mm256_storeu_pd(lanes.interstitial + i, interstitial);
+        _mm256_storeu_pd(lanes.noise + i, noise);
+        _mm256_storeu_pd(lanes.gain + i, gain);
+        _mm256_storeu_pd(lanes.reading + i, _mm256_add_pd(_mm256_mul_pd(interstitial, gain), noise));
+    }
+    return i;
+}
+
+#endif // BATCH_X86_KERNELS
+
+quint64 bits(double value) {
+    quint64 result;
+    std::memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+}
+
+BatchEngine::BatchEngine(int patients)
+    : patients(qMax(0, patients))
+    , kernel(bestKernel())
+    , glucose(this->patients)
+    , iob(this->patients, 0.0)
+    , reservoir(this->patients, InsulinReserve::maxAmount)
+    , basalRate(this->patients, 0.0)
+    , bolusRemaining(this->patients, 0.0)
+    , bolusRate(this->patients, 0.0)
+    , increasePerHour(this->patients)
+    , driftVariance(this->patients)
+    , insulinUsageRate(this->patients)
+    , correctionFactor(this->patients)
+    , volatility(this->patients)
+    , controllerRate(this->patients, 0.0)
+    , thresholds(this->patients)
+    , bolusSuspended(this->patients, 0)
+    , random(this->patients)
+    , profiles(this->patients)
+    , interstitial(this->patients)
+    , sensorNoise(this->patients)
+    , sensorGain(this->patients)
+    , sensorGlucose(this->patients)
+    , sensorInnovation(this->patients, 0.0)
+    , lagWeight(this->patients)
+    , lagCarry(this->patients)
+    , noiseCarry(this->patients)
+    , gainStep(this->patients)
+    , sensorStarted(this->patients)
+    , sensorDropped(this->patients)
+    , sensors(this->patients)
+    , sensorRandom(this->patients)
+{
+    setProfile(Profile::defaultProfile());
+    setSensor(SensorParameters());
+    for (int i = 0; i < this->patients; i++) {
+        setPatient(i, PatientParameters(), 0);
+    }
+}
+
+int BatchEngine::size() const {
+    return patients;
+}
+
+void BatchEngine::setPatient(int index, const PatientParameters &parameters, quint64 seed) {
+    glucose[index] = parameters.startGlucose;
+    increasePerHour[index] = parameters.increasePerHour;
+    insulinUsageRate[index] = parameters.insulinUsageRate;
+    volatility[index] = parameters.volatility;
+    random[index] = SimRandom(seed).split(SimulationEngine::GlucoseDriftStream);
+    driftVariance[index] = (random[index].nextDouble() - 0.5) * volatility[index] * 2;
+    sensorRandom[index] = SimRandom(seed).split(SimulationEngine::SensorNoiseStream);
+    sensorStarted[index] = 0;
+    sensorGlucose[index] = parameters.startGlucose;
+}
+
+void BatchEngine::setProfile(const Profile &profile) {
+    for (int i = 0; i < patients; i++) {
+        setProfile(i, profile);
+    }
+}
+
+void BatchEngine::setProfile(int index, const Profile &profile) {
+    profiles[index] = profile;
+    correctionFactor[index] = profile.getCorrectionFactor();
+}
+
+void BatchEngine::setSensor(const SensorParameters &parameters) {
+    for (int i = 0; i < patients; i++) {
+        setSensor(i, parameters);
+    }
+}
+
+void BatchEngine::setSensor(int index, const SensorParameters &parameters) {
+    const SensorCoefficients coefficients = SensorCoefficients::of(parameters, SimulationEngine::sampleMinutes);
+    sensors[index] = coefficients;
+    lagWeight[index] = coefficients.lagWeight;
+    lagCarry[index] = coefficients.lagCarry;
+    noiseCarry[index] = coefficients.noiseCarry;
+    gainStep[index] = coefficients.gainStep;
+
+    // SensorModel::configure() restarts the sensor
+    sensorStarted[index] = 0;
+    interstitial[index] = 0;
+    sensorNoise[index] = 0;
+    sensorGain[index] = 1;
+    sensorDropped[index] = 0;
+}
+
+void BatchEngine::setKernel(Kernel kernel) {
+    this->kernel = std::min(kernel, bestKernel());
+}
+
+BatchEngine::Kernel BatchEngine::getKernel() const {
+    return kernel;
+}
+
+BatchEngine::Kernel BatchEngine::bestKernel() {
+#ifdef BATCH_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return AVX2Kernel;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return SSE2Kernel;
+    }
+#endif
+    return ScalarKernel;
+}
+
+bool BatchEngine::matchesScalarDosing() {
+#ifdef FIXED_POINT_DOSING
+    return false;
+#else
+    return true;
+#endif
+}
+
+QString BatchEngine::kernelName(Kernel kernel) {
+    switch (kernel) {
+    case SSE2Kernel: return "sse2";
+    case AVX2Kernel: return "avx2";
+    case ScalarKernel: break;
+    }
+    return "scalar";
+}
+
+void BatchEngine::step(double hours) {
+    const Lanes lanes = {glucose.data(), iob.data(), reservoir.data(), bolusRemaining.data(),
+                         basalRate.data(), bolusRate.data(), increasePerHour.data(), driftVariance.data(),
+                         insulinUsageRate.data(), correctionFactor.data()};
+
+    int done = 0;
+#ifdef BATCH_X86_KERNELS
+    if (kernel == AVX2Kernel) {
+        done = stepAVX2(lanes, patients, hours);
+    } else if (kernel == SSE2Kernel) {
+        done = stepSSE2(lanes, patients, hours);
+    }
+#endif
+    stepScalar(lanes, done, patients, hours); // Patients left over from the vector width
+}
+
+void BatchEngine::varyDrift() {
+    for (int i = 0; i < patients; i++) {
+        driftVariance[i] = (random[i].nextDouble() - 0.5) * volatility[i] * 2;
+    }
+}
+
+void BatchEngine::sampleSensors() {
+    // Random draws in SensorModel::sample()'s order, per patient stream
+    for (int i = 0; i < patients; i++) {
+        const SensorCoefficients &sensor = sensors[i];
+        if (!sensorStarted[i]) {
+            interstitial[i] = glucose[i];
+            sensorStarted[i] = 1;
+        }
+        sensorInnovation[i] = (sensor.noiseScale > 0) ? sensor.noiseScale * sensorRandom[i].nextGaussian() : 0.0;
+        if (sensor.dropoutStart > 0) {
+            sensorDropped[i] = sensorRandom[i].nextDouble() < (sensorDropped[i] ? 1 - sensor.dropoutEnd : sensor.dropoutStart);
+        }
+    }
+
+    const SensorLanes lanes = {interstitial.data(), sensorNoise.data(), sensorGain.data(), sensorGlucose.data(),
+                               glucose.data(), sensorInnovation.data(), lagWeight.data(), lagCarry.data(),
+                               noiseCarry.data(), gainStep.data()};
+    int done = 0;
+#ifdef BATCH_X86_KERNELS
+    if (kernel == AVX2Kernel) {
+        done = sensorAVX2(lanes, patients);
+    } else if (kernel == SSE2Kernel) {
+        done = sensorSSE2(lanes, patients);
+    }
+#endif
+    sensorScalar(lanes, done, patients);
+
+    for (int i = 0; i < patients; i++) {
+        if (sensorDropped[i]) {
+            sensorGlucose[i] = -1;
+        }
+    }
+}
+
+void BatchEngine::sampleAndCheck() {
+    varyDrift();
+    sampleSensors();
+    for (int i = 0; i < patients; i++) {
+        const double reading = sensorGlucose[i];
+        if (reading == -1 || reading < 3.9) {
+            bolusSuspended[i] = 1; // SimulationEngine::safetyChecks()
+            bolusRemaining[i] = 0;
+        }
+    }
+}
+
+void BatchEngine::sample() {
+    sample(0, thresholds); // The threshold rules ignore the time
+}
+
+void BatchEngine::intakeCarbs(int index, double carbs) {
+    glucose[index] += profiles[index].getCarbRatio() * carbs;
+}
+
+void BatchEngine::deliverBolus(int index, double units, double rate) {
+    if (bolusSuspended[index]) {
+        return;
+    }
+    bolusRemaining[index] = std::min(reservoir[index], units);
+    bolusRate[index] = rate;
+}
+
+void BatchEngine::adjustBasalRate(int index, double rate) {
+    controllerRate[index] = rate;
+    basalRate[index] = rate;
+}
+
+void BatchEngine::refillInsulin(int index) {
+    reservoir[index] = InsulinReserve::maxAmount;
+}
+
+bool BatchEngine::isInsulinLow(int index) const {
+    return reservoir[index] <= InsulinReserve::lowAmount;
+}
+
+double BatchEngine::getGlucose(int index) const {
+    return glucose[index];
+}
+
+double BatchEngine::getSensorGlucose(int index) const {
+    return sensorGlucose[index];
+}
+
+double BatchEngine::getIOB(int index) const {
+    return iob[index];
+}
+
+double BatchEngine::getInsulinRemaining(int index) const {
+    return reservoir[index];
+}
+
+double BatchEngine::getBasalRate(int index) const {
+    return basalRate[index];
+}
+
+double BatchEngine::getBolusRemaining(int index) const {
+    return bolusRemaining[index];
+}
+
+int BatchEngine::compareWithScalarModel(Kernel kernel, int patients, int steps, quint64 seed) {
+    struct Model {
+        CGMReader cgm;
+        Bloodstream blood;
+        InsulinReserve insulin;
+        PumpController pump{&insulin, nullptr};
+    };
+
+    SimRandom random(seed);
+    BatchEngine batch(patients);
+    batch.setKernel(kernel);
+    std::vector<std::unique_ptr<Model>> models;
+
+    for (int i = 0; i < patients; i++) {
+        PatientParameters parameters;
+        parameters.volatility = 1.2 * random.nextDouble();
+        parameters.increasePerHour = 3 * random.nextDouble();
+        parameters.insulinUsageRate = 1 + 2 * random.nextDouble();
+        parameters.startGlucose = 3 + 9 * random.nextDouble();
+        quint64 patientSeed = random.next();
+
+        std::unique_ptr<Model> model(new Model);
+        model->cgm.setPatient(parameters);
+        model->cgm.setRandom(SimRandom(patientSeed).split(SimulationEngine::GlucoseDriftStream));
+        batch.setPatient(i, parameters, patientSeed);
+
+        SensorParameters sensor;
+        sensor.lagMinutes = 20 * random.nextDouble();
+        sensor.noiseSd = random.nextDouble() < 0.25 ? 0 : random.nextDouble();
+        sensor.noiseCorrelation = random.nextDouble();
+        sensor.driftPerDay = 0.1 * (random.nextDouble() - 0.5);
+        sensor.dropoutRate = 0.05 * random.nextDouble();
+        model->cgm.setSensor(sensor, SimulationEngine::sampleMinutes);
+        model->cgm.setSensorRandom(SimRandom(patientSeed).split(SimulationEngine::SensorNoiseStream));
+        batch.setSensor(i, sensor);
+
+        Profile profile = Profile::defaultProfile();
+        profile.setCorrectionFactor(1 + 3 * random.nextDouble());
+        batch.setProfile(i, profile);
+        models.push_back(std::move(model));
+    }
+
+    int mismatches = 0;
+    for (int step = 0; step < steps; step++) {
+        // Random deliveries, including boluses that end mid-step and drained reservoirs
+        for (int i = 0; i < patients; i++) {
+            Model *model = models[i].get();
+            if (random.nextDouble() < 0.05) {
+                double units = 20 * random.nextDouble();
+                double rate = 60 * random.nextDouble();
+                model->pump.deliverBolus(units, rate);
+                batch.deliverBolus(i, units, rate);
+            }
+            if (random.nextDouble() < 0.1) {
+                double rate = random.nextDouble() < 0.2 ? 0 : 3 * random.nextDouble();
+                model->pump.adjustBasalRate(rate);
+                batch.adjustBasalRate(i, rate);
+            }
+            if (random.nextDouble() < 0.01) {
+                model->insulin.refillInsulin();
+                batch.refillInsulin(i);
+            }
+        }
+
+        qint64 msecs = qRound64((1 + 9 * random.nextDouble()) * 60000); // Whole milliseconds, as the engine steps
+        double hours = msecs / 3600000.0;
+        for (int i = 0; i < patients; i++) {
+            Model *model = models[i].get();
+            model->cgm.advance(&model->blood, batch.profiles[i].getCorrectionFactor(), hours);
+            model->pump.pump(&model->blood, msecs);
+        }
+        batch.step(hours);
+
+        for (int i = 0; i < patients; i++) {
+            Model *model = models[i].get();
+            if (bits(model->cgm.getCurrentGlucoseLevel()) != bits(batch.getGlucose(i))) mismatches++;
+            if (bits(model->blood.getIOB()) != bits(batch.getIOB(i))) mismatches++;
+            if (bits(model->insulin.getInsulinRemaining()) != bits(batch.getInsulinRemaining(i))) mismatches++;
+        }
+
+        if (step % 5 == 4) {
+            batch.sampleSensors();
+            for (int i = 0; i < patients; i++) {
+                if (bits(models[i]->cgm.sampleSensor()) != bits(batch.getSensorGlucose(i))) mismatches++;
+                models[i]->cgm.varyDrift();
+            }
+            batch.varyDrift();
+        }
+    }
+    return mismatches;
+}
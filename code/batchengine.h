@@ -0,0 +1,303 @@
+/**
+ * @file batchengine.h
+ * @brief Defines the BatchEngine class, which steps many patients in lockstep.
+ *
+ * A SimulationEngine keeps one patient's state in separate objects (CGMReader,
+ * Bloodstream, InsulinReserve, PumpController). The BatchEngine keeps the same state for
+ * N patients in contiguous arrays (structure of arrays) and integrates the whole batch
+ * with one kernel, vectorised with AVX2 or SSE2 where the CPU has it. Every kernel
+ * performs the scalar model's operations in the same order, so each patient's glucose,
+ * IOB and reservoir are bit for bit what the scalar objects would compute.
+ *
+ * The batch models a connected sensor (with each patient's SensorModel configuration) and
+ * an unobstructed pump; faults, alerts and the battery stay with SimulationEngine.
+ *
+ * The basal controller is a template parameter of sample() (see controllerpolicies.h):
+ * every patient gets its own policy object, called without virtual dispatch.
+ */
+#ifndef BATCHENGINE_H
+#define BATCHENGINE_H
+
+#include <QElapsedTimer>
+#include <QString>
+#include <QVector>
+#include <vector>
+#include "cgmreader.h"
+#include "controllerpolicies.h"
+#include "profile.h"
+#include "sensormodel.h"
+#include "simrandom.h"
+
+/**
+ * @class BatchEngine
+ * @brief Structure-of-arrays state and integration kernel for a batch of patients.
+ */
+class BatchEngine
+{
+public:
+    /**
+     * @brief Integration kernels, from slowest to fastest.
+     */
+    enum Kernel {
+        ScalarKernel, ///< One patient at a time.
+        SSE2Kernel,   ///< Two patients per instruction.
+        AVX2Kernel    ///< Four patients per instruction.
+    };
+
+    /**
+     * @brief Constructs a batch of default patients with the default profile.
+     *
+     * The kernel defaults to bestKernel().
+     *
+     * @param patients Number of patients in the batch.
+     */
+    explicit BatchEngine(int patients);
+
+    /**
+     * @brief Returns the number of patients in the batch.
+     */
+    int size() const;
+
+    /**
+     * @brief Sets a patient's parameters and seed, and restarts it at its start glucose.
+     *
+     * The glucose drift is drawn from the same stream a SimulationEngine seeded with
+     * @p seed uses, so both see the same drift sequence.
+     *
+     * @param index Patient index.
+     * @param parameters Glucose model parameters.
+     * @param seed Patient seed.
+     */
+    void setPatient(int index, const PatientParameters &parameters, quint64 seed);
+
+    /**
+     * @brief Sets the profile of every patient in the batch.
+     * @param profile Profile to apply.
+     */
+    void setProfile(const Profile &profile);
+
+    /**
+     * @brief Sets the profile of one patient.
+     * @param index Patient index.
+     * @param profile Profile to apply.
+     */
+    void setProfile(int index, const Profile &profile);
+
+    /**
+     * @brief Selects the integration kernel, falling back to the best one the CPU supports.
+     * @param kernel Requested kernel.
+     */
+    void setKernel(Kernel kernel);
+    Kernel getKernel() const;
+
+    /**
+     * @brief Returns the fastest kernel this build and CPU support.
+     */
+    static Kernel bestKernel();
+
+    /**
+     * @brief Returns a kernel's name ("scalar", "sse2" or "avx2").
+     * @param kernel Kernel.
+     */
+    static QString kernelName(Kernel kernel);
+
+    /**
+     * @brief Checks whether the kernels reproduce the scalar model's dosing in this build.
+     *
+     * The kernels always dose in double. In fixed_dosing builds (fixedpoint.h) the scalar
+     * pump rounds each delivery to a micro-unit, so the batch engine would not give the
+     * results of the engines it stands in for; the population tools refuse to use it there.
+     * @return False in fixed_dosing builds.
+     */
+    static bool matchesScalarDosing();
+
+    /**
+     * @brief Integrates every patient over one step: drift, absorption, bolus and basal delivery.
+     *
+     * Equivalent to CGMReader::advance() followed by PumpController::pump() for each patient.
+     *
+     * @param hours Step length in hours.
+     */
+    void step(double hours);
+
+    /**
+     * @brief Draws every patient's next glucose drift variation, as CGMReader::varyDrift().
+     */
+    void varyDrift();
+
+    /**
+     * @brief Configures every patient's sensor, as CGMReader::setSensor().
+     * @param parameters Sensor configuration.
+     */
+    void setSensor(const SensorParameters &parameters);
+
+    /**
+     * @brief Configures one patient's sensor, as CGMReader::setSensor().
+     * @param index Patient index.
+     * @param parameters Sensor configuration.
+     */
+    void setSensor(int index, const SensorParameters &parameters);
+
+    /**
+     * @brief Takes a sensor sample of every patient, as CGMReader::sampleSensor().
+     *
+     * The random draws are made patient by patient; the lag, noise and gain filters then
+     * run over the whole batch with the selected kernel.
+     */
+    void sampleSensors();
+
+    /**
+     * @brief Processes a sensor sample for every patient.
+     *
+     * Draws the next drift variation, takes the sensor samples, cancels the bolus of
+     * patients below 3.9 mmol/L or without a reading and runs the Control-IQ decision on
+     * the readings, as a SimulationEngine does on each SensorSample event.
+     */
+    void sample();
+
+    /**
+     * @brief Processes a sensor sample for every patient, with a basal controller policy.
+     *
+     * As sample(), but each patient's reading goes to its own controller, whose rate is
+     * applied when it differs from the current one. Patients without a reading get no decision.
+     *
+     * @param msecs Time of the sample (ms since epoch).
+     * @param controllers One controller per patient.
+     * @param timing If not null, receives the decisions taken and the time spent in them.
+     */
+    template<class Controller>
+    void sample(qint64 msecs, std::vector<Controller> &controllers, ControllerTiming *timing = nullptr);
+
+    /**
+     * @brief Adds a meal's glucose to one patient, using the patient's carb ratio.
+     * @param index Patient index.
+     * @param carbs Carbohydrates (grams).
+     */
+    void intakeCarbs(int index, double carbs);
+
+    /**
+     * @brief Starts a bolus for one patient, as PumpController::deliverBolus().
+     * @param index Patient index.
+     * @param units Bolus size (units), limited to the insulin remaining.
+     * @param rate Delivery rate (units/hour).
+     */
+    void deliverBolus(int index, double units, double rate);
+
+    /**
+     * @brief Sets one patient's basal rate, as PumpController::adjustBasalRate().
+     * @param index Patient index.
+     * @param rate Basal rate (units/hour).
+     */
+    void adjustBasalRate(int index, double rate);
+
+    /**
+     * @brief Fills one patient's reservoir, as InsulinReserve::refillInsulin().
+     * @param index Patient index.
+     */
+    void refillInsulin(int index);
+
+    /**
+     * @brief Returns true if one patient's reservoir is at or below the low threshold.
+     * @param index Patient index.
+     */
+    bool isInsulinLow(int index) const;
+
+    double getGlucose(int index) const;
+    double getSensorGlucose(int index) const; ///< Reading of the last sensor sample, or -1 in a dropout.
+    double getIOB(int index) const;
+    double getInsulinRemaining(int index) const;
+    double getBasalRate(int index) const;
+    double getBolusRemaining(int index) const;
+
+    /**
+     * @brief Steps the same random patients with the scalar objects and with a kernel.
+     *
+     * The patients get random sensors, and every fifth step their sensor readings are
+     * compared too.
+     *
+     * Used to check a kernel on the machine it runs on (e.g. population --verify-kernel).
+     * Only meaningful where matchesScalarDosing() is true.
+     *
+     * @param kernel Kernel to check.
+     * @param patients Patients to compare.
+     * @param steps Integration steps to compare.
+     * @param seed Seed of the random patients, boluses and basal rates.
+     * @return Number of patient values that differ in any bit; 0 when the kernel is exact.
+     */
+    static int compareWithScalarModel(Kernel kernel, int patients, int steps, quint64 seed);
+
+private:
+    /**
+     * @brief Draws the drift variations, takes the sensor samples and cancels the boluses of patients in danger.
+     */
+    void sampleAndCheck();
+
+    int patients;
+    Kernel kernel;
+
+    // Integrated by the kernel, one entry per patient
+    std::vector<double> glucose;        ///< CGMReader reading (mmol/L).
+    std::vector<double> iob;            ///< Bloodstream insulin on board (units).
+    std::vector<double> reservoir;      ///< InsulinReserve insulin remaining (units).
+    std::vector<double> basalRate;      ///< PumpController basal rate (units/hour).
+    std::vector<double> bolusRemaining; ///< PumpController active bolus amount (units).
+    std::vector<double> bolusRate;      ///< PumpController active bolus rate (units/hour).
+
+    // Read by the kernel
+    std::vector<double> increasePerHour;  ///< Natural glucose rise (mmol/L per hour).
+    std::vector<double> driftVariance;    ///< Current relative variation of the rise.
+    std::vector<double> insulinUsageRate; ///< Insulin absorbed (units/hour).
+    std::vector<double> correctionFactor; ///< Profile correction factor.
+
+    // Used between steps only
+    std::vector<double> volatility;     ///< Patient volatility.
+    std::vector<double> controllerRate; ///< ControlIQAlgorithm current rate (units/hour).
+    std::vector<ThresholdPolicy> thresholds; ///< Controllers of sample().
+    std::vector<char> bolusSuspended;   ///< PumpController bolus suspension.
+    QVector<SimRandom> random;          ///< Per-patient glucose drift streams.
+    QVector<Profile> profiles;          ///< Per-patient profiles.
+
+    // Sensor state, filtered by the sensor kernel
+    std::vector<double> interstitial;     ///< SensorModel lagged glucose (mmol/L).
+    std::vector<double> sensorNoise;      ///< SensorModel noise (mmol/L).
+    std::vector<double> sensorGain;       ///< SensorModel calibration gain.
+    std::vector<double> sensorGlucose;    ///< Last sensor reading (mmol/L), -1 in a dropout.
+    std::vector<double> sensorInnovation; ///< Noise innovation drawn for the current sample.
+    std::vector<double> lagWeight;        ///< SensorCoefficients::lagWeight.
+    std::vector<double> lagCarry;         ///< SensorCoefficients::lagCarry.
+    std::vector<double> noiseCarry;       ///< SensorCoefficients::noiseCarry.
+    std::vector<double> gainStep;         ///< SensorCoefficients::gainStep.
+    std::vector<char> sensorStarted;      ///< Whether the sensor took a sample.
+    std::vector<char> sensorDropped;      ///< Whether the sensor is in a dropout.
+    QVector<SensorCoefficients> sensors;  ///< Per-patient sensor coefficients.
+    QVector<SimRandom> sensorRandom;      ///< Per-patient sensor noise streams.
+};
+
+template<class Controller>
+void BatchEngine::sample(qint64 msecs, std::vector<Controller> &controllers, ControllerTiming *timing) {
+    sampleAndCheck();
+
+    QElapsedTimer timer;
+    if (timing) {
+        timer.start();
+    }
+    qint64 decisions = 0;
+    for (int i = 0; i < patients; i++) {
+        const double reading = sensorGlucose[i];
+        if (reading == -1) {
+            continue; // No reading, no controller decision
+        }
+        const ControllerInput input = {msecs, reading, iob[i], controllerRate[i], &profiles[i]};
+        double rate = controllers[i].decide(input);
+        if (rate != controllerRate[i]) {
+            adjustBasalRate(i, rate);
+        }
+        decisions++;
+    }
+    if (timing) {
+        timing->decisionNs += timer.nsecsElapsed();
+        timing->decisions += decisions;
+    }
+}
+
+#endif // BATCHENGINE_H
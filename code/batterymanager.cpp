@@ -1,7 +1,9 @@
 #include "batterymanager.h"
+#include <QDataStream>
 
 BatteryManager::BatteryManager()
     : batteryLevel(1.0)
+    , failing(false)
 { }
 
 BatteryManager::~BatteryManager()
@@ -11,10 +13,10 @@ double BatteryManager::getBatteryLevel(){
 	return batteryLevel;
 }
 
-void BatteryManager::drainBattery(){ 
-	// Drains battery level by 1%.
+void BatteryManager::drainBattery(double elapsedHours){
+	// Drains battery level by 0.1% every 5 minutes.
 	// Would not exist in a real device.
-    batteryLevel -= 0.001;
+    batteryLevel -= (failing ? failingDrainPerHour : drainPerHour) * elapsedHours;
 	if (batteryLevel <= 0){
 		batteryLevel = 0;
         emit batteryDead();
@@ -26,6 +28,22 @@ void BatteryManager::chargeBattery(){
 	batteryLevel = 1;
 }
 
+void BatteryManager::setFailing(bool failing){
+    this->failing = failing;
+}
+
+bool BatteryManager::isFailing() const{
+    return failing;
+}
+
 bool BatteryManager::isBatteryCritical(){
 	return batteryLevel <= criticalValue;
 }
+
+void BatteryManager::saveState(QDataStream &out) const {
+    out << batteryLevel;
+}
+
+void BatteryManager::restoreState(QDataStream &in) {
+    in >> batteryLevel;
+}
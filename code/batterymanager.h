@@ -11,6 +11,8 @@
 
 #include <QObject>
 
+class QDataStream;
+
 /**
  * @class BatteryManager
  * @brief Simulates the battery behavior of the device.
@@ -39,8 +41,9 @@ public:
 
     /**
      * @brief Drains the battery based on usage.
+     * @param elapsedHours Simulated time the device has been running, in hours.
      */
-    void drainBattery();
+    void drainBattery(double elapsedHours);
 
     /**
      * @brief Checks if the battery level is below the critical threshold.
@@ -53,6 +56,30 @@ public:
      */
     void alertLowBattery();
 
+    /**
+     * @brief Simulates a failing battery, which drains many times faster until cleared.
+     * @param failing True while the battery is failing.
+     */
+    void setFailing(bool failing);
+
+    /**
+     * @brief Checks whether a battery failure is being simulated.
+     * @return True if the battery is failing.
+     */
+    bool isFailing() const;
+
+    /**
+     * @brief Writes the battery level to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the battery level written by saveState().
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
 public slots:
     /**
      * @brief Charges the battery back to full.
@@ -67,7 +94,10 @@ signals:
 
 private:
     double batteryLevel;           ///< Current battery level.
+    bool failing;                  ///< Simulated battery failure (restored by the engine's FaultInjector, not saved here).
     static constexpr double criticalValue = 0.15; ///< Critical battery threshold (15%).
+    static constexpr double drainPerHour = 0.012; ///< Battery used per simulated hour (0.1% every 5 minutes).
+    static constexpr double failingDrainPerHour = 0.3; ///< Battery used per simulated hour while failing (flat in about 3 hours).
 };
 
 #endif // BATTERYMANAGER_H
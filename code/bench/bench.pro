@@ -0,0 +1,19 @@
+# Controller benchmark suite: clinical and compute metrics on the standard scenario sets, written as JSON.
+QT = core
+
+TEMPLATE = app
+CONFIG += console c++17 thread
+CONFIG -= app_bundle
+TARGET = bench
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+
+# The simcore headers must see the same dosing type as the library (see simcore.pri)
+fixed_dosing: DEFINES += FIXED_POINT_DOSING
+
+SOURCES += \
+    main.cpp
+
+LIBS += -L$$OUT_PWD/../simcore -lsimcore
+PRE_TARGETDEPS += $$OUT_PWD/../simcore/libsimcore.a
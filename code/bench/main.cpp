@@ -0,0 +1,426 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "glucosemodel.h"
+#include "populationrunner.h"
+#include "pumpcontroller.h"
+#include "simulationengine.h"
+
+// Controller benchmark suite.
+// Runs the standard scenario sets (fasting, three meals with boluses, a missed lunch bolus,
+// sensor dropouts) through full SimulationEngines, so every sample goes through
+// ControlIQAlgorithm and PumpController, for each controller strategy and a set of virtual
+// patients. It prints clinical metrics (time in range, hypo events, insulin) next to compute
+// metrics (simulated ticks per second, per-decision latency percentiles) and writes them to
+// a JSON file, so runs can be compared over time. Patients run one after another on one
+// thread, so the latencies are not disturbed by other runs. It also times the pump's dosing
+// path on its own, to compare builds with and without fixed-point dosing (fixedpoint.h).
+
+namespace {
+
+constexpr int hypoEventReadings = 3; ///< Consecutive readings below 3.9 mmol/L (15 minutes) that make a hypo event.
+
+// dosingDigest() of a fixed_dosing build. Fixed-point dosing is integer arithmetic only, so
+// every fixed build, on any compiler or target, must reproduce it.
+constexpr quint64 fixedDosingReference = 0x70ccbeffcd668ebcULL;
+
+struct BenchMeal {
+    int minuteOfDay;
+    double carbs;
+};
+
+const BenchMeal dailyMeals[] = {{8 * 60, 50}, {12 * 60 + 30, 70}, {19 * 60, 80}};
+
+struct BenchScenario {
+    const char *name;
+    bool meals;             ///< Whether the three daily meals are eaten.
+    bool boluses;           ///< Whether meals get a bolus from the bolus calculator formula.
+    bool missLunchBolus;    ///< Whether the lunch bolus is forgotten.
+    bool sensorDropouts;    ///< Whether the sensor drops out and disconnects at random.
+};
+
+const BenchScenario scenarios[] = {
+    {"fasting", false, false, false, false},
+    {"three-meals", true, true, false, false},
+    {"missed-bolus", true, true, true, false},
+    {"sensor-dropouts", true, true, false, true},
+};
+
+// Totals of one scenario and controller over every patient
+struct BenchResult {
+    int readings = 0;
+    int inRange = 0;
+    int belowRange = 0;
+    int aboveRange = 0;
+    double glucoseSum = 0;
+    int hypoEvents = 0;
+    double insulin = 0;
+    qint64 events = 0;
+    qint64 ticks = 0;
+    qint64 wallNs = 0;
+    QVector<qint64> latencies;
+};
+
+// Nearest-rank percentile of sorted values
+qint64 percentile(const QVector<qint64> &sorted, double fraction) {
+    if (sorted.isEmpty()) {
+        return 0;
+    }
+    int rank = int(std::ceil(fraction * sorted.size()));
+    return sorted[qBound(0, rank - 1, sorted.size() - 1)];
+}
+
+void runPatient(const BenchScenario &scenario, ControlIQAlgorithm::Strategy strategy, const VirtualPatient &patient,
+                const QDateTime &start, int days, BenchResult *result) {
+    const Profile profile = Profile::defaultProfile();
+    SimulationEngine engine; // No logger, so the decisions are not timed with file output
+    engine.setTime(start);
+    engine.setSeed(patient.seed);
+    engine.setPatient(patient.parameters);
+    engine.setProfile(profile);
+    engine.getController()->setStrategy(strategy);
+    if (scenario.sensorDropouts) {
+        engine.getCGM()->setSensor(SensorParameters::typical(), SimulationEngine::sampleMinutes);
+        FaultProfile disconnects;
+        disconnects.perDay = 4;
+        disconnects.meanMinutes = 20;
+        engine.setFaultProfile(SimulationEngine::SensorFault, disconnects);
+    }
+    engine.setMonitoring(true);
+
+    QVector<QPair<QDateTime, double>> boluses; // Meal boluses, started on the pump when they are due
+    for (int day = 0; scenario.meals && day < days; day++) {
+        QDateTime midnight(start.date().addDays(day), QTime(0, 0), start.timeSpec());
+        for (const BenchMeal &meal : dailyMeals) {
+            QDateTime time = midnight.addSecs(qint64(meal.minuteOfDay) * 60);
+            engine.scheduleMeal(time, meal.carbs);
+            bool lunch = &meal == &dailyMeals[1];
+            if (scenario.boluses && !(scenario.missLunchBolus && lunch)) {
+                boluses.append({time, GlucoseModel::carbBolus(meal.carbs, profile.getCarbRatio(), profile.getCorrectionFactor())});
+            }
+        }
+    }
+
+    double lastInsulin = engine.getInsulinReserve()->getInsulinRemaining();
+    int lowReadings = 0;
+    QObject::connect(&engine, &SimulationEngine::sampled, [&](const SimulationSample &sample) {
+        if (sample.glucose != -1) { // A dropout neither starts nor ends a hypo event
+            result->readings++;
+            result->glucoseSum += sample.glucose;
+            if (sample.glucose < 3.9) {
+                result->belowRange++;
+                if (++lowReadings == hypoEventReadings) {
+                    result->hypoEvents++;
+                }
+            } else {
+                lowReadings = 0;
+                if (sample.glucose > 10.0) result->aboveRange++;
+                else result->inRange++;
+            }
+        }
+        result->insulin += lastInsulin - sample.insulin;
+        lastInsulin = sample.insulin;
+
+        // Attentive user: charge and refill as soon as the device asks for it
+        if (engine.getBattery()->isBatteryCritical()) {
+            engine.getBattery()->chargeBattery();
+            engine.getAlerts()->reset(AlertMonitor::BATTERY_LOW);
+        }
+        if (engine.getInsulinReserve()->isInsulinLow()) {
+            engine.getInsulinReserve()->refillInsulin();
+            engine.getAlerts()->reset(AlertMonitor::INSULIN_LOW);
+            lastInsulin = engine.getInsulinReserve()->getInsulinRemaining();
+        }
+    });
+
+    engine.setDecisionLatencies(&result->latencies);
+    QElapsedTimer timer;
+    timer.start();
+    for (const QPair<QDateTime, double> &bolus : boluses) {
+        result->events += engine.runUntil(bolus.first);
+        engine.getPump()->startPlan(DeliveryPlan::normal(bolus.second, GlucoseModel::bolusRate), /*suppressTime=*/true);
+    }
+    result->events += engine.runUntil(start.addDays(days));
+    result->wallNs += timer.nsecsElapsed();
+    result->ticks += start.msecsTo(engine.currentTime()) / (qint64(SimulationEngine::tickMinutes) * 60 * 1000);
+}
+
+// Metrics of one scenario and controller, derived from the totals
+struct BenchMetrics {
+    double meanGlucose;
+    double timeInRange;
+    double timeBelowRange;
+    double timeAboveRange;
+    double hyposPerPatientDay;
+    double insulinPerPatientDay;
+    double wallSeconds;
+    double ticksPerSecond;
+    double eventsPerSecond;
+    double meanLatency;
+    qint64 p50;
+    qint64 p90;
+    qint64 p99;
+    qint64 maxLatency;
+};
+
+BenchMetrics summarize(BenchResult &result, int patients, int days) {
+    std::sort(result.latencies.begin(), result.latencies.end());
+    const int readings = qMax(1, result.readings);
+    const double patientDays = double(patients) * days;
+    qint64 latencySum = 0;
+    for (qint64 latency : result.latencies) {
+        latencySum += latency;
+    }
+
+    BenchMetrics metrics;
+    metrics.meanGlucose = result.glucoseSum / readings;
+    metrics.timeInRange = double(result.inRange) / readings;
+    metrics.timeBelowRange = double(result.belowRange) / readings;
+    metrics.timeAboveRange = double(result.aboveRange) / readings;
+    metrics.hyposPerPatientDay = result.hypoEvents / patientDays;
+    metrics.insulinPerPatientDay = result.insulin / patientDays;
+    metrics.wallSeconds = result.wallNs / 1e9;
+    metrics.ticksPerSecond = metrics.wallSeconds > 0 ? result.ticks / metrics.wallSeconds : 0.0;
+    metrics.eventsPerSecond = metrics.wallSeconds > 0 ? result.events / metrics.wallSeconds : 0.0;
+    metrics.meanLatency = result.latencies.isEmpty() ? 0.0 : double(latencySum) / result.latencies.size();
+    metrics.p50 = percentile(result.latencies, 0.50);
+    metrics.p90 = percentile(result.latencies, 0.90);
+    metrics.p99 = percentile(result.latencies, 0.99);
+    metrics.maxLatency = result.latencies.isEmpty() ? 0 : result.latencies.last();
+    return metrics;
+}
+
+QJsonObject toJson(const BenchScenario &scenario, const QString &controller, const BenchResult &result,
+                   const BenchMetrics &metrics) {
+    QJsonObject clinical;
+    clinical["readings"] = result.readings;
+    clinical["mean_glucose"] = metrics.meanGlucose;
+    clinical["time_in_range"] = metrics.timeInRange;
+    clinical["time_below_range"] = metrics.timeBelowRange;
+    clinical["time_above_range"] = metrics.timeAboveRange;
+    clinical["hypo_events"] = result.hypoEvents;
+    clinical["hypo_events_per_patient_day"] = metrics.hyposPerPatientDay;
+    clinical["total_insulin"] = result.insulin;
+    clinical["insulin_per_patient_day"] = metrics.insulinPerPatientDay;
+
+    QJsonObject latency;
+    latency["mean"] = metrics.meanLatency;
+    latency["p50"] = metrics.p50;
+    latency["p90"] = metrics.p90;
+    latency["p99"] = metrics.p99;
+    latency["max"] = metrics.maxLatency;
+
+    QJsonObject compute;
+    compute["wall_seconds"] = metrics.wallSeconds;
+    compute["ticks"] = result.ticks;
+    compute["ticks_per_second"] = metrics.ticksPerSecond;
+    compute["events"] = result.events;
+    compute["events_per_second"] = metrics.eventsPerSecond;
+    compute["decisions"] = result.latencies.size();
+    compute["decision_latency_ns"] = latency;
+
+    QJsonObject json;
+    json["scenario"] = scenario.name;
+    json["controller"] = controller;
+    json["clinical"] = clinical;
+    json["compute"] = compute;
+    return json;
+}
+
+// Times the pump's dosing path alone (PumpController::pump() with an insulin reserve), with a
+// bolus started every 6 minutes, so builds with and without fixed_dosing can be compared on
+// the target they are meant for. Returns ns per tick.
+double dosingNsPerTick(int ticks) {
+    InsulinReserve reserve;
+    Bloodstream blood;
+    PumpController pump(&reserve, nullptr);
+    pump.adjustBasalRate(1.2);
+    const qint64 msecs = qint64(SimulationEngine::fineStepMinutes) * 60 * 1000; // The engine's step while a bolus runs
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int tick = 0; tick < ticks; tick++) {
+        if (tick % 6 == 0) {
+            pump.deliverBolus(0.5, 6);
+        }
+        if (reserve.isInsulinLow()) {
+            reserve.refillInsulin();
+        }
+        pump.pump(&blood, msecs);
+    }
+    return double(timer.nsecsElapsed()) / ticks;
+}
+
+quint64 doseBits(DoseValue dose) {
+#ifdef FIXED_POINT_DOSING
+    return quint64(dose.steps());
+#else
+    quint64 bits;
+    std::memcpy(&bits, &dose, sizeof bits);
+    return bits;
+#endif
+}
+
+// Runs a fixed sequence through the dosing path (bolus formulas, normal, extended,
+// dual-wave and split plans, basal changes, suspensions) and returns an FNV-1a hash of every
+// dose value it produces, so the dosing arithmetic of two builds can be compared exactly.
+quint64 dosingDigest() {
+    quint64 hash = 14695981039346656037ULL;
+    auto mix = [&hash](DoseValue dose) {
+        quint64 bits = doseBits(dose);
+        for (int byte = 0; byte < 8; byte++) {
+            hash = (hash ^ ((bits >> (8 * byte)) & 0xff)) * 1099511628211ULL;
+        }
+    };
+
+    InsulinReserve reserve;
+    Bloodstream blood;
+    PumpController pump(&reserve, nullptr);
+    const qint64 msecs = qint64(SimulationEngine::fineStepMinutes) * 60 * 1000;
+    for (int tick = 0; tick < 20000; tick++) {
+        if (tick % 240 == 0) {
+            DoseValue glucose(5 + (tick / 240 % 13) * 0.7);
+            DoseValue dose = GlucoseModel::carbBolus(20 + tick / 240 % 60, DoseValue(10), DoseValue(2.2))
+                             + GlucoseModel::correctionBolus(glucose, DoseValue(6.1), DoseValue(2.2));
+            mix(dose);
+            switch (tick / 240 % 4) {
+            case 0: pump.deliverBolus(static_cast<double>(dose), GlucoseModel::bolusRate); break;
+            case 1: pump.startPlan(DeliveryPlan::extended(static_cast<double>(dose), 2.5)); break;
+            case 2: pump.startPlan(DeliveryPlan::dualWave(0.4 * static_cast<double>(dose), 0.6 * static_cast<double>(dose), 1.5, GlucoseModel::bolusRate)); break;
+            case 3: pump.startPlan(DeliveryPlan::split(0.5 * static_cast<double>(dose), 0.5 * static_cast<double>(dose), 0.75, GlucoseModel::bolusRate)); break;
+            }
+        }
+        if (tick % 97 == 0) {
+            pump.adjustBasalRate(0.35 * (tick / 97 % 7));
+        }
+        if (tick % 1009 == 500) {
+            pump.suspendBolus();
+            pump.resumeBolus();
+        }
+        if (reserve.isInsulinLow()) {
+            reserve.refillInsulin();
+        }
+        pump.pump(&blood, msecs);
+        mix(reserve.getDoseRemaining());
+    }
+    return hash;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("bench");
+
+    const QStringList controllerNames = {"threshold", "mpc"}; // ControlIQAlgorithm::Strategy order
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmarks the controllers on the standard scenario sets and writes the results as JSON.");
+    parser.addHelpOption();
+    parser.addOption({"patients", "Virtual patients per scenario and controller (default 10).", "count", "10"});
+    parser.addOption({"days", "Simulated days per patient (default 3).", "days", "3"});
+    parser.addOption({"seed", "Population seed (default 1).", "seed", "1"});
+    parser.addOption({"controllers", "Comma-separated controllers: threshold, mpc (default both).", "names", "threshold,mpc"});
+    parser.addOption({"output", "JSON results file (default bench.json).", "path", "bench.json"});
+    parser.addOption({"check-dosing", "Only compare the dosing digest with the fixed_dosing reference and exit (fixed_dosing builds)."});
+    parser.process(app);
+
+    quint64 digest = dosingDigest();
+#ifdef FIXED_POINT_DOSING
+    bool dosingMatches = digest == fixedDosingReference;
+#else
+    bool dosingMatches = true; // Only the fixed-point arithmetic is the same on every target
+#endif
+    if (parser.isSet("check-dosing")) {
+        printf("Dosing digest: %016llx (%s)\n", (unsigned long long)digest,
+               dosingMatches ? "matches the fixed_dosing reference" : "DIFFERS from the fixed_dosing reference");
+        return dosingMatches ? 0 : 1;
+    }
+
+    bool okPatients = false, okDays = false, okSeed = false;
+    int patients = parser.value("patients").toInt(&okPatients);
+    int days = parser.value("days").toInt(&okDays);
+    quint64 seed = parser.value("seed").toULongLong(&okSeed);
+    if (!okPatients || !okDays || !okSeed || patients <= 0 || days <= 0) {
+        fprintf(stderr, "Invalid --patients, --days or --seed value\n");
+        return 1;
+    }
+    QList<ControlIQAlgorithm::Strategy> strategies;
+    for (const QString &name : parser.value("controllers").split(',')) {
+        int strategy = controllerNames.indexOf(name.trimmed().toLower());
+        if (strategy < 0) {
+            fprintf(stderr, "Invalid --controllers value: %s\n", qPrintable(name));
+            return 1;
+        }
+        strategies.append(ControlIQAlgorithm::Strategy(strategy));
+    }
+
+    PopulationRunner population(patients, seed); // Same patients for every scenario and controller
+    const QDateTime start(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC);
+
+    printf("%-16s %-10s %6s %6s %5s %8s %11s %8s %8s %8s\n", "scenario", "controller", "TIR %", "<3.9 %", "hypos",
+           "insulin", "ticks/s", "p50 ns", "p99 ns", "max ns");
+    QJsonArray results;
+    for (const BenchScenario &scenario : scenarios) {
+        for (ControlIQAlgorithm::Strategy strategy : strategies) {
+            BenchResult result;
+            for (int i = 0; i < patients; i++) {
+                runPatient(scenario, strategy, population.patient(i), start, days, &result);
+            }
+            BenchMetrics metrics = summarize(result, patients, days);
+            results.append(toJson(scenario, controllerNames[strategy], result, metrics));
+            printf("%-16s %-10s %6.1f %6.1f %5d %8.1f %11.0f %8lld %8lld %8lld\n", scenario.name,
+                   qPrintable(controllerNames[strategy]), 100 * metrics.timeInRange, 100 * metrics.timeBelowRange,
+                   result.hypoEvents, metrics.insulinPerPatientDay, metrics.ticksPerSecond, (long long)metrics.p50,
+                   (long long)metrics.p99, (long long)metrics.maxLatency);
+        }
+    }
+
+#ifdef FIXED_POINT_DOSING
+    const QString dosingArithmetic = "fixed";
+#else
+    const QString dosingArithmetic = "double";
+#endif
+    double dosingNs = dosingNsPerTick(2000000);
+    printf("\nDosing path (%s arithmetic): %.1f ns per tick\n", qPrintable(dosingArithmetic), dosingNs);
+
+    printf("Dosing digest: %016llx%s\n", (unsigned long long)digest, dosingMatches ? "" : " (DIFFERS from the fixed_dosing reference)");
+
+    QJsonObject dosing;
+    dosing["arithmetic"] = dosingArithmetic;
+    dosing["ns_per_tick"] = dosingNs;
+    dosing["digest"] = QString::number(digest, 16);
+    dosing["matches_reference"] = dosingMatches;
+
+    QJsonObject config;
+    config["patients"] = patients;
+    config["days"] = days;
+    config["seed"] = QString::number(seed); // Full 64 bits; JSON numbers are doubles
+
+    QJsonObject root;
+    root["benchmark"] = "controller-suite";
+    root["format"] = 1;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["qt_version"] = qVersion();
+    root["config"] = config;
+    root["results"] = results;
+    root["dosing"] = dosing;
+
+    QFile file(parser.value("output"));
+    QByteArray json = QJsonDocument(root).toJson();
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+        fprintf(stderr, "Could not write %s\n", qPrintable(parser.value("output")));
+        return 1;
+    }
+    printf("\nResults written to %s\n", qPrintable(parser.value("output")));
+    return dosingMatches ? 0 : 1;
+}
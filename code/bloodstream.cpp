@@ -1,20 +1,200 @@
 #include "bloodstream.h"
+#include "glucosemodel.h"
+#include <QDataStream>
+#include <cmath>
+
+namespace {
+// Share of a dose not yet acted t hours after it, with depot rate a and plasma rate b (per hour)
+double remainingShare(double a, double b, double t) {
+    if (a == b) {
+        return (1 + a * t) * std::exp(-a * t);
+    }
+    return (a * std::exp(-b * t) - b * std::exp(-a * t)) / (a - b);
+}
+}
 
 Bloodstream::Bloodstream(QObject *parent)
     : QObject{parent}
+    , model(LinearModel)
     , insulinOnBoard(0)
+    , lastActivity(0)
+    , actionDuration(360)
+    , actionPeak(75)
+    , depot(0)
+    , plasma(0)
+    , depotRate(0)
+    , plasmaRate(0)
+    , cachedHours(-1)
+    , depotDecay(1)
+    , plasmaDecay(1)
+    , transfer(0)
 {
-
+    updateRates();
 }
 
 double Bloodstream::getIOB(){
-    return insulinOnBoard;
+    return model == LinearModel ? insulinOnBoard : depot + plasma;
+}
+
+double Bloodstream::getActivity() const{
+    return model == LinearModel ? lastActivity : plasmaRate * plasma;
 }
 
 void Bloodstream::absorbUnits(double insulin){
-    insulinOnBoard = std::max(0.0, insulinOnBoard - insulin);
+    if (model == LinearModel) {
+        insulinOnBoard = GlucoseModel::afterAbsorption(insulinOnBoard, insulin);
+        return;
+    }
+    double iob = depot + plasma;
+    double share = (iob > 0) ? std::max(0.0, iob - insulin) / iob : 0;
+    depot *= share;
+    plasma *= share;
 }
 
 void Bloodstream::injectUnits(double insulin){
-    insulinOnBoard += insulin;
+    if (model == LinearModel) {
+        insulinOnBoard += insulin;
+    } else if (depotRate > 0) {
+        depot += insulin;
+    } else {
+        plasma += insulin; // Exponential curve: acts at once
+    }
+}
+
+void Bloodstream::setActionCurve(double durationMinutes, double peakMinutes){
+    double iob = getIOB();
+    model = CurveModel;
+    actionDuration = durationMinutes;
+    actionPeak = std::max(0.0, peakMinutes);
+    updateRates();
+
+    insulinOnBoard = 0;
+    depot = (depotRate > 0) ? iob : 0;
+    plasma = (depotRate > 0) ? 0 : iob;
+}
+
+void Bloodstream::setLinearModel(){
+    insulinOnBoard = getIOB();
+    model = LinearModel;
+    depot = 0;
+    plasma = 0;
+    lastActivity = 0;
+}
+
+Bloodstream::Model Bloodstream::getModel() const{
+    return model;
+}
+
+double Bloodstream::getActionDuration() const{
+    return actionDuration;
+}
+
+double Bloodstream::getActionPeak() const{
+    return actionPeak;
+}
+
+double Bloodstream::absorption(double usageRate, double elapsedHours) const{
+    if (model == LinearModel) {
+        return GlucoseModel::absorption(usageRate, insulinOnBoard, elapsedHours);
+    }
+    double depotAfter = 0, plasmaAfter = 0;
+    propagate(elapsedHours, &depotAfter, &plasmaAfter);
+    return (depot + plasma) - (depotAfter + plasmaAfter);
+}
+
+double Bloodstream::absorb(double usageRate, double elapsedHours){
+    if (model == LinearModel) {
+        double absorbed = absorption(usageRate, elapsedHours);
+        insulinOnBoard = GlucoseModel::afterAbsorption(insulinOnBoard, absorbed);
+        lastActivity = (elapsedHours > 0) ? absorbed / elapsedHours : 0;
+        return absorbed;
+    }
+    double iob = depot + plasma;
+    propagate(elapsedHours, &depot, &plasma);
+    return iob - (depot + plasma);
+}
+
+void Bloodstream::propagate(double elapsedHours, double *depotAfter, double *plasmaAfter) const{
+    double hours = std::max(0.0, elapsedHours);
+    if (hours != cachedHours) {
+        depotDecay = std::exp(-depotRate * hours);
+        plasmaDecay = std::exp(-plasmaRate * hours);
+        if (depotRate == 0) {
+            transfer = 0;
+        } else if (depotRate == plasmaRate) {
+            transfer = depotRate * hours * plasmaDecay;
+        } else {
+            transfer = depotRate / (plasmaRate - depotRate) * (depotDecay - plasmaDecay);
+        }
+        cachedHours = hours;
+    }
+    double depotBefore = depot;
+    *plasmaAfter = plasma * plasmaDecay + depotBefore * transfer;
+    *depotAfter = depotBefore * depotDecay;
+}
+
+void Bloodstream::updateRates(){
+    const double remaining = 1 - actedFraction;
+    cachedHours = -1;
+
+    if (actionPeak <= 0) {
+        // Exponential: remaining share exp(-rate t) reaches 1 - actedFraction at the duration
+        double durationHours = std::max(actionDuration, 1.0) / 60;
+        depotRate = 0;
+        plasmaRate = -std::log(remaining) / durationHours;
+        actionDuration = durationHours * 60;
+        return;
+    }
+
+    // Biexponential with depotRate = r * plasmaRate peaks at ln(r) / (plasmaRate * (r - 1));
+    // the tail lengthens with r, so bisect r for the duration. r = 1 is the shortest curve.
+    const double peakHours = actionPeak / 60;
+    auto rates = [peakHours](double r, double *a, double *b) {
+        *b = (r == 1) ? 1 / peakHours : std::log(r) / (peakHours * (r - 1));
+        *a = r * *b;
+    };
+
+    double a = 0, b = 0;
+    rates(1, &a, &b);
+    double shortest = 0, longest = 1;
+    while (remainingShare(a, b, longest) > remaining) longest *= 2;
+    for (int i = 0; i < 100; i++) {
+        double middle = (shortest + longest) / 2;
+        (remainingShare(a, b, middle) > remaining ? shortest : longest) = middle;
+    }
+    double durationHours = std::max(actionDuration / 60, longest);
+
+    double low = 1, high = 2;
+    rates(high, &a, &b);
+    while (remainingShare(a, b, durationHours) < remaining && high < 1e6) {
+        high *= 2;
+        rates(high, &a, &b);
+    }
+    for (int i = 0; i < 100 && durationHours > longest; i++) {
+        double middle = (low + high) / 2;
+        rates(middle, &a, &b);
+        (remainingShare(a, b, durationHours) < remaining ? low : high) = middle;
+    }
+    rates(durationHours > longest ? (low + high) / 2 : 1, &depotRate, &plasmaRate);
+    actionDuration = durationHours * 60;
+}
+
+void Bloodstream::saveState(QDataStream &out) const {
+    out << insulinOnBoard;
+    out << qint32(model) << lastActivity << actionDuration << actionPeak << depot << plasma;
+}
+
+void Bloodstream::restoreState(QDataStream &in, int formatVersion) {
+    in >> insulinOnBoard;
+    if (formatVersion < 3) {
+        model = LinearModel;
+        lastActivity = 0;
+        depot = 0;
+        plasma = 0;
+        return;
+    }
+    qint32 savedModel = 0;
+    in >> savedModel >> lastActivity >> actionDuration >> actionPeak >> depot >> plasma;
+    model = (savedModel == CurveModel) ? CurveModel : LinearModel;
+    updateRates();
 }
@@ -4,6 +4,13 @@
  *
  * The Bloodstream class models how insulin enters and remains in the bloodstream,
  * allowing calculation of Insulin On Board (IOB) at any given time.
+ *
+ * By default IOB is a single amount that the patient absorbs at a constant rate (linear
+ * model). With an insulin action curve set, insulin instead moves through two
+ * compartments (subcutaneous depot, then plasma) with first-order rates, which gives the
+ * biexponential action curves pumps use for IOB. The compartments are the state of the
+ * curve: every dose outstanding is already summed into them, so advancing the model is
+ * O(1) per step however many boluses are still acting.
  */
 
 #ifndef BLOODSTREAM_H
@@ -11,6 +18,8 @@
 
 #include <QObject>
 
+class QDataStream;
+
 /**
  * @class Bloodstream
  * @brief Simulates insulin activity within the bloodstream.
@@ -21,6 +30,14 @@ class Bloodstream : public QObject
 {
     Q_OBJECT
 public:
+    /**
+     * @brief Insulin absorption models.
+     */
+    enum Model {
+        LinearModel, ///< IOB absorbed at the patient's constant usage rate.
+        CurveModel   ///< IOB follows an exponential or biexponential action curve.
+    };
+
     /**
      * @brief Constructs a Bloodstream object with zero insulin on board.
      * @param parent Optional parent QObject.
@@ -29,6 +46,9 @@ public:
 
     /**
      * @brief Absorbs units of insulin over time, decreasing IOB.
+     *
+     * With an action curve, both compartments give up the same share of their insulin.
+     *
      * @param insulin Amount of insulin absorbed.
      */
     void absorbUnits(double insulin);
@@ -45,11 +65,99 @@ public:
      */
     double getIOB();
 
+    /**
+     * @brief Returns the current insulin activity: the rate insulin acts on glucose.
+     *
+     * With an action curve this is the rate insulin leaves the plasma compartment; with
+     * the linear model it is the rate of the last absorb() step.
+     *
+     * @return Activity in units/hour.
+     */
+    double getActivity() const;
+
+    /**
+     * @brief Switches to an action curve, keeping the current IOB.
+     *
+     * The curve's activity peaks @p peakMinutes after a dose and 95% of the dose has acted
+     * after @p durationMinutes. A peak of 0 gives an exponential curve (the dose acts at
+     * once and decays). Durations too short for the peak are raised to the shortest curve
+     * with that peak. IOB already on board starts at the beginning of the curve.
+     *
+     * @param durationMinutes Duration of insulin action (minutes).
+     * @param peakMinutes Time of peak activity (minutes), or 0.
+     */
+    void setActionCurve(double durationMinutes, double peakMinutes);
+
+    /**
+     * @brief Switches back to the linear model, keeping the current IOB.
+     */
+    void setLinearModel();
+
+    Model getModel() const;
+    double getActionDuration() const; ///< Duration of action of the curve (minutes).
+    double getActionPeak() const;     ///< Peak activity time of the curve (minutes).
+
+    /**
+     * @brief Returns the insulin the model absorbs over the next step, without advancing.
+     * @param usageRate Patient's insulin usage rate (units/hour), used by the linear model.
+     * @param elapsedHours Step length in hours.
+     * @return Units absorbed.
+     */
+    double absorption(double usageRate, double elapsedHours) const;
+
+    /**
+     * @brief Advances absorption by one step.
+     * @param usageRate Patient's insulin usage rate (units/hour), used by the linear model.
+     * @param elapsedHours Step length in hours.
+     * @return Units absorbed over the step.
+     */
+    double absorb(double usageRate, double elapsedHours);
+
+    /**
+     * @brief Writes the insulin on board and the absorption model to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the state written by saveState().
+     * @param in Checkpoint stream.
+     * @param formatVersion Checkpoint format; versions before 3 only hold the linear IOB.
+     */
+    void restoreState(QDataStream &in, int formatVersion);
+
 signals:
     // No custom signals yet.
 
 private:
-    double insulinOnBoard;
+    /**
+     * @brief Depot and plasma insulin after a step without new doses (exact solution).
+     */
+    void propagate(double elapsedHours, double *depotAfter, double *plasmaAfter) const;
+
+    /**
+     * @brief Derives the compartment rates from the duration and peak.
+     */
+    void updateRates();
+
+    Model model;
+    double insulinOnBoard; ///< Linear model IOB (units).
+    double lastActivity;   ///< Linear model absorption rate of the last step (units/hour).
+
+    double actionDuration; ///< Curve duration of action (minutes).
+    double actionPeak;     ///< Curve peak activity time (minutes).
+    double depot;          ///< Curve subcutaneous compartment (units).
+    double plasma;         ///< Curve plasma compartment (units).
+    double depotRate;      ///< Depot to plasma rate (per hour); 0 for an exponential curve.
+    double plasmaRate;     ///< Plasma elimination rate (per hour).
+
+    // Propagation coefficients of the last step length, so fixed steps cost no exp()
+    mutable double cachedHours;
+    mutable double depotDecay;
+    mutable double plasmaDecay;
+    mutable double transfer;
+
+    static constexpr double actedFraction = 0.95; ///< Share of a dose acted by the end of the duration.
 };
 
 #endif // BLOODSTREAM_H
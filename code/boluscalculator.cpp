@@ -1,6 +1,8 @@
 #include "boluscalculator.h"
 #include "ui_boluscalculator.h"
 #include "profile.h"
+#include "glucosemodel.h"
+#include "fixedpoint.h"
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QCheckBox>
@@ -16,8 +18,7 @@ BolusCalculator::BolusCalculator(PumpController* pump,
     , logger(logger)
     , cgm(cgm)
     , insulinReserve(insulin)
-    , remainingExtendedDose(0.0)
-    , countdownMinutes(0)
+    , extendedDosePlan(0)
 {
     ui->setupUi(this);
 
@@ -70,15 +71,12 @@ bool BolusCalculator::validateBolusInput(double dose) {
 // Calculates Correction Bolus
 double BolusCalculator::calculateCorrectionBolus(double glucose, double target, double correctionFactor)
 {
-    if (correctionFactor <= 0) return 0;
-    double diff = glucose - target;
-    return (diff > 0) ? (diff / correctionFactor) : 0;
+    return static_cast<double>(GlucoseModel::correctionBolus(DoseValue(glucose), DoseValue(target), DoseValue(correctionFactor)));
 }
 
 // Calculates food bolus
 double BolusCalculator::calculateCarbBolus(double carbs, double carbRatio, double correctionFactor) {
-    if (carbRatio <= 0) return 0;
-    return (carbs * carbRatio)/correctionFactor;
+    return static_cast<double>(GlucoseModel::carbBolus(carbs, DoseValue(carbRatio), DoseValue(correctionFactor)));
 }
 
 // Calculates Total Bolus (before IOB)
@@ -179,14 +177,12 @@ void BolusCalculator::on_btnDeliver_clicked()
         // Second Portion of the Dose to be Delivered Later on 
         double laterDose = dose - nowDose;
 
-        // Start countdown to the second part of the bolus and deliver the immediate part of the dose
+        // The pump delivers both parts and counts down to the second one on its own
         pump->resumeBolus();
-        countdownMinutes = mins;
-        pump->deliverBolus(nowDose, bolusRate, /*suppressTime=*/true);
-        
-        logger->logEvent("Extended Bolus", QString("Now: %1 units, Later: %2 units in %3 min").arg(nowDose).arg(laterDose).arg(mins));
+        pump->cancelPlan(extendedDosePlan); // Replaces any extended dose still pending
+        extendedDosePlan = pump->startPlan(DeliveryPlan::split(nowDose, laterDose, mins / 60.0, bolusRate), /*suppressTime=*/true);
 
-        remainingExtendedDose = laterDose;
+        logger->logEvent("Extended Bolus", QString("Now: %1 units, Later: %2 units in %3 min").arg(nowDose).arg(laterDose).arg(mins));
     } else {
         // Manual delivery path if extended bolus is skipped
         if (QMessageBox::question(this, "Final Confirmation", QString("Deliver %1 units now?").arg(dose)) == QMessageBox::Yes)
@@ -199,31 +195,6 @@ void BolusCalculator::on_btnDeliver_clicked()
     }
 }
 
-void BolusCalculator::deliverExtendedDose() {
-    if (pump && remainingExtendedDose > 0) {
-        pump->resumeBolus();
-
-        // Actual delivery of second portion of extended dose
-        pump->deliverBolus(remainingExtendedDose, bolusRate, /*suppressTime=*/true);
-        
-        if (logger) {
-            logger->logEvent("Extended Bolus Delivered", QString("Delivered extended dose of %1 units.").arg(remainingExtendedDose, 0, 'f', 2));
-        }
-
-        remainingExtendedDose = 0;
-        pump->bolusTimeRemainingUpdated(0.0);
-    }
-}
-
-void BolusCalculator::updateCountdown() {
-    countdownMinutes -= 5; // Because each tick is 5 minutes
-    if (countdownMinutes <= 0) {
-        countdownMinutes = 0;
-        deliverExtendedDose();;
-    }
-    pump->bolusTimeRemainingUpdated(countdownMinutes);
-}
-
 void BolusCalculator::on_logoButton_clicked() {
     emit backToHome();
 }
@@ -5,7 +5,7 @@
  * The BolusCalculator class provides a user interface for computing insulin doses based
  * on current glucose readings, carbohydrate intake, and user overrides. It supports
  * correction bolus, carb bolus, total bolus calculations, dose overrides, and extended
- * dose delivery with countdown management.
+ * doses, which the pump delivers as split DeliveryPlans.
  */
 #ifndef BOLUSCALCULATOR_H
 #define BOLUSCALCULATOR_H
@@ -15,6 +15,7 @@
 #include "datalogger.h"
 #include "cgmreader.h"
 #include "insulinreserve.h"
+#include "glucosemodel.h"
 
 namespace Ui {
 class BolusCalculator;
@@ -26,7 +27,6 @@ class BolusCalculator;
  *
  * Manages UI interactions for computing recommended insulin doses, overriding
  * inputs, validating entries, and dispatching bolus commands to the PumpController.
- * Also handles extended dose timing and countdown display.
  */
 class BolusCalculator : public QWidget
 {
@@ -121,13 +121,6 @@ public:
      */
     static std::pair<double, double> splitBolus(double total, double percentage);
 
-    /**
-     * @brief Update the countdown timer display for extended dose delivery.
-     *
-     * Called periodically to refresh remaining time in the UI.
-     */
-    void updateCountdown();
-
 signals:
      /**
      * @brief Navigate back to the home screen.
@@ -165,10 +158,6 @@ private slots:
      * @brief Trigger delivery of the calculated bolus.
      */
     void on_btnDeliver_clicked();
-    /**
-     * @brief Handle extended dose delivery logic.
-     */
-    void deliverExtendedDose();
     /**
      * @brief Cancel any ongoing bolus and update UI/log.
      */
@@ -184,11 +173,9 @@ private:
     CGMReader* cgm;
     InsulinReserve* insulinReserve;
 
-    QTimer* extendedDoseTimer;
     QTimer* countdownTimer;
-    double remainingExtendedDose;
-    int countdownMinutes;
-    static constexpr double bolusRate = 10;
+    quint64 extendedDosePlan; ///< Pump plan of the last extended dose (0 if none).
+    static constexpr double bolusRate = GlucoseModel::bolusRate;
 };
 
 #endif // BOLUSCALCULATOR_H
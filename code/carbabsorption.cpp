@@ -0,0 +1,112 @@
+#include "carbabsorption.h"
+#include <QDataStream>
+#include <algorithm>
+
+CarbAbsorption::CarbAbsorption()
+{
+}
+
+void CarbAbsorption::setDefaultProfile(const Profile &profile){
+    defaultProfile = profile;
+}
+
+CarbAbsorption::Profile CarbAbsorption::getDefaultProfile() const{
+    return defaultProfile;
+}
+
+double CarbAbsorption::addMeal(double carbs){
+    return addMeal(carbs, defaultProfile);
+}
+
+double CarbAbsorption::addMeal(double carbs, const Profile &profile){
+    if (profile.shape == Instant || profile.minutes <= 0) {
+        return carbs;
+    }
+    meals.append({carbs, 0, 0, profile.minutes / 60, profile.shape});
+    return 0;
+}
+
+double CarbAbsorption::absorb(double elapsedHours){
+    double absorbed = 0;
+    int kept = 0;
+    for (int i = 0; i < meals.size(); i++) {
+        Meal meal = meals[i];
+        meal.hours += elapsedHours;
+        double fraction = absorbedFraction(meal.shape, meal.hours / meal.duration);
+        absorbed += meal.carbs * (fraction - meal.absorbed);
+        meal.absorbed = fraction;
+        if (fraction < 1) {
+            meals[kept++] = meal; // Finished meals drop out, the rest keep their order
+        }
+    }
+    meals.resize(kept);
+    return absorbed;
+}
+
+double CarbAbsorption::getCOB() const{
+    double cob = 0;
+    for (const Meal &meal : meals) {
+        cob += meal.carbs * (1 - meal.absorbed);
+    }
+    return cob;
+}
+
+double CarbAbsorption::getAbsorptionRate() const{
+    double rate = 0;
+    for (const Meal &meal : meals) {
+        double x = meal.hours / meal.duration;
+        double slope = (meal.shape == Triangular) ? ((x < 0.5) ? 4 * x : 4 * (1 - x)) : 1; // d(fraction)/d(progress)
+        rate += meal.carbs * slope / meal.duration;
+    }
+    return rate;
+}
+
+double CarbAbsorption::absorbedWithin(double hours) const{
+    double absorbed = 0;
+    for (const Meal &meal : meals) {
+        absorbed += meal.carbs * (absorbedFraction(meal.shape, (meal.hours + hours) / meal.duration) - meal.absorbed);
+    }
+    return absorbed;
+}
+
+int CarbAbsorption::activeMeals() const{
+    return meals.size();
+}
+
+void CarbAbsorption::clear(){
+    meals.clear();
+}
+
+double CarbAbsorption::absorbedFraction(Shape shape, double progress){
+    double x = std::min(1.0, std::max(0.0, progress));
+    switch (shape) {
+    case Instant:
+        return 1;
+    case Linear:
+        return x;
+    case Triangular:
+        return (x < 0.5) ? 2 * x * x : 1 - 2 * (1 - x) * (1 - x);
+    }
+    return 1;
+}
+
+void CarbAbsorption::saveState(QDataStream &out) const {
+    out << qint32(defaultProfile.shape) << defaultProfile.minutes;
+    out << qint32(meals.size());
+    for (const Meal &meal : meals) {
+        out << meal.carbs << meal.absorbed << meal.hours << meal.duration << qint32(meal.shape);
+    }
+}
+
+void CarbAbsorption::restoreState(QDataStream &in) {
+    qint32 shape = 0, count = 0;
+    in >> shape >> defaultProfile.minutes >> count;
+    defaultProfile.shape = Shape(shape);
+    meals.clear();
+    for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        Meal meal;
+        in >> meal.carbs >> meal.absorbed >> meal.hours >> meal.duration >> shape;
+        meal.shape = Shape(shape);
+        meals.append(meal);
+    }
+}
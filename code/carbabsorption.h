@@ -0,0 +1,145 @@
+/**
+ * @file carbabsorption.h
+ * @brief Defines the CarbAbsorption class, which absorbs meals into the blood over time.
+ *
+ * Each meal absorbs along its own profile (a shape and an absorption time) from the
+ * moment it is eaten, and meals overlap freely. Profiles have closed-form absorbed
+ * fractions, so a step costs one evaluation per meal still absorbing; finished meals are
+ * dropped, and the cost never grows with the meal history.
+ */
+
+#ifndef CARBABSORPTION_H
+#define CARBABSORPTION_H
+
+#include <QVector>
+
+class QDataStream;
+
+/**
+ * @class CarbAbsorption
+ * @brief Tracks the meals being absorbed and the carbs on board (COB).
+ */
+class CarbAbsorption
+{
+public:
+    /**
+     * @brief Shapes of the absorption rate over a meal's absorption time.
+     */
+    enum Shape {
+        Instant,    ///< Absorbed the moment it is eaten (the simulator's original model).
+        Linear,     ///< Constant rate.
+        Triangular  ///< Rate rising to a peak halfway, then falling back to zero.
+    };
+
+    /**
+     * @brief How a meal is absorbed.
+     */
+    struct Profile {
+        Shape shape = Triangular; ///< Shape of the absorption rate.
+        double minutes = 180;     ///< Absorption time (ignored for Instant).
+    };
+
+    /**
+     * @brief Constructs a model with no meals and the default Triangular, 3 hour profile.
+     */
+    CarbAbsorption();
+
+    /**
+     * @brief Sets the profile of meals added without one.
+     * @param profile Default absorption profile.
+     */
+    void setDefaultProfile(const Profile &profile);
+
+    /**
+     * @brief Returns the profile of meals added without one.
+     */
+    Profile getDefaultProfile() const;
+
+    /**
+     * @brief Starts absorbing a meal with the default profile.
+     * @param carbs Carbohydrates eaten (grams).
+     * @return Grams absorbed at once: all of them for an Instant profile, otherwise 0.
+     */
+    double addMeal(double carbs);
+
+    /**
+     * @brief Starts absorbing a meal with its own profile.
+     * @param carbs Carbohydrates eaten (grams).
+     * @param profile Absorption profile of the meal.
+     * @return Grams absorbed at once: all of them for an Instant profile, otherwise 0.
+     */
+    double addMeal(double carbs, const Profile &profile);
+
+    /**
+     * @brief Advances every meal by one step.
+     * @param elapsedHours Step length in hours.
+     * @return Grams absorbed over the step.
+     */
+    double absorb(double elapsedHours);
+
+    /**
+     * @brief Returns the carbs eaten but not yet absorbed.
+     * @return Carbs on board (grams).
+     */
+    double getCOB() const;
+
+    /**
+     * @brief Returns the rate the meals are absorbing at now.
+     * @return Absorption rate (grams/hour).
+     */
+    double getAbsorptionRate() const;
+
+    /**
+     * @brief Returns the carbs the meals will absorb over a coming period, without advancing.
+     * @param hours Length of the period in hours.
+     * @return Grams absorbed over the period.
+     */
+    double absorbedWithin(double hours) const;
+
+    /**
+     * @brief Returns the number of meals still absorbing.
+     */
+    int activeMeals() const;
+
+    /**
+     * @brief Drops every meal still absorbing.
+     */
+    void clear();
+
+    /**
+     * @brief Writes the default profile and the meals still absorbing to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the state written by saveState().
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
+    /**
+     * @brief Fraction of a meal absorbed by a point of its absorption time.
+     * @param shape Absorption shape.
+     * @param progress Elapsed share of the absorption time (clamped to 0-1).
+     * @return Absorbed fraction between 0 and 1.
+     */
+    static double absorbedFraction(Shape shape, double progress);
+
+private:
+    /**
+     * @brief A meal still absorbing.
+     */
+    struct Meal {
+        double carbs;    ///< Grams eaten.
+        double absorbed; ///< Absorbed fraction so far.
+        double hours;    ///< Time since the meal (hours).
+        double duration; ///< Absorption time (hours).
+        Shape shape;
+    };
+
+    Profile defaultProfile;
+    QVector<Meal> meals; ///< Meals still absorbing, oldest first.
+};
+
+#endif // CARBABSORPTION_H
@@ -1,20 +1,49 @@
 #include "cgmreader.h"
+#include "glucosemodel.h"
+#include <QDataStream>
 
-CGMReader::CGMReader(QCheckBox *errorCheckBox)
+CGMReader::CGMReader()
     : CGMConnected(true)
-    , reading(startAmount)
-    , errorCheckBox(errorCheckBox)
+    , sensorError(false)
+    , reading(patient.startGlucose)
 {
+    varyDrift();
 }
 
-double CGMReader::getCurrentGlucoseLevel(Bloodstream *blood, double correctionFactor){
-    double randomVariance = (QRandomGenerator::global()->generateDouble() - 0.5) * volatility * 2;
+void CGMReader::advance(Bloodstream *blood, double correctionFactor, double elapsedHours){
+    double absorbed = blood->absorb(patient.insulinUsageRate, elapsedHours);
+    reading += GlucoseModel::glucoseChangeAbsorbed(patient.increasePerHour, driftVariance, absorbed,
+                                                   correctionFactor, elapsedHours);
+}
 
-    reading += (increasePerHour/12 + increasePerHour/12 * randomVariance);
-    double absorbed = std::max(0.0, std::min(insulinUsageRate/12, blood->getIOB()));
-    reading -= absorbed * correctionFactor;
-    blood->absorbUnits(absorbed);
+double CGMReader::glucoseChange(double iob, double correctionFactor, double elapsedHours) const{
+    return GlucoseModel::glucoseChange(patient.increasePerHour, driftVariance, patient.insulinUsageRate,
+                                       iob, correctionFactor, elapsedHours);
+}
 
+double CGMReader::absorption(double iob, double elapsedHours) const{
+    return GlucoseModel::absorption(patient.insulinUsageRate, iob, elapsedHours);
+}
+
+void CGMReader::setPatient(const PatientParameters &parameters){
+    patient = parameters;
+    reading = patient.startGlucose;
+}
+
+PatientParameters CGMReader::getPatient() const{
+    return patient;
+}
+
+void CGMReader::setRandom(const SimRandom &random){
+    this->random = random;
+    varyDrift();
+}
+
+void CGMReader::varyDrift(){
+    driftVariance = (random.nextDouble() - 0.5) * patient.volatility * 2;
+}
+
+double CGMReader::getCurrentGlucoseLevel(){
     if (CGMConnected) {
         return reading;
     } else {
@@ -23,10 +52,61 @@ double CGMReader::getCurrentGlucoseLevel(Bloodstream *blood, double correctionFa
 }
 
 bool CGMReader::isCGMConnected() {
-    CGMConnected = not errorCheckBox->isChecked();
+    CGMConnected = not sensorError;
     return CGMConnected;
 }
 
+void CGMReader::setSensorError(bool error) {
+    sensorError = error;
+}
+
+bool CGMReader::hasSensorError() const {
+    return sensorError;
+}
+
+double CGMReader::sampleSensor(){
+    if (!CGMConnected) {
+        return -1;
+    }
+    return sensor.sample(reading, sensorRandom);
+}
+
+void CGMReader::setSensor(const SensorParameters &parameters, double sampleMinutes){
+    sensor.configure(parameters, sampleMinutes);
+}
+
+SensorParameters CGMReader::getSensorParameters() const{
+    return sensor.getParameters();
+}
+
+void CGMReader::setSensorRandom(const SimRandom &random){
+    sensorRandom = random;
+}
+
 void CGMReader::intakeGlucose(double glucose){
     reading += glucose;
 }
+
+void CGMReader::setReading(double glucose){
+    reading = glucose;
+}
+
+void CGMReader::saveState(QDataStream &out) const {
+    out << CGMConnected << sensorError << reading << driftVariance;
+    out << patient.volatility << patient.increasePerHour << patient.insulinUsageRate << patient.startGlucose;
+    random.saveState(out);
+    sensor.saveState(out);
+    sensorRandom.saveState(out);
+}
+
+void CGMReader::restoreState(QDataStream &in, int formatVersion) {
+    in >> CGMConnected >> sensorError >> reading >> driftVariance;
+    in >> patient.volatility >> patient.increasePerHour >> patient.insulinUsageRate >> patient.startGlucose;
+    random.restoreState(in);
+    if (formatVersion < 5) {
+        sensor = SensorModel();
+        return;
+    }
+    sensor.restoreState(in);
+    sensorRandom.restoreState(in);
+}
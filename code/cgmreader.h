@@ -3,16 +3,32 @@
  * @brief Defines the CGMReader class for simulating continuous glucose monitoring.
  *
  * The CGMReader class simulates glucose readings based on insulin activity and
- * random natural variations. It also simulates sensor connection loss and recovery.
+ * random natural variations drawn from the patient's own seeded generator.
+ * It also simulates sensor connection loss and recovery, and the sensor itself (lag,
+ * noise, calibration drift and dropouts, see SensorModel) between the modelled glucose
+ * and the readings the pump acts on.
  */
 
 #ifndef CGMREADER_H
 #define CGMREADER_H
 
-#include <QRandomGenerator>
 #include "bloodstream.h"
-#include <QCheckBox>
-#include <QSpinBox>
+#include "sensormodel.h"
+#include "simrandom.h"
+
+class QDataStream;
+
+/**
+ * @brief Physiological parameters of a simulated patient's glucose model.
+ *
+ * The defaults are the single patient the simulator has always modelled.
+ */
+struct PatientParameters {
+    double volatility = 0.8;       ///< How much increasePerHour can randomly vary, as a coefficient.
+    double increasePerHour = 2;    ///< Natural glucose rise in mmol/L per hour.
+    double insulinUsageRate = 2;   ///< Insulin absorbed in units per hour.
+    double startGlucose = 6.0;     ///< Glucose at the start of a run in mmol/L.
+};
 
 /**
  * @class CGMReader
@@ -25,18 +41,89 @@ class CGMReader
 {
 public:
     /**
-     * @brief Constructs a CGMReader with an associated error checkbox UI component.
-     * @param errorCheckBox Pointer to the checkbox that simulates CGM errors.
+     * @brief Constructs a connected CGMReader at the starting glucose level.
      */
-    CGMReader(QCheckBox *errorCheckBox);
+    CGMReader();
 
     /**
-     * @brief Gets the current simulated glucose level.
+     * @brief Advances the glucose model by one integration step: natural drift and insulin absorption.
      * @param blood Pointer to the Bloodstream to account for insulin absorption effects.
      * @param correctionFactor Correction sensitivity factor.
-     * @return Current glucose level in mmol/L.
+     * @param elapsedHours Simulated time to advance by, in hours.
+     */
+    void advance(Bloodstream *blood, double correctionFactor, double elapsedHours);
+
+    /**
+     * @brief Computes the glucose change of one integration step without changing any state.
+     * @param iob Insulin on board at the start of the step (units).
+     * @param correctionFactor Correction sensitivity factor.
+     * @param elapsedHours Step length in hours.
+     * @return Change in glucose (mmol/L).
+     */
+    double glucoseChange(double iob, double correctionFactor, double elapsedHours) const;
+
+    /**
+     * @brief Computes the insulin absorbed over one integration step.
+     * @param iob Insulin on board at the start of the step (units).
+     * @param elapsedHours Step length in hours.
+     * @return Units absorbed.
      */
-    double getCurrentGlucoseLevel(Bloodstream *blood, double correctionFactor);
+    double absorption(double iob, double elapsedHours) const;
+
+    /**
+     * @brief Sets the patient's physiological parameters and restarts at their start glucose.
+     * @param parameters Patient parameters.
+     */
+    void setPatient(const PatientParameters &parameters);
+
+    /**
+     * @brief Returns the patient's physiological parameters.
+     * @return Patient parameters.
+     */
+    PatientParameters getPatient() const;
+
+    /**
+     * @brief Sets the generator the natural variations are drawn from, and draws a new one.
+     * @param random Seeded stream owned by this reader from now on.
+     */
+    void setRandom(const SimRandom &random);
+
+    /**
+     * @brief Draws a new random variation of the natural glucose drift.
+     *
+     * Called once per sensor sample, so the noise does not depend on the integration step.
+     */
+    void varyDrift();
+
+    /**
+     * @brief Gets the current simulated glucose level.
+     * @return Current glucose level in mmol/L, or -1 if the CGM is disconnected.
+     */
+    double getCurrentGlucoseLevel();
+
+    /**
+     * @brief Takes a sensor sample of the current glucose level.
+     *
+     * With the default ideal sensor this is getCurrentGlucoseLevel().
+     *
+     * @return Sensor reading in mmol/L, or -1 if the CGM is disconnected or in a dropout.
+     */
+    double sampleSensor();
+
+    /**
+     * @brief Configures the sensor model and restarts it.
+     * @param parameters Sensor configuration.
+     * @param sampleMinutes Interval between sensor samples (minutes).
+     */
+    void setSensor(const SensorParameters &parameters, double sampleMinutes);
+
+    SensorParameters getSensorParameters() const;
+
+    /**
+     * @brief Sets the stream of the sensor's noise and dropouts.
+     * @param random Sensor stream, independent of the drift stream.
+     */
+    void setSensorRandom(const SimRandom &random);
 
     /**
      * @brief Simulates glucose intake from carbohydrate consumption.
@@ -44,22 +131,52 @@ public:
      */
     void intakeGlucose(double glucose);
 
+    /**
+     * @brief Replaces the modelled glucose with a known value, e.g. a recorded reading being replayed.
+     * @param glucose Glucose level in mmol/L.
+     */
+    void setReading(double glucose);
+
     /**
      * @brief Checks if the CGM sensor is connected.
      * @return True if CGM is connected, false if disconnected.
      */
     bool isCGMConnected();
 
+    /**
+     * @brief Simulates a sensor error, disconnecting the CGM until cleared.
+     * @param error True to simulate a sensor error, false to clear it.
+     */
+    void setSensorError(bool error);
+
+    /**
+     * @brief Checks whether a sensor error is being simulated.
+     * @return True if the sensor error is set.
+     */
+    bool hasSensorError() const;
+
+    /**
+     * @brief Writes the reading, sensor state, patient and drift stream to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the state written by saveState().
+     * @param in Checkpoint stream.
+     * @param formatVersion Checkpoint format; versions before 5 have no sensor model (ideal sensor).
+     */
+    void restoreState(QDataStream &in, int formatVersion);
+
 private:
 	bool CGMConnected;
+    bool sensorError; ///< Simulated sensor fault (set by the GUI or a headless driver).
+    PatientParameters patient; ///< Physiological parameters of the simulated patient.
     double reading;
-    QCheckBox *errorCheckBox;
-    QSpinBox *carbSpinBox;
-    QRandomGenerator randomGen;
-    static constexpr double volatility = 0.8; // how much the increasePerHour can randomly vary, as a coefficient
-    static constexpr double startAmount = 6.0; // in mmol/L
-    static constexpr double increasePerHour = 2; // in mmol/L per hour
-    static constexpr double insulinUsageRate = 2; // in units per hour
+    double driftVariance; ///< Current random variation of increasePerHour, as a coefficient.
+    SimRandom random; ///< Patient-owned generator for the natural variations.
+    SensorModel sensor; ///< Sensor between the modelled glucose and the readings.
+    SimRandom sensorRandom; ///< Generator for the sensor noise and dropouts.
 };
 
 #endif // CGMREADER_H
@@ -0,0 +1,19 @@
+# Command-line runner for comparing the controller policies on the same virtual patients.
+QT = core
+
+TEMPLATE = app
+CONFIG += console c++17 thread
+CONFIG -= app_bundle
+TARGET = compare
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+
+# The simcore headers must see the same dosing type as the library (see simcore.pri)
+fixed_dosing: DEFINES += FIXED_POINT_DOSING
+
+SOURCES += \
+    main.cpp
+
+LIBS += -L$$OUT_PWD/../simcore -lsimcore
+PRE_TARGETDEPS += $$OUT_PWD/../simcore/libsimcore.a
@@ -0,0 +1,139 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <cstdio>
+#include <vector>
+#include "controllerregistry.h"
+#include "workstealingpool.h"
+
+// Controller comparison harness.
+// Runs every registered controller policy (or those given with --controllers) over the
+// same seeded virtual patients with the batch engine, all on one thread pool, and prints a
+// table of outcomes and the compute time per controller decision. Each controller is its
+// own instantiation of the batch loop, so the timing is that of the statically dispatched
+// decision code.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("compare");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares the basal controller policies on the same virtual patients.");
+    parser.addHelpOption();
+    parser.addOption({"patients", "Number of virtual patients (default 1000).", "count", "1000"});
+    parser.addOption({"days", "Simulated days per patient (default 1).", "days", "1"});
+    parser.addOption({"threads", "Worker threads (default: one per core).", "count", QString::number(QThread::idealThreadCount())});
+    parser.addOption({"seed", "Population seed (default 1).", "seed", "1"});
+    parser.addOption({"batch", "Patients stepped together per task (default 64).", "count", "64"});
+    parser.addOption({"controllers", "Comma-separated controllers to compare (default: all of "
+                      + ControllerRegistry::names().join(", ") + ").", "names"});
+    parser.addOption({"sensor", "CGM sensor: ideal, typical or lag:noise[:drift[:dropout]] (default ideal).", "sensor", "ideal"});
+    parser.addOption({"scenario", "Run every patient through a scenario file instead of their own meals.", "file"});
+    parser.process(app);
+
+    bool okPatients = false, okDays = false, okThreads = false, okSeed = false, okBatch = false;
+    int patients = parser.value("patients").toInt(&okPatients);
+    int days = parser.value("days").toInt(&okDays);
+    int threads = parser.value("threads").toInt(&okThreads);
+    quint64 seed = parser.value("seed").toULongLong(&okSeed);
+    int batchSize = parser.value("batch").toInt(&okBatch);
+    if (!okPatients || !okDays || !okThreads || !okSeed || !okBatch || patients <= 0 || days <= 0 || threads <= 0 || batchSize <= 0) {
+        fprintf(stderr, "Invalid --patients, --days, --threads, --seed or --batch value\n");
+        return 1;
+    }
+    if (!BatchEngine::matchesScalarDosing()) {
+        fprintf(stderr, "The batch engine doses in double and is not available in fixed_dosing builds\n");
+        return 1;
+    }
+
+    QVector<const ControllerInfo *> controllers;
+    if (parser.isSet("controllers")) {
+        for (const QString &name : parser.value("controllers").split(',')) {
+            const ControllerInfo *controller = ControllerRegistry::find(name.trimmed());
+            if (!controller) {
+                fprintf(stderr, "Unknown controller: %s (known: %s)\n", qPrintable(name),
+                        qPrintable(ControllerRegistry::names().join(", ")));
+                return 1;
+            }
+            controllers.append(controller);
+        }
+    } else {
+        for (const ControllerInfo &controller : ControllerRegistry::controllers()) {
+            controllers.append(&controller);
+        }
+    }
+
+    bool okSensor = false;
+    SensorParameters sensor = SensorParameters::fromString(parser.value("sensor"), &okSensor);
+    if (!okSensor) {
+        fprintf(stderr, "Invalid --sensor value\n");
+        return 1;
+    }
+    if (parser.isSet("scenario")) {
+        Scenario scenario; // Checked once here; every batch streams the file on its own
+        QString error;
+        if (!scenario.open(parser.value("scenario"), &error)
+                || !PopulationRunner::checkBatchScenario(parser.value("scenario"), &error)) {
+            fprintf(stderr, "%s\n", qPrintable(error));
+            return 1;
+        }
+    }
+
+    // Every controller sees the same patients, meals and sensor noise
+    PopulationRunner population(patients, seed);
+    population.setSensor(sensor);
+    population.setScenario(parser.value("scenario"));
+    const Profile profile = Profile::defaultProfile();
+    const QDateTime start(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC);
+
+    std::vector<std::vector<PatientOutcome>> outcomes(controllers.size(), std::vector<PatientOutcome>(patients));
+    std::vector<ControllerTiming> timings(controllers.size());
+    QMutex timingMutex;
+
+    QElapsedTimer timer;
+    timer.start();
+    {
+        WorkStealingPool pool(threads);
+        for (int c = 0; c < controllers.size(); c++) {
+            for (int first = 0; first < patients; first += batchSize) {
+                pool.submit([&, c, first]() {
+                    QVector<VirtualPatient> batch;
+                    for (int i = first; i < qMin(patients, first + batchSize); i++) {
+                        batch.append(population.patient(i));
+                    }
+                    ControllerTiming timing;
+                    QVector<PatientOutcome> results = controllers[c]->simulateBatch(batch, profile, start, days,
+                                                                                     BatchEngine::bestKernel(), &timing);
+                    for (int i = 0; i < results.size(); i++) {
+                        outcomes[c][first + i] = results[i]; // Each task owns its slots
+                    }
+
+                    QMutexLocker locker(&timingMutex);
+                    timings[c].add(timing);
+                });
+            }
+        }
+        pool.waitForDone();
+    }
+    double wall = timer.nsecsElapsed() / 1e9;
+
+    printf("%-11s %7s %7s %7s %8s %9s %6s %9s %12s\n", "controller", "TIR %", "<3.9 %", ">10 %", "mean", "worst TIR",
+           "lows", "insulin", "ns/decision");
+    for (int c = 0; c < controllers.size(); c++) {
+        PopulationSummary summary;
+        for (const PatientOutcome &outcome : outcomes[c]) { // Patient order, so the table does not depend on scheduling
+            summary.add(outcome);
+        }
+        printf("%-11s %7.1f %7.1f %7.1f %8.2f %9.1f %6d %9.1f %12.1f\n", qPrintable(controllers[c]->name),
+               100 * summary.meanTimeInRange, 100 * summary.meanTimeBelowRange, 100 * summary.meanTimeAboveRange,
+               summary.meanGlucose, 100 * summary.worstTimeInRange, summary.patientsWithLows,
+               summary.meanInsulinDelivered, timings[c].nsPerDecision());
+    }
+    printf("\n%d patients x %d day(s) per controller, seed %llu, %.3f s on %d thread(s)\n", patients, days,
+           static_cast<unsigned long long>(seed), wall, threads);
+    return 0;
+}
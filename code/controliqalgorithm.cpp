@@ -2,31 +2,173 @@
 #include "profile.h"
 #include "datalogger.h"
 #include "pumpcontroller.h"
+#include <QDataStream>
+#include <cmath>
 
-double ControlIQAlgorithm::currentRate = 0;
+ControlIQAlgorithm::Decision ControlIQAlgorithm::decide(double glucose, double target, double profileRate, double currentRate) {
+    return decide(glucose, glucose, target, profileRate, currentRate);
+}
+
+ControlIQAlgorithm::Decision ControlIQAlgorithm::decide(double glucose, double predicted, double target, double profileRate, double currentRate) {
+    if (glucose <= 3.9) {
+        return SuspendForLow;
+    } else if (predicted <= 3.9) {
+        return (currentRate != 0) ? SuspendForPredictedLow : KeepRate; // Stay suspended until the prediction recovers
+    } else if ((glucose > target) and (currentRate == 0)) {
+        return ResumeBasal;
+    } else if ((currentRate != 0) and (currentRate != profileRate)) {
+        return ApplyProfileRate;
+    }
+    return KeepRate;
+}
+
+ControlIQAlgorithm *ControlIQAlgorithm::clone() const {
+    return new ControlIQAlgorithm(*this);
+}
+
+const Forecast &ControlIQAlgorithm::observe(qint64 msecs, double glucose, const ForecastEffects &effects) {
+    nowMSecs = msecs;
+    if (glucose != -1) {
+        history.addReading(msecs, glucose);
+        forecast = history.forecast(effects);
+    } else {
+        history.clear(); // The trend before a dropout is stale when the sensor comes back
+        forecast = Forecast();
+    }
+    return forecast;
+}
+
+const Forecast &ControlIQAlgorithm::getForecast() const {
+    return forecast;
+}
 
-void ControlIQAlgorithm::analyzeGlucoseData(double glucose, DataLogger* logger, PumpController* pump) {
+void ControlIQAlgorithm::analyzeGlucoseData(double glucose, const Profile &profile, DataLogger* logger, PumpController* pump,
+                                            double iob) {
+    if (strategy == MPCStrategy) {
+        double rate = mpc.decide(glucose, iob, profile);
+        if (glucose <= 3.9) {
+            if (currentRate != 0) {
+                adjustBasalRate(pump, 0);
+                if (logger) logger->logEvent("Warning", "Low glucose detected. Basal rate pumping suspended.");
+            }
+        } else if (std::fabs(rate - currentRate) >= 0.01) { // Smallest rate step the pump takes
+            if (logger && rate == 0) {
+                logger->logEvent("Warning", "MPC predicted low glucose of " + QString::number(mpc.getPredictedGlucose(), 'f', 1)
+                                 + " mmol/L. Basal rate pumping suspended.");
+            } else if (logger && currentRate == 0) {
+                logger->logEvent("Info", "MPC resumed basal rate pumping.");
+            }
+            adjustBasalRate(pump, rate);
+        }
+        return;
+    }
 
-    // Loads active profile data
-    Profile profile = Profile::getActiveProfile();
-    double target = profile.getTargetGlucose();
+    // Loads profile data
     double profileRate = profile.getBasalRate();
+    double predicted = forecast.valid ? forecast.in30 : glucose;
 
-    if (glucose <= 3.9) {
+    switch (decide(glucose, predicted, profile.getTargetGlucose(), profileRate, currentRate)) {
+    case SuspendForLow:
         adjustBasalRate(pump, 0);
-        logger->logEvent("Warning", "Low glucose detected. Basal rate pumping suspended.");
-    } else if ((glucose > target) and (currentRate == 0)) {
+        if (logger) logger->logEvent("Warning", "Low glucose detected. Basal rate pumping suspended.");
+        break;
+    case SuspendForPredictedLow:
+        adjustBasalRate(pump, 0);
+        if (logger) logger->logEvent("Warning", "Predicted low glucose of " + QString::number(predicted, 'f', 1)
+                                     + " mmol/L in 30 minutes. Basal rate pumping suspended.");
+        break;
+    case ResumeBasal:
         adjustBasalRate(pump, profileRate);
-        logger->logEvent("Info", "Glucose stable. Resumed basal rate pumping.");
-    } else if ((currentRate != 0) and (currentRate != profileRate)) {
+        if (logger) logger->logEvent("Info", "Glucose stable. Resumed basal rate pumping.");
+        break;
+    case ApplyProfileRate:
         adjustBasalRate(pump, profileRate);
-        logger->logEvent("Info", "Profile basal rate set manually to " + QString::number(profileRate) + ".");
+        if (logger) logger->logEvent("Info", "Profile basal rate set manually to " + QString::number(profileRate) + ".");
+        break;
+    case KeepRate:
+        break;
+    }
+}
+
+void ControlIQAlgorithm::setStrategy(Strategy strategy) {
+    if (strategy != this->strategy) {
+        this->strategy = strategy;
+        mpc.reset();
     }
 }
 
+ControlIQAlgorithm::Strategy ControlIQAlgorithm::getStrategy() const {
+    return strategy;
+}
+
+MPCController *ControlIQAlgorithm::getMPC() {
+    return &mpc;
+}
+
+double ControlIQAlgorithm::getCurrentRate() const {
+    return currentRate;
+}
+
+bool ControlIQAlgorithm::isSuspended() const {
+    return suspendedSinceMSecs >= 0;
+}
+
+int ControlIQAlgorithm::getSuspensions() const {
+    return suspensions;
+}
+
+qint64 ControlIQAlgorithm::getSuspendedMSecs() const {
+    return suspendedMSecs + (isSuspended() ? nowMSecs - suspendedSinceMSecs : 0);
+}
+
 void ControlIQAlgorithm::adjustBasalRate(PumpController* pump, double rate) {
     if (pump) {
         currentRate = rate;
         pump->adjustBasalRate(rate);
+
+        if (rate == 0 && !isSuspended()) {
+            suspendedSinceMSecs = nowMSecs;
+            suspensions++;
+        } else if (rate != 0 && isSuspended()) {
+            suspendedMSecs += nowMSecs - suspendedSinceMSecs;
+            suspendedSinceMSecs = -1;
+        }
+    }
+}
+
+void ControlIQAlgorithm::saveState(QDataStream &out) const {
+    out << currentRate << qint32(strategy);
+    mpc.saveState(out);
+    history.saveState(out);
+    out << forecast.valid << forecast.level << forecast.trend << forecast.in30 << forecast.in60;
+    out << nowMSecs << suspendedSinceMSecs << suspendedMSecs << qint32(suspensions);
+}
+
+void ControlIQAlgorithm::restoreHistory(QDataStream &in) {
+    history.restoreState(in);
+    in >> forecast.valid >> forecast.level >> forecast.trend >> forecast.in30 >> forecast.in60;
+}
+
+void ControlIQAlgorithm::restoreState(QDataStream &in, int formatVersion) {
+    in >> currentRate;
+    strategy = ThresholdStrategy;
+    mpc = MPCController();
+    if (formatVersion >= 9) {
+        qint32 saved = 0;
+        in >> saved;
+        strategy = Strategy(saved);
+        mpc.restoreState(in);
+    }
+    history = GlucoseForecaster(); // The trend rebuilds over the next readings
+    forecast = Forecast();
+    nowMSecs = 0;
+    suspendedSinceMSecs = -1;
+    suspendedMSecs = 0;
+    suspensions = 0;
+    if (formatVersion >= 10) {
+        restoreHistory(in);
+        qint32 count = 0;
+        in >> nowMSecs >> suspendedSinceMSecs >> suspendedMSecs >> count;
+        suspensions = count;
     }
 }
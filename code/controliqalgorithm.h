@@ -3,15 +3,25 @@
  * @brief Implements the Control-IQ insulin delivery algorithm interface.
  *
  * Provides methods to analyze glucose readings, adjust basal rates, and
- * direct pump actions based on algorithmic decisions.
+ * direct pump actions based on algorithmic decisions. The basal rate comes from
+ * threshold rules by default, or from an MPCController (see mpccontroller.h).
+ *
+ * A controller is a plain per-patient object: its basal rate, glucose history,
+ * suspension timer and MPC estimate are all members, and nothing is static except the
+ * pure decide() rules. Controllers in different threads share nothing, and a copy
+ * (see clone()) continues exactly like the original.
  */
 #ifndef CONTROLIQALGORITHM_H
 #define CONTROLIQALGORITHM_H
 
-#include <vector>
+#include <QtGlobal>
+#include "glucoseforecaster.h"
+#include "mpccontroller.h"
 
+class QDataStream;
 class DataLogger;
 class PumpController;
+class Profile;
 
 /**
  * @class ControlIQAlgorithm
@@ -22,17 +32,106 @@ class PumpController;
  */
 class ControlIQAlgorithm {
 public:
+    /**
+     * @brief Outcome of evaluating one glucose reading.
+     */
+    enum Decision {
+        KeepRate,        ///< Leave the basal rate unchanged.
+        SuspendForLow,   ///< Suspend basal delivery (rate 0).
+        SuspendForPredictedLow, ///< Suspend basal delivery (rate 0) before a predicted low.
+        ResumeBasal,     ///< Resume the profile basal rate after a suspension.
+        ApplyProfileRate ///< Switch to a profile basal rate that was changed manually.
+    };
+
+    /**
+     * @brief How the basal rate is chosen.
+     */
+    enum Strategy {
+        ThresholdStrategy, ///< Suspend on (predicted) lows, otherwise the profile rate; see decide().
+        MPCStrategy        ///< Rate picked by the model-predictive controller, suspended on lows.
+    };
+
+    /**
+     * @brief Decides how to change the basal rate for a glucose reading, without side effects.
+     *
+     * Shared by analyzeGlucoseData() and the batched engine, which keeps the controller
+     * state of many patients in arrays.
+     *
+     * @param glucose Latest glucose reading (mmol/L).
+     * @param target Profile target glucose (mmol/L).
+     * @param profileRate Profile basal rate (units/hour).
+     * @param currentRate Basal rate currently applied by the controller (units/hour).
+     * @return The decision; SuspendForLow means rate 0, ResumeBasal and ApplyProfileRate mean profileRate.
+     */
+    static Decision decide(double glucose, double target, double profileRate, double currentRate);
+
+    /**
+     * @brief Decides how to change the basal rate, acting on a glucose prediction as well.
+     *
+     * Delivery is suspended when the prediction falls to the low threshold, and not
+     * resumed while it stays there. With @p predicted equal to @p glucose this is the
+     * reactive decide() above.
+     *
+     * @param glucose Latest glucose reading (mmol/L).
+     * @param predicted Glucose predicted 30 minutes ahead (mmol/L), or @p glucose without a forecast.
+     * @param target Profile target glucose (mmol/L).
+     * @param profileRate Profile basal rate (units/hour).
+     * @param currentRate Basal rate currently applied by the controller (units/hour).
+     * @return The decision; both suspensions mean rate 0, ResumeBasal and ApplyProfileRate mean profileRate.
+     */
+    static Decision decide(double glucose, double predicted, double target, double profileRate, double currentRate);
+
+    /**
+     * @brief Returns an independent copy with the same state, e.g. to branch a run or compare strategies.
+     *
+     * The caller owns the copy.
+     */
+    ControlIQAlgorithm *clone() const;
+
+    /**
+     * @brief Adds a CGM reading to the controller's history and updates its forecast.
+     *
+     * Called for every sensor sample before analyzeGlucoseData(), so the safety checks
+     * can act on the same forecast. A missing reading clears the history.
+     *
+     * @param msecs Time of the reading (ms since epoch); also the clock of the suspension timer.
+     * @param glucose Reading (mmol/L), or -1 if there is none.
+     * @param effects What insulin and carbs on board do to glucose from now on.
+     * @return The forecast made from the history.
+     */
+    const Forecast &observe(qint64 msecs, double glucose, const ForecastEffects &effects);
+
+    /**
+     * @brief Returns the forecast made at the last observe().
+     */
+    const Forecast &getForecast() const;
+
     /**
      * @brief Analyze a glucose data point and trigger pump actions.
      *
      * Evaluates a single glucose reading, logs any relevant events,
      * and instructs the PumpController to adjust insulin delivery as needed.
+     * The threshold rules act on the forecast of the last observe(), if it is valid.
      *
      * @param data Latest blood glucose measurement (mg/dL).
-     * @param logger DataLogger instance for recording algorithm events.
+     * @param profile Profile supplying the target glucose and basal rate.
+     * @param logger DataLogger instance for recording algorithm events (may be nullptr).
      * @param pump PumpController instance for executing insulin commands.
+     * @param iob Insulin on board (units), used by the MPCStrategy.
      */
-    static void analyzeGlucoseData(double data, DataLogger* logger, PumpController* pump);
+    void analyzeGlucoseData(double data, const Profile &profile, DataLogger* logger, PumpController* pump, double iob = 0);
+
+    /**
+     * @brief Selects how the basal rate is chosen. Switching resets the MPC's state estimate.
+     * @param strategy New strategy.
+     */
+    void setStrategy(Strategy strategy);
+    Strategy getStrategy() const;
+
+    /**
+     * @brief Returns the model-predictive controller, for its settings and compute timing.
+     */
+    MPCController *getMPC();
      /**
      * @brief Adjust the basal insulin rate on the pump.
      *
@@ -41,12 +140,67 @@ public:
      * @param pump PumpController instance controlling the insulin pump.
      * @param rate New basal rate to set (units per hour).
      */
-    static void adjustBasalRate(PumpController* pump, double rate);
+    void adjustBasalRate(PumpController* pump, double rate);
+
+    /**
+     * @brief Returns the basal rate last applied by this controller.
+     * @return Basal rate in units per hour (0 while delivery is suspended).
+     */
+    double getCurrentRate() const;
+
+    /**
+     * @brief Checks whether the controller has suspended basal delivery.
+     */
+    bool isSuspended() const;
+
+    /**
+     * @brief Returns the number of suspensions so far.
+     */
+    int getSuspensions() const;
+
+    /**
+     * @brief Returns the total time basal delivery was suspended, including a suspension in progress.
+     * @return Suspended time (ms), measured on the clock of observe().
+     */
+    qint64 getSuspendedMSecs() const;
+
+    /**
+     * @brief Writes the controller state to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the controller state written by saveState().
+     * @param in Checkpoint stream.
+     * @param formatVersion Checkpoint format; versions before 9 only hold the rate, versions
+     *        before 10 keep the history elsewhere (see restoreHistory()) and lack the timer.
+     */
+    void restoreState(QDataStream &in, int formatVersion);
+
+    /**
+     * @brief Restores the history and forecast from the place checkpoint versions 8 and 9 kept them.
+     * @param in Checkpoint stream.
+     */
+    void restoreHistory(QDataStream &in);
+
+private:
     /**
      * @brief Current basal rate applied by the Control-IQ algorithm.
+     *
+     * Kept per instance so every simulated patient has its own controller state.
      */
+    double currentRate = 0;
+
+    Strategy strategy = ThresholdStrategy;
+    MPCController mpc; ///< Used by the MPCStrategy
 
-    static double currentRate;
+    GlucoseForecaster history; ///< Latest readings
+    Forecast forecast;         ///< Forecast made at the latest reading
+    qint64 nowMSecs = 0;       ///< Time of the latest observe()
+    qint64 suspendedSinceMSecs = -1; ///< Start of the suspension in progress, or -1
+    qint64 suspendedMSecs = 0; ///< Time of the suspensions that ended (ms)
+    int suspensions = 0;       ///< Suspensions started
 };
 
 #endif // CONTROLIQALGORITHM_H
@@ -0,0 +1,183 @@
+/**
+ * @file controllerpolicies.h
+ * @brief Defines the basal controller policies the batch engine is templated on.
+ *
+ * A policy is a plain per-patient class with one non-virtual member:
+ *
+ * @code
+ * double decide(const ControllerInput &input); // Basal rate to apply (units/hour)
+ * @endcode
+ *
+ * BatchEngine::sample() and PopulationRunner::simulateBatch() take the policy as a
+ * template parameter, so each controller gets its own instantiation of the per-sample
+ * loop and decide() is called (and usually inlined) without virtual dispatch. Policies
+ * are default-constructed, one per patient, and keep whatever state they need.
+ *
+ * Returning the current rate leaves the pump alone. ControllerRegistry lists the
+ * policies by name for runtime selection.
+ */
+#ifndef CONTROLLERPOLICIES_H
+#define CONTROLLERPOLICIES_H
+
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+#include "controliqalgorithm.h"
+#include "glucoseforecaster.h"
+#include "mpccontroller.h"
+#include "profile.h"
+
+/**
+ * @brief What a controller sees at each sensor sample.
+ */
+struct ControllerInput {
+    qint64 msecs;           ///< Time of the reading (ms since epoch).
+    double glucose;         ///< Sensor reading (mmol/L).
+    double iob;             ///< Insulin on board (units).
+    double currentRate;     ///< Basal rate the controller applied last (units/hour).
+    const Profile *profile; ///< Patient's profile.
+};
+
+/**
+ * @brief Compute time spent in controller decisions.
+ */
+struct ControllerTiming {
+    qint64 decisions = 0;  ///< Decisions taken.
+    qint64 decisionNs = 0; ///< Total wall-clock time of the decision loops (ns).
+
+    void add(const ControllerTiming &other) {
+        decisions += other.decisions;
+        decisionNs += other.decisionNs;
+    }
+
+    double nsPerDecision() const { return decisions > 0 ? double(decisionNs) / decisions : 0.0; }
+};
+
+/**
+ * @class ThresholdPolicy
+ * @brief The reactive Control-IQ rules: suspend at 3.9 mmol/L, resume the profile rate above target.
+ */
+class ThresholdPolicy
+{
+public:
+    double decide(const ControllerInput &input) {
+        double profileRate = input.profile->getBasalRate();
+        return rateFor(ControlIQAlgorithm::decide(input.glucose, input.profile->getTargetGlucose(), profileRate,
+                                                  input.currentRate),
+                       profileRate, input.currentRate);
+    }
+
+    /**
+     * @brief Returns the basal rate a ControlIQAlgorithm decision stands for.
+     * @param decision Decision.
+     * @param profileRate Profile basal rate (units/hour).
+     * @param currentRate Basal rate currently applied (units/hour).
+     */
+    static double rateFor(ControlIQAlgorithm::Decision decision, double profileRate, double currentRate) {
+        switch (decision) {
+        case ControlIQAlgorithm::SuspendForLow:
+        case ControlIQAlgorithm::SuspendForPredictedLow:
+            return 0;
+        case ControlIQAlgorithm::ResumeBasal:
+        case ControlIQAlgorithm::ApplyProfileRate:
+            return profileRate;
+        case ControlIQAlgorithm::KeepRate:
+            break;
+        }
+        return currentRate;
+    }
+};
+
+/**
+ * @class PredictiveSuspendPolicy
+ * @brief The threshold rules acting on the 30-minute trend forecast as well (predictive low glucose suspend).
+ *
+ * The batch engine does not model carb absorption, so the forecast is the trend of the
+ * last readings alone, without insulin or carb effects.
+ */
+class PredictiveSuspendPolicy
+{
+public:
+    double decide(const ControllerInput &input) {
+        history.addReading(input.msecs, input.glucose);
+        Forecast forecast = history.forecast(ForecastEffects());
+        double predicted = forecast.valid ? forecast.in30 : input.glucose;
+        double profileRate = input.profile->getBasalRate();
+        return ThresholdPolicy::rateFor(ControlIQAlgorithm::decide(input.glucose, predicted, input.profile->getTargetGlucose(),
+                                                                   profileRate, input.currentRate),
+                                        profileRate, input.currentRate);
+    }
+
+private:
+    GlucoseForecaster history;
+};
+
+/**
+ * @class PIDPolicy
+ * @brief Proportional-integral-derivative control of the basal rate around the profile rate.
+ *
+ * The gains are scaled by the correction factor, so the proportional term alone would
+ * deliver the insulin that corrects the current excess over 1 / proportionalPerHour hours.
+ * The integral stops accumulating while the rate is clipped (anti-windup), and delivery is
+ * suspended at 3.9 mmol/L whatever the terms say.
+ */
+class PIDPolicy
+{
+public:
+    static constexpr double proportionalPerHour = 0.5; ///< Share of the correction delivered per hour.
+    static constexpr double integralHours = 24;        ///< Integral time; long, so it trims a steady offset without stacking insulin after meals.
+    static constexpr double derivativeHours = 0.5;     ///< Derivative time.
+    static constexpr double maxBasalFactor = 3;        ///< Highest basal rate as a multiple of the profile rate.
+
+    double decide(const ControllerInput &input) {
+        const Profile &profile = *input.profile;
+        double error = input.glucose - profile.getTargetGlucose();
+        double hours = havePrevious ? (input.msecs - previousMSecs) / 3600000.0 : 0;
+        double derivative = hours > 0 ? (error - previousError) / hours : 0;
+        havePrevious = true;
+        previousMSecs = input.msecs;
+        previousError = error;
+
+        if (input.glucose <= 3.9) {
+            integral = 0; // A low resets the correction history
+            return 0;
+        }
+
+        double gain = proportionalPerHour / profile.getCorrectionFactor(); // units/hour per mmol/L
+        double accumulated = integral + error * hours;
+        double rate = profile.getBasalRate() + gain * (error + accumulated / integralHours + derivativeHours * derivative);
+        double maxRate = maxBasalFactor * profile.getBasalRate();
+        if (rate > 0 && rate < maxRate) {
+            integral = accumulated;
+        }
+        rate = std::min(std::max(0.0, rate), maxRate);
+        return std::fabs(rate - input.currentRate) >= 0.01 ? rate : input.currentRate; // Smallest rate step the pump takes
+    }
+
+private:
+    bool havePrevious = false;
+    qint64 previousMSecs = 0;
+    double previousError = 0;
+    double integral = 0; ///< Integral of the error (mmol/L hours).
+};
+
+/**
+ * @class MPCPolicy
+ * @brief The model-predictive controller of ControlIQAlgorithm::MPCStrategy, suspended at 3.9 mmol/L.
+ */
+class MPCPolicy
+{
+public:
+    double decide(const ControllerInput &input) {
+        double rate = mpc.decide(input.glucose, input.iob, *input.profile);
+        if (input.glucose <= 3.9) {
+            return 0;
+        }
+        return std::fabs(rate - input.currentRate) >= 0.01 ? rate : input.currentRate; // Smallest rate step the pump takes
+    }
+
+private:
+    MPCController mpc;
+};
+
+#endif // CONTROLLERPOLICIES_H
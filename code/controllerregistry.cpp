@@ -0,0 +1,32 @@
+#include "controllerregistry.h"
+
+const QVector<ControllerInfo> &ControllerRegistry::controllers() {
+    static const QVector<ControllerInfo> registered = {
+        {"threshold", "Suspend at 3.9 mmol/L, profile rate above target",
+         &PopulationRunner::simulateBatch<ThresholdPolicy>},
+        {"predictive", "Threshold rules on the 30-minute trend forecast as well",
+         &PopulationRunner::simulateBatch<PredictiveSuspendPolicy>},
+        {"pid", "PID control around the profile rate",
+         &PopulationRunner::simulateBatch<PIDPolicy>},
+        {"mpc", "Model-predictive control with precomputed gains",
+         &PopulationRunner::simulateBatch<MPCPolicy>},
+    };
+    return registered;
+}
+
+const ControllerInfo *ControllerRegistry::find(const QString &name) {
+    for (const ControllerInfo &controller : controllers()) {
+        if (controller.name == name) {
+            return &controller;
+        }
+    }
+    return nullptr;
+}
+
+QStringList ControllerRegistry::names() {
+    QStringList names;
+    for (const ControllerInfo &controller : controllers()) {
+        names.append(controller.name);
+    }
+    return names;
+}
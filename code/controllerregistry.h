@@ -0,0 +1,58 @@
+/**
+ * @file controllerregistry.h
+ * @brief Defines the ControllerRegistry class, which lists the controller policies by name.
+ *
+ * The policies of controllerpolicies.h are compile-time template parameters; the
+ * registry holds one instantiation of PopulationRunner::simulateBatch() per policy, so a
+ * command-line tool can pick a controller by name while the per-sample loop stays
+ * statically dispatched. A new policy is added here and instantiated in populationrunner.cpp.
+ */
+#ifndef CONTROLLERREGISTRY_H
+#define CONTROLLERREGISTRY_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "populationrunner.h"
+
+/**
+ * @brief A registered controller.
+ */
+struct ControllerInfo {
+    QString name;        ///< Name used on the command line.
+    QString description; ///< One-line description.
+
+    /**
+     * @brief PopulationRunner::simulateBatch() instantiated for the controller's policy.
+     */
+    QVector<PatientOutcome> (*simulateBatch)(const QVector<VirtualPatient> &patients, const Profile &profile,
+                                             const QDateTime &start, int days, BatchEngine::Kernel kernel,
+                                             ControllerTiming *timing);
+};
+
+/**
+ * @class ControllerRegistry
+ * @brief Runtime lookup of the compiled-in controller policies.
+ */
+class ControllerRegistry
+{
+public:
+    /**
+     * @brief Returns every registered controller, the threshold rules first.
+     */
+    static const QVector<ControllerInfo> &controllers();
+
+    /**
+     * @brief Returns the controller with a name.
+     * @param name Controller name.
+     * @return The controller, or nullptr if none has that name.
+     */
+    static const ControllerInfo *find(const QString &name);
+
+    /**
+     * @brief Returns the names of every registered controller.
+     */
+    static QStringList names();
+};
+
+#endif // CONTROLLERREGISTRY_H
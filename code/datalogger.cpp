@@ -1,4 +1,5 @@
 #include "datalogger.h"
+#include "simclock.h"
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -15,13 +16,24 @@ DataLogger::DataLogger(QObject *parent)
 void DataLogger::logEvent(const QString &eventType, const QString &description)
 {
     LogEntry entry;
-    entry.timestamp = QDateTime::currentDateTime();
+    entry.timestamp = m_clock ? m_clock->now() : QDateTime::currentDateTime();
     entry.eventType = eventType;
     entry.description = description;
 
     m_logs.logs.append(entry);
-    saveLogs();
-    emit logsUpdated();
+    entryAdded();
+}
+
+void DataLogger::logEvents(const QList<LogEntry> &entries)
+{
+    for (const LogEntry &entry : entries) {
+        int position = m_logs.logs.size();
+        while (position > 0 && m_logs.logs[position - 1].timestamp > entry.timestamp) {
+            position--;
+        }
+        m_logs.logs.insert(position, entry);
+    }
+    entryAdded();
 }
 
 void DataLogger::logGlucose(const QDateTime &timestamp, double glucose)
@@ -31,8 +43,7 @@ void DataLogger::logGlucose(const QDateTime &timestamp, double glucose)
     entry.glucose = glucose;
     
     m_logs.glucoseLog.append(entry);
-    saveLogs();
-    emit logsUpdated();
+    entryAdded();
 }
 
 void DataLogger::logInsulin(const QDateTime &timestamp, double dose)
@@ -42,8 +53,45 @@ void DataLogger::logInsulin(const QDateTime &timestamp, double dose)
     entry.dose = dose;
     
     m_logs.insulinLog.append(entry);
-    saveLogs();
+    entryAdded();
+}
+
+void DataLogger::entryAdded()
+{
+    m_dirty = true;
+    if (!m_deferredWrites) {
+        saveIfDirty();
+    }
+}
+
+void DataLogger::setDeferredWrites(bool deferred)
+{
+    m_deferredWrites = deferred;
+    if (!deferred) {
+        flush();
+    }
+}
+
+void DataLogger::setClock(SimClock *clock)
+{
+    m_clock = clock;
+}
+
+bool DataLogger::flush()
+{
+    emit aboutToFlush();
+    return saveIfDirty();
+}
+
+bool DataLogger::saveIfDirty()
+{
+    if (!m_dirty) {
+        return true;
+    }
+    m_dirty = false;
+    bool saved = saveLogs();
     emit logsUpdated();
+    return saved;
 }
 
 QList<LogEntry> DataLogger::retrieveHistory() const
@@ -19,6 +19,8 @@
 #include <QJsonArray>
 #include <QStandardPaths>
 
+class SimClock;
+
 /**
  * @brief Represents a single log entry for general events.
  */
@@ -26,12 +28,16 @@ struct LogEntry {
     QDateTime timestamp;
     QString eventType;
     QString description;
+    double reservoir = -1; ///< Units left in the pump reservoir after a delivery action, -1 for other events.
 
     QJsonObject toJson() const {
         QJsonObject obj;
         obj["timestamp"] = timestamp.toString(Qt::ISODate);
         obj["eventType"] = eventType;
         obj["description"] = description;
+        if (reservoir >= 0) {
+            obj["reservoir"] = reservoir;
+        }
         return obj;
     }
     
@@ -40,6 +46,7 @@ struct LogEntry {
         entry.timestamp = QDateTime::fromString(obj["timestamp"].toString(), Qt::ISODate);
         entry.eventType = obj["eventType"].toString();
         entry.description = obj["description"].toString();
+        entry.reservoir = obj["reservoir"].toDouble(-1);
         return entry;
     }
 };
@@ -175,7 +182,7 @@ public:
     /**
      * @brief Logs a general event.
      *
-     * Records an event with the current timestamp, event type, and description.
+     * Records an event with the current (simulated) timestamp, event type, and description.
      *
      * @param eventType A string describing the type of event.
      *                  Valid Values:
@@ -186,10 +193,23 @@ public:
      *                  - "Extended Bolus"
      * @param description A detailed description of the event.
      *
-     * @note This function saves logs after adding the event and emits the logsUpdated signal.
+     * @note This function saves logs after adding the event and emits the logsUpdated signal, unless writes are deferred.
      */
     void logEvent(const QString &eventType, const QString &description);
 
+    /**
+     * @brief Logs events recorded earlier, with their own timestamps.
+     *
+     * Entries are inserted in time order among the events already logged, and the logs
+     * are saved once for the whole batch. Used for the pump's delivery audit trail
+     * (DeliveryAuditor).
+     *
+     * @param entries Events to log.
+     *
+     * @note This function saves logs after adding the events and emits the logsUpdated signal, unless writes are deferred.
+     */
+    void logEvents(const QList<LogEntry> &entries);
+
     /**
      * @brief Logs a glucose reading.
      *
@@ -198,7 +218,7 @@ public:
      * @param timestamp The time at which the glucose reading was taken.
      * @param glucose The glucose value.
      *
-     * @note This function saves logs after logging the glucose entry and emits the logsUpdated signal.
+     * @note This function saves logs after logging the glucose entry and emits the logsUpdated signal, unless writes are deferred.
      */
     void logGlucose(const QDateTime &timestamp, double glucose);
 
@@ -210,7 +230,7 @@ public:
      * @param timestamp The time at which the insulin dose was administered.
      * @param dose The insulin dose amount.
      *
-     * @note This function saves logs after logging the insulin entry and emits the logsUpdated signal.
+     * @note This function saves logs after logging the insulin entry and emits the logsUpdated signal, unless writes are deferred.
      */
     void logInsulin(const QDateTime &timestamp, double dose);
 
@@ -275,12 +295,58 @@ public:
      */
     bool saveLogs();
 
+    /**
+     * @brief Enables or disables deferred writes.
+     *
+     * While writes are deferred, new entries are only kept in memory: logs are not saved
+     * and logsUpdated is not emitted until flush() is called. This keeps logging cheap
+     * when the simulation runs many ticks back-to-back (fast-forward or headless runs).
+     * Disabling deferred writes flushes any pending entries.
+     *
+     * @param deferred True to defer writes, false to save after every entry (default).
+     */
+    void setDeferredWrites(bool deferred);
+
+    /**
+     * @brief Saves pending entries and emits logsUpdated if anything was logged since the last flush.
+     *
+     * Emits aboutToFlush first, so buffered sources can hand over their entries.
+     *
+     * @return true if there was nothing to save or the logs were saved successfully, false otherwise.
+     */
+    bool flush();
+
+    /**
+     * @brief Sets the clock used to timestamp events.
+     *
+     * @param clock Simulation clock, or nullptr to use the wall-clock time.
+     */
+    void setClock(SimClock *clock);
+
 signals:
     void logsUpdated();
 
+    /**
+     * @brief Emitted at the start of flush(), before pending entries are saved.
+     */
+    void aboutToFlush();
+
 private:
     LogData m_logs;
     QString m_logsFilePath;
+    bool m_deferredWrites = false; ///< Entries are buffered in memory until flush().
+    bool m_dirty = false; ///< Entries were added since the last save.
+    SimClock *m_clock = nullptr; ///< Source of event timestamps (wall clock if nullptr).
+
+    /**
+     * @brief Saves and notifies after a new entry, unless writes are deferred.
+     */
+    void entryAdded();
+
+    /**
+     * @brief Saves the logs and emits logsUpdated if anything was logged since the last save.
+     */
+    bool saveIfDirty();
 };
 
 #endif // DATALOGGER_H
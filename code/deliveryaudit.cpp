@@ -0,0 +1,162 @@
+#include "deliveryaudit.h"
+#include <QMutexLocker>
+#include <QThread>
+#include <QTimer>
+
+DeliveryAuditLog::DeliveryAuditLog()
+    : records{}
+    , head(0)
+    , tail(0)
+    , waits(0)
+{ }
+
+void DeliveryAuditLog::record(const DeliveryRecord &record) {
+    int slot = head.loadAcquire();
+    int next = (slot + 1) % capacity;
+    if (next == tail.loadAcquire()) {
+        waits.fetchAndAddOrdered(1);
+        while (next == tail.loadAcquire()) { // Full: wait for the consumer rather than lose the record
+            QThread::yieldCurrentThread();
+        }
+    }
+    records[slot] = record;
+    head.storeRelease(next); // Publishes the record to the consumer
+}
+
+bool DeliveryAuditLog::take(DeliveryRecord *record) {
+    int slot = tail.loadAcquire();
+    if (slot == head.loadAcquire()) {
+        return false;
+    }
+    *record = records[slot];
+    tail.storeRelease((slot + 1) % capacity); // Hands the slot back to the producer
+    return true;
+}
+
+DeliveryAuditor *DeliveryAuditor::of(DataLogger *logger) {
+    DeliveryAuditor *auditor = logger->findChild<DeliveryAuditor *>(QString(), Qt::FindDirectChildrenOnly);
+    if (!auditor) {
+        auditor = new DeliveryAuditor(logger);
+    }
+    return auditor;
+}
+
+DeliveryAuditor::DeliveryAuditor(DataLogger *logger)
+    : QObject(logger)
+    , logger(logger)
+    , handOverTimer(new QTimer(this))
+    , stopping(false)
+    , thread(nullptr)
+{
+    connect(logger, &DataLogger::aboutToFlush, this, &DeliveryAuditor::deliver, Qt::DirectConnection);
+    handOverTimer->setInterval(handOverIntervalMs);
+    connect(handOverTimer, &QTimer::timeout, this, &DeliveryAuditor::deliver);
+    handOverTimer->start();
+
+    thread = QThread::create([this]() { run(); });
+    thread->start();
+}
+
+DeliveryAuditor::~DeliveryAuditor() {
+    {
+        QMutexLocker locker(&stateMutex);
+        stopping = true;
+        stopRequested.wakeAll();
+    }
+    thread->wait();
+    delete thread;
+}
+
+void DeliveryAuditor::attach(DeliveryAuditLog *log) {
+    QMutexLocker locker(&drainMutex);
+    logs.append(log);
+}
+
+void DeliveryAuditor::detach(DeliveryAuditLog *log) {
+    drain(); // Leaves the ring empty; the pump records nothing more
+    {
+        QMutexLocker locker(&drainMutex);
+        logs.removeOne(log);
+    }
+    deliver();
+}
+
+void DeliveryAuditor::deliver() {
+    drain(); // Records made since the drain thread last ran
+    QList<LogEntry> entries;
+    {
+        QMutexLocker locker(&pendingMutex);
+        entries.swap(pending);
+    }
+    if (!entries.isEmpty()) {
+        logger->logEvents(entries);
+    }
+}
+
+void DeliveryAuditor::drain() {
+    QMutexLocker drainLocker(&drainMutex);
+    QList<LogEntry> entries;
+    DeliveryRecord record;
+    for (DeliveryAuditLog *log : logs) {
+        while (log->take(&record)) {
+            entries.append(toLogEntry(record));
+        }
+    }
+    if (!entries.isEmpty()) {
+        QMutexLocker locker(&pendingMutex);
+        pending.append(entries);
+    }
+}
+
+void DeliveryAuditor::run() {
+    QMutexLocker locker(&stateMutex);
+    while (!stopping) {
+        locker.unlock();
+        drain();
+        locker.relock();
+        if (!stopping) {
+            stopRequested.wait(&stateMutex, drainIntervalMs);
+        }
+    }
+}
+
+LogEntry DeliveryAuditor::toLogEntry(const DeliveryRecord &record) {
+    LogEntry entry;
+    entry.timestamp = QDateTime::fromMSecsSinceEpoch(record.msecs);
+    entry.eventType = "Info";
+    entry.reservoir = record.reservoir;
+    switch (record.kind) {
+    case DeliveryRecord::BolusStarted:
+        entry.description = "Delivered " + QString::number(record.units) + " units at rate " + QString::number(record.rate);
+        break;
+    case DeliveryRecord::ExtendedStarted:
+    case DeliveryRecord::DualWaveStarted:
+    case DeliveryRecord::SplitStarted:
+        entry.description = QString("Started %1 units in %2 pulses over %3 h")
+                .arg(record.units, 0, 'f', 2).arg(record.pulses).arg(record.hours, 0, 'f', 2);
+        break;
+    case DeliveryRecord::BolusBlocked:
+        entry.eventType = "Error";
+        entry.description = "Bolus blocked due to unsafe condition.";
+        break;
+    case DeliveryRecord::DelayedPulseStarted:
+        entry.eventType = "Extended Bolus";
+        entry.description = QString("Delivering delayed dose of %1 units.").arg(record.units, 0, 'f', 2);
+        break;
+    case DeliveryRecord::PlanCancelled:
+        entry.description = QString("Bolus plan cancelled with %1 units remaining to deliver").arg(record.units, 0, 'f', 2);
+        break;
+    case DeliveryRecord::BolusCancelled:
+        entry.eventType = "Warning";
+        entry.description = QString("Bolus cancelled with %1 units remaining to deliver").arg(record.units, 0, 'f', 2);
+        break;
+    case DeliveryRecord::BolusResumed:
+        entry.description = "Bolus delivery resumed.";
+        break;
+    case DeliveryRecord::EmergencyStop:
+        entry.eventType = "Warning";
+        entry.description = "Emergency stop activated.";
+        break;
+    }
+    return entry;
+}
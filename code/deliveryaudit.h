@@ -0,0 +1,169 @@
+/**
+ * @file deliveryaudit.h
+ * @brief Defines the pump's delivery audit trail: DeliveryRecord, DeliveryAuditLog and DeliveryAuditor.
+ *
+ * PumpController records each delivery action (a bolus started, blocked or cancelled, a
+ * delayed pulse starting, an emergency stop) as a fixed-size DeliveryRecord in its own
+ * DeliveryAuditLog, a preallocated single-producer single-consumer ring buffer. Recording
+ * is a few stores and one release barrier: no allocation, no lock and no I/O on the
+ * delivery path. Each DataLogger has one DeliveryAuditor whose thread drains the rings of
+ * all its pumps and formats the records; the entries are handed to the logger on the
+ * logger's own thread, whenever it is flushed and every handOverIntervalMs.
+ */
+#ifndef DELIVERYAUDIT_H
+#define DELIVERYAUDIT_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QWaitCondition>
+#include "datalogger.h"
+
+class QThread;
+class QTimer;
+
+/**
+ * @brief One pump delivery action, as recorded on the delivery path.
+ */
+struct DeliveryRecord {
+    enum Kind : quint8 {
+        BolusStarted,        ///< Normal bolus started (units, rate).
+        ExtendedStarted,     ///< Extended bolus started (units, pulses, hours).
+        DualWaveStarted,     ///< Dual-wave bolus started (units, pulses, hours).
+        SplitStarted,        ///< Split bolus started (units, pulses, hours).
+        BolusBlocked,        ///< Bolus refused while suspended or stopped (units, rate requested).
+        DelayedPulseStarted, ///< Delayed part of a plan started (units, rate).
+        PlanCancelled,       ///< Plan cancelled (units left undelivered).
+        BolusCancelled,      ///< Bolus delivery suspended (units left undelivered).
+        BolusResumed,        ///< Bolus delivery resumed.
+        EmergencyStop        ///< Emergency stop activated.
+    };
+
+    qint64 msecs;     ///< Simulated time (ms since epoch).
+    Kind kind;        ///< Action.
+    int pulses;       ///< Pulses of a started plan, 0 otherwise.
+    double units;     ///< Insulin units of the action.
+    double rate;      ///< Delivery rate (units/hour), 0 if none.
+    double hours;     ///< Duration of a started plan (hours), 0 otherwise.
+    double reservoir; ///< Units left in the reservoir after the action.
+};
+
+/**
+ * @class DeliveryAuditLog
+ * @brief Lock-free ring buffer of DeliveryRecords for one producer and one consumer.
+ *
+ * The producer (the thread running the pump) only writes the head, the consumer only the
+ * tail. Records are never dropped: when the ring is full the producer yields until the
+ * consumer has taken a record. That wait takes no lock and allocates nothing; it only
+ * happens if a pump records more than capacity - 1 actions within one drain interval.
+ */
+class DeliveryAuditLog
+{
+public:
+    static constexpr int capacity = 1024; ///< Slots; one is kept free, so capacity - 1 records fit.
+
+    DeliveryAuditLog();
+
+    /**
+     * @brief Appends a record (producer side), waiting for a free slot if the ring is full.
+     * @param record Record.
+     */
+    void record(const DeliveryRecord &record);
+
+    /**
+     * @brief Removes the oldest record (consumer side).
+     * @param record Receives the record.
+     * @return false if the ring is empty.
+     */
+    bool take(DeliveryRecord *record);
+
+    /**
+     * @brief Returns how many times the producer found the ring full.
+     */
+    int fullWaits() const { return waits.loadAcquire(); }
+
+private:
+    DeliveryRecord records[capacity];
+    QAtomicInt head;  ///< Next slot the producer writes.
+    QAtomicInt tail;  ///< Next slot the consumer reads.
+    QAtomicInt waits; ///< Records that had to wait for a free slot.
+};
+
+/**
+ * @class DeliveryAuditor
+ * @brief Drains the delivery audit trails of every pump writing to one DataLogger.
+ *
+ * There is one auditor per logger, a child of it (see of()). Its thread is the single
+ * consumer of the attached rings: it drains them every drainIntervalMs and formats the
+ * records. The logger is only called on its own thread, from deliver(), so it needs no
+ * locking.
+ */
+class DeliveryAuditor : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int drainIntervalMs = 20;      ///< Drain thread polling interval.
+    static constexpr int handOverIntervalMs = 1000; ///< Hand-over interval to the logger (needs an event loop).
+
+    /**
+     * @brief Returns the logger's auditor, creating it on first use.
+     * @param logger Logger that receives the audit entries.
+     */
+    static DeliveryAuditor *of(DataLogger *logger);
+
+    /**
+     * @brief Stops the drain thread. Entries not yet handed over are dropped with the logger.
+     */
+    ~DeliveryAuditor();
+
+    /**
+     * @brief Adds a pump's ring to the rings drained by the auditor thread.
+     * @param log Ring; must stay alive until detach().
+     */
+    void attach(DeliveryAuditLog *log);
+
+    /**
+     * @brief Stops draining a pump's ring and hands what was left in it to the logger.
+     * @param log Ring given to attach().
+     */
+    void detach(DeliveryAuditLog *log);
+
+    /**
+     * @brief Drains the rings and hands all formatted entries to the logger (logger's thread).
+     */
+    void deliver();
+
+    /**
+     * @brief Formats a record as a log entry.
+     *
+     * The description is the text the pump logged before the audit trail existed, so
+     * recorded logs still replay; the reservoir goes in its own field.
+     *
+     * @param record Record.
+     * @return Entry with the record's time, event type, description and reservoir.
+     */
+    static LogEntry toLogEntry(const DeliveryRecord &record);
+
+private:
+    explicit DeliveryAuditor(DataLogger *logger);
+
+    void drain();
+    void run();
+
+    DataLogger *logger;
+    QTimer *handOverTimer;
+
+    QMutex drainMutex;              ///< Guards logs; only one consumer of the rings at a time.
+    QList<DeliveryAuditLog *> logs; ///< Rings of the attached pumps.
+    QMutex pendingMutex;            ///< Guards pending.
+    QList<LogEntry> pending;        ///< Formatted entries waiting for deliver().
+
+    QMutex stateMutex;              ///< Guards stopping.
+    QWaitCondition stopRequested;
+    bool stopping;
+    QThread *thread;
+};
+
+#endif // DELIVERYAUDIT_H
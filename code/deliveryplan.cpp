@@ -0,0 +1,81 @@
+#include "deliveryplan.h"
+#include <algorithm>
+
+DeliveryPlan::DeliveryPlan()
+    : planKind(Normal)
+{ }
+
+DeliveryPlan DeliveryPlan::normal(double units, double rate) {
+    DeliveryPlan plan;
+    plan.addPulse(0, units, rate);
+    return plan;
+}
+
+DeliveryPlan DeliveryPlan::extended(double units, double hours) {
+    DeliveryPlan plan;
+    plan.planKind = Extended;
+    if (hours > 0) {
+        plan.addPulse(0, units, units / hours);
+    }
+    return plan;
+}
+
+DeliveryPlan DeliveryPlan::dualWave(double nowUnits, double extendedUnits, double hours, double rate) {
+    DeliveryPlan plan;
+    plan.planKind = DualWave;
+    plan.addPulse(0, nowUnits, rate);
+    if (hours > 0) {
+        plan.addPulse(0, extendedUnits, extendedUnits / hours);
+    }
+    return plan;
+}
+
+DeliveryPlan DeliveryPlan::split(double nowUnits, double laterUnits, double delayHours, double rate) {
+    DeliveryPlan plan;
+    plan.planKind = Split;
+    plan.addPulse(0, nowUnits, rate);
+    plan.addPulse(std::max(0.0, delayHours), laterUnits, rate);
+    return plan;
+}
+
+DeliveryPlan::Kind DeliveryPlan::kind() const {
+    return planKind;
+}
+
+const QVector<DeliveryPulse> &DeliveryPlan::pulses() const {
+    return pulseList;
+}
+
+DoseValue DeliveryPlan::totalUnits() const {
+    DoseValue total(0);
+    for (const DeliveryPulse &pulse : pulseList) {
+        total += pulse.units;
+    }
+    return total;
+}
+
+double DeliveryPlan::durationHours() const {
+    double duration = 0;
+    for (const DeliveryPulse &pulse : pulseList) {
+        duration = std::max(duration, pulse.endHours());
+    }
+    return duration;
+}
+
+void DeliveryPlan::limitTo(const DoseValue &units) {
+    DoseValue left = units;
+    for (int i = 0; i < pulseList.size(); i++) {
+        pulseList[i].units = std::min(pulseList[i].units, left);
+        left -= pulseList[i].units;
+    }
+    pulseList.erase(std::remove_if(pulseList.begin(), pulseList.end(),
+                                   [](const DeliveryPulse &pulse) { return pulse.units <= DoseValue(0); }),
+                    pulseList.end());
+}
+
+void DeliveryPlan::addPulse(double startHours, double units, double rate) {
+    if (units <= 0 || rate <= 0) {
+        return;
+    }
+    pulseList.append({startHours, DoseValue(units), rate});
+}
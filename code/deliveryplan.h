@@ -0,0 +1,114 @@
+/**
+ * @file deliveryplan.h
+ * @brief Defines the DeliveryPlan class, a bolus request compiled into timed pulses.
+ *
+ * Every bolus the pump delivers is compiled once, when it is requested, into a list of
+ * pulses: a number of units delivered at a constant rate from a given offset. A normal
+ * bolus is one pulse; an extended bolus one slow pulse; a dual-wave bolus an immediate and
+ * a slow pulse that start together; a split bolus two pulses with a delay between them.
+ * PumpController runs the pulses of any number of plans side by side, so on each tick it
+ * only starts the pulses that are due and delivers the running ones, and the time until
+ * every plan is complete is known exactly.
+ */
+#ifndef DELIVERYPLAN_H
+#define DELIVERYPLAN_H
+
+#include <QVector>
+#include "fixedpoint.h"
+
+/**
+ * @brief Part of a delivery plan: units delivered at a constant rate from an offset.
+ */
+struct DeliveryPulse {
+    double startHours; ///< Offset from the start of the plan (hours).
+    DoseValue units;   ///< Units delivered by the pulse.
+    double rate;       ///< Delivery rate (units/hour), always > 0.
+
+    /**
+     * @brief Returns the offset the pulse finishes at.
+     * @return Hours from the start of the plan.
+     */
+    double endHours() const { return startHours + static_cast<double>(units) / rate; }
+};
+
+/**
+ * @class DeliveryPlan
+ * @brief A bolus request compiled into pulses, in start order.
+ *
+ * Built with the factory functions; pulses of no units or no rate are left out.
+ */
+class DeliveryPlan
+{
+public:
+    /**
+     * @brief Kind of bolus the plan was compiled from.
+     */
+    enum Kind {
+        Normal,   ///< All units at the bolus rate.
+        Extended, ///< All units spread evenly over a duration.
+        DualWave, ///< Part at the bolus rate, the rest spread over a duration, both from the start.
+        Split     ///< Part at the bolus rate, the rest at the bolus rate after a delay.
+    };
+
+    DeliveryPlan();
+
+    /**
+     * @brief Compiles a normal bolus.
+     * @param units Insulin units.
+     * @param rate Delivery rate (units/hour).
+     */
+    static DeliveryPlan normal(double units, double rate);
+
+    /**
+     * @brief Compiles an extended bolus.
+     * @param units Insulin units.
+     * @param hours Duration the units are spread over.
+     */
+    static DeliveryPlan extended(double units, double hours);
+
+    /**
+     * @brief Compiles a dual-wave bolus.
+     * @param nowUnits Units delivered at once, at @p rate.
+     * @param extendedUnits Units spread over @p hours, starting at the same time.
+     * @param hours Duration of the extended part.
+     * @param rate Delivery rate of the immediate part (units/hour).
+     */
+    static DeliveryPlan dualWave(double nowUnits, double extendedUnits, double hours, double rate);
+
+    /**
+     * @brief Compiles a split bolus.
+     * @param nowUnits Units delivered at once.
+     * @param laterUnits Units delivered after @p delayHours.
+     * @param delayHours Delay of the second part (hours).
+     * @param rate Delivery rate of both parts (units/hour).
+     */
+    static DeliveryPlan split(double nowUnits, double laterUnits, double delayHours, double rate);
+
+    Kind kind() const;
+    const QVector<DeliveryPulse> &pulses() const;
+
+    /**
+     * @brief Returns the units of all pulses.
+     */
+    DoseValue totalUnits() const;
+
+    /**
+     * @brief Returns the time from the start of the plan until its last pulse finishes.
+     * @return Hours; 0 for an empty plan.
+     */
+    double durationHours() const;
+
+    /**
+     * @brief Caps the plan at a number of units, trimming the pulses that start last.
+     * @param units Most units the plan may deliver (e.g. the insulin in the reservoir).
+     */
+    void limitTo(const DoseValue &units);
+
+private:
+    void addPulse(double startHours, double units, double rate);
+
+    Kind planKind;                     ///< Kind of bolus.
+    QVector<DeliveryPulse> pulseList;  ///< Pulses in start order.
+};
+
+#endif // DELIVERYPLAN_H
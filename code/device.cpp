@@ -1,45 +1,52 @@
 #include <device.h>
 #include <ui_device.h>
 #include <QTimer>
-#include <controliqalgorithm.h>
-#include <QDateTime>
 #include <QSlider>
+#include <QCheckBox>
+#include <QMessageBox>
 
 Device::Device(QWidget *parent)
     : QMainWindow{parent}
     , simulationRate(1)
     , poweredOn(false)
-    , monitoring(false)
     , paused(false)
-    , battery(new BatteryManager)
+    , fastForward(false)
     , logger(DataLogger::instance(this))
-    , insulin(new InsulinReserve)
-    , bloodstream(new Bloodstream)
-    , controlIQ(new ControlIQAlgorithm())
+    , engine(new SimulationEngine(logger, this))
     , window(new Ui::Device)
     , tickClock(new QTimer(this))
+    , frameClock(new QTimer(this))
 {
     window->setupUi(this);
+    tickClock->setTimerType(Qt::PreciseTimer);
+    frameClock->setInterval(0);
 
     Profile::loadProfiles();
     Profile::initDefaultProfile();
     Profile::selectProfileById(1);
+    settingsProfile = Profile::getActiveProfile();
+    engine->setProfile(settingsProfile);
 
-    pump = new PumpController(insulin, logger, window->pumpErrorBox);
-    interface = new UserInterface(pump, window->uiWidget);
-    cgm = new CGMReader(window->cgmErrorBox);
+    logger->setClock(engine->getClock()); // Log timestamps follow simulated time
+    interface = new UserInterface(engine, window->uiWidget);
 
     connect(window->powerButton, &QPushButton::released, this, &Device::power);
     connect(interface, &UserInterface::deviceUnlocked, this, &Device::startMonitoring);
     connect(tickClock, &QTimer::timeout, this, &Device::tick);
-    connect(window->chargeBatteryButton, &QPushButton::released, battery, &BatteryManager::chargeBattery);
-    connect(window->chargeBatteryButton, &QPushButton::released, this, [](){ Alert::reset(Alert::BATTERY_LOW); });
+    connect(frameClock, &QTimer::timeout, this, &Device::fastForwardFrame);
+    connect(window->chargeBatteryButton, &QPushButton::released, engine->getBattery(), &BatteryManager::chargeBattery);
+    connect(window->chargeBatteryButton, &QPushButton::released, this, [this](){ engine->getAlerts()->reset(AlertMonitor::BATTERY_LOW); });
     connect(window->chargeBatteryButton, &QPushButton::released, this, [this](){ window->chargeBatteryButton->setText("Charge battery"); });
-    connect(window->refillInsulinButton, &QPushButton::released, insulin, &InsulinReserve::refillInsulin);
-    connect(battery, &BatteryManager::batteryDead, this, &Device::noPower);
+    connect(window->refillInsulinButton, &QPushButton::released, engine->getInsulinReserve(), &InsulinReserve::refillInsulin);
+    connect(window->cgmErrorBox, &QCheckBox::toggled, engine, &SimulationEngine::setCGMError);
+    connect(window->pumpErrorBox, &QCheckBox::toggled, engine, &SimulationEngine::setPumpError);
+    connect(window->batteryErrorBox, &QCheckBox::toggled, engine, &SimulationEngine::setBatteryError);
+    connect(engine->getBattery(), &BatteryManager::batteryDead, this, &Device::noPower);
+    connect(engine->getAlerts(), &AlertMonitor::alertRaised, this, [this](int type){ Alert::raise(type, interface); });
     connect(window->pauseButton, &QPushButton::released, this, &Device::togglePaused);
     connect(window->simRateSlider, &QSlider::valueChanged, this, &Device::setSimRate);
     connect(window->carbButton, &QPushButton::released, this, &Device::simCarbIntake);
+    connect(window->fastForwardButton, &QPushButton::toggled, this, &Device::setFastForward);
 
     logger->loadLogs();
 
@@ -47,12 +54,12 @@ Device::Device(QWidget *parent)
 }
 
 void Device::power(){
-    if (poweredOn || battery->getBatteryLevel() == 0){
+    if (poweredOn || engine->getBattery()->getBatteryLevel() == 0){
         poweredOn = false;
-        monitoring = false;
+        engine->setMonitoring(false);
         interface->hide();
         window->powerButton->setText("Power on");
-        tickClock->stop();
+        stopClock();
     } else {
         poweredOn = true;
         interface->show();
@@ -63,110 +70,145 @@ void Device::power(){
 
 void Device::noPower(){
         poweredOn = false;
-        monitoring = false;
+        engine->setMonitoring(false);
         interface->hide();
         window->powerButton->setText("Power on");
         window->chargeBatteryButton->setText("Charge battery\n(battery is dead)");
-        tickClock->stop();
+        stopClock();
 }
 
 void Device::startMonitoring(){
-    monitoring = true;
+    engine->setMonitoring(true);
     interface->displayHomeScreen();
     if (not paused){
         tick(); // Updates the display immediately upon showing it
-        tickClock->start(1000.0 / simulationRate);
+        startClock();
     }
 }
 
 void Device::tick(){ // Each tick represents 5 minutes
-    battery->drainBattery();
+    followSettingsProfile(); // Follows profile changes made in Settings
+
+    SimulationSample sample = engine->tick();
 
-    if (monitoring) {
-        this->monitor();
+    if (engine->isMonitoring()) {
+        interface->refresh(sample.glucose, sample.battery, sample.insulin, sample.iob);
+        interface->updateForecast(sample.glucose, sample.forecast30);
     }
 }
 
-void Device::monitor(){
-    QDateTime time = QDateTime::currentDateTime();
-
-    double batteryLevel = battery->getBatteryLevel();
-    double glucose = cgm->getCurrentGlucoseLevel(bloodstream, profiles->getActiveProfile().getCorrectionFactor());
-    double target = Profile::getActiveProfile().getTargetGlucose();
-    double insulinReading = insulin->getInsulinRemaining();
-
-    safetyChecks(glucose, target);
+void Device::togglePaused(){
+    if (paused) {
+        paused = false;
+        startClock();
+        window->pauseButton->setText("Pause simulation");
+    } else {
+        paused = true;
+        stopClock();
+        window->pauseButton->setText("Resume simulation");
+    }
+}
 
-    // Pump logic
-    if (glucose != -1){
-        controlIQ->analyzeGlucoseData(glucose, logger, pump);
+void Device::setSimRate(int rate){
+    simulationRate = rate;
+    if (this->poweredOn and not paused and not fastForward){
+        tickClock->start(tickInterval());
+    }
+    if (not fastForward){
+        window->simRateLabel->setText("Simulation rate: " + QString::number(simulationRate) + "x");
+    }
+}
 
-        pump->pump(bloodstream);
+int Device::tickInterval() const{
+    return qMax(1, qRound(1000.0 / simulationRate));
+}
 
-        logger->logGlucose(time, glucose);
-        logger->logInsulin(time, bloodstream->getIOB());
+void Device::startClock(){
+    if (fastForward) {
+        tickClock->stop();
+        frameClock->start();
+    } else {
+        frameClock->stop();
+        tickClock->start(tickInterval());
     }
-    double currentIOB = bloodstream->getIOB();
+}
 
-    interface->refresh(glucose, batteryLevel, insulinReading, currentIOB);
+void Device::stopClock(){
+    tickClock->stop();
+    frameClock->stop();
 }
 
-void Device::safetyChecks(double glucose, double target){
-    if (battery->isBatteryCritical()){
-        alerts->raise(Alert::BATTERY_LOW, interface, logger);
+void Device::setFastForward(bool enabled){
+    if (fastForward == enabled) {
+        return;
     }
+    fastForward = enabled;
 
-    if (insulin->isInsulinLow()){
-        alerts->raise(Alert::INSULIN_LOW, interface, logger);
-    }
+    // Saving the whole log after every entry would dominate a fast-forward frame
+    logger->setDeferredWrites(enabled);
+    lastLogFlush.start();
+    engine->resetSpeedMeasurement();
 
-    if (cgm->isCGMConnected()) {
-        alerts->reset(Alert::CGM_DISCONNECTED);
+    if (enabled) {
+        window->simRateLabel->setText("Fast-forward");
     } else {
-        alerts->raise(Alert::CGM_DISCONNECTED, interface, logger);
+        window->simRateLabel->setText("Simulation rate: " + QString::number(simulationRate) + "x");
     }
 
-    if (not window->pumpErrorBox->isChecked()) {
-        alerts->reset(Alert::PUMP_OCCLUSION);
-    } else {
-        alerts->raise(Alert::PUMP_OCCLUSION, interface, logger);
+    if (poweredOn and engine->isMonitoring() and not paused) {
+        startClock();
+    }
+}
+
+void Device::fastForwardFrame(){
+    followSettingsProfile(); // Follows profile changes made in Settings
+
+    QVector<SimulationSample> samples;
+    engine->runFor(frameBudgetMs, &samples);
+
+    if (engine->isMonitoring() and not samples.isEmpty()) {
+        QVector<double> readings;
+        readings.reserve(samples.size());
+        for (const SimulationSample &sample : samples) {
+            readings.append(sample.glucose);
+        }
+        const SimulationSample &last = samples.last();
+        interface->refreshBatch(readings, last.battery, last.insulin, last.iob);
+        interface->updateForecast(last.glucose, last.forecast30);
     }
 
-    if (glucose == -1){
-        pump->suspendBolus();  // Stop insulin delivery temporarily
-    } else if (glucose < 3.9) {
-        pump->suspendBolus();  // Stop insulin delivery temporarily
-        alerts->raise(Alert::GLUCOSE_LOW, interface, logger);
-    } else if (glucose > target + 2.0) {
-        alerts->raise(Alert::GLUCOSE_HIGH, interface, logger);
-    } else if (glucose <= target + 0.5 and glucose >= target -0.5) {
-        alerts->reset(Alert::GLUCOSE_HIGH);
-        alerts->reset(Alert::GLUCOSE_LOW);
+    if (lastLogFlush.elapsed() >= logFlushIntervalMs) {
+        logger->flush();
+        lastLogFlush.restart();
     }
+
+    window->simRateLabel->setText("Fast-forward: " + QString::number(qRound64(engine->getSimulationSpeed())) + "x");
 }
 
-void Device::togglePaused(){
-    if (paused) {
-        paused = false;
-        tickClock->start(1000/simulationRate);
-        window->pauseButton->setText("Pause simulation");
-    } else {
-        paused = true;
-        tickClock->stop();
-        window->pauseButton->setText("Resume simulation");
+bool Device::loadScenario(const QString &path){
+    QString error;
+    if (!engine->loadScenario(path, &error)) {
+        QMessageBox::warning(this, "Scenario", "The scenario could not be loaded: " + error);
+        return false;
     }
+    logger->logEvent("Info", "Scenario " + path + " started.");
+    return true;
 }
 
-void Device::setSimRate(int rate){
-    simulationRate = rate;
-    if (this->poweredOn and not paused){
-        tickClock->stop();
-        tickClock->start(1000 / simulationRate);
+void Device::followSettingsProfile(){
+    Profile active = Profile::getActiveProfile();
+    if (active.getId() == settingsProfile.getId() && active.getName() == settingsProfile.getName()
+            && active.getBasalRate() == settingsProfile.getBasalRate()
+            && active.getCarbRatio() == settingsProfile.getCarbRatio()
+            && active.getCorrectionFactor() == settingsProfile.getCorrectionFactor()
+            && active.getTargetGlucose() == settingsProfile.getTargetGlucose()) {
+        return; // Unchanged: keep any profile change a scenario made
     }
-    window->simRateLabel->setText("Simulation rate: " + QString::number(simulationRate) + "x");
+    settingsProfile = active;
+    engine->setProfile(active);
 }
 
 void Device::simCarbIntake(){
-    double ratio = Profile::getActiveProfile().getCarbRatio();
-    cgm->intakeGlucose(ratio * window->carbSpinBox->value());
+    followSettingsProfile();
+    engine->intakeCarbs(window->carbSpinBox->value());
 }
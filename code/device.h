@@ -2,24 +2,22 @@
  * @file device.h
  * @brief Defines the Device class, central orchestrator of the insulin pump simulator.
  *
- * The Device class initializes and connects all subsystems (pump, CGM, battery, UI, etc.),
- * manages the simulation lifecycle (power on/off, monitoring loop via QTimer ticks),
- * and enforces safety protocols through periodic checks and alerts.
+ * The Device class is the GUI view over the headless SimulationEngine. It connects the
+ * engine to the user interface and the simulator controls, manages the simulation
+ * lifecycle (power on/off, monitoring loop via QTimer ticks) and displays the alerts
+ * raised by the engine's safety checks.
  */
 #ifndef DEVICE_H
 #define DEVICE_H
 
 #include <QMainWindow>
+#include <QElapsedTimer>
 //#include <unistd.h>
-#include <batterymanager.h>
 #include <datalogger.h>
-#include <insulinreserve.h>
-#include <cgmreader.h>
 #include <profile.h>
-#include <pumpcontroller.h>
+#include <simulationengine.h>
 #include <userinterface.h>
 #include <alert.h>
-#include <bloodstream.h>
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class Device; }
@@ -29,9 +27,8 @@ QT_END_NAMESPACE
  * @class Device
  * @brief Central orchestrator for the insulin pump simulator.
  *
- * Initializes and connects all subsystems (pump, CGM, battery, UI, etc.),
- * manages the simulation lifecycle (power, monitoring loop),
- * and enforces safety via periodic checks.
+ * Owns the SimulationEngine and the UI, forwards the simulator controls
+ * (faults, carbs, refill, charge) to the engine and drives its ticks.
  */
 class Device : public QMainWindow
 {
@@ -43,6 +40,16 @@ public:
      */
     explicit Device(QWidget *parent = nullptr);
 
+    /**
+     * @brief Loads a scenario file into the engine, starting at the current simulated time.
+     *
+     * Shows a warning if the file cannot be loaded.
+     *
+     * @param path Scenario file, see scenario.h for the format.
+     * @return True if the scenario was loaded.
+     */
+    bool loadScenario(const QString &path);
+
 public slots:
     /**
      * @brief Toggles device power on or off.
@@ -75,49 +82,67 @@ public slots:
      */
     void simCarbIntake();
 
+    /**
+     * @brief Switches fast-forward mode on or off.
+     *
+     * In fast-forward mode ticks run back-to-back with no timer and the UI is
+     * refreshed once per frame instead of once per tick.
+     *
+     * @param enabled True to fast-forward, false to return to the timed simulation rate.
+     */
+    void setFastForward(bool enabled);
+
+    /**
+     * @brief Runs one fast-forward frame: simulates for the frame budget, then refreshes the UI.
+     */
+    void fastForwardFrame();
+
 private:
     int simulationRate; // a rate of 1 means 1 second represents 5 minutes
+    static constexpr int frameBudgetMs = 25; ///< Simulation time per fast-forward frame (~30 fps with rendering)
+    static constexpr int logFlushIntervalMs = 2000; ///< How often deferred logs are saved while fast-forwarding
 
     bool poweredOn; ///< Device power state
-    bool monitoring; ///< Whether monitoring is active
     bool paused; ///< Whether simulation is paused
+    bool fastForward; ///< Whether ticks run back-to-back instead of on tickClock
     
-    BatteryManager *battery; ///< Manages battery level and drain
     DataLogger *logger; ///< Logs events, glucose, and insulin data
-    InsulinReserve *insulin; ///< Tracks insulin reservoir
-    CGMReader *cgm; ///< Simulates CGM readings
-    Bloodstream *bloodstream; ///< Receives insulin injections
-    ControlIQAlgorithm *controlIQ; ///< Automated basal adjustment algorithm
-    Profile *profiles; ///< Manages user profiles
-    PumpController *pump; ///< Executes insulin delivery logic
+    SimulationEngine *engine; ///< Headless simulation core (patient, pump, controller, alerts)
     UserInterface *interface; ///< Handles UI navigation and updates
-    Alert *alerts; ///< Displays alert dialogs
     Ui::Device *window; ///< Generated UI components
     QTimer *tickClock; ///< Timer driving simulation ticks
+    QTimer *frameClock; ///< Zero-interval timer driving fast-forward frames
+    QElapsedTimer lastLogFlush; ///< Time since deferred logs were last saved
+    Profile settingsProfile; ///< Active Settings profile last given to the engine
     
-    bool batteryAlertShown= false; ///< Prevents repeated battery alerts
-    bool insulinAlertShown= false; ///< Prevents repeated insulin-low alerts
-    bool cgmAlertShown= false; ///< Prevents repeated CGM disconnect alerts
-    bool lowGlucoseAlertShown= false; ///< Prevents repeated low-glucose alerts 
-    bool highGlucoseAlertShown= false; ///< Prevents repeated high-glucose alerts
+    /**
+     * @brief Updates simulation rate and adjusts timer interval accordingly.
+     * @param rate New simulation speed factor
+     */
+    void setSimRate(int rate);
 
     /**
-     * @brief Executes one monitoring cycle: read sensors, update pump, log data, and refresh UI.
+     * @brief Returns the tick timer interval for the current simulation rate.
+     * @return Interval in milliseconds.
      */
-    void monitor();
-    
+    int tickInterval() const;
+
     /**
-     * @brief Evaluates safety conditions and triggers alerts as needed.
-     * @param glucose Current glucose reading from CGM
-     * @param target  User-defined target glucose level
+     * @brief Gives the engine the active Settings profile if it was changed since the last call.
+     *
+     * Profile changes made by a scenario are kept until the user edits or switches profiles.
      */
-    void safetyChecks(double glucose, double target);
-    
+    void followSettingsProfile();
+
     /**
-     * @brief Updates simulation rate and adjusts timer interval accordingly.
-     * @param rate New simulation speed factor
+     * @brief Starts the timer that drives the simulation (tick or fast-forward frame).
      */
-    void setSimRate(int rate);
+    void startClock();
+
+    /**
+     * @brief Stops whichever timer drives the simulation.
+     */
+    void stopClock();
 };
 
 #endif // DEVICE_H
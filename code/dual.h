@@ -0,0 +1,105 @@
+/**
+ * @file dual.h
+ * @brief Defines the Dual class template, a dual number for forward-mode differentiation.
+ *
+ * A Dual<N> carries a value and its derivatives with respect to N inputs. Arithmetic on
+ * duals applies the chain rule as it goes, so running code templated on its scalar type
+ * (see glucosemodel.h) with Dual<N> instead of double yields the result and all N partial
+ * derivatives in one pass. Comparisons look at the value only: branches follow the same
+ * path as the double computation and differentiate the branch taken.
+ */
+#ifndef DUAL_H
+#define DUAL_H
+
+#include <array>
+
+/**
+ * @class Dual
+ * @brief Value with derivatives with respect to N inputs.
+ */
+template<int N>
+class Dual
+{
+public:
+    /**
+     * @brief Constructs a constant (all derivatives zero).
+     * @param value Value.
+     */
+    Dual(double value = 0) : val(value) { der.fill(0); }
+
+    /**
+     * @brief Returns an input: a value whose derivative with respect to itself is 1.
+     * @param value Value of the input.
+     * @param index Index of the input (0 to N - 1).
+     */
+    static Dual variable(double value, int index) {
+        Dual dual(value);
+        dual.der[index] = 1;
+        return dual;
+    }
+
+    double value() const { return val; }
+
+    /**
+     * @brief Returns the derivative with respect to an input.
+     * @param index Index of the input.
+     */
+    double derivative(int index) const { return der[index]; }
+
+    Dual &operator+=(const Dual &other) {
+        val += other.val;
+        for (int i = 0; i < N; i++) der[i] += other.der[i];
+        return *this;
+    }
+
+    Dual &operator-=(const Dual &other) {
+        val -= other.val;
+        for (int i = 0; i < N; i++) der[i] -= other.der[i];
+        return *this;
+    }
+
+    Dual &operator*=(const Dual &other) {
+        for (int i = 0; i < N; i++) der[i] = der[i] * other.val + val * other.der[i];
+        val *= other.val;
+        return *this;
+    }
+
+    Dual &operator/=(const Dual &other) {
+        val /= other.val;
+        for (int i = 0; i < N; i++) der[i] = (der[i] - val * other.der[i]) / other.val;
+        return *this;
+    }
+
+    Dual operator-() const {
+        Dual negated(-val);
+        for (int i = 0; i < N; i++) negated.der[i] = -der[i];
+        return negated;
+    }
+
+    // Hidden friends, so doubles convert on either side
+    friend Dual operator+(Dual a, const Dual &b) { return a += b; }
+    friend Dual operator-(Dual a, const Dual &b) { return a -= b; }
+    friend Dual operator*(Dual a, const Dual &b) { return a *= b; }
+    friend Dual operator/(Dual a, const Dual &b) { return a /= b; }
+
+    friend bool operator<(const Dual &a, const Dual &b) { return a.val < b.val; }
+    friend bool operator>(const Dual &a, const Dual &b) { return a.val > b.val; }
+    friend bool operator<=(const Dual &a, const Dual &b) { return a.val <= b.val; }
+    friend bool operator>=(const Dual &a, const Dual &b) { return a.val >= b.val; }
+    friend bool operator==(const Dual &a, const Dual &b) { return a.val == b.val; }
+    friend bool operator!=(const Dual &a, const Dual &b) { return a.val != b.val; }
+
+private:
+    double val;
+    std::array<double, N> der;
+};
+
+/**
+ * @brief Returns the value of a scalar, whether a double or a Dual.
+ */
+inline double valueOf(double value) { return value; }
+
+template<int N>
+double valueOf(const Dual<N> &value) { return value.value(); }
+
+#endif // DUAL_H
@@ -0,0 +1,104 @@
+#include "eventscheduler.h"
+#include <QDataStream>
+
+EventScheduler::EventScheduler()
+    : nextId(1)
+{
+}
+
+quint64 EventScheduler::schedule(SimEvent event) {
+    event.id = nextId++;
+    queue.push(event);
+    queued.insert(event.id);
+    return event.id;
+}
+
+void EventScheduler::cancel(quint64 id) {
+    if (queued.contains(id)) { // Fired ids would never be dropped
+        cancelled.insert(id);
+    }
+}
+
+bool EventScheduler::isEmpty() {
+    dropCancelled();
+    return queue.empty();
+}
+
+qint64 EventScheduler::nextTime() {
+    dropCancelled();
+    return queue.empty() ? -1 : queue.top().time;
+}
+
+bool EventScheduler::takeNext(SimEvent *event) {
+    dropCancelled();
+    if (queue.empty()) {
+        return false;
+    }
+    *event = queue.top();
+    queue.pop();
+    queued.remove(event->id);
+    return true;
+}
+
+void EventScheduler::shift(qint64 msecs) {
+    std::vector<SimEvent> events;
+    events.reserve(queue.size());
+    while (!queue.empty()) {
+        SimEvent event = queue.top();
+        queue.pop();
+        event.time += msecs;
+        events.push_back(event);
+    }
+    for (const SimEvent &event : events) {
+        queue.push(event);
+    }
+}
+
+void EventScheduler::clear() {
+    queue = std::priority_queue<SimEvent, std::vector<SimEvent>, Later>();
+    queued.clear();
+    cancelled.clear();
+}
+
+void EventScheduler::saveState(QDataStream &out) const {
+    std::vector<SimEvent> events;
+    auto pending = queue;
+    while (!pending.empty()) {
+        if (!cancelled.contains(pending.top().id)) { // Cancelled events are not worth keeping
+            events.push_back(pending.top());
+        }
+        pending.pop();
+    }
+
+    out << nextId << quint32(events.size());
+    for (const SimEvent &event : events) {
+        out << event.time << qint32(event.type) << event.amount << event.rate << qint32(event.fault)
+            << event.active << event.id;
+    }
+}
+
+void EventScheduler::restoreState(QDataStream &in, bool (*isValid)(const SimEvent &event)) {
+    clear();
+    quint32 count = 0;
+    in >> nextId >> count;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        SimEvent event;
+        qint32 type = 0, fault = 0;
+        in >> event.time >> type >> event.amount >> event.rate >> fault >> event.active >> event.id;
+        event.type = SimEvent::Type(type);
+        event.fault = fault;
+        if (type < SimEvent::SensorSample || type > SimEvent::FaultTransition || (isValid && !isValid(event))) {
+            in.setStatus(QDataStream::ReadCorruptData);
+            return;
+        }
+        queue.push(event);
+        queued.insert(event.id);
+    }
+}
+
+void EventScheduler::dropCancelled() {
+    while (!queue.empty() && !cancelled.isEmpty() && cancelled.remove(queue.top().id)) {
+        queued.remove(queue.top().id);
+        queue.pop();
+    }
+}
@@ -0,0 +1,138 @@
+/**
+ * @file eventscheduler.h
+ * @brief Defines the EventScheduler class, the discrete-event queue of the simulation.
+ *
+ * Instead of advancing everything in fixed 5-minute ticks, the SimulationEngine keeps
+ * a time-ordered queue of the moments where something happens (a sensor sample, a basal
+ * segment change, a bolus pulse starting or ending, a meal, a fault or a scenario action) and
+ * jumps straight from one to the next. Continuous processes (insulin delivery, glucose
+ * drift, battery drain) are integrated exactly over the gap between two events.
+ */
+#ifndef EVENTSCHEDULER_H
+#define EVENTSCHEDULER_H
+
+#include <QtGlobal>
+#include <QSet>
+#include <queue>
+#include <vector>
+
+class QDataStream;
+
+/**
+ * @brief A timed simulation event.
+ *
+ * Events carry plain data rather than callbacks so the queue can be inspected and saved.
+ */
+struct SimEvent {
+    enum Type {
+        SensorSample,        ///< CGM sample: read, run safety checks and the controller.
+        BasalChange,         ///< Start of a new basal segment (rate).
+        BolusComplete,       ///< A pulse of the pump's delivery plans starts or finishes delivering.
+        ExtendedDoseRelease, ///< No longer scheduled (delayed doses are pump plans); kept so saved types keep their values (amount, rate).
+        Meal,                ///< Carbohydrate intake (amount in grams; absorption profile if active).
+        Fault,               ///< Fault set or cleared (fault, active).
+        RecordedReading,     ///< Recorded CGM reading replayed in place of the model (amount in mmol/L).
+        ScenarioStep,        ///< The next actions of the loaded scenario are due (no payload).
+        FaultTransition      ///< A random fault starts or ends (fault), see FaultInjector.
+    };
+
+    qint64 time;   ///< Simulated time the event fires (ms since epoch).
+    Type type;     ///< Kind of event.
+    double amount; ///< Grams of carbs (Meal) or insulin units (ExtendedDoseRelease).
+    double rate;   ///< Basal rate (BasalChange) or delivery rate (ExtendedDoseRelease), units/hour; absorption minutes (Meal); recorded IOB (RecordedReading).
+    int fault;     ///< Fault kind (Fault, FaultTransition), see SimulationEngine::FaultType; absorption shape (Meal).
+    bool active;   ///< Whether the fault is set or cleared (Fault); whether the meal has its own absorption profile (Meal); whether the IOB was recorded (RecordedReading).
+    quint64 id;    ///< Unique id, also breaks ties so equal-time events fire in scheduling order.
+};
+
+/**
+ * @class EventScheduler
+ * @brief Priority queue of SimEvents ordered by time.
+ *
+ * Scheduling and taking the next event are O(log n). Cancelled events are dropped
+ * lazily when they reach the front of the queue.
+ */
+class EventScheduler
+{
+public:
+    EventScheduler();
+
+    /**
+     * @brief Adds an event to the queue.
+     * @param event Event to schedule; its id is assigned by the scheduler.
+     * @return Id of the scheduled event, for cancel().
+     */
+    quint64 schedule(SimEvent event);
+
+    /**
+     * @brief Cancels a pending event. Unknown or already fired ids are ignored.
+     * @param id Id returned by schedule().
+     */
+    void cancel(quint64 id);
+
+    /**
+     * @brief Checks whether any event is pending.
+     * @return True if no event is pending.
+     */
+    bool isEmpty();
+
+    /**
+     * @brief Returns the time of the next pending event.
+     * @return Time in ms since epoch, or -1 if nothing is pending.
+     */
+    qint64 nextTime();
+
+    /**
+     * @brief Removes the next pending event from the queue.
+     * @param event Receives the event.
+     * @return False if nothing is pending.
+     */
+    bool takeNext(SimEvent *event);
+
+    /**
+     * @brief Moves every pending event by the same amount of time.
+     * @param msecs Offset in milliseconds.
+     */
+    void shift(qint64 msecs);
+
+    /**
+     * @brief Removes every pending event.
+     */
+    void clear();
+
+    /**
+     * @brief Writes every pending event, in order, to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Replaces the pending events with those written by saveState().
+     *
+     * An event of an unknown type, or one @p isValid rejects, marks the stream as corrupt
+     * (QDataStream::ReadCorruptData) and stops the restore.
+     *
+     * @param in Checkpoint stream.
+     * @param isValid Optional check of each event's payload.
+     */
+    void restoreState(QDataStream &in, bool (*isValid)(const SimEvent &event) = nullptr);
+
+private:
+    struct Later {
+        bool operator()(const SimEvent &a, const SimEvent &b) const {
+            return a.time != b.time ? a.time > b.time : a.id > b.id;
+        }
+    };
+
+    std::priority_queue<SimEvent, std::vector<SimEvent>, Later> queue;
+    QSet<quint64> queued;    ///< Ids in the queue, cancelled or not.
+    QSet<quint64> cancelled; ///< Ids still in the queue that must be skipped.
+    quint64 nextId;
+
+    /**
+     * @brief Drops cancelled events from the front of the queue.
+     */
+    void dropCancelled();
+};
+
+#endif // EVENTSCHEDULER_H
@@ -0,0 +1,123 @@
+#include "faultinjector.h"
+#include <QDataStream>
+#include <QStringList>
+#include <cmath>
+
+bool FaultProfile::isEnabled() const {
+    return perDay > 0 && meanMinutes > 0;
+}
+
+FaultProfile FaultProfile::fromString(const QString &text, bool *ok) {
+    FaultProfile profile;
+    QStringList parts = text.split(':');
+    bool valid = parts.size() <= 2;
+    if (valid) profile.perDay = parts[0].toDouble(&valid);
+    if (valid && parts.size() == 2) profile.meanMinutes = parts[1].toDouble(&valid);
+    valid = valid && profile.perDay >= 0 && profile.meanMinutes > 0;
+    if (!valid) {
+        profile = FaultProfile();
+    }
+    if (ok) *ok = valid;
+    return profile;
+}
+
+FaultInjector::FaultInjector()
+    : manual(0)
+    , random(0)
+    , onsets{}
+{
+}
+
+void FaultInjector::setFault(int fault, bool active) {
+    int bit = 1 << fault;
+    if (active) {
+        manual.fetchAndOrOrdered(bit);
+    } else {
+        manual.fetchAndAndOrdered(~bit);
+    }
+}
+
+bool FaultInjector::isFaultSet(int fault) const {
+    return manual.loadAcquire() & (1 << fault);
+}
+
+int FaultInjector::activeFaults() const {
+    return manual.loadAcquire() | random;
+}
+
+void FaultInjector::setProfile(int fault, const FaultProfile &profile) {
+    profiles[fault] = profile;
+    if (!profile.isEnabled()) {
+        random &= ~(1 << fault);
+    }
+}
+
+FaultProfile FaultInjector::getProfile(int fault) const {
+    return profiles[fault];
+}
+
+qint64 FaultInjector::firstTransition(int fault, SimRandom &random) const {
+    const FaultProfile &profile = profiles[fault];
+    if (!profile.isEnabled()) {
+        return -1;
+    }
+    return exponential(24 * 3600 * 1000.0 / profile.perDay, random);
+}
+
+qint64 FaultInjector::transition(int fault, SimRandom &random) {
+    const FaultProfile &profile = profiles[fault];
+    int bit = 1 << fault;
+    if (!profile.isEnabled()) {
+        this->random &= ~bit;
+        return -1;
+    }
+    if (this->random & bit) {
+        this->random &= ~bit; // Recovered; wait for the next onset
+        return exponential(24 * 3600 * 1000.0 / profile.perDay, random);
+    }
+    this->random |= bit;
+    onsets[fault]++;
+    return exponential(profile.meanMinutes * 60 * 1000, random);
+}
+
+int FaultInjector::getOnsets(int fault) const {
+    return onsets[fault];
+}
+
+int FaultInjector::faultNamed(const QString &name) {
+    const QStringList names = {"sensor", "occlusion", "battery"}; // SimulationEngine::FaultType order
+    return names.indexOf(name);
+}
+
+void FaultInjector::clear() {
+    manual.storeRelease(0);
+    random = 0;
+    for (int i = 0; i < faultCount; i++) {
+        profiles[i] = FaultProfile();
+        onsets[i] = 0;
+    }
+}
+
+qint64 FaultInjector::exponential(double meanMSecs, SimRandom &random) {
+    double u = random.nextDouble(); // [0, 1), so 1 - u is never 0
+    return qMax(qint64(1), qint64(-std::log(1 - u) * meanMSecs));
+}
+
+void FaultInjector::saveState(QDataStream &out) const {
+    out << qint32(manual.loadAcquire()) << qint32(random);
+    for (int i = 0; i < faultCount; i++) {
+        out << profiles[i].perDay << profiles[i].meanMinutes << qint32(onsets[i]);
+    }
+}
+
+void FaultInjector::restoreState(QDataStream &in) {
+    qint32 savedManual = 0, savedRandom = 0;
+    in >> savedManual >> savedRandom;
+    manual.storeRelease(savedManual);
+    random = savedRandom;
+    for (int i = 0; i < faultCount; i++) {
+        qint32 count = 0;
+        in >> profiles[i].perDay >> profiles[i].meanMinutes >> count;
+        onsets[i] = count;
+    }
+}
@@ -0,0 +1,149 @@
+/**
+ * @file faultinjector.h
+ * @brief Defines the FaultInjector class, the fault state of the simulated hardware.
+ *
+ * Faults come from two sources. Manual faults are flags any client can set or clear, the
+ * GUI checkboxes as much as a scenario or a stress test; they are kept in one atomic
+ * word, so a client on another thread never touches the simulation state. Random faults
+ * follow a FaultProfile: onsets arrive as a Poisson process and each lasts an
+ * exponentially distributed time. The SimulationEngine turns every random onset and
+ * recovery into an event, so fault-heavy runs cost nothing between transitions.
+ *
+ * A fault is active while either source sets it. Faults are identified by
+ * SimulationEngine::FaultType.
+ */
+#ifndef FAULTINJECTOR_H
+#define FAULTINJECTOR_H
+
+#include <QAtomicInt>
+#include <QString>
+#include "simrandom.h"
+
+class QDataStream;
+
+/**
+ * @brief How often a fault strikes at random and how long it lasts. The defaults never strike.
+ */
+struct FaultProfile {
+    double perDay = 0;       ///< Mean onsets per simulated day.
+    double meanMinutes = 30; ///< Mean duration of a fault (minutes).
+
+    /**
+     * @brief Returns true if the fault can strike.
+     */
+    bool isEnabled() const;
+
+    /**
+     * @brief Parses "perDay[:minutes]", e.g. "2:45" for two 45-minute faults a day on average.
+     * @param text Profile description.
+     * @param ok Optional; set to false if @p text is not valid.
+     * @return The profile, disabled if @p text is not valid.
+     */
+    static FaultProfile fromString(const QString &text, bool *ok = nullptr);
+};
+
+/**
+ * @class FaultInjector
+ * @brief Manual fault flags and random fault profiles of one simulated device.
+ */
+class FaultInjector
+{
+public:
+    static constexpr int faultCount = 3; ///< Number of fault kinds (SimulationEngine::FaultType).
+
+    FaultInjector();
+
+    /**
+     * @brief Sets or clears a manual fault. Safe to call from any thread.
+     *
+     * The engine picks the change up before its next event.
+     *
+     * @param fault Fault kind, see SimulationEngine::FaultType.
+     * @param active True to set the fault, false to clear it.
+     */
+    void setFault(int fault, bool active);
+
+    /**
+     * @brief Returns true if a manual fault is set. Safe to call from any thread.
+     * @param fault Fault kind.
+     */
+    bool isFaultSet(int fault) const;
+
+    /**
+     * @brief Returns the faults currently active from either source, one bit per fault kind.
+     */
+    int activeFaults() const;
+
+    /**
+     * @brief Sets a fault's random profile. Only call from the thread running the engine.
+     *
+     * Disabling a profile ends a random fault in progress.
+     *
+     * @param fault Fault kind.
+     * @param profile Random profile.
+     */
+    void setProfile(int fault, const FaultProfile &profile);
+    FaultProfile getProfile(int fault) const;
+
+    /**
+     * @brief Returns the time until the first random onset of a fault.
+     * @param fault Fault kind.
+     * @param random Stream of the fault draws.
+     * @return Delay (ms), or -1 if the profile is disabled.
+     */
+    qint64 firstTransition(int fault, SimRandom &random) const;
+
+    /**
+     * @brief Starts or ends a random fault and returns the time until its next transition.
+     * @param fault Fault kind.
+     * @param random Stream of the fault draws.
+     * @return Delay (ms) until the fault ends or next starts, or -1 if the profile is disabled.
+     */
+    qint64 transition(int fault, SimRandom &random);
+
+    /**
+     * @brief Returns the number of random onsets of a fault so far.
+     * @param fault Fault kind.
+     */
+    int getOnsets(int fault) const;
+
+    /**
+     * @brief Looks up a fault kind by name: "sensor", "occlusion" or "battery".
+     * @param name Fault name.
+     * @return The fault kind, or -1 for an unknown name.
+     */
+    static int faultNamed(const QString &name);
+
+    /**
+     * @brief Clears every fault and disables every profile.
+     */
+    void clear();
+
+    /**
+     * @brief Writes the fault flags, profiles and onset counts to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the state written by saveState().
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
+private:
+    /**
+     * @brief Draws an exponentially distributed delay.
+     * @param meanMSecs Mean delay (ms).
+     * @param random Stream of the draw.
+     * @return Delay (ms), at least 1.
+     */
+    static qint64 exponential(double meanMSecs, SimRandom &random);
+
+    QAtomicInt manual;                ///< Manual faults, one bit per kind.
+    int random;                       ///< Random faults in progress, one bit per kind.
+    FaultProfile profiles[faultCount];
+    int onsets[faultCount];           ///< Random onsets so far.
+};
+
+#endif // FAULTINJECTOR_H
@@ -0,0 +1,128 @@
+/**
+ * @file fixedpoint.h
+ * @brief Defines the Fixed class template and DoseValue, the scalar type of the dosing path.
+ *
+ * A Fixed<Scale> stores a value as an integer count of 1/Scale steps. Addition,
+ * subtraction and comparisons are exact integer operations; multiplication and division
+ * round to the nearest step (halves away from zero) with integer arithmetic only, so a
+ * sequence of operations gives the same bits on every platform, with or without an FPU.
+ *
+ * DoseValue is the type PumpController, InsulinReserve and BolusCalculator do their
+ * dosing arithmetic in. It is double by default. Builds with FIXED_POINT_DOSING defined
+ * (qmake CONFIG+=fixed_dosing, see simcore.pri) make it Fixed<1000000>: insulin in
+ * integer micro-units and glucose on the dosing path in micro-mmol/L. The formulas in
+ * glucosemodel.h are templates and run unchanged on either type; the interfaces of the
+ * classes stay double and convert at their edges. The pump keeps its rates as DoseValue
+ * and takes each step in integer milliseconds, so with Fixed a delivery tick computes
+ * the units it delivers (unitsOver()) without floating point.
+ */
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <QtGlobal>
+#include <cmath>
+
+/**
+ * @class Fixed
+ * @brief Fixed-point number with Scale steps per unit, stored in 64 bits.
+ *
+ * Intermediate results must fit in 63 bits. A multiplication forms the product of the
+ * raw values, so with Scale 10^6 the product of the operands must stay below about
+ * 9.2 * 10^6 in magnitude (e.g. both below 3000); a division forms dividend * Scale, so
+ * the dividend must stay below 9.2 * 10^6. Doses, rates and glucose levels are far below
+ * either bound, but carbs and ratios should not be multiplied in this type without care.
+ */
+template<qint64 Scale>
+class Fixed
+{
+public:
+    Fixed() : raw(0) {}
+
+    /**
+     * @brief Converts a double, rounding to the nearest step.
+     * @param value Value.
+     */
+    explicit Fixed(double value) : raw(std::llround(value * Scale)) {}
+    explicit Fixed(int value) : raw(qint64(value) * Scale) {}
+
+    /**
+     * @brief Returns the number with a given count of steps.
+     * @param steps Steps of 1/Scale.
+     */
+    static Fixed fromRaw(qint64 steps) {
+        Fixed fixed;
+        fixed.raw = steps;
+        return fixed;
+    }
+
+    qint64 steps() const { return raw; }
+
+    /**
+     * @brief Multiplies by a ratio of integers, rounding once to the nearest step.
+     * @param numerator Numerator.
+     * @param denominator Denominator.
+     */
+    Fixed scaled(qint64 numerator, qint64 denominator) const { return fromRaw(divideRounded(raw * numerator, denominator)); }
+    explicit operator double() const { return double(raw) / Scale; }
+
+    Fixed &operator+=(const Fixed &other) { raw += other.raw; return *this; }
+    Fixed &operator-=(const Fixed &other) { raw -= other.raw; return *this; }
+    Fixed &operator*=(const Fixed &other) { raw = divideRounded(raw * other.raw, Scale); return *this; }
+    Fixed &operator/=(const Fixed &other) { raw = divideRounded(raw * Scale, other.raw); return *this; }
+
+    friend Fixed operator+(Fixed a, const Fixed &b) { return a += b; }
+    friend Fixed operator-(Fixed a, const Fixed &b) { return a -= b; }
+    friend Fixed operator*(Fixed a, const Fixed &b) { return a *= b; }
+    friend Fixed operator/(Fixed a, const Fixed &b) { return a /= b; }
+    friend Fixed operator*(double a, const Fixed &b) { return Fixed(a) * b; }
+    friend Fixed operator-(const Fixed &a) { return fromRaw(-a.raw); }
+
+    friend bool operator<(const Fixed &a, const Fixed &b) { return a.raw < b.raw; }
+    friend bool operator>(const Fixed &a, const Fixed &b) { return a.raw > b.raw; }
+    friend bool operator<=(const Fixed &a, const Fixed &b) { return a.raw <= b.raw; }
+    friend bool operator>=(const Fixed &a, const Fixed &b) { return a.raw >= b.raw; }
+    friend bool operator==(const Fixed &a, const Fixed &b) { return a.raw == b.raw; }
+    friend bool operator!=(const Fixed &a, const Fixed &b) { return a.raw != b.raw; }
+
+private:
+    /**
+     * @brief Integer division rounding halves away from zero.
+     */
+    static qint64 divideRounded(qint64 numerator, qint64 denominator) {
+        if (denominator < 0) {
+            numerator = -numerator;
+            denominator = -denominator;
+        }
+        return numerator >= 0 ? (numerator + denominator / 2) / denominator
+                              : -((-numerator + denominator / 2) / denominator);
+    }
+
+    qint64 raw; ///< Value in steps of 1/Scale.
+};
+
+/**
+ * @brief Units delivered at a constant rate over an interval.
+ * @param unitsPerHour Delivery rate.
+ * @param msecs Interval in milliseconds.
+ */
+inline double unitsOver(double unitsPerHour, qint64 msecs) {
+    return unitsPerHour * (msecs / 3600000.0);
+}
+
+/**
+ * @brief Units delivered at a constant rate over an interval, in integer arithmetic only.
+ * @param unitsPerHour Delivery rate.
+ * @param msecs Interval in milliseconds.
+ */
+template<qint64 Scale>
+inline Fixed<Scale> unitsOver(const Fixed<Scale> &unitsPerHour, qint64 msecs) {
+    return unitsPerHour.scaled(msecs, 3600000);
+}
+
+#ifdef FIXED_POINT_DOSING
+typedef Fixed<1000000> DoseValue; ///< Insulin in micro-units, glucose in micro-mmol/L.
+#else
+typedef double DoseValue;
+#endif
+
+#endif // FIXEDPOINT_H
@@ -0,0 +1,138 @@
+#include "glucoseforecaster.h"
+#include <QDataStream>
+#include <algorithm>
+
+namespace {
+constexpr double rebaseMinutes = 24 * 60; ///< Distance from the origin after which the sums are recomputed.
+
+double minutesBetween(qint64 from, qint64 to) {
+    return (to - from) / 60000.0;
+}
+}
+
+GlucoseForecaster::GlucoseForecaster(int capacity)
+    : times(std::max(capacity, minReadings))
+    , values(std::max(capacity, minReadings))
+    , head(0)
+    , count(0)
+    , originMSecs(0)
+    , sumT(0)
+    , sumG(0)
+    , sumTT(0)
+    , sumTG(0)
+{
+}
+
+void GlucoseForecaster::addReading(qint64 msecs, double glucose){
+    if (count > 0) {
+        qint64 latest = times[(head + count - 1) % times.size()];
+        if (minutesBetween(latest, msecs) > maxGapMinutes) {
+            clear();
+        }
+    }
+    if (count == 0) {
+        originMSecs = msecs;
+    }
+
+    if (count == times.size()) {
+        // Full: the new reading overwrites the oldest one
+        double t = minutesBetween(originMSecs, times[head]);
+        double g = values[head];
+        sumT -= t;
+        sumG -= g;
+        sumTT -= t * t;
+        sumTG -= t * g;
+        head = (head + 1) % times.size();
+        count--;
+    }
+
+    int slot = (head + count) % times.size();
+    times[slot] = msecs;
+    values[slot] = glucose;
+    count++;
+
+    double t = minutesBetween(originMSecs, msecs);
+    sumT += t;
+    sumG += glucose;
+    sumTT += t * t;
+    sumTG += t * glucose;
+
+    if (t > rebaseMinutes) {
+        rebase();
+    }
+}
+
+void GlucoseForecaster::clear(){
+    head = 0;
+    count = 0;
+    sumT = sumG = sumTT = sumTG = 0;
+}
+
+int GlucoseForecaster::readings() const{
+    return count;
+}
+
+int GlucoseForecaster::capacity() const{
+    return times.size();
+}
+
+Forecast GlucoseForecaster::forecast(const ForecastEffects &effects) const{
+    Forecast forecast;
+    if (count < minReadings) {
+        return forecast;
+    }
+    double denominator = count * sumTT - sumT * sumT;
+    if (denominator <= 0) {
+        return forecast; // Readings all at the same time
+    }
+    double slope = (count * sumTG - sumT * sumG) / denominator;
+    double intercept = (sumG - slope * sumT) / count;
+    double latest = minutesBetween(originMSecs, times[(head + count - 1) % times.size()]);
+
+    // The trend minus what insulin and carbs do now is the drift they will not explain later
+    double drift = slope - effects.rate;
+    forecast.valid = true;
+    forecast.level = intercept + slope * latest;
+    forecast.trend = slope;
+    forecast.in30 = std::max(0.0, forecast.level + drift * 30 + effects.in30);
+    forecast.in60 = std::max(0.0, forecast.level + drift * 60 + effects.in60);
+    return forecast;
+}
+
+void GlucoseForecaster::rebase(){
+    originMSecs = times[head];
+    sumT = sumG = sumTT = sumTG = 0;
+    for (int i = 0; i < count; i++) {
+        int slot = (head + i) % times.size();
+        double t = minutesBetween(originMSecs, times[slot]);
+        sumT += t;
+        sumG += values[slot];
+        sumTT += t * t;
+        sumTG += t * values[slot];
+    }
+}
+
+void GlucoseForecaster::saveState(QDataStream &out) const{
+    out << qint32(times.size()) << qint32(count) << originMSecs;
+    for (int i = 0; i < count; i++) {
+        int slot = (head + i) % times.size();
+        out << times[slot] << values[slot];
+    }
+    out << sumT << sumG << sumTT << sumTG; // Saved as is, so a restored run rounds identically
+}
+
+void GlucoseForecaster::restoreState(QDataStream &in){
+    qint32 size = 0, saved = 0;
+    in >> size >> saved;
+    size = std::max(size, qint32(minReadings));
+    times = QVector<qint64>(size);
+    values = QVector<double>(size);
+    head = 0;
+    count = 0;
+    in >> originMSecs;
+    for (qint32 i = 0; i < saved && i < size && in.status() == QDataStream::Ok; i++) {
+        in >> times[i] >> values[i];
+        count++;
+    }
+    in >> sumT >> sumG >> sumTT >> sumTG;
+}
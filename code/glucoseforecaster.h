@@ -0,0 +1,130 @@
+/**
+ * @file glucoseforecaster.h
+ * @brief Defines the GlucoseForecaster class, which predicts glucose 30 and 60 minutes ahead.
+ *
+ * The forecaster keeps the latest CGM readings in a fixed-size ring buffer together with
+ * the sums of a least-squares line through them. Adding a reading adds its terms to the
+ * sums and, once the buffer is full, subtracts those of the reading it overwrites, so the
+ * trend costs the same whatever the window length and the history is never rescanned.
+ *
+ * The observed trend already contains the insulin and carbs acting at the moment. The
+ * forecast removes their current rate from it to get the underlying drift, then adds
+ * what the insulin on board and carbs on board will do over each horizon:
+ *
+ * @code
+ * predicted(h) = level + (slope - effects.rate) * h + effects.change(h)
+ * @endcode
+ *
+ * The controller, the safety checks and the home screen all read the same Forecast,
+ * computed once per sample.
+ */
+#ifndef GLUCOSEFORECASTER_H
+#define GLUCOSEFORECASTER_H
+
+#include <QVector>
+
+class QDataStream;
+
+/**
+ * @brief What insulin on board and carbs on board do to glucose, supplied with each forecast.
+ */
+struct ForecastEffects {
+    double rate = 0; ///< Current glucose change rate from insulin and carbs (mmol/L per minute).
+    double in30 = 0; ///< Glucose change from insulin and carbs over the next 30 minutes (mmol/L).
+    double in60 = 0; ///< Glucose change from insulin and carbs over the next 60 minutes (mmol/L).
+};
+
+/**
+ * @brief Glucose predictions from the latest readings.
+ */
+struct Forecast {
+    bool valid = false; ///< False until enough recent readings were seen; the other fields are then 0.
+    double level = 0;   ///< Fitted glucose at the latest reading (mmol/L).
+    double trend = 0;   ///< Observed glucose trend (mmol/L per minute).
+    double in30 = 0;    ///< Predicted glucose in 30 minutes (mmol/L).
+    double in60 = 0;    ///< Predicted glucose in 60 minutes (mmol/L).
+};
+
+/**
+ * @class GlucoseForecaster
+ * @brief Incremental linear regression over the last readings, combined with IOB and COB effects.
+ */
+class GlucoseForecaster
+{
+public:
+    static constexpr int defaultCapacity = 6;      ///< Readings in the window (30 minutes of 5-minute samples).
+    static constexpr int minReadings = 3;          ///< Readings needed before a forecast is valid.
+    static constexpr double maxGapMinutes = 15;    ///< A longer gap between readings restarts the window.
+
+    /**
+     * @brief Constructs an empty forecaster.
+     * @param capacity Readings kept in the window (at least minReadings).
+     */
+    explicit GlucoseForecaster(int capacity = defaultCapacity);
+
+    /**
+     * @brief Adds a CGM reading, in O(1).
+     *
+     * Readings must come in time order. A gap longer than maxGapMinutes since the
+     * previous reading drops the old ones, whose trend no longer applies.
+     *
+     * @param msecs Time of the reading (ms since epoch).
+     * @param glucose Reading (mmol/L).
+     */
+    void addReading(qint64 msecs, double glucose);
+
+    /**
+     * @brief Drops every reading, e.g. when the sensor disconnects.
+     */
+    void clear();
+
+    /**
+     * @brief Returns the number of readings in the window.
+     */
+    int readings() const;
+
+    /**
+     * @brief Returns the maximum number of readings in the window.
+     */
+    int capacity() const;
+
+    /**
+     * @brief Predicts glucose from the readings in the window.
+     * @param effects Insulin and carb effects at the latest reading.
+     * @return The forecast, invalid with fewer than minReadings readings.
+     */
+    Forecast forecast(const ForecastEffects &effects) const;
+
+    /**
+     * @brief Writes the window to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the state written by saveState(); the capacity comes from the checkpoint.
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
+private:
+    /**
+     * @brief Recomputes the sums from the window with a new time origin.
+     *
+     * Run when the origin gets far from the readings, so the squared times stay small
+     * and the running sums do not lose precision over a long run.
+     */
+    void rebase();
+
+    QVector<qint64> times;   ///< Ring buffer of reading times (ms since epoch).
+    QVector<double> values;  ///< Ring buffer of readings (mmol/L).
+    int head;                ///< Slot of the oldest reading.
+    int count;               ///< Readings in the window.
+    qint64 originMSecs;      ///< Time origin of the sums.
+    double sumT;             ///< Sum of reading times (minutes after the origin).
+    double sumG;             ///< Sum of readings.
+    double sumTT;            ///< Sum of squared times.
+    double sumTG;            ///< Sum of time-reading products.
+};
+
+#endif // GLUCOSEFORECASTER_H
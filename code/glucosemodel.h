@@ -0,0 +1,188 @@
+/**
+ * @file glucosemodel.h
+ * @brief Defines the glucose/insulin model formulas, templated on their scalar type.
+ *
+ * CGMReader, Bloodstream, PumpController, SensorModel, BolusCalculator and the scalar
+ * kernel of BatchEngine compute with these functions instantiated for double, which
+ * inline to exactly the arithmetic they did before. ProfileSensitivity instantiates the
+ * same functions with Dual numbers (see dual.h) to get the derivatives of a run's outcome
+ * with respect to the profile in the same pass.
+ *
+ * Parameters that are never differentiated (patient physiology, step length, delivery
+ * rates) stay double. minOf()/maxOf() keep std::min/std::max's operand order, so ties
+ * and the double results are unchanged.
+ */
+#ifndef GLUCOSEMODEL_H
+#define GLUCOSEMODEL_H
+
+#include "fixedpoint.h"
+
+namespace GlucoseModel {
+
+constexpr double bolusRate = 10; ///< Delivery rate of boluses given with the bolus calculator (units/hour).
+
+/**
+ * @brief std::min for any scalar type: returns @p a unless @p b is smaller.
+ */
+template<typename T>
+inline T minOf(const T &a, const T &b) {
+    return (b < a) ? b : a;
+}
+
+/**
+ * @brief std::max for any scalar type: returns @p a unless @p b is larger.
+ */
+template<typename T>
+inline T maxOf(const T &a, const T &b) {
+    return (a < b) ? b : a;
+}
+
+/**
+ * @brief Insulin absorbed from the bloodstream over a step (CGMReader::absorption()).
+ * @param insulinUsageRate Patient's insulin absorption (units/hour).
+ * @param iob Insulin on board (units).
+ * @param hours Step length in hours.
+ * @return Units absorbed, at most the insulin on board.
+ */
+template<typename T>
+inline T absorption(double insulinUsageRate, const T &iob, double hours) {
+    return maxOf(T(0.0), minOf(T(insulinUsageRate * hours), iob));
+}
+
+/**
+ * @brief Glucose change over a step in which a known amount of insulin was absorbed.
+ * @param increasePerHour Patient's natural glucose rise (mmol/L per hour).
+ * @param driftVariance Current relative variation of the rise.
+ * @param absorbed Insulin absorbed over the step (units).
+ * @param correctionFactor Profile correction factor (mmol/L per unit absorbed).
+ * @param hours Step length in hours.
+ * @return Change in glucose (mmol/L).
+ */
+template<typename T>
+inline T glucoseChangeAbsorbed(double increasePerHour, double driftVariance, const T &absorbed,
+                               const T &correctionFactor, double hours) {
+    double drift = increasePerHour * hours * (1 + driftVariance);
+    return drift - absorbed * correctionFactor;
+}
+
+/**
+ * @brief Glucose change over a step (CGMReader::glucoseChange()).
+ * @param increasePerHour Patient's natural glucose rise (mmol/L per hour).
+ * @param driftVariance Current relative variation of the rise.
+ * @param insulinUsageRate Patient's insulin absorption (units/hour).
+ * @param iob Insulin on board at the start of the step (units).
+ * @param correctionFactor Profile correction factor (mmol/L per unit absorbed).
+ * @param hours Step length in hours.
+ * @return Change in glucose (mmol/L).
+ */
+template<typename T>
+inline T glucoseChange(double increasePerHour, double driftVariance, double insulinUsageRate,
+                       const T &iob, const T &correctionFactor, double hours) {
+    return glucoseChangeAbsorbed(increasePerHour, driftVariance, absorption(insulinUsageRate, iob, hours),
+                                 correctionFactor, hours);
+}
+
+/**
+ * @brief Insulin on board after absorbing some of it (Bloodstream::absorbUnits()).
+ * @param iob Insulin on board (units).
+ * @param absorbed Units absorbed.
+ * @return Remaining insulin on board, never negative.
+ */
+template<typename T>
+inline T afterAbsorption(const T &iob, const T &absorbed) {
+    return maxOf(T(0.0), iob - absorbed);
+}
+
+/**
+ * @brief Bolus insulin delivered over a step (PumpController::pump()).
+ * @param remaining Bolus left to deliver (units).
+ * @param rate Bolus delivery rate (units/hour).
+ * @param hours Step length in hours.
+ * @return Units delivered, at most the bolus left.
+ */
+template<typename T>
+inline T bolusDelivered(const T &remaining, double rate, double hours) {
+    T unitsPerTick = T(rate * hours);
+    return (remaining < unitsPerTick) ? remaining : unitsPerTick;
+}
+
+/**
+ * @brief Bolus insulin delivered over a step given in milliseconds, with the rate in the
+ * dose type, so a Fixed dose is delivered in integer arithmetic only (PumpController::pump()).
+ * @param remaining Bolus left to deliver (units).
+ * @param rate Bolus delivery rate (units/hour).
+ * @param msecs Step length in milliseconds.
+ * @return Units delivered, at most the bolus left; for double, the same as with hours = msecs / 3600000.0.
+ */
+template<typename T>
+inline T bolusDelivered(const T &remaining, const T &rate, qint64 msecs) {
+    T unitsPerTick = unitsOver(rate, msecs);
+    return (remaining < unitsPerTick) ? remaining : unitsPerTick;
+}
+
+/**
+ * @brief Insulin left in the reservoir after a delivery (InsulinReserve::useInsulin()).
+ * @param remaining Insulin in the reservoir (units).
+ * @param amount Units delivered.
+ * @return Units left; 0 if the delivery took more than there was.
+ */
+template<typename T>
+inline T afterUse(const T &remaining, const T &amount) {
+    return (amount <= remaining) ? remaining - amount : T(0);
+}
+
+/**
+ * @brief Interstitial glucose after one sensor sample (SensorModel::sample()).
+ * @param lagWeight Weight of the blood glucose (SensorCoefficients::lagWeight).
+ * @param lagCarry Weight of the previous interstitial glucose (SensorCoefficients::lagCarry).
+ * @param glucose Blood glucose (mmol/L).
+ * @param interstitial Interstitial glucose at the previous sample (mmol/L).
+ * @return Interstitial glucose (mmol/L).
+ */
+template<typename T>
+inline T lagged(double lagWeight, double lagCarry, const T &glucose, const T &interstitial) {
+    return lagWeight * glucose + lagCarry * interstitial;
+}
+
+/**
+ * @brief Sensor reading of an interstitial glucose (SensorModel::sample()).
+ * @param interstitial Interstitial glucose (mmol/L).
+ * @param gain Calibration gain.
+ * @param noise Sensor noise (mmol/L).
+ * @return Reading (mmol/L).
+ */
+template<typename T>
+inline T sensorReading(const T &interstitial, double gain, double noise) {
+    return interstitial * gain + noise;
+}
+
+/**
+ * @brief Correction bolus (BolusCalculator::calculateCorrectionBolus()).
+ * @param glucose Current glucose.
+ * @param target Target glucose.
+ * @param correctionFactor Correction factor.
+ * @return Units to bring glucose down to target; 0 at or below target.
+ */
+template<typename T>
+inline T correctionBolus(const T &glucose, const T &target, const T &correctionFactor) {
+    if (correctionFactor <= T(0)) return T(0);
+    T diff = glucose - target;
+    return (diff > T(0)) ? (diff / correctionFactor) : T(0);
+}
+
+/**
+ * @brief Carb bolus (BolusCalculator::calculateCarbBolus()).
+ * @param carbs Carbohydrates (grams).
+ * @param carbRatio Carb ratio.
+ * @param correctionFactor Correction factor.
+ * @return Units covering the carbohydrates.
+ */
+template<typename T>
+inline T carbBolus(double carbs, const T &carbRatio, const T &correctionFactor) {
+    if (carbRatio <= T(0)) return T(0);
+    return (carbs * carbRatio) / correctionFactor;
+}
+
+}
+
+#endif // GLUCOSEMODEL_H
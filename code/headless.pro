@@ -0,0 +1,27 @@
+# Builds the headless simulation core library, the CLI runners and the unit tests.
+# Use a shadow build directory so it does not clash with insulinPump.pro:
+#   mkdir build-headless && cd build-headless && qmake ../headless.pro && make
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    simcore \
+    simrunner \
+    population \
+    replay \
+    optimizer \
+    compare \
+    bench \
+    tests
+
+simrunner.depends = simcore
+population.depends = simcore
+replay.depends = simcore
+optimizer.depends = simcore
+compare.depends = simcore
+bench.depends = simcore
+tests.depends = simcore # "make check" runs the unit tests
+
+# "make benchmark" builds the suite and writes its results to bench.json in the build directory
+benchmark.depends = sub-bench
+benchmark.commands = $$OUT_PWD/bench/bench --output $$OUT_PWD/bench.json
+QMAKE_EXTRA_TARGETS += benchmark
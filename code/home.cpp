@@ -2,6 +2,7 @@
 #include "ui_home.h"
 #include <QTime>
 #include <QDate>
+#include <QDateTime>
 
 Home::Home(QWidget *parent)
     : QWidget(parent)
@@ -73,6 +74,31 @@ void Home::addGlucoseReading(double value)
     axisX->setRange(timeInHours - selectedGraphHours, timeInHours);
 }
 
+void Home::addGlucoseReadings(const QVector<double> &values)
+{
+    QList<QPointF> points;
+    points.reserve(values.size());
+    for (double value : values) {
+        if (value != -1) {
+            points.append(QPointF(double(currentTime)/12, value));
+        }
+        currentTime++;
+    }
+    series->append(points);
+
+    // Only the last maxGraphHours can be shown, so keep the series from growing without bound
+    double timeInHours = double(currentTime - 1)/12;
+    int stale = 0;
+    while (stale < series->count() && series->at(stale).x() < timeInHours - maxGraphHours) {
+        stale++;
+    }
+    if (stale > 0) {
+        series->removePoints(0, stale);
+    }
+
+    axisX->setRange(timeInHours - selectedGraphHours, timeInHours);
+}
+
 void Home::updateStatus(double glucose, double battery, double insulin)
 {
     int batteryPercent = static_cast<int>(battery * 100);
@@ -106,9 +132,15 @@ void Home::updateStatus(double glucose, double battery, double insulin)
     updateInsulinDisplay(insulin);
 }
 
+void Home::setClock(SimClock *clock) {
+    simClock = clock;
+    updateDateTime();
+}
+
 void Home::updateDateTime() {
-   QString timeStr = QTime::currentTime().toString("hh:mm AP");
-   QString dateStr = QDate::currentDate().toString("dd MMM");
+   QDateTime now = simClock ? simClock->now() : QDateTime::currentDateTime();
+   QString timeStr = now.time().toString("hh:mm AP");
+   QString dateStr = now.date().toString("dd MMM");
    ui->timeLabel->setText(timeStr);
    ui->dateLabel->setText(dateStr);
 }
@@ -133,6 +165,17 @@ void Home::updateIOB(double iob) {
     ui-> iobLabel->setText(QString::number(iob, 'f', 1)+ "u");
 }
 
+void Home::updateForecast(double glucose, double predicted) {
+    if (glucose == -1 || predicted == -1) {
+        ui->forecastLabel->setText("");
+        return;
+    }
+    QString arrow = (predicted > glucose + 1) ? "\u2191" : (predicted < glucose - 1) ? "\u2193" : "\u2192";
+    QString color = (predicted < 3.9) ? "#FF4444" : "#CCCCCC";
+    ui->forecastLabel->setText(arrow + " " + QString::number(predicted, 'f', 1) + " in 30 min");
+    ui->forecastLabel->setStyleSheet("QLabel { color: " + color + "; font-size: 12px; }");
+}
+
 void Home::updateInsulinDisplay(double insulinRemaining){
     ui-> insulinUnitsLabel-> setText(QString::number(insulinRemaining, 'f', 1) + " u");
     int percentage= static_cast<int>((insulinRemaining/300.0) * 100);
@@ -14,6 +14,8 @@
 #include <QtCharts/QLineSeries>
 #include <QtCharts/QValueAxis>
 #include <QTimer>
+#include <QVector>
+#include "simclock.h"
 
 QT_CHARTS_USE_NAMESPACE
 
@@ -39,6 +41,12 @@ public:
      */
     ~Home();
 
+    /**
+     * @brief Sets the clock whose time and date are displayed.
+     * @param clock Simulation clock, or nullptr to show the wall-clock time.
+     */
+    void setClock(SimClock *clock);
+
     /**
      * @brief Initializes and configures the glucose chart.
      */
@@ -50,6 +58,12 @@ public:
      */
     void addGlucoseReading(double value);
 
+    /**
+     * @brief Adds several consecutive glucose readings to the chart in one update.
+     * @param values Glucose values in mmol/L, oldest first (-1 for missing readings).
+     */
+    void addGlucoseReadings(const QVector<double> &values);
+
     /**
      * @brief Updates the displayed device status (battery, glucose, insulin).
      */
@@ -60,6 +74,13 @@ public:
      */
     void updateIOB(double iob);
 
+    /**
+     * @brief Updates the glucose prediction shown under the reading.
+     * @param glucose Current glucose reading (-1 if disconnected).
+     * @param predicted Glucose predicted in 30 minutes, or -1 without a forecast.
+     */
+    void updateForecast(double glucose, double predicted);
+
     /**
      * @brief Updates the insulin progress bar and label.
      * @param insulinRemaining Insulin remaining in the reservoir.
@@ -91,8 +112,10 @@ private:
     QTimer *chartTimer;
     int currentTime;
     QTimer *clockTimer;
+    SimClock *simClock = nullptr; ///< Source of the displayed time (wall clock if nullptr).
     QValueAxis *axisX;
     int selectedGraphHours = 1;
+    static constexpr int maxGraphHours = 6; ///< Longest selectable range; older points are dropped.
 
 private slots:
     /**
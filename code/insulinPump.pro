@@ -3,7 +3,9 @@ QT       += core gui
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 QT += charts
 
-CONFIG += c++11
+CONFIG += c++17
+
+include(simcore.pri)
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
@@ -11,38 +13,22 @@ CONFIG += c++11
 
 SOURCES += \
     alert.cpp \
-    batterymanager.cpp \
-    bloodstream.cpp \
     boluscalculator.cpp \
-    cgmreader.cpp \
-    controliqalgorithm.cpp \
-    datalogger.cpp \
     device.cpp \
     history.cpp \
     home.cpp \
-    insulinreserve.cpp \
     login.cpp \
     main.cpp \
-    profile.cpp \
-    pumpcontroller.cpp \
     settings.cpp \
     userinterface.cpp
 
 HEADERS += \
     alert.h \
-    batterymanager.h \
-    bloodstream.h \
     boluscalculator.h \
-    cgmreader.h \
-    controliqalgorithm.h \
-    datalogger.h \
     device.h \
     history.h \
     home.h \
-    insulinreserve.h \
     login.h \
-    profile.h \
-    pumpcontroller.h \
     settings.h \
     userinterface.h
 
@@ -1,31 +1,50 @@
 #include "insulinreserve.h"
+#include <QDataStream>
 
 InsulinReserve::InsulinReserve()
-	: insulinRemaining {maxAmount}
+	: insulinRemaining {DoseValue(maxAmount)}
 { }
 
 InsulinReserve::~InsulinReserve()
 { }
 
 double InsulinReserve::getInsulinRemaining() {
-	return insulinRemaining;
+	return static_cast<double>(insulinRemaining);
 }
 
 double InsulinReserve::useInsulin(double amount) {
+	return static_cast<double>(useDose(DoseValue(amount)));
+}
+
+DoseValue InsulinReserve::getDoseRemaining() const {
+	return insulinRemaining;
+}
+
+DoseValue InsulinReserve::useDose(const DoseValue &amount) {
 	if (amount <= insulinRemaining){
 		insulinRemaining -= amount;
         return amount;
 	} else {
-		double insulinDeployed = insulinRemaining;
-		insulinRemaining = 0;
+		DoseValue insulinDeployed = insulinRemaining;
+		insulinRemaining = DoseValue(0);
 		return insulinDeployed;
 	}
 }
 
 bool InsulinReserve::isInsulinLow() {
-	return insulinRemaining <= lowAmount;
+	return insulinRemaining <= DoseValue(lowAmount);
 }
 
 void InsulinReserve::refillInsulin() {
-	insulinRemaining = maxAmount;
+	insulinRemaining = DoseValue(maxAmount);
+}
+
+void InsulinReserve::saveState(QDataStream &out) const {
+	out << static_cast<double>(insulinRemaining);
+}
+
+void InsulinReserve::restoreState(QDataStream &in) {
+	double remaining;
+	in >> remaining;
+	insulinRemaining = DoseValue(remaining);
 }
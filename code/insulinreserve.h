@@ -9,6 +9,9 @@
 #ifndef INSULINRESERVE_H
 #include <QObject>
 #define INSULINRESERVE_H
+#include "fixedpoint.h"
+
+class QDataStream;
 
 /**
  * @class InsulinReserve
@@ -21,6 +24,9 @@ class InsulinReserve : public QObject
 {
     Q_OBJECT;
 public:
+    static constexpr double maxAmount = 300; ///< Maximum reservoir capacity (units).
+    static constexpr double lowAmount = maxAmount/10; ///< Low-level warning threshold.
+
     /**
      * @brief Constructs an InsulinReserve with full capacity.
      */
@@ -43,21 +49,45 @@ public:
      * @return Actual units deployed (may be less if reservoir is insufficient).
      */
     double useInsulin(double amount);
+
+    /**
+     * @brief Retrieves the insulin remaining in the dosing type.
+     * @return Remaining insulin units.
+     */
+    DoseValue getDoseRemaining() const;
+
+    /**
+     * @brief Consumes insulin from the reservoir, in the dosing type (PumpController).
+     * @param amount Units of insulin to deploy.
+     * @return Actual units deployed (may be less if reservoir is insufficient).
+     */
+    DoseValue useDose(const DoseValue &amount);
 	
     /**
      * @brief Checks if insulin level is at or below the low threshold.
      * @return true if insulinRemaining <= lowAmount, false otherwise.
      */
     bool isInsulinLow();
+
+    /**
+     * @brief Writes the insulin remaining to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the insulin remaining written by saveState().
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
 public slots:
 	/**
      * @brief Refills the insulin reservoir to maximum capacity.
      */
     void refillInsulin();
 private:
-	double insulinRemaining; // Measured in "units"
-    static constexpr double maxAmount = 300; ///< Maximum reservoir capacity (units).
-    static constexpr double lowAmount = maxAmount/10; ///< Low-level warning threshold.
+	DoseValue insulinRemaining; // Measured in "units"
 };
 
 #endif // INSULINRESERVE_H
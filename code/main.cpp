@@ -1,12 +1,22 @@
 #include <QApplication>
+#include <QCommandLineParser>
 #include "device.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Insulin pump simulator.");
+    parser.addHelpOption();
+    parser.addOption({"scenario", "Scenario file of timed meals, boluses, faults and profile changes to run.", "file"});
+    parser.process(a);
+
     Device *device = new Device();
     device->show();
+    if (parser.isSet("scenario")) {
+        device->loadScenario(parser.value("scenario"));
+    }
 
     return a.exec();
 
@@ -0,0 +1,223 @@
+#include "mpccontroller.h"
+#include "profile.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+
+bool MPCSettings::operator==(const MPCSettings &other) const {
+    return horizon == other.horizon && moves == other.moves && moveWeight == other.moveWeight
+        && insulinMinutes == other.insulinMinutes && maxBasalFactor == other.maxBasalFactor
+        && driftSmoothing == other.driftSmoothing;
+}
+
+MPCController::MPCController()
+    : valid(false)
+    , modelBasal(0)
+    , modelCorrection(0)
+    , decay(0)
+    , steadyIOB(0)
+    , endRow{}
+    , havePrevious(false)
+    , previousDeviation(0)
+    , previousInsulin(0)
+    , drift(0)
+    , predicted(0)
+{
+}
+
+void MPCController::setSettings(const MPCSettings &settings){
+    MPCSettings checked = settings;
+    checked.horizon = std::max(1, checked.horizon);
+    checked.moves = std::min(std::max(1, checked.moves), std::min(checked.horizon, maxMoves));
+    if (checked != this->settings) {
+        this->settings = checked;
+        valid = false;
+    }
+}
+
+MPCSettings MPCController::getSettings() const{
+    return settings;
+}
+
+void MPCController::rebuild(double basalRate, double correctionFactor){
+    const int horizon = settings.horizon;
+    const int moves = settings.moves;
+    decay = std::exp(-sampleHours * 60 / settings.insulinMinutes);
+    steadyIOB = basalRate * sampleHours / (1 - decay);
+
+    // Model x' = A x + B u with output y = e. rows[i] = C A^i, so y after i steps is rows[i] x.
+    const double A[stateSize][stateSize] = {
+        {1, -correctionFactor * (1 - decay), 1},
+        {0, decay, 0},
+        {0, 0, 1}
+    };
+    const double B[stateSize] = {0, sampleHours, 0};
+    QVector<double> rows((horizon + 1) * stateSize, 0);
+    rows[0] = 1;
+    for (int i = 1; i <= horizon; i++) {
+        for (int c = 0; c < stateSize; c++) {
+            double sum = 0;
+            for (int r = 0; r < stateSize; r++) {
+                sum += rows[(i - 1) * stateSize + r] * A[r][c];
+            }
+            rows[i * stateSize + c] = sum;
+        }
+    }
+
+    // Prediction matrices: Y = Phi x + Gamma U, a move held from its step to the next move
+    QVector<double> phi(horizon * stateSize), gamma(horizon * moves, 0);
+    for (int i = 1; i <= horizon; i++) {
+        for (int c = 0; c < stateSize; c++) {
+            phi[(i - 1) * stateSize + c] = rows[i * stateSize + c];
+        }
+        for (int k = 0; k < i; k++) {
+            double effect = 0;
+            for (int r = 0; r < stateSize; r++) {
+                effect += rows[(i - 1 - k) * stateSize + r] * B[r];
+            }
+            gamma[(i - 1) * moves + std::min(k, moves - 1)] += effect;
+        }
+    }
+
+    // K = (Gamma' Gamma + w I)^-1 Gamma' Phi, by Gauss-Jordan elimination on [H | R]
+    const int width = moves + stateSize;
+    QVector<double> system(moves * width, 0);
+    for (int r = 0; r < moves; r++) {
+        for (int c = 0; c < moves; c++) {
+            double sum = (r == c) ? settings.moveWeight : 0;
+            for (int i = 0; i < horizon; i++) {
+                sum += gamma[i * moves + r] * gamma[i * moves + c];
+            }
+            system[r * width + c] = sum;
+        }
+        for (int c = 0; c < stateSize; c++) {
+            double sum = 0;
+            for (int i = 0; i < horizon; i++) {
+                sum += gamma[i * moves + r] * phi[i * stateSize + c];
+            }
+            system[r * width + moves + c] = sum;
+        }
+    }
+    for (int p = 0; p < moves; p++) {
+        int pivot = p;
+        for (int r = p + 1; r < moves; r++) {
+            if (std::fabs(system[r * width + p]) > std::fabs(system[pivot * width + p])) pivot = r;
+        }
+        for (int c = 0; c < width; c++) {
+            std::swap(system[p * width + c], system[pivot * width + c]);
+        }
+        double scale = system[p * width + p]; // H is positive definite, so never 0 with a positive weight
+        for (int c = 0; c < width; c++) {
+            system[p * width + c] /= scale;
+        }
+        for (int r = 0; r < moves; r++) {
+            double factor = system[r * width + p];
+            if (r == p || factor == 0) continue;
+            for (int c = 0; c < width; c++) {
+                system[r * width + c] -= factor * system[p * width + c];
+            }
+        }
+    }
+
+    gain.resize(moves * stateSize);
+    for (int r = 0; r < moves; r++) {
+        for (int c = 0; c < stateSize; c++) {
+            gain[r * stateSize + c] = system[r * width + moves + c];
+        }
+    }
+    for (int c = 0; c < stateSize; c++) {
+        endRow[c] = phi[(horizon - 1) * stateSize + c];
+    }
+    endMoves = gamma.mid((horizon - 1) * moves, moves);
+
+    modelBasal = basalRate;
+    modelCorrection = correctionFactor;
+    valid = true;
+}
+
+double MPCController::decide(double glucose, double iob, const Profile &profile){
+    QElapsedTimer timer;
+    timer.start();
+
+    double basalRate = profile.getBasalRate();
+    double correctionFactor = profile.getCorrectionFactor();
+    if (!valid || basalRate != modelBasal || correctionFactor != modelCorrection) {
+        rebuild(basalRate, correctionFactor);
+        timing.rebuilds++;
+        timing.rebuildNs += timer.nsecsElapsed();
+        timer.restart();
+    }
+
+    // State estimate: the drift is what the model failed to predict since the last reading
+    double deviation = glucose - profile.getTargetGlucose();
+    double insulin = iob - steadyIOB;
+    if (havePrevious) {
+        double observed = deviation - previousDeviation + correctionFactor * (1 - decay) * previousInsulin;
+        drift += settings.driftSmoothing * (observed - drift);
+    }
+    const double state[stateSize] = {deviation, insulin, drift};
+
+    double move[maxMoves];
+    const int moves = settings.moves;
+    predicted = profile.getTargetGlucose();
+    for (int c = 0; c < stateSize; c++) {
+        predicted += endRow[c] * state[c];
+    }
+    for (int r = 0; r < moves; r++) {
+        double sum = 0;
+        for (int c = 0; c < stateSize; c++) {
+            sum += gain[r * stateSize + c] * state[c];
+        }
+        move[r] = -sum;
+        predicted += endMoves[r] * move[r];
+    }
+
+    havePrevious = true;
+    previousDeviation = deviation;
+    previousInsulin = insulin;
+
+    double rate = std::min(std::max(0.0, basalRate + move[0]), settings.maxBasalFactor * basalRate);
+
+    qint64 elapsed = timer.nsecsElapsed();
+    timing.decisions++;
+    timing.decisionNs += elapsed;
+    timing.maxDecisionNs = std::max(timing.maxDecisionNs, elapsed);
+    return rate;
+}
+
+double MPCController::getPredictedGlucose() const{
+    return predicted;
+}
+
+MPCTiming MPCController::getTiming() const{
+    return timing;
+}
+
+void MPCController::resetTiming(){
+    timing = MPCTiming();
+}
+
+void MPCController::reset(){
+    havePrevious = false;
+    previousDeviation = 0;
+    previousInsulin = 0;
+    drift = 0;
+}
+
+void MPCController::saveState(QDataStream &out) const{
+    out << qint32(settings.horizon) << qint32(settings.moves) << settings.moveWeight << settings.insulinMinutes
+        << settings.maxBasalFactor << settings.driftSmoothing;
+    out << havePrevious << previousDeviation << previousInsulin << drift << predicted;
+}
+
+void MPCController::restoreState(QDataStream &in){
+    qint32 horizon = 0, moves = 0;
+    MPCSettings saved;
+    in >> horizon >> moves >> saved.moveWeight >> saved.insulinMinutes >> saved.maxBasalFactor >> saved.driftSmoothing;
+    saved.horizon = horizon;
+    saved.moves = moves;
+    setSettings(saved);
+    valid = false; // Rebuilt from the settings and the profile at the next decision
+    in >> havePrevious >> previousDeviation >> previousInsulin >> drift >> predicted;
+}
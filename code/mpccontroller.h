@@ -0,0 +1,146 @@
+/**
+ * @file mpccontroller.h
+ * @brief Defines the MPCController class, a model-predictive basal controller with precomputed gains.
+ *
+ * The controller predicts glucose over a horizon with a small linear model of the patient,
+ * one row per 5-minute sample:
+ *
+ * @code
+ * e[k+1] = e[k] - correctionFactor * (1 - a) * I[k] + d   // glucose above target
+ * I[k+1] = a * I[k] + u[k] * dt                            // insulin on board above basal steady state
+ * d[k+1] = d                                               // drift the model does not explain
+ * @endcode
+ *
+ * where a = exp(-dt / insulin time constant) and u is the basal rate above the profile's.
+ * It picks the basal moves that minimise the squared glucose deviation over the horizon
+ * plus a penalty on the moves. Without constraints that optimum is linear in the state,
+ * so the prediction matrices and the gain K are solved once per profile and kept; a
+ * decision is the state estimate and one product u = -K x, clipped to the pump's range.
+ * The gains are rebuilt only when the profile or the settings change.
+ *
+ * Every decision is timed, and the counts are reported by getTiming().
+ */
+#ifndef MPCCONTROLLER_H
+#define MPCCONTROLLER_H
+
+#include <QVector>
+
+class QDataStream;
+class Profile;
+
+/**
+ * @brief Tuning of the MPC controller.
+ */
+struct MPCSettings {
+    int horizon = 12;            ///< Prediction horizon (5-minute samples).
+    int moves = 3;               ///< Basal moves optimised; the last is held to the end of the horizon.
+    double moveWeight = 4;       ///< Penalty on basal deviation ((mmol/L)^2 per (units/hour)^2).
+    double insulinMinutes = 90;  ///< Time constant of the insulin action in the model (minutes).
+    double maxBasalFactor = 3;   ///< Highest basal rate as a multiple of the profile rate.
+    double driftSmoothing = 0.3; ///< Weight of a new observation in the drift estimate (0-1).
+
+    bool operator==(const MPCSettings &other) const;
+    bool operator!=(const MPCSettings &other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Compute time spent by an MPCController.
+ */
+struct MPCTiming {
+    qint64 decisions = 0;  ///< Decisions taken.
+    qint64 decisionNs = 0; ///< Total wall-clock time of the decisions (ns).
+    qint64 maxDecisionNs = 0; ///< Slowest decision (ns).
+    qint64 rebuilds = 0;   ///< Gain tables built.
+    qint64 rebuildNs = 0;  ///< Total wall-clock time of the rebuilds (ns).
+};
+
+/**
+ * @class MPCController
+ * @brief Picks basal rates by minimising predicted glucose deviation, with gains precomputed per profile.
+ */
+class MPCController
+{
+public:
+    static constexpr double sampleHours = 5.0 / 60; ///< Model step: one CGM sample.
+    static constexpr int maxMoves = 16;             ///< Most basal moves that can be optimised.
+
+    MPCController();
+
+    /**
+     * @brief Changes the tuning; the gains are rebuilt at the next decision.
+     * @param settings New settings (horizon and moves are raised to at least 1, moves capped at the horizon and maxMoves).
+     */
+    void setSettings(const MPCSettings &settings);
+    MPCSettings getSettings() const;
+
+    /**
+     * @brief Picks the basal rate for a glucose reading.
+     * @param glucose Latest glucose reading (mmol/L).
+     * @param iob Insulin on board (units).
+     * @param profile Profile supplying the target, basal rate and correction factor.
+     * @return Basal rate to deliver (units/hour), between 0 and maxBasalFactor times the profile rate.
+     */
+    double decide(double glucose, double iob, const Profile &profile);
+
+    /**
+     * @brief Returns the glucose the last decision predicted at the end of the horizon (mmol/L).
+     */
+    double getPredictedGlucose() const;
+
+    /**
+     * @brief Returns the compute time spent so far. Not part of the saved state.
+     */
+    MPCTiming getTiming() const;
+
+    /**
+     * @brief Clears the compute time counters.
+     */
+    void resetTiming();
+
+    /**
+     * @brief Forgets the previous reading and the drift estimate.
+     */
+    void reset();
+
+    /**
+     * @brief Writes the settings and the state estimate to a checkpoint; the gains are rebuilt on restore.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the state written by saveState().
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
+private:
+    static constexpr int stateSize = 3; ///< Glucose deviation, excess insulin on board, drift.
+
+    /**
+     * @brief Solves the gain table K for the profile's model.
+     * @param basalRate Profile basal rate (units/hour).
+     * @param correctionFactor Profile correction factor (mmol/L per unit).
+     */
+    void rebuild(double basalRate, double correctionFactor);
+
+    MPCSettings settings;
+    bool valid;                 ///< Whether the gains match modelBasal and modelCorrection.
+    double modelBasal;          ///< Profile basal rate the gains were built for.
+    double modelCorrection;     ///< Correction factor the gains were built for.
+    double decay;               ///< Insulin decay per step, a.
+    double steadyIOB;           ///< Insulin on board at the profile basal rate in the model.
+    QVector<double> gain;       ///< K, moves x stateSize, row-major.
+    double endRow[stateSize];   ///< Row of the prediction matrix at the end of the horizon.
+    QVector<double> endMoves;   ///< Effect of each move on the glucose at the end of the horizon.
+
+    bool havePrevious;          ///< Whether previousDeviation and previousInsulin hold the last reading.
+    double previousDeviation;   ///< Glucose above target at the last reading.
+    double previousInsulin;     ///< Excess insulin on board at the last reading.
+    double drift;               ///< Estimated unexplained glucose change per step.
+    double predicted;           ///< Glucose predicted at the end of the horizon by the last decision.
+
+    MPCTiming timing;
+};
+
+#endif // MPCCONTROLLER_H
@@ -0,0 +1,155 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QPair>
+#include <QThread>
+#include <cstdio>
+#include "profileoptimizer.h"
+#include "profilesensitivity.h"
+
+// Profile optimizer.
+// Searches basal rate, carb ratio, correction factor and target glucose over a virtual
+// patient population, on all cores, and prints the candidates that are best on time in
+// range and time below range (the Pareto set). With --import the Pareto set is added to
+// the profile store (./data/profiles.json), where Settings lists it like any other profile.
+// With --gradient it instead tunes the default profile by gradient descent, using
+// derivatives of the run's outcome computed alongside it (forward-mode differentiation).
+
+// Parses "low:high" into a parameter range.
+static bool parseRange(const QString &text, ParameterRange *range)
+{
+    QStringList parts = text.split(':');
+    bool okLow = false, okHigh = false;
+    if (parts.size() == 2) {
+        range->low = parts.first().toDouble(&okLow);
+        range->high = parts.last().toDouble(&okHigh);
+    }
+    return okLow && okHigh && range->low > 0 && range->low <= range->high;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("optimizer");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Searches profile settings over a virtual patient population.");
+    parser.addHelpOption();
+    parser.addOption({"patients", "Virtual patients per candidate (default 50).", "count", "50"});
+    parser.addOption({"days", "Scored days per patient (default 2).", "days", "2"});
+    parser.addOption({"warmup-days", "Shared warm-up days with the default profile (default 1).", "days", "1"});
+    parser.addOption({"threads", "Worker threads (default: one per core).", "count", QString::number(QThread::idealThreadCount())});
+    parser.addOption({"seed", "Population seed (default 1).", "seed", "1"});
+    parser.addOption({"grid", "Values per parameter of the (initial) grid (default 3).", "count", "3"});
+    parser.addOption({"rounds", "Adaptive refinement rounds around the Pareto set (default 0: grid search only).", "count", "0"});
+    parser.addOption({"basal", "Basal rate range (units/hour).", "low:high"});
+    parser.addOption({"carb-ratio", "Carb ratio range.", "low:high"});
+    parser.addOption({"correction", "Correction factor range.", "low:high"});
+    parser.addOption({"target", "Target glucose range (mmol/L).", "low:high"});
+    parser.addOption({"gradient", "Tune the default profile by gradient descent with this many population passes instead.", "count"});
+    parser.addOption({"meal-boluses", "With --gradient, bolus for meals with the bolus calculator formulas."});
+    parser.addOption({"import", "Add the Pareto set (or the tuned profile) to the profile store."});
+    parser.process(app);
+
+    bool okPatients = false, okDays = false, okWarmUp = false, okThreads = false, okSeed = false, okGrid = false, okRounds = false;
+    int patients = parser.value("patients").toInt(&okPatients);
+    int days = parser.value("days").toInt(&okDays);
+    int warmUpDays = parser.value("warmup-days").toInt(&okWarmUp);
+    int threads = parser.value("threads").toInt(&okThreads);
+    quint64 seed = parser.value("seed").toULongLong(&okSeed);
+    int grid = parser.value("grid").toInt(&okGrid);
+    int rounds = parser.value("rounds").toInt(&okRounds);
+    if (!okPatients || !okDays || !okWarmUp || !okThreads || !okSeed || !okGrid || !okRounds
+        || patients <= 0 || days <= 0 || warmUpDays < 0 || threads <= 0 || grid <= 0 || rounds < 0) {
+        fprintf(stderr, "Invalid --patients, --days, --warmup-days, --threads, --seed, --grid or --rounds value\n");
+        return 1;
+    }
+
+    ProfileSearchSpace space = ProfileSearchSpace::around(Profile::defaultProfile());
+    const QPair<QString, ParameterRange *> ranges[] = {
+        {"basal", &space.basalRate}, {"carb-ratio", &space.carbRatio},
+        {"correction", &space.correctionFactor}, {"target", &space.targetGlucose}};
+    for (const auto &range : ranges) {
+        if (parser.isSet(range.first) && !parseRange(parser.value(range.first), range.second)) {
+            fprintf(stderr, "Invalid --%s range: %s\n", qPrintable(range.first), qPrintable(parser.value(range.first)));
+            return 1;
+        }
+    }
+
+    if (parser.isSet("gradient")) {
+        bool okIterations = false;
+        int iterations = parser.value("gradient").toInt(&okIterations);
+        if (!okIterations || iterations <= 0) {
+            fprintf(stderr, "Invalid --gradient value\n");
+            return 1;
+        }
+
+        ProfileSensitivity sensitivity(patients, seed);
+        sensitivity.setDays(days);
+        sensitivity.setThreads(threads);
+        sensitivity.setMealBoluses(parser.isSet("meal-boluses"));
+
+        QElapsedTimer timer;
+        timer.start();
+        QList<QPair<Profile, ProfileSensitivities>> trajectory;
+        Profile tuned = sensitivity.descend(Profile::defaultProfile(), iterations, 0.2, &trajectory);
+        double wall = timer.nsecsElapsed() / 1e9;
+
+        printf("step   basal  carb ratio  correction  target      risk  d/d basal  d/d carb  d/d corr  d/d target\n");
+        for (int i = 0; i < trajectory.size(); i++) {
+            const Profile &profile = trajectory[i].first;
+            const Sensitivity risk = trajectory[i].second.risk();
+            printf("%4d  %6.3f  %10.4f  %10.3f  %6.2f  %8.3f  %9.3f  %8.1f  %8.3f  %10.3f\n", i, profile.getBasalRate(),
+                   profile.getCarbRatio(), profile.getCorrectionFactor(), profile.getTargetGlucose(), risk.value,
+                   risk.basalRate, risk.carbRatio, risk.correctionFactor, risk.targetGlucose);
+        }
+        printf("Population passes: %d in %.3f s on %d thread(s)\n", iterations, wall, threads);
+
+        if (parser.isSet("import")) {
+            Profile::loadProfiles();
+            if (!Profile::createProfile("Tuned", tuned.getBasalRate(), tuned.getCarbRatio(),
+                                        tuned.getCorrectionFactor(), tuned.getTargetGlucose())) {
+                fprintf(stderr, "Could not add the tuned profile to the profile store\n");
+                return 1;
+            }
+            printf("Added the tuned profile to the profile store\n");
+        }
+        return 0;
+    }
+
+    ProfileOptimizer optimizer(patients, seed);
+    optimizer.setSearchSpace(space);
+    optimizer.setDays(days);
+    optimizer.setWarmUp(Profile::defaultProfile(), QDateTime(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC), warmUpDays);
+    optimizer.setThreads(threads);
+
+    QElapsedTimer timer;
+    timer.start();
+    QList<ProfileCandidate> pareto = rounds > 0 ? optimizer.adaptiveSearch(grid, rounds) : optimizer.gridSearch(grid);
+    double wall = timer.nsecsElapsed() / 1e9;
+
+    printf("name          basal  carb ratio  correction  target  in range  below  above  mean glucose\n");
+    for (const ProfileCandidate &candidate : pareto) {
+        const Profile &profile = candidate.profile;
+        printf("%-12s  %5.3f  %10.4f  %10.3f  %6.2f  %7.1f%%  %4.1f%%  %4.1f%%  %12.2f\n", qPrintable(profile.getName()),
+               profile.getBasalRate(), profile.getCarbRatio(), profile.getCorrectionFactor(), profile.getTargetGlucose(),
+               100 * candidate.summary.meanTimeInRange, 100 * candidate.summary.meanTimeBelowRange,
+               100 * candidate.summary.meanTimeAboveRange, candidate.summary.meanGlucose);
+    }
+    printf("Candidates simulated: %d (%d cache hits) in %.3f s on %d thread(s)\n",
+           optimizer.candidatesSimulated(), optimizer.cacheHits(), wall, threads);
+
+    if (parser.isSet("import")) {
+        Profile::loadProfiles();
+        for (const ProfileCandidate &candidate : pareto) {
+            const Profile &profile = candidate.profile;
+            if (!Profile::createProfile(profile.getName(), profile.getBasalRate(), profile.getCarbRatio(),
+                                        profile.getCorrectionFactor(), profile.getTargetGlucose())) {
+                fprintf(stderr, "Could not add %s to the profile store\n", qPrintable(profile.getName()));
+                return 1;
+            }
+        }
+        printf("Added %d profile(s) to the profile store\n", int(pareto.size()));
+    }
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QList>
+#include <QTextStream>
+#include <QThread>
+#include <cstdio>
+#include "populationrunner.h"
+
+// Population runner.
+// Simulates a population of virtual patients with one profile across all cores and
+// prints aggregate outcome metrics. With --scaling it repeats the run with 1, 2, 4, ...
+// threads and reports the speedup over one thread. With --batch, blocks of patients are
+// stepped together by the SIMD batch engine; --scenario replaces the patients' meals with
+// a scenario file's actions; --verify-kernel checks its kernels against
+// the scalar model on this machine.
+
+static void printSummary(const PopulationSummary &summary)
+{
+    printf("Patients:          %d (%d with lows)\n", summary.patients, summary.patientsWithLows);
+    printf("Mean glucose:      %.2f mmol/L\n", summary.meanGlucose);
+    printf("Time in range:     %.1f%% (sd %.1f%%, worst %.1f%%)\n", 100 * summary.meanTimeInRange,
+           100 * summary.timeInRangeStdDev(), 100 * summary.worstTimeInRange);
+    printf("Time below 3.9:    %.1f%%\n", 100 * summary.meanTimeBelowRange);
+    printf("Time above 10.0:   %.1f%%\n", 100 * summary.meanTimeAboveRange);
+    printf("Insulin delivered: %.1f units per patient\n", summary.meanInsulinDelivered);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("population");
+
+    Profile defaults = Profile::defaultProfile();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulates a virtual patient population in parallel.");
+    parser.addHelpOption();
+    parser.addOption({"patients", "Number of virtual patients (default 1000).", "count", "1000"});
+    parser.addOption({"days", "Simulated days per patient (default 1).", "days", "1"});
+    parser.addOption({"threads", "Worker threads (default: one per core).", "count", QString::number(QThread::idealThreadCount())});
+    parser.addOption({"seed", "Population seed (default 1).", "seed", "1"});
+    parser.addOption({"basal", "Profile basal rate (units/hour).", "rate", QString::number(defaults.getBasalRate())});
+    parser.addOption({"carb-ratio", "Profile carb ratio.", "ratio", QString::number(defaults.getCarbRatio())});
+    parser.addOption({"correction", "Profile correction factor.", "factor", QString::number(defaults.getCorrectionFactor())});
+    parser.addOption({"target", "Profile target glucose (mmol/L).", "glucose", QString::number(defaults.getTargetGlucose())});
+    parser.addOption({"csv", "Write each patient's outcome to a CSV file as it finishes.", "path"});
+    parser.addOption({"scaling", "Repeat the run with 1, 2, 4, ... threads and report the speedup."});
+    parser.addOption({"batch", "Step patients in batches of this size with the batch engine (default 0: one engine per patient).", "count", "0"});
+    parser.addOption({"kernel", "Batch engine kernel: scalar, sse2 or avx2 (default: best supported).", "kernel"});
+    parser.addOption({"sensor", "CGM sensor: ideal, typical or lag:noise[:drift[:dropout]] (minutes, mmol/L, fraction per day, "
+                      "probability per sample; default ideal).", "sensor", "ideal"});
+    parser.addOption({"fault", "Random fault for every patient as kind:perDay[:minutes], kind sensor, occlusion or battery, "
+                      "may be repeated (not with --batch).", "fault"});
+    parser.addOption({"scenario", "Run every patient through a scenario file instead of their own meals.", "file"});
+    parser.addOption({"verify-kernel", "Check every batch engine kernel against the scalar model and exit."});
+    parser.process(app);
+
+    bool okPatients = false, okDays = false, okThreads = false, okSeed = false, okBatch = false;
+    int patients = parser.value("patients").toInt(&okPatients);
+    int days = parser.value("days").toInt(&okDays);
+    int threads = parser.value("threads").toInt(&okThreads);
+    quint64 seed = parser.value("seed").toULongLong(&okSeed);
+    int batch = parser.value("batch").toInt(&okBatch);
+    if (!okPatients || !okDays || !okThreads || !okSeed || !okBatch || patients <= 0 || days <= 0 || threads <= 0 || batch < 0) {
+        fprintf(stderr, "Invalid --patients, --days, --threads, --seed or --batch value\n");
+        return 1;
+    }
+
+    if ((batch > 0 || parser.isSet("verify-kernel")) && !BatchEngine::matchesScalarDosing()) {
+        fprintf(stderr, "The batch engine doses in double and is not available in fixed_dosing builds\n");
+        return 1;
+    }
+
+    BatchEngine::Kernel kernel = BatchEngine::bestKernel();
+    if (parser.isSet("kernel")) {
+        QString name = parser.value("kernel");
+        if (name == BatchEngine::kernelName(BatchEngine::ScalarKernel)) kernel = BatchEngine::ScalarKernel;
+        else if (name == BatchEngine::kernelName(BatchEngine::SSE2Kernel)) kernel = BatchEngine::SSE2Kernel;
+        else if (name == BatchEngine::kernelName(BatchEngine::AVX2Kernel)) kernel = BatchEngine::AVX2Kernel;
+        else {
+            fprintf(stderr, "Invalid --kernel value: %s\n", qPrintable(name));
+            return 1;
+        }
+        if (kernel > BatchEngine::bestKernel()) {
+            fprintf(stderr, "The %s kernel is not supported on this CPU\n", qPrintable(name));
+            return 1;
+        }
+    }
+
+    if (parser.isSet("verify-kernel")) {
+        int failed = 0;
+        for (int k = BatchEngine::ScalarKernel; k <= BatchEngine::bestKernel(); k++) {
+            int mismatches = BatchEngine::compareWithScalarModel(BatchEngine::Kernel(k), 1003, 2000, seed);
+            printf("%-7s %s (%d mismatching values)\n", qPrintable(BatchEngine::kernelName(BatchEngine::Kernel(k))),
+                   mismatches == 0 ? "exact" : "DIFFERS", mismatches);
+            failed += mismatches;
+        }
+        return failed == 0 ? 0 : 1;
+    }
+
+    bool okSensor = false;
+    SensorParameters sensor = SensorParameters::fromString(parser.value("sensor"), &okSensor);
+    if (!okSensor) {
+        fprintf(stderr, "Invalid --sensor value\n");
+        return 1;
+    }
+
+    if (parser.isSet("scenario")) {
+        Scenario scenario; // Checked once here; every patient streams the file on its own
+        QString error;
+        if (!scenario.open(parser.value("scenario"), &error)
+                || (batch > 0 && !PopulationRunner::checkBatchScenario(parser.value("scenario"), &error))) {
+            fprintf(stderr, "%s\n", qPrintable(error));
+            return 1;
+        }
+    }
+
+    Profile profile("Population", parser.value("basal").toDouble(), parser.value("carb-ratio").toDouble(),
+                    parser.value("correction").toDouble(), parser.value("target").toDouble(), 1);
+
+    PopulationRunner runner(patients, seed);
+    runner.setProfile(profile);
+    runner.setDays(days);
+    runner.setBatchSize(batch);
+    runner.setKernel(kernel);
+    runner.setSensor(sensor);
+    runner.setScenario(parser.value("scenario"));
+    for (const QString &fault : parser.values("fault")) {
+        int separator = fault.indexOf(':');
+        int kind = FaultInjector::faultNamed(fault.left(separator));
+        bool okFault = false;
+        FaultProfile faultProfile = FaultProfile::fromString(fault.mid(separator + 1), &okFault);
+        if (separator < 0 || kind < 0 || !okFault) {
+            fprintf(stderr, "Invalid --fault value: %s\n", qPrintable(fault));
+            return 1;
+        }
+        runner.setFaultProfile(kind, faultProfile);
+    }
+
+    if (parser.isSet("scaling")) {
+        double baseline = 0;
+        printf("threads  wall (s)  patients/s  speedup  efficiency\n");
+        QList<int> counts;
+        for (int count = 1; count < threads; count *= 2) {
+            counts.append(count);
+        }
+        counts.append(threads);
+
+        for (int count : counts) {
+            runner.setThreads(count);
+            QElapsedTimer timer;
+            timer.start();
+            runner.run();
+            double wall = timer.nsecsElapsed() / 1e9;
+            if (count == 1) {
+                baseline = wall;
+            }
+            double speedup = wall > 0 ? baseline / wall : 0;
+            printf("%7d  %8.3f  %10.1f  %7.2f  %9.0f%%\n", count, wall, patients / wall, speedup, 100 * speedup / count);
+        }
+        return 0;
+    }
+
+    QFile csvFile;
+    QTextStream csv;
+    if (parser.isSet("csv")) {
+        csvFile.setFileName(parser.value("csv"));
+        if (!csvFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            fprintf(stderr, "Could not open %s for writing\n", qPrintable(parser.value("csv")));
+            return 1;
+        }
+        csv.setDevice(&csvFile);
+        csv << "patient,seed,volatility,increase_per_hour,insulin_usage_rate,mean_glucose,min_glucose,max_glucose,"
+               "time_in_range,time_below_range,time_above_range,insulin_delivered\n";
+        runner.setOutcomeCallback([&csv](const PatientOutcome &outcome) {
+            csv << outcome.index << ',' << outcome.seed << ',' << outcome.parameters.volatility << ','
+                << outcome.parameters.increasePerHour << ',' << outcome.parameters.insulinUsageRate << ','
+                << outcome.meanGlucose << ',' << outcome.minGlucose << ',' << outcome.maxGlucose << ','
+                << outcome.timeInRange << ',' << outcome.timeBelowRange << ',' << outcome.timeAboveRange << ','
+                << outcome.insulinDelivered << '\n';
+        });
+    }
+
+    runner.setThreads(threads);
+    QElapsedTimer timer;
+    timer.start();
+    PopulationSummary summary = runner.run();
+    double wall = timer.nsecsElapsed() / 1e9;
+
+    printSummary(summary);
+    printf("Wall time:         %.3f s on %d thread(s) (%.1f patients/s, %.1f simulated days/s)\n",
+           wall, threads, wall > 0 ? patients / wall : 0.0, wall > 0 ? double(patients) * days / wall : 0.0);
+    if (batch > 0) {
+        printf("Batch engine:      %d patients per batch, %s kernel\n", batch, qPrintable(BatchEngine::kernelName(kernel)));
+    }
+    return 0;
+}
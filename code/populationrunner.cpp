@@ -0,0 +1,449 @@
+#include "populationrunner.h"
+#include "glucosemodel.h"
+#include "simulationengine.h"
+#include "workstealingpool.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+double uniform(SimRandom &random, double low, double high) {
+    return low + (high - low) * random.nextDouble();
+}
+
+// Accumulates one patient's outcome from its sensor samples
+struct OutcomeTally {
+    PatientOutcome outcome;
+    int inRange = 0;
+    int belowRange = 0;
+    int aboveRange = 0;
+    double glucoseSum = 0;
+    double lastInsulin = 0;
+
+    OutcomeTally(const VirtualPatient &patient, double insulin) : lastInsulin(insulin) {
+        outcome.index = patient.index;
+        outcome.seed = patient.seed;
+        outcome.parameters = patient.parameters;
+        outcome.readings = 0;
+        outcome.minGlucose = 0;
+        outcome.maxGlucose = 0;
+        outcome.insulinDelivered = 0;
+    }
+
+    void addSample(double glucose, double insulin) {
+        if (glucose != -1) {
+            if (outcome.readings == 0 || glucose < outcome.minGlucose) outcome.minGlucose = glucose;
+            if (outcome.readings == 0 || glucose > outcome.maxGlucose) outcome.maxGlucose = glucose;
+            outcome.readings++;
+            glucoseSum += glucose;
+            if (glucose < 3.9) belowRange++;
+            else if (glucose > 10.0) aboveRange++;
+            else inRange++;
+        }
+        outcome.insulinDelivered += lastInsulin - insulin;
+        lastInsulin = insulin;
+    }
+
+    PatientOutcome finish() {
+        int readings = qMax(1, outcome.readings);
+        outcome.meanGlucose = glucoseSum / readings;
+        outcome.timeInRange = double(inRange) / readings;
+        outcome.timeBelowRange = double(belowRange) / readings;
+        outcome.timeAboveRange = double(aboveRange) / readings;
+        return outcome;
+    }
+};
+}
+
+void PopulationSummary::add(const PatientOutcome &outcome) {
+    patients++;
+    if (outcome.timeBelowRange > 0) {
+        patientsWithLows++;
+    }
+
+    // Running means (Welford for time in range, which also needs its spread)
+    double delta = outcome.timeInRange - meanTimeInRange;
+    meanTimeInRange += delta / patients;
+    timeInRangeM2 += delta * (outcome.timeInRange - meanTimeInRange);
+
+    meanGlucose += (outcome.meanGlucose - meanGlucose) / patients;
+    meanTimeBelowRange += (outcome.timeBelowRange - meanTimeBelowRange) / patients;
+    meanTimeAboveRange += (outcome.timeAboveRange - meanTimeAboveRange) / patients;
+    meanInsulinDelivered += (outcome.insulinDelivered - meanInsulinDelivered) / patients;
+    worstTimeInRange = qMin(worstTimeInRange, outcome.timeInRange);
+}
+
+double PopulationSummary::timeInRangeStdDev() const {
+    return patients > 1 ? std::sqrt(timeInRangeM2 / (patients - 1)) : 0.0;
+}
+
+PopulationRunner::PopulationRunner(int patients, quint64 seed)
+    : patients(patients)
+    , seed(seed)
+    , profile(Profile::defaultProfile())
+    , days(1)
+    , start(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC)
+    , threads(QThread::idealThreadCount())
+    , batchSize(0)
+    , kernel(BatchEngine::bestKernel())
+{
+}
+
+void PopulationRunner::setProfile(const Profile &profile) {
+    this->profile = profile;
+}
+
+void PopulationRunner::setDays(int days) {
+    this->days = days;
+}
+
+void PopulationRunner::setStart(const QDateTime &start) {
+    this->start = start;
+}
+
+void PopulationRunner::setThreads(int threads) {
+    this->threads = threads;
+}
+
+void PopulationRunner::setSensor(const SensorParameters &sensor) {
+    this->sensor = sensor;
+}
+
+void PopulationRunner::setScenario(const QString &path) {
+    scenario = path;
+}
+
+bool PopulationRunner::checkBatchScenario(const QString &path, QString *error) {
+    Scenario scenario;
+    if (!scenario.open(path, error)) {
+        return false;
+    }
+    while (scenario.hasNext()) {
+        ScenarioAction action = scenario.takeNext();
+        if (action.type == ScenarioAction::Bolus
+                && (action.bolusKind == DeliveryPlan::DualWave || action.bolusKind == DeliveryPlan::Split)) {
+            if (error) *error = QString("%1:%2: dual-wave and split boluses need one engine per patient")
+                                    .arg(path).arg(action.line);
+            return false;
+        }
+    }
+    if (!scenario.errorString().isEmpty()) {
+        if (error) *error = scenario.errorString();
+        return false;
+    }
+    return true;
+}
+
+void PopulationRunner::setFaultProfile(int fault, const FaultProfile &profile) {
+    faultProfiles[fault] = profile;
+}
+
+void PopulationRunner::setBatchSize(int patients) {
+    batchSize = qMax(0, patients);
+}
+
+void PopulationRunner::setKernel(BatchEngine::Kernel kernel) {
+    this->kernel = kernel;
+}
+
+void PopulationRunner::setOutcomeCallback(const std::function<void(const PatientOutcome &)> &callback) {
+    outcomeCallback = callback;
+}
+
+PopulationSummary PopulationRunner::run() {
+    QVector<PatientOutcome> outcomes(patients); // Each task fills its own patients' slots
+    QMutex callbackMutex;
+
+    WorkStealingPool pool(threads);
+    if (batchSize == 0) {
+        for (int i = 0; i < patients; i++) {
+            pool.submit([this, i, &outcomes, &callbackMutex]() {
+                outcomes[i] = simulate(patient(i), profile, start, days);
+
+                if (outcomeCallback) {
+                    QMutexLocker locker(&callbackMutex);
+                    outcomeCallback(outcomes[i]);
+                }
+            });
+        }
+    } else {
+        for (int first = 0; first < patients; first += batchSize) {
+            pool.submit([this, first, &outcomes, &callbackMutex]() {
+                QVector<VirtualPatient> batch;
+                for (int i = first; i < qMin(patients, first + batchSize); i++) {
+                    batch.append(patient(i));
+                }
+                QVector<PatientOutcome> results = simulateBatch(batch, profile, start, days, kernel);
+                for (int i = 0; i < results.size(); i++) {
+                    outcomes[first + i] = results[i];
+                }
+
+                if (outcomeCallback) {
+                    QMutexLocker locker(&callbackMutex);
+                    for (const PatientOutcome &outcome : results) {
+                        outcomeCallback(outcome);
+                    }
+                }
+            });
+        }
+    }
+    pool.waitForDone();
+
+    // Folded in patient order, so the floating-point sums do not depend on thread scheduling
+    PopulationSummary summary;
+    for (const PatientOutcome &outcome : outcomes) {
+        summary.add(outcome);
+    }
+    return summary;
+}
+
+VirtualPatient PopulationRunner::patient(int index) const {
+    SimRandom random = SimRandom(seed).split(quint64(index));
+
+    VirtualPatient patient;
+    patient.index = index;
+    patient.seed = random.next();
+    patient.parameters.volatility = uniform(random, 0.4, 1.2);
+    patient.parameters.increasePerHour = uniform(random, 1.0, 3.0);
+    patient.parameters.insulinUsageRate = uniform(random, 1.5, 2.5);
+    patient.parameters.startGlucose = uniform(random, 5.0, 9.0);
+
+    patient.meals.append({int(uniform(random, 7 * 60, 9 * 60)), uniform(random, 30, 60)});    // Breakfast
+    patient.meals.append({int(uniform(random, 12 * 60, 13.5 * 60)), uniform(random, 40, 80)}); // Lunch
+    patient.meals.append({int(uniform(random, 18 * 60, 20 * 60)), uniform(random, 50, 90)});  // Dinner
+    patient.sensor = sensor;
+    patient.scenario = scenario;
+    for (int fault = 0; fault < FaultInjector::faultCount; fault++) {
+        patient.faults[fault] = faultProfiles[fault];
+    }
+    return patient;
+}
+
+QVector<PopulationRunner::Meal> PopulationRunner::meals(const VirtualPatient &patient, const QDateTime &start, int days) {
+    // Day-to-day variation of the usual meals
+    QVector<Meal> meals;
+    const SimRandom mealStreams = SimRandom(patient.seed).split(mealStream);
+    const QDateTime end = start.addDays(days);
+    for (int day = 0; day <= days; day++) {
+        QDate date = start.date().addDays(day);
+        QDateTime midnight(date, QTime(0, 0), start.timeSpec());
+        // Keyed by date, so a run continued from a warm-up carries on instead of repeating its days
+        SimRandom mealRandom = mealStreams.split(quint64(date.toJulianDay()));
+        for (const MealPattern &meal : patient.meals) {
+            int minute = meal.minuteOfDay + int(uniform(mealRandom, -mealJitterMinutes, mealJitterMinutes));
+            double carbs = meal.carbs * (1 + uniform(mealRandom, -mealCarbVariation, mealCarbVariation));
+            QDateTime time = midnight.addSecs(qint64(minute) * 60);
+            if (time >= start && time < end) {
+                meals.append({time, carbs});
+            }
+        }
+    }
+    return meals;
+}
+
+PatientOutcome PopulationRunner::simulate(const VirtualPatient &patient, const Profile &profile, const QDateTime &start, int days) {
+    SimulationEngine engine; // No logger: patients share nothing
+    engine.setTime(start);
+    engine.setSeed(patient.seed);
+    engine.setPatient(patient.parameters);
+    engine.getCGM()->setSensor(patient.sensor, SimulationEngine::sampleMinutes);
+    engine.setProfile(profile);
+    engine.setMonitoring(true);
+    for (int fault = 0; fault < FaultInjector::faultCount; fault++) {
+        if (patient.faults[fault].isEnabled()) {
+            engine.setFaultProfile(SimulationEngine::FaultType(fault), patient.faults[fault]);
+        }
+    }
+    if (!patient.scenario.isEmpty()) {
+        engine.loadScenario(patient.scenario);
+    }
+    return run(engine, patient, days);
+}
+
+QByteArray PopulationRunner::warmUp(const VirtualPatient &patient, const Profile &profile, const QDateTime &start, int days) {
+    SimulationEngine engine;
+    engine.setTime(start);
+    engine.setSeed(patient.seed);
+    engine.setPatient(patient.parameters);
+    engine.getCGM()->setSensor(patient.sensor, SimulationEngine::sampleMinutes);
+    engine.setProfile(profile);
+    engine.setMonitoring(true);
+    for (int fault = 0; fault < FaultInjector::faultCount; fault++) {
+        if (patient.faults[fault].isEnabled()) {
+            engine.setFaultProfile(SimulationEngine::FaultType(fault), patient.faults[fault]);
+        }
+    }
+    if (!patient.scenario.isEmpty()) {
+        engine.loadScenario(patient.scenario);
+    }
+    run(engine, patient, days);
+    return engine.saveCheckpoint();
+}
+
+PatientOutcome PopulationRunner::simulate(const VirtualPatient &patient, const Profile &profile, const QByteArray &warmUpState, int days) {
+    SimulationEngine engine;
+    engine.restoreCheckpoint(warmUpState);
+    engine.setProfile(profile);
+    return run(engine, patient, days);
+}
+
+PatientOutcome PopulationRunner::run(SimulationEngine &engine, const VirtualPatient &patient, int days) {
+    const QDateTime start = engine.currentTime();
+    if (patient.scenario.isEmpty()) { // Otherwise the scenario has the meals
+        for (const Meal &meal : meals(patient, start, days)) {
+            engine.scheduleMeal(meal.time, meal.carbs);
+        }
+    }
+
+    OutcomeTally tally(patient, engine.getInsulinReserve()->getInsulinRemaining());
+    QObject::connect(&engine, &SimulationEngine::sampled, [&](const SimulationSample &sample) {
+        tally.addSample(sample.glucose, sample.insulin);
+
+        // Attentive user: charge and refill as soon as the device asks for it
+        if (engine.getBattery()->isBatteryCritical()) {
+            engine.getBattery()->chargeBattery();
+            engine.getAlerts()->reset(AlertMonitor::BATTERY_LOW);
+        }
+        if (engine.getInsulinReserve()->isInsulinLow()) {
+            engine.getInsulinReserve()->refillInsulin();
+            engine.getAlerts()->reset(AlertMonitor::INSULIN_LOW);
+            tally.lastInsulin = engine.getInsulinReserve()->getInsulinRemaining();
+        }
+    });
+
+    engine.runUntil(start.addDays(days));
+    return tally.finish();
+}
+
+void PopulationRunner::applyScenarioAction(BatchEngine &batch, const ScenarioAction &action, Profile *profile) {
+    switch (action.type) {
+        case ScenarioAction::Meal: // The batch absorbs meals at once
+            for (int i = 0; i < batch.size(); i++) {
+                batch.intakeCarbs(i, action.amount);
+            }
+            break;
+        case ScenarioAction::Bolus: {
+            // One constant-rate pulse per patient; checkBatchScenario() turns away the other kinds
+            DeliveryPlan plan = action.bolusPlan(GlucoseModel::bolusRate);
+            if (plan.pulses().size() == 1 && plan.pulses().first().startHours == 0) {
+                for (int i = 0; i < batch.size(); i++) {
+                    batch.deliverBolus(i, static_cast<double>(plan.totalUnits()), plan.pulses().first().rate);
+                }
+            }
+            break;
+        }
+        case ScenarioAction::BasalRate:
+            profile->setBasalRate(action.amount);
+            batch.setProfile(*profile);
+            break;
+        case ScenarioAction::ProfileChange:
+            if (action.basalRate >= 0) profile->setBasalRate(action.basalRate);
+            if (action.carbRatio >= 0) profile->setCarbRatio(action.carbRatio);
+            if (action.correctionFactor >= 0) profile->setCorrectionFactor(action.correctionFactor);
+            if (action.targetGlucose >= 0) profile->setTargetGlucose(action.targetGlucose);
+            batch.setProfile(*profile);
+            break;
+        case ScenarioAction::Refill:
+            for (int i = 0; i < batch.size(); i++) {
+                batch.refillInsulin(i);
+            }
+            break;
+        case ScenarioAction::CGMFault:
+        case ScenarioAction::PumpFault:
+        case ScenarioAction::BatteryFault:
+        case ScenarioAction::Charge:
+            break; // The batch has no fault or battery model
+    }
+}
+
+QVector<PatientOutcome> PopulationRunner::simulateBatch(const QVector<VirtualPatient> &patients, const Profile &profile,
+                                                        const QDateTime &start, int days, BatchEngine::Kernel kernel) {
+    return simulateBatch<ThresholdPolicy>(patients, profile, start, days, kernel, nullptr);
+}
+
+template<class Controller>
+QVector<PatientOutcome> PopulationRunner::simulateBatch(const QVector<VirtualPatient> &patients, const Profile &profile,
+                                                        const QDateTime &start, int days, BatchEngine::Kernel kernel,
+                                                        ControllerTiming *timing) {
+    BatchEngine batch(patients.size());
+    std::vector<Controller> controllers(patients.size());
+    batch.setKernel(kernel);
+    batch.setProfile(profile);
+
+    struct BatchMeal {
+        qint64 step;
+        int patient;
+        double carbs;
+    };
+    QVector<BatchMeal> batchMeals;
+    std::vector<OutcomeTally> tallies;
+    const qint64 stepMSecs = qint64(batchStepMinutes) * 60 * 1000;
+    for (int i = 0; i < patients.size(); i++) {
+        batch.setPatient(i, patients[i].parameters, patients[i].seed);
+        batch.setSensor(i, patients[i].sensor);
+        tallies.push_back(OutcomeTally(patients[i], batch.getInsulinRemaining(i)));
+        if (!patients[i].scenario.isEmpty()) {
+            continue; // Meals come from the scenario
+        }
+        for (const Meal &meal : meals(patients[i], start, days)) {
+            batchMeals.append({(start.msecsTo(meal.time) + stepMSecs - 1) / stepMSecs, i, meal.carbs}); // First step boundary at or after the meal
+        }
+    }
+    std::stable_sort(batchMeals.begin(), batchMeals.end(),
+                     [](const BatchMeal &a, const BatchMeal &b) { return a.step < b.step; });
+
+    // The batch shares one scenario, streamed like an engine's
+    Scenario scenario;
+    Profile scenarioProfile = profile;
+    if (!patients.isEmpty() && !patients[0].scenario.isEmpty()) {
+        scenario.open(patients[0].scenario);
+    }
+
+    // Fixed steps for the whole batch; meals, then samples, at each step boundary
+    const qint64 steps = start.msecsTo(start.addDays(days)) / stepMSecs;
+    const int stepsPerSample = SimulationEngine::sampleMinutes / batchStepMinutes;
+    const double stepHours = batchStepMinutes / 60.0;
+    int nextMeal = 0;
+    for (qint64 step = 0; step <= steps; step++) {
+        for (; nextMeal < batchMeals.size() && batchMeals[nextMeal].step == step; nextMeal++) {
+            batch.intakeCarbs(batchMeals[nextMeal].patient, batchMeals[nextMeal].carbs);
+        }
+        while (scenario.hasNext() && (scenario.peekNext().offsetMSecs + stepMSecs - 1) / stepMSecs <= step) {
+            applyScenarioAction(batch, scenario.takeNext(), &scenarioProfile);
+        }
+
+        if (step > 0 && step % stepsPerSample == 0) {
+            batch.sample(start.toMSecsSinceEpoch() + step * stepMSecs, controllers, timing);
+            for (int i = 0; i < patients.size(); i++) {
+                tallies[i].addSample(batch.getSensorGlucose(i), batch.getInsulinRemaining(i));
+
+                // Attentive user: refill as soon as the device asks for it
+                if (batch.isInsulinLow(i)) {
+                    batch.refillInsulin(i);
+                    tallies[i].lastInsulin = batch.getInsulinRemaining(i);
+                }
+            }
+        }
+
+        if (step < steps) {
+            batch.step(stepHours);
+        }
+    }
+
+    QVector<PatientOutcome> outcomes;
+    for (OutcomeTally &tally : tallies) {
+        outcomes.append(tally.finish());
+    }
+    return outcomes;
+}
+
+template QVector<PatientOutcome> PopulationRunner::simulateBatch<ThresholdPolicy>(
+    const QVector<VirtualPatient> &, const Profile &, const QDateTime &, int, BatchEngine::Kernel, ControllerTiming *);
+template QVector<PatientOutcome> PopulationRunner::simulateBatch<PredictiveSuspendPolicy>(
+    const QVector<VirtualPatient> &, const Profile &, const QDateTime &, int, BatchEngine::Kernel, ControllerTiming *);
+template QVector<PatientOutcome> PopulationRunner::simulateBatch<PIDPolicy>(
+    const QVector<VirtualPatient> &, const Profile &, const QDateTime &, int, BatchEngine::Kernel, ControllerTiming *);
+template QVector<PatientOutcome> PopulationRunner::simulateBatch<MPCPolicy>(
+    const QVector<VirtualPatient> &, const Profile &, const QDateTime &, int, BatchEngine::Kernel, ControllerTiming *);
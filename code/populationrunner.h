@@ -0,0 +1,319 @@
+/**
+ * @file populationrunner.h
+ * @brief Defines the PopulationRunner class for Monte Carlo runs over virtual patients.
+ *
+ * A PopulationRunner generates a population of virtual patients from a seed (each with
+ * its own glucose model parameters and meal pattern), simulates every patient with its
+ * own SimulationEngine on a WorkStealingPool, and aggregates the outcomes as they arrive.
+ * Patients share no state, so the run scales with the number of cores and any patient
+ * can be re-run on its own from the population seed and its index.
+ *
+ * With a batch size set, blocks of patients are instead stepped together by a
+ * BatchEngine, which keeps their state in arrays and integrates them with SIMD kernels.
+ */
+#ifndef POPULATIONRUNNER_H
+#define POPULATIONRUNNER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QVector>
+#include <functional>
+#include "batchengine.h"
+#include "cgmreader.h"
+#include "faultinjector.h"
+#include "profile.h"
+#include "scenario.h"
+#include "sensormodel.h"
+
+class SimulationEngine;
+
+/**
+ * @brief A meal a virtual patient usually eats every day.
+ */
+struct MealPattern {
+    int minuteOfDay; ///< Usual time of the meal, in minutes after midnight.
+    double carbs;    ///< Usual carbohydrates (grams).
+};
+
+/**
+ * @brief A generated virtual patient.
+ */
+struct VirtualPatient {
+    int index;                    ///< Position in the population.
+    quint64 seed;                 ///< Seed of the patient's engine and meal variations.
+    PatientParameters parameters; ///< Glucose model parameters.
+    QVector<MealPattern> meals;   ///< Usual daily meals.
+    SensorParameters sensor;      ///< CGM sensor, see PopulationRunner::setSensor().
+    QString scenario;             ///< Scenario file replacing the usual meals, or empty (see PopulationRunner::setScenario()).
+    FaultProfile faults[FaultInjector::faultCount]; ///< Random faults, see PopulationRunner::setFaultProfile().
+};
+
+/**
+ * @brief Outcome metrics of one simulated patient.
+ */
+struct PatientOutcome {
+    int index;                    ///< Position in the population.
+    quint64 seed;                 ///< Seed the patient was simulated with.
+    PatientParameters parameters; ///< Glucose model parameters.
+    int readings;                 ///< Valid CGM readings.
+    double meanGlucose;           ///< Mean glucose (mmol/L).
+    double minGlucose;            ///< Lowest glucose (mmol/L).
+    double maxGlucose;            ///< Highest glucose (mmol/L).
+    double timeInRange;           ///< Fraction of readings in 3.9-10.0 mmol/L.
+    double timeBelowRange;        ///< Fraction of readings below 3.9 mmol/L.
+    double timeAboveRange;        ///< Fraction of readings above 10.0 mmol/L.
+    double insulinDelivered;      ///< Insulin delivered over the run (units).
+};
+
+/**
+ * @brief Running aggregate of patient outcomes, updated as each patient finishes.
+ */
+struct PopulationSummary {
+    int patients = 0;                ///< Patients aggregated so far.
+    int patientsWithLows = 0;        ///< Patients with at least one reading below range.
+    double meanGlucose = 0;          ///< Mean of the patients' mean glucose (mmol/L).
+    double meanTimeInRange = 0;      ///< Mean time in range (fraction).
+    double timeInRangeM2 = 0;        ///< Sum of squared deviations of time in range (Welford).
+    double worstTimeInRange = 1;     ///< Lowest time in range of any patient (fraction).
+    double meanTimeBelowRange = 0;   ///< Mean time below range (fraction).
+    double meanTimeAboveRange = 0;   ///< Mean time above range (fraction).
+    double meanInsulinDelivered = 0; ///< Mean insulin delivered per patient (units).
+
+    /**
+     * @brief Adds a patient outcome to the aggregate.
+     * @param outcome Outcome of one patient.
+     */
+    void add(const PatientOutcome &outcome);
+
+    /**
+     * @brief Returns the standard deviation of time in range across patients.
+     * @return Standard deviation (fraction).
+     */
+    double timeInRangeStdDev() const;
+};
+
+/**
+ * @class PopulationRunner
+ * @brief Simulates a population of virtual patients in parallel.
+ */
+class PopulationRunner
+{
+public:
+    /**
+     * @brief Constructs a runner for a population.
+     *
+     * Defaults: the default profile, one simulated day from 2024-01-01 00:00 UTC and one
+     * thread per core.
+     *
+     * @param patients Number of virtual patients.
+     * @param seed Population seed; the same seed always generates the same patients.
+     */
+    PopulationRunner(int patients, quint64 seed);
+
+    void setProfile(const Profile &profile);
+    void setDays(int days);
+    void setStart(const QDateTime &start);
+    void setThreads(int threads);
+
+    /**
+     * @brief Gives every patient a CGM sensor model; the outcomes are then measured on the readings.
+     * @param sensor Sensor configuration (default: ideal).
+     */
+    void setSensor(const SensorParameters &sensor);
+
+    /**
+     * @brief Runs every patient through a scenario file instead of their own meal pattern.
+     *
+     * Each patient streams the file on its own. Batched runs read it once per batch and
+     * apply its meals, boluses, basal and profile changes and refills to every patient of
+     * the batch at the next step boundary; faults and charges do not apply to a batch.
+     *
+     * @param path Scenario file (see scenario.h), or an empty string for the meal patterns.
+     */
+    void setScenario(const QString &path);
+
+    /**
+     * @brief Checks that batched runs can take every action of a scenario file.
+     *
+     * The batch engine delivers one constant-rate bolus per patient, so it can run normal
+     * and extended boluses but not dual-wave or split ones.
+     * @param path Scenario file.
+     * @param error Optional; receives a description of the problem on failure.
+     * @return False if the file cannot be read or has a bolus the batch engine cannot deliver.
+     */
+    static bool checkBatchScenario(const QString &path, QString *error = nullptr);
+
+    /**
+     * @brief Makes a fault strike every patient at random, for stress runs.
+     *
+     * Each patient draws its own onsets and durations from its seed. Batched runs have
+     * no fault model and ignore the profiles.
+     *
+     * @param fault Fault kind, see SimulationEngine::FaultType.
+     * @param profile How often the fault strikes and how long it lasts.
+     */
+    void setFaultProfile(int fault, const FaultProfile &profile);
+
+    /**
+     * @brief Selects between per-patient engines and batched simulation.
+     *
+     * With 0 (the default) every patient gets its own SimulationEngine. With N > 0, each
+     * task steps N patients together with a BatchEngine in fixed one-minute steps, which
+     * is much faster but leaves out the battery, alerts and adaptive stepping.
+     *
+     * @param patients Patients per batch, or 0.
+     */
+    void setBatchSize(int patients);
+
+    /**
+     * @brief Selects the BatchEngine kernel used with a batch size.
+     * @param kernel Kernel; falls back to the best one the CPU supports.
+     */
+    void setKernel(BatchEngine::Kernel kernel);
+
+    /**
+     * @brief Sets a function called with each patient outcome as soon as it is available.
+     *
+     * Calls are serialised but come from the worker threads, in completion order.
+     *
+     * @param callback Function receiving each outcome.
+     */
+    void setOutcomeCallback(const std::function<void(const PatientOutcome &)> &callback);
+
+    /**
+     * @brief Simulates every patient and blocks until all are done.
+     *
+     * Outcomes are folded into the summary in patient order, so the same seed gives the
+     * same summary whatever the number of threads.
+     *
+     * @return Aggregate of all patient outcomes.
+     */
+    PopulationSummary run();
+
+    /**
+     * @brief Generates a patient of the population.
+     * @param index Position in the population.
+     * @return The patient; depends only on the population seed and the index.
+     */
+    VirtualPatient patient(int index) const;
+
+    /**
+     * @brief Simulates one patient with its own engine, acting as an attentive user.
+     * @param patient Patient to simulate.
+     * @param profile Profile to simulate with.
+     * @param start Simulated start time.
+     * @param days Simulated days.
+     * @return The patient's outcome.
+     */
+    static PatientOutcome simulate(const VirtualPatient &patient, const Profile &profile, const QDateTime &start, int days);
+
+    /**
+     * @brief Simulates one patient over a warm-up period and returns the engine state at its end.
+     *
+     * Runs that continue from the state with simulate(patient, profile, state, days) share
+     * the warm-up instead of simulating it again.
+     *
+     * @param patient Patient to simulate.
+     * @param profile Profile of the warm-up.
+     * @param start Simulated start time of the warm-up.
+     * @param days Warm-up days.
+     * @return A SimulationEngine checkpoint.
+     */
+    static QByteArray warmUp(const VirtualPatient &patient, const Profile &profile, const QDateTime &start, int days);
+
+    /**
+     * @brief Simulates one patient from a warm-up state, acting as an attentive user.
+     * @param patient Patient the state was warmed up for.
+     * @param profile Profile to simulate with from the end of the warm-up.
+     * @param warmUpState Checkpoint returned by warmUp().
+     * @param days Simulated days after the warm-up.
+     * @return The patient's outcome over those days (the warm-up is not counted).
+     */
+    static PatientOutcome simulate(const VirtualPatient &patient, const Profile &profile, const QByteArray &warmUpState, int days);
+
+    /**
+     * @brief A meal on a given day, after the day-to-day variation.
+     */
+    struct Meal {
+        QDateTime time;
+        double carbs;
+    };
+
+    /**
+     * @brief Returns a patient's meals over a run, varied from day to day.
+     *
+     * Each calendar day's variation comes from its own stream, so the meals of a date do
+     * not depend on when the run started.
+     *
+     * @param patient Patient.
+     * @param start Simulated start time of the run.
+     * @param days Simulated days.
+     * @return The meals from @p start on, in time order per day.
+     */
+    static QVector<Meal> meals(const VirtualPatient &patient, const QDateTime &start, int days);
+
+    /**
+     * @brief Simulates patients together with a BatchEngine, acting as an attentive user.
+     * @param patients Patients to simulate.
+     * @param profile Profile to simulate with.
+     * @param start Simulated start time.
+     * @param days Simulated days.
+     * @param kernel BatchEngine kernel.
+     * @return The patients' outcomes, in the order given.
+     */
+    static QVector<PatientOutcome> simulateBatch(const QVector<VirtualPatient> &patients, const Profile &profile,
+                                                 const QDateTime &start, int days, BatchEngine::Kernel kernel);
+
+    /**
+     * @brief Simulates patients together with a BatchEngine and a basal controller policy.
+     *
+     * Instantiated in populationrunner.cpp for the policies of controllerpolicies.h.
+     *
+     * @param patients Patients to simulate.
+     * @param profile Profile to simulate with.
+     * @param start Simulated start time.
+     * @param days Simulated days.
+     * @param kernel BatchEngine kernel.
+     * @param timing If not null, receives the controller decisions and their compute time.
+     * @return The patients' outcomes, in the order given.
+     */
+    template<class Controller>
+    static QVector<PatientOutcome> simulateBatch(const QVector<VirtualPatient> &patients, const Profile &profile,
+                                                 const QDateTime &start, int days, BatchEngine::Kernel kernel,
+                                                 ControllerTiming *timing);
+
+private:
+    /**
+     * @brief Schedules a patient's meals on an engine, unless the patient has a scenario, and runs it for a number of days.
+     * @return The patient's outcome from the engine's current time on.
+     */
+    static PatientOutcome run(SimulationEngine &engine, const VirtualPatient &patient, int days);
+
+    /**
+     * @brief Applies a scenario action to every patient of a batch.
+     * @param batch Batch to act on.
+     * @param action Action to take.
+     * @param profile Profile of the batch, updated by basal and profile changes.
+     */
+    static void applyScenarioAction(BatchEngine &batch, const ScenarioAction &action, Profile *profile);
+
+    int patients;
+    quint64 seed;
+    Profile profile;
+    int days;
+    QDateTime start;
+    int threads;
+    SensorParameters sensor;
+    QString scenario;
+    FaultProfile faultProfiles[FaultInjector::faultCount];
+    int batchSize;
+    BatchEngine::Kernel kernel;
+    std::function<void(const PatientOutcome &)> outcomeCallback;
+
+    static constexpr quint64 mealStream = 100; ///< Stream of a patient's day-to-day meal variations.
+    static constexpr int mealJitterMinutes = 30; ///< Largest shift of a meal from its usual time.
+    static constexpr double mealCarbVariation = 0.2; ///< Largest relative change of a meal's carbs.
+    static constexpr int batchStepMinutes = 1; ///< Integration step of batched runs.
+};
+
+#endif // POPULATIONRUNNER_H
@@ -73,10 +73,16 @@ bool Profile::createProfile(const QString &name, double basalRate, double carbRa
     return saveProfiles();
 }
 
+Profile Profile::defaultProfile() {
+    return Profile("Default", 0.8, 0.09, 2.5, 5.5, 1);
+}
+
 void Profile::initDefaultProfile() {
     QFile profileFile(s_profilesFilePath);
     if (!profileFile.exists()) {
-        createProfile("Default", 0.8, 0.09, 2.5, 5.5);
+        Profile defaults = defaultProfile();
+        createProfile(defaults.getName(), defaults.getBasalRate(), defaults.getCarbRatio(),
+                      defaults.getCorrectionFactor(), defaults.getTargetGlucose());
     }
 }
 
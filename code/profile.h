@@ -97,6 +97,16 @@ public:
      */
     static bool createProfile(const QString &name, double basalRate, double carbRatio, double correctionFactor, double targetGlucose);
 
+    /**
+     * @brief Returns the built-in default profile settings.
+     *
+     * Used to seed the profile store on first start and as the starting profile
+     * of headless simulations that do not load the profile store.
+     *
+     * @return Profile The default profile (id 1).
+     */
+    static Profile defaultProfile();
+
     /**
      * @brief Initializes the default profile if none exists.
      *
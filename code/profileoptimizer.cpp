@@ -0,0 +1,253 @@
+#include "profileoptimizer.h"
+#include "workstealingpool.h"
+#include <algorithm>
+#include <vector>
+
+ProfileSearchSpace ProfileSearchSpace::around(const Profile &profile) {
+    ProfileSearchSpace space;
+    space.basalRate = {profile.getBasalRate() / 2, profile.getBasalRate() * 2};
+    space.carbRatio = {profile.getCarbRatio() / 2, profile.getCarbRatio() * 2};
+    space.correctionFactor = {profile.getCorrectionFactor() / 2, profile.getCorrectionFactor() * 2};
+    space.targetGlucose = {5.0, 8.0};
+    return space;
+}
+
+bool ProfileCandidate::dominates(const ProfileCandidate &other) const {
+    const PopulationSummary &a = summary, &b = other.summary;
+    return a.meanTimeInRange >= b.meanTimeInRange && a.meanTimeBelowRange <= b.meanTimeBelowRange
+        && (a.meanTimeInRange > b.meanTimeInRange || a.meanTimeBelowRange < b.meanTimeBelowRange);
+}
+
+bool ProfileOptimizer::Key::operator==(const Key &other) const {
+    return std::equal(values, values + 4, other.values);
+}
+
+uint qHash(const ProfileOptimizer::Key &key, uint seed) {
+    for (qint64 value : key.values) {
+        seed = qHash(value, seed) ^ (seed << 1);
+    }
+    return seed;
+}
+
+ProfileOptimizer::ProfileOptimizer(int patients, quint64 seed)
+    : patients(patients)
+    , population(patients, seed)
+    , space(ProfileSearchSpace::around(Profile::defaultProfile()))
+    , days(2)
+    , warmUpProfile(Profile::defaultProfile())
+    , warmUpStart(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC)
+    , warmUpDays(1)
+    , threads(QThread::idealThreadCount())
+    , simulated(0)
+    , hits(0)
+{
+}
+
+void ProfileOptimizer::setSearchSpace(const ProfileSearchSpace &space) {
+    this->space = space;
+}
+
+ProfileSearchSpace ProfileOptimizer::getSearchSpace() const {
+    return space;
+}
+
+void ProfileOptimizer::setDays(int days) {
+    this->days = days;
+    cache.clear();
+}
+
+void ProfileOptimizer::setWarmUp(const Profile &profile, const QDateTime &start, int days) {
+    warmUpProfile = profile;
+    warmUpStart = start;
+    warmUpDays = days;
+    warmUpStates.clear();
+    cache.clear();
+}
+
+void ProfileOptimizer::setThreads(int threads) {
+    this->threads = threads;
+}
+
+QList<ProfileCandidate> ProfileOptimizer::gridSearch(int stepsPerParameter) {
+    evaluate(grid(space, stepsPerParameter));
+    return paretoSet();
+}
+
+QList<ProfileCandidate> ProfileOptimizer::adaptiveSearch(int stepsPerParameter, int rounds) {
+    stepsPerParameter = qMax(2, stepsPerParameter);
+    evaluate(grid(space, stepsPerParameter));
+
+    const ParameterRange *ranges[4] = {&space.basalRate, &space.carbRatio, &space.correctionFactor, &space.targetGlucose};
+    double steps[4];
+    for (int p = 0; p < 4; p++) {
+        steps[p] = (ranges[p]->high - ranges[p]->low) / (stepsPerParameter - 1);
+    }
+
+    for (int round = 0; round < rounds; round++) {
+        QList<Profile> neighbours;
+        for (const ProfileCandidate &candidate : paretoSet()) {
+            const Profile &centre = candidate.profile;
+            double values[4] = {centre.getBasalRate(), centre.getCarbRatio(), centre.getCorrectionFactor(), centre.getTargetGlucose()};
+            for (int p = 0; p < 4; p++) {
+                for (int direction = -1; direction <= 1; direction += 2) {
+                    double moved[4] = {values[0], values[1], values[2], values[3]};
+                    moved[p] = qBound(ranges[p]->low, values[p] + direction * steps[p], ranges[p]->high);
+                    neighbours.append(Profile("Candidate", moved[0], moved[1], moved[2], moved[3], 0));
+                }
+            }
+        }
+        evaluate(neighbours); // Neighbours scored in an earlier round come from the cache
+
+        for (double &step : steps) {
+            step /= 2;
+        }
+    }
+    return paretoSet();
+}
+
+QList<ProfileCandidate> ProfileOptimizer::evaluate(const QList<Profile> &profiles) {
+    // Candidates not in the cache yet, each once
+    QList<Profile> pending;
+    QHash<Key, int> pendingIndex;
+    for (const Profile &profile : profiles) {
+        Key key = keyOf(profile);
+        if (cache.contains(key) || pendingIndex.contains(key)) {
+            hits++;
+        } else {
+            pendingIndex.insert(key, pending.size());
+            pending.append(profile);
+        }
+    }
+
+    if (!pending.isEmpty()) {
+        warmUpPatients();
+
+        // One task per candidate and patient; outcomes are kept by patient and folded in
+        // order afterwards, so scores do not depend on the thread count
+        std::vector<std::vector<PatientOutcome>> outcomes(pending.size(), std::vector<PatientOutcome>(patients));
+        {
+            WorkStealingPool pool(threads);
+            for (int c = 0; c < pending.size(); c++) {
+                for (int i = 0; i < patients; i++) {
+                    pool.submit([this, c, i, &pending, &outcomes]() {
+                        outcomes[c][i] = PopulationRunner::simulate(population.patient(i), pending.at(c), warmUpStates[i], days);
+                    });
+                }
+            }
+            pool.waitForDone();
+        }
+
+        for (int c = 0; c < pending.size(); c++) {
+            ProfileCandidate candidate;
+            candidate.profile = pending[c];
+            for (const PatientOutcome &outcome : outcomes[c]) {
+                candidate.summary.add(outcome);
+            }
+            cache.insert(keyOf(pending[c]), candidate);
+        }
+        simulated += pending.size();
+    }
+
+    QList<ProfileCandidate> scored;
+    for (const Profile &profile : profiles) {
+        ProfileCandidate candidate = cache.value(keyOf(profile));
+        candidate.profile = profile;
+        scored.append(candidate);
+    }
+    return scored;
+}
+
+QList<ProfileCandidate> ProfileOptimizer::ranked() const {
+    QList<ProfileCandidate> candidates = cache.values();
+    rank(&candidates);
+    return candidates;
+}
+
+QList<ProfileCandidate> ProfileOptimizer::paretoSet() const {
+    QList<ProfileCandidate> front;
+    for (const ProfileCandidate &candidate : ranked()) {
+        if (candidate.rank > 0) {
+            break;
+        }
+        front.append(candidate);
+        front.last().profile.setName(QString("Optimized %1").arg(front.size()));
+    }
+    return front;
+}
+
+void ProfileOptimizer::rank(QList<ProfileCandidate> *candidates) {
+    // Peel off non-dominated fronts one after the other
+    QList<ProfileCandidate> remaining = *candidates;
+    candidates->clear();
+    for (int front = 0; !remaining.isEmpty(); front++) {
+        QList<ProfileCandidate> current, rest;
+        for (const ProfileCandidate &candidate : remaining) {
+            bool dominated = std::any_of(remaining.begin(), remaining.end(), [&candidate](const ProfileCandidate &other) {
+                return other.dominates(candidate);
+            });
+            (dominated ? rest : current).append(candidate);
+        }
+
+        std::sort(current.begin(), current.end(), [](const ProfileCandidate &a, const ProfileCandidate &b) {
+            if (a.summary.meanTimeInRange != b.summary.meanTimeInRange) {
+                return a.summary.meanTimeInRange > b.summary.meanTimeInRange;
+            }
+            Key keyA = keyOf(a.profile), keyB = keyOf(b.profile); // Stable order of equal scores
+            return std::lexicographical_compare(keyA.values, keyA.values + 4, keyB.values, keyB.values + 4);
+        });
+        for (ProfileCandidate &candidate : current) {
+            candidate.rank = front;
+            candidates->append(candidate);
+        }
+        remaining = rest;
+    }
+}
+
+int ProfileOptimizer::candidatesSimulated() const {
+    return simulated;
+}
+
+int ProfileOptimizer::cacheHits() const {
+    return hits;
+}
+
+ProfileOptimizer::Key ProfileOptimizer::keyOf(const Profile &profile) {
+    Key key;
+    key.values[0] = qRound64(profile.getBasalRate() / resolution);
+    key.values[1] = qRound64(profile.getCarbRatio() / resolution);
+    key.values[2] = qRound64(profile.getCorrectionFactor() / resolution);
+    key.values[3] = qRound64(profile.getTargetGlucose() / resolution);
+    return key;
+}
+
+void ProfileOptimizer::warmUpPatients() {
+    if (int(warmUpStates.size()) == patients) {
+        return;
+    }
+    warmUpStates.assign(patients, QByteArray());
+
+    WorkStealingPool pool(threads);
+    for (int i = 0; i < patients; i++) {
+        pool.submit([this, i]() {
+            warmUpStates[i] = PopulationRunner::warmUp(population.patient(i), warmUpProfile, warmUpStart, warmUpDays);
+        });
+    }
+    pool.waitForDone();
+}
+
+QList<Profile> ProfileOptimizer::grid(const ProfileSearchSpace &space, int stepsPerParameter) {
+    stepsPerParameter = qMax(1, stepsPerParameter);
+    auto value = [stepsPerParameter](const ParameterRange &range, int step) {
+        return stepsPerParameter == 1 ? (range.low + range.high) / 2
+                                      : range.low + (range.high - range.low) * step / (stepsPerParameter - 1);
+    };
+
+    QList<Profile> profiles;
+    for (int b = 0; b < stepsPerParameter; b++)
+        for (int c = 0; c < stepsPerParameter; c++)
+            for (int f = 0; f < stepsPerParameter; f++)
+                for (int t = 0; t < stepsPerParameter; t++)
+                    profiles.append(Profile("Candidate", value(space.basalRate, b), value(space.carbRatio, c),
+                                            value(space.correctionFactor, f), value(space.targetGlucose, t), 0));
+    return profiles;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file profileoptimizer.h
+ * @brief Defines the ProfileOptimizer class, which searches profile settings in parallel.
+ *
+ * A ProfileOptimizer scores candidate profiles (basal rate, carb ratio, correction factor
+ * and target glucose) by simulating a population of virtual patients with each of them
+ * on a WorkStealingPool, and returns the candidates no other candidate beats on both time
+ * in range and time below range (the Pareto set). Every patient is warmed up once with a
+ * reference profile; all candidates continue from the same warm-up checkpoints. Scores are
+ * cached, so repeated and overlapping searches only simulate new candidates.
+ */
+#ifndef PROFILEOPTIMIZER_H
+#define PROFILEOPTIMIZER_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <vector>
+#include "populationrunner.h"
+#include "profile.h"
+
+/**
+ * @brief Range searched for one profile parameter.
+ */
+struct ParameterRange {
+    double low;  ///< Smallest value searched.
+    double high; ///< Largest value searched.
+};
+
+/**
+ * @brief Ranges searched for each profile parameter.
+ */
+struct ProfileSearchSpace {
+    ParameterRange basalRate;        ///< Basal rate (units/hour).
+    ParameterRange carbRatio;        ///< Carb ratio.
+    ParameterRange correctionFactor; ///< Correction factor.
+    ParameterRange targetGlucose;    ///< Target glucose (mmol/L).
+
+    /**
+     * @brief Returns a search space from half to twice each parameter of a profile.
+     *
+     * The target glucose is searched from 5.0 to 8.0 mmol/L.
+     *
+     * @param profile Profile to search around.
+     */
+    static ProfileSearchSpace around(const Profile &profile);
+};
+
+/**
+ * @brief A scored candidate profile.
+ */
+struct ProfileCandidate {
+    Profile profile;           ///< Candidate settings.
+    PopulationSummary summary; ///< Outcomes of the population simulated with it.
+    int rank = 0;              ///< Pareto front the candidate is on (0 is the Pareto set).
+
+    /**
+     * @brief Returns true if this candidate is at least as good as another on time in range
+     * and time below range, and better on one of them.
+     * @param other Candidate to compare with.
+     */
+    bool dominates(const ProfileCandidate &other) const;
+};
+
+/**
+ * @class ProfileOptimizer
+ * @brief Grid and adaptive search of profile settings over a virtual population.
+ */
+class ProfileOptimizer
+{
+public:
+    /**
+     * @brief Constructs an optimizer over a population.
+     *
+     * Defaults: the search space around the default profile, one warm-up day with the
+     * default profile, two scored days from 2024-01-01 00:00 UTC and one thread per core.
+     *
+     * @param patients Number of virtual patients each candidate is simulated with.
+     * @param seed Population seed (see PopulationRunner).
+     */
+    ProfileOptimizer(int patients, quint64 seed);
+
+    void setSearchSpace(const ProfileSearchSpace &space);
+    ProfileSearchSpace getSearchSpace() const;
+
+    /**
+     * @brief Sets the days simulated with each candidate after the warm-up.
+     *
+     * Clears the cached scores.
+     *
+     * @param days Scored days.
+     */
+    void setDays(int days);
+
+    /**
+     * @brief Sets the shared warm-up every candidate continues from.
+     *
+     * Clears the warm-up checkpoints and the cached scores.
+     *
+     * @param profile Profile the patients are warmed up with.
+     * @param start Simulated start time of the warm-up.
+     * @param days Warm-up days.
+     */
+    void setWarmUp(const Profile &profile, const QDateTime &start, int days);
+
+    void setThreads(int threads);
+
+    /**
+     * @brief Scores every combination of evenly spaced values of each parameter.
+     * @param stepsPerParameter Values per parameter, including both ends of its range (at least 1).
+     * @return The ranked Pareto set of everything scored so far.
+     */
+    QList<ProfileCandidate> gridSearch(int stepsPerParameter);
+
+    /**
+     * @brief Scores a coarse grid, then repeatedly refines around the Pareto set.
+     *
+     * Each round scores the neighbours of every Pareto candidate one step away along each
+     * parameter, and halves the step for the next round.
+     *
+     * @param stepsPerParameter Values per parameter of the initial grid (at least 2).
+     * @param rounds Refinement rounds.
+     * @return The ranked Pareto set of everything scored so far.
+     */
+    QList<ProfileCandidate> adaptiveSearch(int stepsPerParameter, int rounds);
+
+    /**
+     * @brief Scores candidate profiles in parallel, reusing cached scores.
+     * @param profiles Candidates.
+     * @return The scored candidates, in the order given.
+     */
+    QList<ProfileCandidate> evaluate(const QList<Profile> &profiles);
+
+    /**
+     * @brief Returns every candidate scored so far, ranked by Pareto front.
+     *
+     * Within a front, candidates are ordered by time in range, highest first.
+     */
+    QList<ProfileCandidate> ranked() const;
+
+    /**
+     * @brief Returns the ranked Pareto set of everything scored so far.
+     *
+     * The candidates are named "Optimized 1", "Optimized 2", ... in rank order so they
+     * can be added to the profile store as they are.
+     */
+    QList<ProfileCandidate> paretoSet() const;
+
+    /**
+     * @brief Assigns each candidate its Pareto front (ProfileCandidate::rank).
+     * @param candidates Candidates to rank; ordered by front, then by time in range.
+     */
+    static void rank(QList<ProfileCandidate> *candidates);
+
+    int candidatesSimulated() const; ///< Candidates simulated (cache misses) since construction.
+    int cacheHits() const;           ///< Candidates answered from the cache since construction.
+
+private:
+    /**
+     * @brief Cache key of a candidate: its parameters rounded to the step resolution.
+     */
+    struct Key {
+        qint64 values[4];
+        bool operator==(const Key &other) const;
+    };
+    friend uint qHash(const Key &key, uint seed);
+
+    static Key keyOf(const Profile &profile);
+
+    /**
+     * @brief Warms up every patient whose checkpoint is missing.
+     */
+    void warmUpPatients();
+
+    /**
+     * @brief Returns the grid of a search space with a number of values per parameter.
+     */
+    static QList<Profile> grid(const ProfileSearchSpace &space, int stepsPerParameter);
+
+    int patients;
+    PopulationRunner population; ///< Generates the patients.
+    ProfileSearchSpace space;
+    int days;
+    Profile warmUpProfile;
+    QDateTime warmUpStart;
+    int warmUpDays;
+    int threads;
+
+    std::vector<QByteArray> warmUpStates; ///< Warm-up checkpoint of each patient.
+    QHash<Key, ProfileCandidate> cache;   ///< Scored candidates.
+    int simulated;
+    int hits;
+
+    static constexpr double resolution = 1e-4; ///< Parameters closer than this are the same candidate.
+};
+
+#endif // PROFILEOPTIMIZER_H
@@ -0,0 +1,308 @@
+#include "profilesensitivity.h"
+#include "controliqalgorithm.h"
+#include "dual.h"
+#include "glucosemodel.h"
+#include "insulinreserve.h"
+#include "simulationengine.h"
+#include "workstealingpool.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+enum Parameter { BasalRate, CarbRatio, CorrectionFactor, TargetGlucose, ParameterCount };
+
+using ProfileDual = Dual<ParameterCount>;
+
+// A profile parameter as an input of the duals
+template<typename T> T input(double value, Parameter parameter);
+
+template<> ProfileDual input<ProfileDual>(double value, Parameter parameter) {
+    return ProfileDual::variable(value, parameter);
+}
+
+Sensitivity sensitivityOf(const ProfileDual &metric) {
+    Sensitivity sensitivity;
+    sensitivity.value = metric.value();
+    sensitivity.basalRate = metric.derivative(BasalRate);
+    sensitivity.carbRatio = metric.derivative(CarbRatio);
+    sensitivity.correctionFactor = metric.derivative(CorrectionFactor);
+    sensitivity.targetGlucose = metric.derivative(TargetGlucose);
+    return sensitivity;
+}
+
+// Sums over one patient's run, as PopulationRunner's outcome tally
+template<typename T>
+struct Run {
+    int readings = 0;
+    T glucoseSum = 0;
+    T lowRiskSum = 0;
+    T highRiskSum = 0;
+    T insulinDelivered = 0;
+};
+
+// PopulationRunner::simulateBatch() for one patient with BatchEngine's state held in T:
+// the same steps, sensor samples, safety checks, threshold controller and refills, so
+// with double it reports the outcome simulateBatch() does
+template<typename T>
+Run<T> simulate(const VirtualPatient &patient, const Profile &profile, const QDateTime &start, int days,
+                bool mealBoluses, int stepMinutes) {
+    using GlucoseModel::maxOf;
+
+    const T basal = input<T>(profile.getBasalRate(), BasalRate);
+    const T carbRatio = input<T>(profile.getCarbRatio(), CarbRatio);
+    const T correctionFactor = input<T>(profile.getCorrectionFactor(), CorrectionFactor);
+    const T target = input<T>(profile.getTargetGlucose(), TargetGlucose);
+
+    // BatchEngine::setPatient() and setSensor()
+    const PatientParameters &parameters = patient.parameters;
+    SimRandom random = SimRandom(patient.seed).split(SimulationEngine::GlucoseDriftStream);
+    double driftVariance = (random.nextDouble() - 0.5) * parameters.volatility * 2;
+    SimRandom sensorRandom = SimRandom(patient.seed).split(SimulationEngine::SensorNoiseStream);
+    const SensorCoefficients sensor = SensorCoefficients::of(patient.sensor, SimulationEngine::sampleMinutes);
+
+    T glucose = parameters.startGlucose;
+    T iob = 0;
+    T reservoir = InsulinReserve::maxAmount;
+    T basalRate = 0;
+    T controllerRate = 0;
+    T bolusRemaining = 0;
+    double bolusRate = 0;
+    bool bolusSuspended = false;
+    bool sensorStarted = false;
+    bool sensorDropped = false;
+    T interstitial = 0;
+    T reading = parameters.startGlucose;
+    double sensorNoise = 0;
+    double sensorGain = 1;
+
+    struct StepMeal {
+        qint64 step;
+        double carbs;
+    };
+    QVector<StepMeal> stepMeals;
+    const qint64 stepMSecs = qint64(stepMinutes) * 60 * 1000;
+    for (const PopulationRunner::Meal &meal : PopulationRunner::meals(patient, start, days)) {
+        stepMeals.append({(start.msecsTo(meal.time) + stepMSecs - 1) / stepMSecs, meal.carbs}); // First step boundary at or after the meal
+    }
+    std::stable_sort(stepMeals.begin(), stepMeals.end(),
+                     [](const StepMeal &a, const StepMeal &b) { return a.step < b.step; });
+
+    Run<T> run;
+    T lastInsulin = reservoir;
+    const qint64 steps = start.msecsTo(start.addDays(days)) / stepMSecs;
+    const int stepsPerSample = SimulationEngine::sampleMinutes / stepMinutes;
+    const double hours = stepMinutes / 60.0;
+    int nextMeal = 0;
+    for (qint64 step = 0; step <= steps; step++) {
+        for (; nextMeal < stepMeals.size() && stepMeals[nextMeal].step == step; nextMeal++) {
+            double carbs = stepMeals[nextMeal].carbs;
+            if (mealBoluses && !bolusSuspended) {
+                // BolusCalculator::calculateBolus() on the last reading, then BatchEngine::deliverBolus()
+                T dose = GlucoseModel::carbBolus(carbs, carbRatio, correctionFactor)
+                       + GlucoseModel::correctionBolus(reading, target, correctionFactor);
+                if (dose > T(0)) {
+                    bolusRemaining = GlucoseModel::minOf(reservoir, dose);
+                    bolusRate = GlucoseModel::bolusRate;
+                }
+            }
+            glucose += carbRatio * carbs; // BatchEngine::intakeCarbs()
+        }
+
+        if (step > 0 && step % stepsPerSample == 0) {
+            // BatchEngine::sampleAndCheck()
+            driftVariance = (random.nextDouble() - 0.5) * parameters.volatility * 2;
+            if (!sensorStarted) {
+                interstitial = glucose;
+                sensorStarted = true;
+            }
+            double innovation = (sensor.noiseScale > 0) ? sensor.noiseScale * sensorRandom.nextGaussian() : 0.0;
+            if (sensor.dropoutStart > 0) {
+                sensorDropped = sensorRandom.nextDouble() < (sensorDropped ? 1 - sensor.dropoutEnd : sensor.dropoutStart);
+            }
+            interstitial = GlucoseModel::lagged(sensor.lagWeight, sensor.lagCarry, glucose, interstitial);
+            sensorNoise = sensor.noiseCarry * sensorNoise + innovation;
+            sensorGain += sensor.gainStep;
+            reading = sensorDropped ? T(-1) : GlucoseModel::sensorReading(interstitial, sensorGain, sensorNoise);
+            if (sensorDropped || reading < T(3.9)) {
+                bolusSuspended = true; // SimulationEngine::safetyChecks()
+                bolusRemaining = 0;
+            }
+
+            if (!sensorDropped) {
+                // ThresholdPolicy, with the rate in T
+                T rate = controllerRate;
+                switch (ControlIQAlgorithm::decide(valueOf(reading), valueOf(target), valueOf(basal), valueOf(controllerRate))) {
+                case ControlIQAlgorithm::SuspendForLow:
+                case ControlIQAlgorithm::SuspendForPredictedLow:
+                    rate = T(0);
+                    break;
+                case ControlIQAlgorithm::ResumeBasal:
+                case ControlIQAlgorithm::ApplyProfileRate:
+                    rate = basal;
+                    break;
+                case ControlIQAlgorithm::KeepRate:
+                    break;
+                }
+                if (rate != controllerRate) {
+                    controllerRate = basalRate = rate;
+                }
+
+                T low = maxOf(T(0), T(3.9) - reading);
+                T high = maxOf(T(0), reading - T(10.0));
+                run.readings++;
+                run.glucoseSum += reading;
+                run.lowRiskSum += low * low;
+                run.highRiskSum += high * high;
+            }
+            run.insulinDelivered += lastInsulin - reservoir;
+            lastInsulin = reservoir;
+
+            // Attentive user: refill as soon as the device asks for it
+            if (reservoir <= T(InsulinReserve::lowAmount)) {
+                reservoir = InsulinReserve::maxAmount;
+                lastInsulin = reservoir;
+            }
+        }
+
+        if (step < steps) {
+            // BatchEngine's scalar kernel
+            T absorbed = GlucoseModel::absorption(parameters.insulinUsageRate, iob, hours);
+            glucose += GlucoseModel::glucoseChange(parameters.increasePerHour, driftVariance,
+                                                   parameters.insulinUsageRate, iob, correctionFactor, hours);
+            iob = GlucoseModel::afterAbsorption(iob, absorbed);
+            if (bolusRemaining > T(0)) {
+                T delivered = GlucoseModel::bolusDelivered(bolusRemaining, bolusRate, hours);
+                bolusRemaining -= delivered;
+                iob += delivered;
+                reservoir = GlucoseModel::afterUse(reservoir, delivered);
+            }
+            T basalUnits = basalRate * hours;
+            iob += basalUnits;
+            reservoir = GlucoseModel::afterUse(reservoir, basalUnits);
+        }
+    }
+    return run;
+}
+
+}
+
+void Sensitivity::add(const Sensitivity &other, double weight) {
+    value += weight * other.value;
+    basalRate += weight * other.basalRate;
+    carbRatio += weight * other.carbRatio;
+    correctionFactor += weight * other.correctionFactor;
+    targetGlucose += weight * other.targetGlucose;
+}
+
+Sensitivity ProfileSensitivities::risk() const {
+    Sensitivity risk = highRisk;
+    risk.add(lowRisk, lowRiskWeight);
+    return risk;
+}
+
+ProfileSensitivity::ProfileSensitivity(int patients, quint64 seed)
+    : population(patients, seed)
+    , patients(patients)
+    , days(2)
+    , start(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC)
+    , threads(QThread::idealThreadCount())
+    , mealBoluses(false)
+{
+}
+
+void ProfileSensitivity::setDays(int days) {
+    this->days = days;
+}
+
+void ProfileSensitivity::setStart(const QDateTime &start) {
+    this->start = start;
+}
+
+void ProfileSensitivity::setThreads(int threads) {
+    this->threads = threads;
+}
+
+void ProfileSensitivity::setMealBoluses(bool enabled) {
+    mealBoluses = enabled;
+}
+
+ProfileSensitivities ProfileSensitivity::evaluate(const Profile &profile) const {
+    // Kept by patient and averaged in order, so results do not depend on the thread count
+    std::vector<ProfileSensitivities> results(patients);
+    {
+        WorkStealingPool pool(threads);
+        for (int i = 0; i < patients; i++) {
+            pool.submit([this, i, &profile, &results]() {
+                results[i] = evaluate(population.patient(i), profile, start, days, mealBoluses);
+            });
+        }
+        pool.waitForDone();
+    }
+
+    ProfileSensitivities mean;
+    for (const ProfileSensitivities &result : results) {
+        mean.readings += result.readings;
+        mean.meanGlucose.add(result.meanGlucose, 1.0 / patients);
+        mean.lowRisk.add(result.lowRisk, 1.0 / patients);
+        mean.highRisk.add(result.highRisk, 1.0 / patients);
+        mean.insulinDelivered.add(result.insulinDelivered, 1.0 / patients);
+    }
+    mean.patients = patients;
+    return mean;
+}
+
+Profile ProfileSensitivity::descend(const Profile &start, int iterations, double stepSize,
+                                    QList<QPair<Profile, ProfileSensitivities>> *trajectory) const {
+    Profile best = start;
+    ProfileSensitivities bestResult = evaluate(best);
+    if (trajectory) trajectory->append({best, bestResult});
+
+    for (int iteration = 1; iteration < iterations; iteration++) {
+        // Relative gradient: derivative by the parameter's logarithm
+        const Sensitivity risk = bestResult.risk();
+        double relative[ParameterCount] = {risk.basalRate * best.getBasalRate(), risk.carbRatio * best.getCarbRatio(),
+                                           risk.correctionFactor * best.getCorrectionFactor(),
+                                           risk.targetGlucose * best.getTargetGlucose()};
+        double largest = 0;
+        for (double derivative : relative) {
+            largest = std::max(largest, std::fabs(derivative));
+        }
+        if (largest == 0) {
+            break; // Flat: no direction to move in
+        }
+
+        Profile candidate = best;
+        double scale = stepSize / largest;
+        candidate.setBasalRate(best.getBasalRate() * std::exp(-scale * relative[BasalRate]));
+        candidate.setCarbRatio(best.getCarbRatio() * std::exp(-scale * relative[CarbRatio]));
+        candidate.setCorrectionFactor(best.getCorrectionFactor() * std::exp(-scale * relative[CorrectionFactor]));
+        candidate.setTargetGlucose(best.getTargetGlucose() * std::exp(-scale * relative[TargetGlucose]));
+
+        ProfileSensitivities result = evaluate(candidate);
+        if (result.risk().value < bestResult.risk().value) {
+            best = candidate;
+            bestResult = result;
+            if (trajectory) trajectory->append({best, bestResult});
+        } else {
+            stepSize /= 2;
+        }
+    }
+    return best;
+}
+
+ProfileSensitivities ProfileSensitivity::evaluate(const VirtualPatient &patient, const Profile &profile,
+                                                  const QDateTime &start, int days, bool mealBoluses) {
+    Run<ProfileDual> run = simulate<ProfileDual>(patient, profile, start, days, mealBoluses, stepMinutes);
+
+    int readings = std::max(1, run.readings);
+    ProfileSensitivities result;
+    result.patients = 1;
+    result.readings = run.readings;
+    result.meanGlucose = sensitivityOf(run.glucoseSum / double(readings));
+    result.lowRisk = sensitivityOf(run.lowRiskSum / double(readings));
+    result.highRisk = sensitivityOf(run.highRiskSum / double(readings));
+    result.insulinDelivered = sensitivityOf(run.insulinDelivered);
+    return result;
+}
@@ -0,0 +1,148 @@
+/**
+ * @file profilesensitivity.h
+ * @brief Defines the ProfileSensitivity class, which differentiates run outcomes by the profile.
+ *
+ * A ProfileSensitivity runs PopulationRunner's batched simulation over a virtual
+ * population with the model formulas (glucosemodel.h) instantiated for dual numbers
+ * (dual.h), so a single pass gives each outcome metric and its derivatives with respect
+ * to basal rate, carb ratio, correction factor and target glucose. Gradient descent on
+ * those derivatives costs one pass per step however many parameters are tuned, where a
+ * grid search grows exponentially with them.
+ *
+ * Time in range is a step function of glucose and has no useful derivative, so the
+ * metrics differentiated are smooth ones: mean glucose and the mean squared distance
+ * below and above the 3.9-10.0 mmol/L range.
+ */
+#ifndef PROFILESENSITIVITY_H
+#define PROFILESENSITIVITY_H
+
+#include <QDateTime>
+#include <QList>
+#include <QPair>
+#include "populationrunner.h"
+#include "profile.h"
+
+/**
+ * @brief An outcome metric and its derivatives with respect to the profile.
+ */
+struct Sensitivity {
+    double value = 0;            ///< Metric.
+    double basalRate = 0;        ///< Derivative by basal rate.
+    double carbRatio = 0;        ///< Derivative by carb ratio.
+    double correctionFactor = 0; ///< Derivative by correction factor.
+    double targetGlucose = 0;    ///< Derivative by target glucose.
+
+    /**
+     * @brief Adds another metric, scaled, to this one (value and derivatives).
+     * @param other Metric to add.
+     * @param weight Scale of @p other.
+     */
+    void add(const Sensitivity &other, double weight = 1);
+};
+
+/**
+ * @brief Differentiable outcome metrics of a run, averaged over patients.
+ */
+struct ProfileSensitivities {
+    int patients = 0;              ///< Patients averaged.
+    int readings = 0;              ///< Sensor readings over all patients.
+    Sensitivity meanGlucose;       ///< Mean sensor glucose (mmol/L).
+    Sensitivity lowRisk;           ///< Mean squared distance of the readings below 3.9 mmol/L.
+    Sensitivity highRisk;          ///< Mean squared distance of the readings above 10.0 mmol/L.
+    Sensitivity insulinDelivered;  ///< Insulin delivered per patient (units).
+
+    /**
+     * @brief Returns the objective ProfileSensitivity::descend() minimises.
+     *
+     * lowRiskWeight times the low risk plus the high risk: lows weigh more than highs.
+     */
+    Sensitivity risk() const;
+
+    static constexpr double lowRiskWeight = 10; ///< Weight of the low risk in risk().
+};
+
+/**
+ * @class ProfileSensitivity
+ * @brief Outcome metrics and their profile derivatives over a virtual population.
+ */
+class ProfileSensitivity
+{
+public:
+    /**
+     * @brief Constructs an analysis over a population.
+     *
+     * Defaults: two simulated days from 2024-01-01 00:00 UTC, no meal boluses and one
+     * thread per core.
+     *
+     * @param patients Number of virtual patients.
+     * @param seed Population seed (see PopulationRunner).
+     */
+    ProfileSensitivity(int patients, quint64 seed);
+
+    void setDays(int days);
+    void setStart(const QDateTime &start);
+    void setThreads(int threads);
+
+    /**
+     * @brief Gives each meal a bolus computed with the bolus calculator formulas.
+     *
+     * Without meal boluses (the default, as PopulationRunner) the target glucose only
+     * switches the controller and its derivatives are zero. As with any bolus, none is
+     * given once a low or a sensor dropout has suspended bolus delivery.
+     *
+     * @param enabled True to bolus for meals.
+     */
+    void setMealBoluses(bool enabled);
+
+    /**
+     * @brief Simulates the population with a profile and differentiates the outcome.
+     * @param profile Profile to evaluate.
+     * @return Population means of the metrics and their derivatives.
+     */
+    ProfileSensitivities evaluate(const Profile &profile) const;
+
+    /**
+     * @brief Tunes a profile by gradient descent on ProfileSensitivities::risk().
+     *
+     * Each iteration moves every parameter against its derivative, in proportion to
+     * the parameter, by at most @p stepSize of its value. Steps that do not lower the risk
+     * are retried at half the size.
+     *
+     * @param start Profile to start from.
+     * @param iterations Evaluations (each one population pass).
+     * @param stepSize Largest relative change of a parameter in one step (e.g. 0.2).
+     * @param trajectory Optional; receives the profile and risk of every accepted step.
+     * @return The profile with the lowest risk found.
+     */
+    Profile descend(const Profile &start, int iterations, double stepSize,
+                    QList<QPair<Profile, ProfileSensitivities>> *trajectory = nullptr) const;
+
+    /**
+     * @brief Simulates one patient with the templated model and differentiates the outcome.
+     *
+     * Runs PopulationRunner::simulateBatch()'s loop for the patient on the model formulas
+     * BatchEngine's scalar kernel uses (glucosemodel.h): the metric values are bit for bit
+     * those of the batch run, without a scenario and without meal boluses.
+     *
+     * @param patient Patient to simulate.
+     * @param profile Profile to simulate with.
+     * @param start Simulated start time.
+     * @param days Simulated days.
+     * @param mealBoluses True to bolus for meals.
+     * @return The patient's metrics and their derivatives.
+     */
+    static ProfileSensitivities evaluate(const VirtualPatient &patient, const Profile &profile,
+                                         const QDateTime &start, int days, bool mealBoluses);
+
+private:
+    PopulationRunner population; ///< Generates the patients.
+    int patients;
+    int days;
+    QDateTime start;
+    int threads;
+    bool mealBoluses;
+
+    static constexpr int stepMinutes = 1; ///< Integration step.
+};
+
+#endif // PROFILESENSITIVITY_H
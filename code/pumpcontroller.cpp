@@ -1,56 +1,123 @@
 #include "pumpcontroller.h"
+#include "glucosemodel.h"
+#include "simclock.h"
+#include <QDataStream>
+#include <algorithm>
 
 // Holds the current basal rate applied by ControlIQ algorithm
 // (If used externally) but here just resets to 0 by default.
 
-PumpController::PumpController(InsulinReserve *insulin, DataLogger *logger, QCheckBox *errorCheckBox, QObject *parent)
+PumpController::PumpController(InsulinReserve *insulin, DataLogger *logger, QObject *parent)
     : QObject(parent),
-      currentBasalRate(0.0),
-      activeBolusAmount(0.0),
-      activeBolusRate(0.0),
+      currentBasalRate(0),
       bolusSuspended(false),
       emergencyStopped(false),
-      insulinReserve(insulin),
-      logger(logger),
-      errorCheckBox(errorCheckBox)
+      occluded(false),
+      insulinReserve(insulin)
 {
-    // No additional setup needed
+    if (logger) {
+        auditLog = new DeliveryAuditLog;
+        auditor = DeliveryAuditor::of(logger);
+        auditor->attach(auditLog);
+    }
+}
+
+PumpController::~PumpController()
+{
+    if (auditor) {
+        auditor->detach(auditLog); // Logs the rest of the audit trail
+    }
+    delete auditLog;
 }
 
 void PumpController::deliverBolus(double amount, double rate, bool suppressTime)
+{
+    startPlan(DeliveryPlan::normal(amount, rate), suppressTime);
+}
+
+quint64 PumpController::startPlan(const DeliveryPlan &plan, bool suppressTime)
 {
     // Guard against unsafe conditions
     if (emergencyStopped || bolusSuspended) {
-        logger->logEvent("Error", "Bolus blocked due to unsafe condition.");
-        return;
+        audit(DeliveryRecord::BolusBlocked, static_cast<double>(plan.totalUnits()),
+              plan.pulses().isEmpty() ? 0 : plan.pulses().first().rate);
+        return 0;
     }
     // Determine how much insulin can actually be delivered
-    double delivered = std::min(insulinReserve->getInsulinRemaining(), amount);
-    activeBolusAmount = delivered;
-    activeBolusRate = rate;
+    DeliveryPlan limited = plan;
+    limited.limitTo(insulinReserve->getDoseRemaining());
+    if (plan.kind() == DeliveryPlan::Normal) { // A new normal bolus replaces the one in progress
+        pulses.erase(std::remove_if(pulses.begin(), pulses.end(),
+                                    [](const RunningPulse &pulse) { return pulse.kind == DeliveryPlan::Normal; }),
+                     pulses.end());
+    }
+
+    quint64 id = nextPlanId++;
+    for (const DeliveryPulse &pulse : limited.pulses()) {
+        RunningPulse running = {id, plan.kind(), qRound64(pulse.startHours * 3600000), pulse.units, DoseValue(pulse.rate)};
+        auto later = std::upper_bound(pulses.begin(), pulses.end(), running,
+                                      [](const RunningPulse &a, const RunningPulse &b) { return a.startsIn < b.startsIn; });
+        pulses.insert(later, running);
+    }
     suppressTimeUpdate = suppressTime;
-    // Log the delivered bolus initiation
-    logger->logEvent("Info", "Delivered " + QString::number(delivered) + " units at rate " + QString::number(rate));
+
+    double delivered = static_cast<double>(limited.totalUnits());
+    double rate = limited.pulses().isEmpty() ? 0 : limited.pulses().first().rate;
+    static const DeliveryRecord::Kind started[] = { // Indexed by DeliveryPlan::Kind
+                                                   DeliveryRecord::BolusStarted, DeliveryRecord::ExtendedStarted,
+                                                   DeliveryRecord::DualWaveStarted, DeliveryRecord::SplitStarted};
+    audit(started[plan.kind()], delivered, rate, limited.pulses().size(), limited.durationHours());
+    emit bolusDeliveryStarted(delivered, rate);
+    return id;
+}
+
+void PumpController::cancelPlan(quint64 id)
+{
+    DoseValue cancelled(0);
+    for (const RunningPulse &pulse : pulses) {
+        if (pulse.plan == id) {
+            cancelled += pulse.remaining;
+        }
+    }
+    if (cancelled > DoseValue(0)) {
+        audit(DeliveryRecord::PlanCancelled, static_cast<double>(cancelled));
+    }
+    pulses.erase(std::remove_if(pulses.begin(), pulses.end(), [id](const RunningPulse &pulse) { return pulse.plan == id; }),
+                 pulses.end());
+}
+
+int PumpController::activePlans() const
+{
+    QVector<quint64> plans;
+    for (const RunningPulse &pulse : pulses) {
+        if (!plans.contains(pulse.plan)) {
+            plans.append(pulse.plan);
+        }
+    }
+    return plans.size();
 }
 
 void PumpController::adjustBasalRate(double rate)
 {// Updates basal rate without immediate insulin injection.
-    currentBasalRate = rate;
+    currentBasalRate = DoseValue(rate);
 }
 
 void PumpController::suspendBolus() // Cancels any ongoing bolus, emits cancellation, and logs warning.
 {
     bolusSuspended = true;
-    emit bolusCancelled(activeBolusAmount);
-    logger-> logEvent("Warning", QString("Bolus cancelled with %1 units remaining to deliver").arg(activeBolusAmount, 0, 'f', 2));
-    activeBolusAmount= 0;
+    double remaining = static_cast<double>(bolusRemaining());
+    emit bolusCancelled(remaining);
+    audit(DeliveryRecord::BolusCancelled, remaining);
+    pulses.erase(std::remove_if(pulses.begin(), pulses.end(), [](const RunningPulse &pulse) { return pulse.startsIn <= 0; }),
+                 pulses.end());
+    emit bolusTimeRemainingUpdated(0); // The countdown stops until delivery resumes
 }
 
 void PumpController::resumeBolus()// Resumes bolus delivery if no emergency is present.
 {
     if (!emergencyStopped) {
         bolusSuspended = false;
-        logger->logEvent("Info", "Bolus delivery resumed.");
+        audit(DeliveryRecord::BolusResumed);
     }
 }
 
@@ -64,13 +131,99 @@ int PumpController::checkDeviceStatus() // Returns pump status: 0=OK, 1=Suspende
 void PumpController::triggerEmergencyStop() // Immediately stops all insulin delivery and logs the event.
 {
     emergencyStopped = true;
-    logger->logEvent("Warning", "Emergency stop activated.");
+    audit(DeliveryRecord::EmergencyStop);
+}
+
+void PumpController::setOccluded(bool occluded) // Simulated hardware occlusion, polled by pump().
+{
+    this->occluded = occluded;
 }
 
-void PumpController::pump(Bloodstream *blood) // Called on each simulation tick to deliver basal and bolus insulin.
+bool PumpController::isOccluded() const
 {
-    // Update emergency state from hardware error checkbox
-    emergencyStopped = errorCheckBox->isChecked();
+    return occluded;
+}
+
+void PumpController::setClock(SimClock *clock)
+{
+    this->clock = clock;
+}
+
+void PumpController::audit(DeliveryRecord::Kind kind, double units, double rate, int pulses, double hours, qint64 msecs)
+{
+    if (auditLog && auditor) {
+        if (msecs < 0) {
+            msecs = clock ? clock->nowMSecs() : QDateTime::currentMSecsSinceEpoch();
+        }
+        auditLog->record({msecs, kind, pulses, units, rate, hours, insulinReserve->getInsulinRemaining()});
+    }
+}
+
+double PumpController::getDeliveryRate() const
+{
+    if (occluded) {
+        return 0;
+    }
+    DoseValue bolusRate(0);
+    if (!bolusSuspended) {
+        for (const RunningPulse &pulse : pulses) {
+            if (pulse.startsIn <= 0) {
+                bolusRate += pulse.rate;
+            }
+        }
+    }
+    return static_cast<double>(currentBasalRate + bolusRate);
+}
+
+double PumpController::hoursUntilBolusComplete() const
+{
+    double hours = 0;
+    if (!bolusSuspended) {
+        for (const RunningPulse &pulse : pulses) {
+            hours = std::max(hours, pulse.startsIn / 3600000.0 + static_cast<double>(pulse.remaining) / static_cast<double>(pulse.rate));
+        }
+    }
+    return hours;
+}
+
+double PumpController::hoursUntilDeliveryChange() const
+{
+    double hours = 0;
+    if (!bolusSuspended) {
+        for (const RunningPulse &pulse : pulses) {
+            double change = pulse.startsIn > 0 ? pulse.startsIn / 3600000.0
+                                               : static_cast<double>(pulse.remaining) / static_cast<double>(pulse.rate);
+            hours = hours > 0 ? std::min(hours, change) : change;
+        }
+    }
+    return hours;
+}
+
+double PumpController::hoursUntilNextPulse() const
+{
+    for (const RunningPulse &pulse : pulses) { // Start order, so the first waiting pulse is the next one
+        if (pulse.startsIn > 0) {
+            return bolusSuspended ? 0 : pulse.startsIn / 3600000.0;
+        }
+    }
+    return 0;
+}
+
+DoseValue PumpController::bolusRemaining() const
+{
+    DoseValue remaining(0);
+    for (const RunningPulse &pulse : pulses) {
+        if (pulse.startsIn <= 0) {
+            remaining += pulse.remaining;
+        }
+    }
+    return remaining;
+}
+
+void PumpController::pump(Bloodstream *blood, qint64 elapsedMSecs, qint64 startMSecs) // Called on each simulation tick to deliver basal and bolus insulin.
+{
+    // Update emergency state from the simulated occlusion
+    emergencyStopped = occluded;
 
     // only pump if delivery is active + not blocked
     if (emergencyStopped) {
@@ -78,17 +231,89 @@ void PumpController::pump(Bloodstream *blood) // Called on each simulation tick
         return;
     }
 
-    if (not (bolusSuspended || activeBolusAmount <= 0)) { // If a bolus is active and not suspended, deliver a fraction this tick
-        double unitsPerTick = activeBolusRate / 12.0; // Calculate insulin units delivered per 5-minute tick
-        double deliveredThisTick = (activeBolusAmount < unitsPerTick) ? activeBolusAmount : unitsPerTick;
-        activeBolusAmount -= deliveredThisTick;
+    if (not (bolusSuspended || pulses.isEmpty())) { // If a bolus is active and not suspended, deliver a fraction this tick
+        bool pulseStarted = false;
+        DoseValue remaining(0);
+        qint64 untilNext = 0; // Start order, so the first pulse still waiting is the next one
+        for (int i = 0; i < pulses.size();) {
+            RunningPulse &pulse = pulses[i];
+            qint64 msecs = elapsedMSecs;
+            if (pulse.startsIn > 0) {
+                if (pulse.startsIn > elapsedMSecs) { // Not due yet
+                    pulse.startsIn -= elapsedMSecs;
+                    if (untilNext == 0) untilNext = pulse.startsIn;
+                    remaining += pulse.remaining;
+                    i++;
+                    continue;
+                }
+                qint64 startedAt = startMSecs < 0 ? -1 : startMSecs + pulse.startsIn;
+                msecs -= pulse.startsIn; // Due during this tick
+                pulse.startsIn = 0;
+                pulseStarted = true;
+                audit(DeliveryRecord::DelayedPulseStarted, static_cast<double>(pulse.remaining), static_cast<double>(pulse.rate),
+                      0, 0, startedAt);
+            }
 
-        emit bolusDeliveryProgress(activeBolusAmount); // Notify UI
+            DoseValue deliveredThisTick = GlucoseModel::bolusDelivered(pulse.remaining, pulse.rate, msecs); // Insulin units delivered during this tick
+            pulse.remaining -= deliveredThisTick;
+            blood->injectUnits(static_cast<double>(deliveredThisTick)); // Inject bolus units into bloodstream and deduct from reserve
+            insulinReserve->useDose(deliveredThisTick);
+            if (pulse.remaining <= DoseValue(0)) {
+                pulses.removeAt(i);
+            } else {
+                remaining += pulse.remaining;
+                i++;
+            }
+        }
 
-        blood->injectUnits(deliveredThisTick); // Inject bolus units into bloodstream and deduct from reserve
-        insulinReserve->useInsulin(deliveredThisTick);
+        emit bolusDeliveryProgress(static_cast<double>(remaining)); // Notify UI
+        if (untilNext > 0 || pulseStarted) {
+            emit bolusTimeRemainingUpdated(untilNext / 1000.0);
+        }
+    }
+    // Basal delivery: inject steady rate each tick, rounded once so the bloodstream and the reserve agree
+    DoseValue basalThisTick = unitsOver(currentBasalRate, elapsedMSecs);
+    blood->injectUnits(static_cast<double>(basalThisTick));
+    insulinReserve->useDose(basalThisTick);
+}
+
+void PumpController::saveState(QDataStream &out) const
+{
+    out << static_cast<double>(currentBasalRate) << nextPlanId << qint32(pulses.size());
+    for (const RunningPulse &pulse : pulses) { // Hours and double units, as before
+        out << pulse.plan << qint32(pulse.kind) << pulse.startsIn / 3600000.0 << static_cast<double>(pulse.remaining)
+            << static_cast<double>(pulse.rate);
+    }
+    out << bolusSuspended << emergencyStopped << suppressTimeUpdate << occluded;
+}
+
+void PumpController::restoreState(QDataStream &in, int formatVersion)
+{
+    pulses.clear();
+    if (formatVersion < 11) {
+        double basalRate = 0, bolusAmount = 0, bolusRate = 0;
+        in >> basalRate >> bolusAmount >> bolusRate;
+        currentBasalRate = DoseValue(basalRate);
+        nextPlanId = 2;
+        if (bolusAmount > 0 && bolusRate > 0) { // The single bolus becomes a normal plan
+            pulses.append({1, DeliveryPlan::Normal, 0, DoseValue(bolusAmount), DoseValue(bolusRate)});
+        }
+    } else {
+        qint32 count = 0;
+        double basalRate = 0;
+        in >> basalRate >> nextPlanId >> count;
+        currentBasalRate = DoseValue(basalRate);
+        for (qint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+            RunningPulse pulse;
+            qint32 kind = 0;
+            double startsIn = 0, remaining = 0, rate = 0;
+            in >> pulse.plan >> kind >> startsIn >> remaining >> rate;
+            pulse.kind = DeliveryPlan::Kind(kind);
+            pulse.startsIn = qRound64(startsIn * 3600000);
+            pulse.remaining = DoseValue(remaining);
+            pulse.rate = DoseValue(rate);
+            pulses.append(pulse);
+        }
     }
-    // Basal delivery: inject steady rate each tick
-    blood->injectUnits(currentBasalRate/12);
-    insulinReserve->useInsulin(currentBasalRate/12);
+    in >> bolusSuspended >> emergencyStopped >> suppressTimeUpdate >> occluded;
 }
@@ -4,16 +4,23 @@
  *
  * The PumpController manages both basal and bolus insulin injections over time,
  * enforces safety through suspension and emergency stop mechanisms,
- * and emits status signals for UI updates.
+ * and emits status signals for UI updates. Boluses are delivered as DeliveryPlans,
+ * several of which may run at once.
  */
 #ifndef PUMPCONTROLLER_H
 #define PUMPCONTROLLER_H
 
+#include "deliveryplan.h"
+#include "fixedpoint.h"
 #include "insulinreserve.h"
 #include "datalogger.h"
+#include "deliveryaudit.h"
 #include "bloodstream.h"
 #include <QObject>
-#include <QCheckBox>
+#include <QPointer>
+
+class QDataStream;
+class SimClock;
 
 /**
  * @class PumpController
@@ -28,19 +35,43 @@ public:
 /**
      *  @brief Constructs a PumpController.
      *  @param insulin Pointer to shared InsulinReserve object.
-     *  @param logger Pointer to shared DataLogger for event logging.
-     *  @param iob Pointer to IOBTracker to track insulin on board.
-     *  @param errorCheckBox UI checkbox used to signal occlusion/emergency.
+     *  @param logger Pointer to shared DataLogger that receives the delivery audit trail.
      * @param parent Parent QObject.
      */
-    explicit PumpController(InsulinReserve *insulin, DataLogger *logger, QCheckBox *errorCheckBox, QObject *parent = nullptr);
+    explicit PumpController(InsulinReserve *insulin, DataLogger *logger, QObject *parent = nullptr);
+    ~PumpController();
 /**
      * @brief Initiates a bolus delivery.
+     *
+     * Starts DeliveryPlan::normal(); a normal bolus replaces a normal bolus still being
+     * delivered, while extended, dual-wave and split plans keep running alongside it.
      * @param amount Amount of insulin units to deliver.
      * @param rate   Delivery rate in units per hour.
      * @param suppressTime If true, suppress time updates during delivery.
  */
     void deliverBolus(double amount, double rate, bool suppressTime = false);
+
+    /**
+     * @brief Starts delivering a compiled bolus.
+     *
+     * The plan is capped at the insulin left in the reservoir and then runs alongside any
+     * other plan, without further calls, until it is complete or cancelled.
+     * @param plan Bolus compiled into pulses.
+     * @param suppressTime If true, suppress time updates during delivery.
+     * @return Plan id, for cancelPlan(); 0 if delivery is blocked.
+     */
+    quint64 startPlan(const DeliveryPlan &plan, bool suppressTime = false);
+
+    /**
+     * @brief Stops a plan; the units it has delivered stay delivered.
+     * @param id Plan id returned by startPlan().
+     */
+    void cancelPlan(quint64 id);
+
+    /**
+     * @brief Returns how many plans have pulses left to deliver.
+     */
+    int activePlans() const;
     
     /**
      * @brief Adjusts basal rate insulin delivery.
@@ -50,7 +81,8 @@ public:
     
     /**
      *  @brief Suspends the current bolus delivery.
-     * Emits a cancellation signal.
+     * Emits a cancellation signal. The pulses being delivered are cancelled; delayed pulses
+     * (e.g. the second part of a split bolus) are kept and wait until delivery resumes.
      */
     void suspendBolus();
     
@@ -69,12 +101,70 @@ public:
      * @brief Activates an emergency stop, halting all insulin delivery.
      */
     void triggerEmergencyStop(); //activates an emergency stop, halting all insulin delivery
+
+    /**
+     * @brief Simulates an occlusion; the pump halts on the next tick while it is set.
+     * @param occluded True to simulate an occlusion, false to clear it.
+     */
+    void setOccluded(bool occluded);
+
+    /**
+     * @brief Checks whether an occlusion is currently being simulated.
+     * @return True if the pump is occluded.
+     */
+    bool isOccluded() const;
+
+    /**
+     * @brief Sets the clock used to timestamp delivery audit records.
+     * @param clock Simulation clock, or nullptr to use the wall-clock time.
+     */
+    void setClock(SimClock *clock);
     
+    /**
+     * @brief Returns the rate insulin is currently being delivered at.
+     * @return Basal plus active bolus rate in units per hour, or 0 while occluded.
+     */
+    double getDeliveryRate() const;
+
+    /**
+     * @brief Returns how long the active plans will take to finish, delayed pulses included.
+     * @return Remaining delivery time in hours, or 0 if no bolus is being delivered.
+     */
+    double hoursUntilBolusComplete() const;
+
+    /**
+     * @brief Returns the time until a pulse starts or finishes, when the delivery rate changes.
+     * @return Hours, or 0 if no bolus is being delivered.
+     */
+    double hoursUntilDeliveryChange() const;
+
+    /**
+     * @brief Returns the time until the next delayed pulse (e.g. the second part of a split bolus) starts.
+     * @return Hours, or 0 if no pulse is waiting.
+     */
+    double hoursUntilNextPulse() const;
+
     /**
      * @brief Simulation loop or single "tick" of pump operation.
      * @param blood Pointer to Bloodstream where insulin is delivered.
+     * @param elapsedMSecs Simulated time since the previous delivery, in milliseconds.
+     * @param startMSecs Simulated time the step starts at (ms since epoch), used to timestamp
+     *        pulses starting within it; -1 to use the clock.
+     */
+    void pump(Bloodstream *blood, qint64 elapsedMSecs, qint64 startMSecs = -1); //simulation loop or single "tick"
+
+    /**
+     * @brief Writes the basal rate, running pulses and pump flags to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the pump state written by saveState(), without emitting any signal.
+     * @param in Checkpoint stream.
+     * @param formatVersion Checkpoint format (below 11 the pump held a single bolus).
      */
-    void pump(Bloodstream *blood); //simulation loop or single "tick"
+    void restoreState(QDataStream &in, int formatVersion);
 
 signals:
     /**
@@ -84,8 +174,8 @@ signals:
       void bolusDeliveryProgress(double remainingBolus); //Emitted during bolus delivery to report remaining units.
       
     /**
-     * @brief Updates estimated time remaining for bolus.
-     * @param timeRemaining Estimated time remaining.
+     * @brief Updates the time until the next delayed pulse starts, on each tick while one is waiting.
+     * @param timeRemaining Seconds remaining; 0 once it has started or was cancelled.
      */  
       void bolusTimeRemainingUpdated(double timeRemaining); //update estimated time remaining for bolus
       
@@ -95,20 +185,57 @@ signals:
      */ 
       void bolusCancelled(double amountDelivered); //when a bolus delivery is cancelled.
 
+    /**
+     * @brief Emitted when a bolus starts delivering.
+     * @param units Insulin units to deliver.
+     * @param rate Delivery rate in units per hour.
+     */
+      void bolusDeliveryStarted(double units, double rate);
+
 private:
-    double currentBasalRate; ///< Current basal delivery rate (units/hour).
-    double activeBolusAmount; ///< Active bolus amount remaining (units).
-    double activeBolusRate; ///< Active bolus delivery rate (units/hour).
+    /**
+     * @brief A pulse of a running plan.
+     */
+    struct RunningPulse {
+        quint64 plan;            ///< Id of the plan it belongs to.
+        DeliveryPlan::Kind kind; ///< Kind of the plan.
+        qint64 startsIn;         ///< Milliseconds until it starts; 0 once it is delivering.
+        DoseValue remaining;     ///< Units left to deliver.
+        DoseValue rate;          ///< Delivery rate (units/hour).
+    };
+
+    DoseValue currentBasalRate; ///< Current basal delivery rate (units/hour).
+    QVector<RunningPulse> pulses; ///< Pulses of the running plans, in start order.
+    quint64 nextPlanId = 1; ///< Id of the next plan started.
     bool bolusSuspended; ///< True if bolus delivery is suspended.
     bool emergencyStopped; ///< True if emergency stop is active.
     bool suppressTimeUpdate = false; ///< True if time updates are suppressed.
+    bool occluded; ///< Simulated occlusion (set by the GUI or a headless driver).
  
     InsulinReserve *insulinReserve; ///< Shared insulin reserve.
-    DataLogger *logger; ///< Shared event logger.
-    QCheckBox *errorCheckBox; ///< UI checkbox for error/emergency.
+    DeliveryAuditLog *auditLog = nullptr; ///< Delivery audit trail (nullptr for silent runs).
+    QPointer<DeliveryAuditor> auditor; ///< The logger's auditor; gone once the logger is.
+    SimClock *clock = nullptr; ///< Source of audit timestamps (wall clock if nullptr).
 
     bool isSafeToDeliver(); //checks if conditions are safe for insulin delivery. true if safe
                             //false otherwise
+
+    /**
+     * @brief Returns the units the pulses being delivered have left (delayed pulses excluded).
+     */
+    DoseValue bolusRemaining() const;
+
+    /**
+     * @brief Records a delivery action in the audit trail; allocates nothing.
+     * @param kind Action.
+     * @param units Insulin units of the action.
+     * @param rate Delivery rate (units/hour).
+     * @param pulses Pulses of a started plan.
+     * @param hours Duration of a started plan (hours).
+     * @param msecs Simulated time of the action (ms since epoch), or -1 for the clock's time.
+     */
+    void audit(DeliveryRecord::Kind kind, double units = 0, double rate = 0, int pulses = 0, double hours = 0,
+               qint64 msecs = -1);
 };
 
 #endif // PUMPCONTROLLER_H
@@ -0,0 +1,76 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <cstdio>
+#include "replayengine.h"
+
+// Replay runner.
+// Feeds the glucose trace recorded in a DataLogger store (data/logs.json by default)
+// through the current controller and lists every decision that differs from the one
+// recorded. Exits with status 1 when the decisions differ, so it can gate controller
+// changes against a library of recorded sessions.
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("replay");
+
+    Profile defaults = Profile::defaultProfile();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays a recorded session and diffs the controller's decisions.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("log", "Recorded logs.json (default ./data/logs.json).", "[log]");
+    parser.addOption({"basal", "Profile basal rate of the recorded session (units/hour).", "rate", QString::number(defaults.getBasalRate())});
+    parser.addOption({"carb-ratio", "Profile carb ratio.", "ratio", QString::number(defaults.getCarbRatio())});
+    parser.addOption({"correction", "Profile correction factor.", "factor", QString::number(defaults.getCorrectionFactor())});
+    parser.addOption({"target", "Profile target glucose (mmol/L).", "glucose", QString::number(defaults.getTargetGlucose())});
+    parser.addOption({"replayed-log", "Write everything the replay logged to a logs.json file.", "path"});
+    parser.process(app);
+
+    QStringList positional = parser.positionalArguments();
+    if (positional.size() > 1) {
+        fprintf(stderr, "Expected at most one recorded log\n");
+        return 1;
+    }
+    QString path = positional.isEmpty() ? QStringLiteral("./data/logs.json") : positional.first();
+
+    LogData recording;
+    QString error;
+    if (!ReplayEngine::loadRecording(path, &recording, &error)) {
+        fprintf(stderr, "%s\n", qPrintable(error));
+        return 1;
+    }
+
+    ReplayEngine engine;
+    engine.setProfile(Profile("Replay", parser.value("basal").toDouble(), parser.value("carb-ratio").toDouble(),
+                              parser.value("correction").toDouble(), parser.value("target").toDouble(), 1));
+
+    QElapsedTimer timer;
+    timer.start();
+    ReplayReport report = engine.replay(recording);
+    double wall = timer.nsecsElapsed() / 1e9;
+
+    printf("Readings replayed:  %d in %.3f s\n", report.readings, wall);
+    printf("Recorded decisions: %d\n", report.recordedDecisions);
+    printf("Replayed decisions: %d\n", report.replayedDecisions);
+    printf("Matched decisions:  %d\n", report.matchedDecisions);
+    for (const ReplayDifference &difference : report.differences) {
+        printf("%c %s  %-12s %s\n", difference.kind == ReplayDifference::Added ? '+' : '-',
+               qPrintable(difference.decision.timestamp.toString(Qt::ISODate)),
+               qPrintable(difference.decision.eventType), qPrintable(difference.decision.description));
+    }
+    printf("%s\n", report.identical() ? "Decisions identical" : "Decisions differ");
+
+    if (parser.isSet("replayed-log")) {
+        QFile file(parser.value("replayed-log"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            fprintf(stderr, "Could not open %s for writing\n", qPrintable(parser.value("replayed-log")));
+            return 1;
+        }
+        file.write(QJsonDocument(engine.getReplayedLog().toJson()).toJson());
+    }
+    return report.identical() ? 0 : 1;
+}
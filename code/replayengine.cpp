@@ -0,0 +1,165 @@
+#include "replayengine.h"
+#include "simulationengine.h"
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QMap>
+#include <algorithm>
+
+namespace {
+// Start of every message ControlIQAlgorithm, PumpController's safety logic and AlertMonitor log
+const char *const decisionPrefixes[] = {
+    "Low glucose detected.",
+    "Predicted low glucose",
+    "MPC",
+    "Glucose stable.",
+    "Profile basal rate set manually",
+    "Bolus cancelled with",
+    "Emergency stop activated.",
+    "Low Battery",
+    "Low Insulin",
+    "CGM disconnected",
+    "Pump occluded",
+    "Glucose went below",
+    "Glucose went above",
+    "Glucose predicted to go below",
+};
+
+// Log timestamps are stored with second precision
+qint64 secondOf(const QDateTime &time) {
+    return time.toMSecsSinceEpoch() / 1000;
+}
+}
+
+ReplayEngine::ReplayEngine()
+    : profile(Profile::defaultProfile())
+{
+}
+
+void ReplayEngine::setProfile(const Profile &profile) {
+    this->profile = profile;
+}
+
+bool ReplayEngine::loadRecording(const QString &path, LogData *recording, QString *error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = "Could not open " + path;
+        return false;
+    }
+
+    QJsonParseError parseError;
+    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+    if (!doc.isObject()) {
+        if (error) *error = path + " is not a log file: " + parseError.errorString();
+        return false;
+    }
+
+    *recording = LogData::fromJson(doc.object());
+    return true;
+}
+
+ReplayReport ReplayEngine::replay(const LogData &recording) {
+    ReplayReport report;
+    replayedLog = LogData();
+
+    QList<GlucoseLogEntry> readings = recording.glucoseLog;
+    std::stable_sort(readings.begin(), readings.end(), [](const GlucoseLogEntry &a, const GlucoseLogEntry &b) {
+        return a.timestamp < b.timestamp;
+    });
+    if (readings.isEmpty()) {
+        return report;
+    }
+    const QDateTime first = readings.first().timestamp;
+    const QDateTime last = readings.last().timestamp;
+
+    DataLogger logger;
+    logger.setDeferredWrites(true); // Kept in memory, never saved over the real logs
+    {
+        SimulationEngine engine(&logger);
+        logger.setClock(engine.getClock());
+        engine.setSeed(0);
+        engine.setTime(first);
+        engine.setProfile(profile);
+        engine.setReplayMode(true);
+        engine.setMonitoring(true);
+
+        QHash<qint64, double> recordedIOB; // Logged with every reading
+        for (const InsulinLogEntry &entry : recording.insulinLog) {
+            recordedIOB.insert(entry.timestamp.toMSecsSinceEpoch(), entry.dose);
+        }
+        for (const GlucoseLogEntry &reading : readings) {
+            engine.scheduleRecordedReading(reading.timestamp, reading.glucose,
+                                           recordedIOB.value(reading.timestamp.toMSecsSinceEpoch(), -1));
+        }
+
+        QObject::connect(&engine, &SimulationEngine::sampled, [&engine]() {
+            // Attentive user: charge and refill as soon as the device asks for it
+            if (engine.getBattery()->isBatteryCritical()) {
+                engine.getBattery()->chargeBattery();
+                engine.getAlerts()->reset(AlertMonitor::BATTERY_LOW);
+            }
+            if (engine.getInsulinReserve()->isInsulinLow()) {
+                engine.getInsulinReserve()->refillInsulin();
+                engine.getAlerts()->reset(AlertMonitor::INSULIN_LOW);
+            }
+        });
+
+        engine.runUntil(last);
+        logger.setClock(nullptr);
+    }
+    report.readings = readings.size();
+    replayedLog.logs = logger.retrieveHistory();
+    replayedLog.glucoseLog = logger.retrieveGlucoseLog();
+    replayedLog.insulinLog = logger.retrieveInsulinLog();
+
+    // Decisions of both sides by the second they were logged in
+    QMap<qint64, QList<LogEntry>> recorded, replayed;
+    for (const LogEntry &entry : recording.logs) {
+        if (isDecision(entry) && entry.timestamp >= first && secondOf(entry.timestamp) <= secondOf(last)) {
+            recorded[secondOf(entry.timestamp)].append(entry);
+            report.recordedDecisions++;
+        }
+    }
+    for (const LogEntry &entry : replayedLog.logs) {
+        if (isDecision(entry)) {
+            replayed[secondOf(entry.timestamp)].append(entry);
+            report.replayedDecisions++;
+        }
+    }
+
+    for (qint64 second : replayed.keys()) {
+        recorded[second]; // Visit every second either side logged in, in time order
+    }
+
+    for (qint64 second : recorded.keys()) {
+        QList<LogEntry> unmatched = replayed.value(second);
+        for (const LogEntry &entry : recorded.value(second)) {
+            auto match = std::find_if(unmatched.begin(), unmatched.end(), [&entry](const LogEntry &candidate) {
+                return candidate.eventType == entry.eventType && candidate.description == entry.description;
+            });
+            if (match != unmatched.end()) {
+                unmatched.erase(match);
+                report.matchedDecisions++;
+            } else {
+                report.differences.append({ReplayDifference::Removed, entry});
+            }
+        }
+        for (const LogEntry &entry : unmatched) {
+            report.differences.append({ReplayDifference::Added, entry});
+        }
+    }
+    return report;
+}
+
+const LogData &ReplayEngine::getReplayedLog() const {
+    return replayedLog;
+}
+
+bool ReplayEngine::isDecision(const LogEntry &entry) {
+    for (const char *prefix : decisionPrefixes) {
+        if (entry.description.startsWith(prefix)) {
+            return true;
+        }
+    }
+    return false;
+}
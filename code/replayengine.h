@@ -0,0 +1,115 @@
+/**
+ * @file replayengine.h
+ * @brief Defines the ReplayEngine class, which replays recorded sessions through the controller.
+ *
+ * A ReplayEngine takes a DataLogger store (e.g. data/logs.json), feeds its recorded
+ * glucose trace to a SimulationEngine in replay mode as fast as it can, and compares the
+ * decisions the current Control-IQ, pump safety logic and alerting make against the
+ * decisions recorded in the same log. Controller changes can then be regression-tested
+ * against weeks of sessions in seconds.
+ */
+#ifndef REPLAYENGINE_H
+#define REPLAYENGINE_H
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include "datalogger.h"
+#include "profile.h"
+
+/**
+ * @brief A decision that appears on only one side of a replay.
+ */
+struct ReplayDifference {
+    /**
+     * @brief Side the decision appears on.
+     */
+    enum Kind {
+        Added,  ///< Made by the replay but not recorded.
+        Removed ///< Recorded but not made by the replay.
+    };
+
+    Kind kind;
+    LogEntry decision; ///< The decision as logged.
+};
+
+/**
+ * @brief Result of replaying one recorded session.
+ */
+struct ReplayReport {
+    int readings = 0;            ///< Recorded glucose readings replayed.
+    int recordedDecisions = 0;   ///< Decisions in the recording over the replayed period.
+    int replayedDecisions = 0;   ///< Decisions made by the replay.
+    int matchedDecisions = 0;    ///< Decisions made at the same time on both sides.
+    QList<ReplayDifference> differences; ///< Unmatched decisions, in time order.
+
+    /**
+     * @brief Returns true if the replay made exactly the recorded decisions.
+     */
+    bool identical() const { return differences.isEmpty(); }
+};
+
+/**
+ * @class ReplayEngine
+ * @brief Replays recorded glucose traces and diffs the resulting decisions.
+ */
+class ReplayEngine
+{
+public:
+    /**
+     * @brief Constructs a replay engine with the default profile.
+     */
+    ReplayEngine();
+
+    /**
+     * @brief Sets the profile the controller runs with during replay.
+     *
+     * The log does not record the profile, so it should match the recorded session's.
+     *
+     * @param profile Profile to replay with.
+     */
+    void setProfile(const Profile &profile);
+
+    /**
+     * @brief Reads a DataLogger store from any path.
+     * @param path Path of a logs.json file.
+     * @param recording Receives the logs.
+     * @param error Optional; receives a description of the problem on failure.
+     * @return False if the file cannot be read or is not a DataLogger store.
+     */
+    static bool loadRecording(const QString &path, LogData *recording, QString *error = nullptr);
+
+    /**
+     * @brief Replays a recorded session and compares the decisions.
+     *
+     * Readings drive the controller at their recorded times. Before each reading the
+     * bloodstream is brought to the insulin on board recorded with it, so boluses given
+     * during the session count without being replayed. The replay acts as an attentive
+     * user (charges and refills when asked) and delivers no boluses of its own.
+     *
+     * @param recording Recorded session.
+     * @return Comparison of the recorded and replayed decisions.
+     */
+    ReplayReport replay(const LogData &recording);
+
+    /**
+     * @brief Returns everything the last replay logged (events, glucose and insulin on board).
+     */
+    const LogData &getReplayedLog() const;
+
+    /**
+     * @brief Returns true if a log entry is a decision compared by replay().
+     *
+     * Decisions are what Control-IQ, the pump's safety logic and the alert monitor log;
+     * user actions and bolus deliveries are inputs of the session, not decisions.
+     *
+     * @param entry Log entry.
+     */
+    static bool isDecision(const LogEntry &entry);
+
+private:
+    Profile profile;
+    LogData replayedLog;
+};
+
+#endif // REPLAYENGINE_H
@@ -0,0 +1,293 @@
+#include "scenario.h"
+#include <QStringList>
+
+namespace {
+// Parses "[Nd] HH:MM[:SS]" from the start of the fields; returns the fields used, or 0
+int parseTime(const QStringList &fields, qint64 *offsetMSecs) {
+    qint64 days = 0;
+    int used = 0;
+    if (fields.size() > 1 && fields[0].endsWith('d')) {
+        bool ok = false;
+        days = fields[0].chopped(1).toLongLong(&ok);
+        if (!ok || days < 0) {
+            return 0;
+        }
+        used = 1;
+    }
+    if (fields.size() <= used) {
+        return 0;
+    }
+    QStringList parts = fields[used].split(':');
+    if (parts.size() < 2 || parts.size() > 3) {
+        return 0;
+    }
+    int limits[] = {24, 60, 60};
+    qint64 seconds = days * 24 * 3600;
+    qint64 units[] = {3600, 60, 1};
+    for (int i = 0; i < parts.size(); i++) {
+        bool ok = false;
+        int value = parts[i].toInt(&ok);
+        if (!ok || value < 0 || value >= limits[i]) {
+            return 0;
+        }
+        seconds += value * units[i];
+    }
+    *offsetMSecs = seconds * 1000;
+    return used + 1;
+}
+
+bool parseOnOff(const QString &text, bool *active) {
+    if (text == "on") {
+        *active = true;
+    } else if (text == "off") {
+        *active = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseAbsorption(const QString &text, CarbAbsorption::Profile *profile) {
+    const QStringList shapes = {"instant", "linear", "triangular"};
+    QStringList parts = text.split(':');
+    int shape = shapes.indexOf(parts[0]);
+    bool ok = shape >= 0 && parts.size() <= 2;
+    if (ok) {
+        profile->shape = CarbAbsorption::Shape(shape);
+        if (parts.size() == 2) {
+            profile->minutes = parts[1].toDouble(&ok);
+            ok = ok && profile->minutes > 0;
+        }
+    }
+    return ok;
+}
+
+// Parses "extended:hours", "dual-wave:percent:hours" or "split:percent:hours"
+bool parseBolusKind(const QString &text, ScenarioAction *action) {
+    const QStringList kinds = {"normal", "extended", "dual-wave", "split"}; // DeliveryPlan::Kind order
+    QStringList parts = text.split(':');
+    int kind = kinds.indexOf(parts[0]);
+    bool ok = (kind == DeliveryPlan::Extended && parts.size() == 2)
+              || ((kind == DeliveryPlan::DualWave || kind == DeliveryPlan::Split) && parts.size() == 3);
+    if (ok) {
+        action->bolusKind = DeliveryPlan::Kind(kind);
+        action->bolusHours = parts.last().toDouble(&ok);
+        ok = ok && (action->bolusHours > 0 || (kind == DeliveryPlan::Split && action->bolusHours == 0));
+    }
+    if (ok && parts.size() == 3) {
+        action->bolusNowPercent = parts[1].toDouble(&ok);
+        ok = ok && action->bolusNowPercent >= 0 && action->bolusNowPercent <= 100;
+    }
+    return ok;
+}
+}
+
+DeliveryPlan ScenarioAction::bolusPlan(double defaultRate) const {
+    double bolusRate = rate > 0 ? rate : defaultRate;
+    double now = amount * bolusNowPercent / 100;
+    switch (bolusKind) {
+    case DeliveryPlan::Extended: return DeliveryPlan::extended(amount, bolusHours);
+    case DeliveryPlan::DualWave: return DeliveryPlan::dualWave(now, amount - now, bolusHours, bolusRate);
+    case DeliveryPlan::Split: return DeliveryPlan::split(now, amount - now, bolusHours, bolusRate);
+    case DeliveryPlan::Normal: break;
+    }
+    return DeliveryPlan::normal(amount, bolusRate);
+}
+
+Scenario::Scenario()
+    : havePending(false)
+    , pendingPosition(0)
+    , pendingLine(0)
+    , line(0)
+    , lastOffset(0)
+{
+}
+
+bool Scenario::open(const QString &path, QString *error) {
+    file.close();
+    file.setFileName(path);
+    havePending = false;
+    line = 0;
+    lastOffset = 0;
+    this->error.clear();
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (error) *error = "Could not open " + path;
+        return false;
+    }
+    readAhead();
+    if (!this->error.isEmpty()) {
+        if (error) *error = this->error;
+        return false;
+    }
+    return true;
+}
+
+QString Scenario::path() const {
+    return file.fileName();
+}
+
+bool Scenario::hasNext() const {
+    return havePending;
+}
+
+const ScenarioAction &Scenario::peekNext() const {
+    return pending;
+}
+
+ScenarioAction Scenario::takeNext() {
+    ScenarioAction action = pending;
+    lastOffset = action.offsetMSecs;
+    readAhead();
+    return action;
+}
+
+QString Scenario::errorString() const {
+    return error;
+}
+
+qint64 Scenario::position() const {
+    return havePending ? pendingPosition : file.pos();
+}
+
+int Scenario::lineNumber() const {
+    return havePending ? pendingLine - 1 : line;
+}
+
+qint64 Scenario::previousOffset() const {
+    return lastOffset;
+}
+
+bool Scenario::seek(qint64 position, int line, qint64 previousOffsetMSecs) {
+    if (!file.isOpen() || !file.seek(position)) {
+        error = "Could not seek in " + path();
+        havePending = false;
+        return false;
+    }
+    this->line = line;
+    lastOffset = previousOffsetMSecs;
+    error.clear();
+    readAhead();
+    return error.isEmpty();
+}
+
+void Scenario::readAhead() {
+    havePending = false;
+    while (!file.atEnd()) {
+        qint64 start = file.pos();
+        QString text = QString::fromUtf8(file.readLine());
+        line++;
+        ScenarioAction action;
+        QString problem;
+        int result = parseLine(text, &action, &problem);
+        if (result == 0) {
+            continue;
+        }
+        if (result > 0 && action.offsetMSecs < lastOffset) {
+            result = -1;
+            problem = "time goes backwards";
+        }
+        if (result < 0) {
+            error = path() + ":" + QString::number(line) + ": " + problem;
+            return; // The scenario ends at the first invalid line
+        }
+        action.line = line;
+        pending = action;
+        pendingPosition = start;
+        pendingLine = line;
+        havePending = true;
+        return;
+    }
+}
+
+int Scenario::parseLine(const QString &text, ScenarioAction *action, QString *error) {
+    int comment = text.indexOf('#');
+    QString content = (comment >= 0 ? text.left(comment) : text).simplified();
+    if (content.isEmpty()) {
+        return 0;
+    }
+
+    QStringList fields = content.split(' ');
+    int used = parseTime(fields, &action->offsetMSecs);
+    if (used == 0) {
+        *error = "invalid time, expected [Nd] HH:MM[:SS]";
+        return -1;
+    }
+    if (fields.size() <= used) {
+        *error = "missing action";
+        return -1;
+    }
+    const QString name = fields[used];
+    const QStringList args = fields.mid(used + 1);
+    bool ok = true;
+
+    if (name == "meal") {
+        action->type = ScenarioAction::Meal;
+        ok = args.size() >= 1 && args.size() <= 2;
+        if (ok) action->amount = args[0].toDouble(&ok);
+        ok = ok && action->amount > 0;
+        if (ok && args.size() == 2) {
+            action->hasAbsorption = true;
+            ok = parseAbsorption(args[1], &action->absorption);
+        }
+        if (!ok) *error = "expected meal grams [shape[:minutes]]";
+    } else if (name == "bolus") {
+        action->type = ScenarioAction::Bolus;
+        ok = args.size() >= 1 && args.size() <= 3;
+        if (ok) action->amount = args[0].toDouble(&ok);
+        bool numeric = false;
+        if (args.size() >= 2) args[1].toDouble(&numeric);
+        int rateArg = 1;
+        if (ok && args.size() >= 2 && !numeric) { // A kind of bolus before the rate
+            ok = parseBolusKind(args[1], action);
+            ok = ok && (action->bolusKind != DeliveryPlan::Extended || args.size() == 2); // Its rate follows from the hours
+            rateArg = 2;
+        } else {
+            ok = ok && args.size() <= 2;
+        }
+        if (ok && args.size() > rateArg) action->rate = args[rateArg].toDouble(&ok);
+        ok = ok && action->amount > 0 && action->rate >= 0;
+        if (!ok) *error = "expected bolus units [extended:hours | dual-wave:percent:hours | split:percent:hours] [units/hour]";
+    } else if (name == "basal") {
+        action->type = ScenarioAction::BasalRate;
+        ok = args.size() == 1;
+        if (ok) action->amount = args[0].toDouble(&ok);
+        ok = ok && action->amount >= 0;
+        if (!ok) *error = "expected basal units/hour";
+    } else if (name == "profile") {
+        action->type = ScenarioAction::ProfileChange;
+        ok = !args.isEmpty();
+        for (int i = 0; ok && i < args.size(); i++) {
+            int equals = args[i].indexOf('=');
+            QString key = args[i].left(equals);
+            double value = args[i].mid(equals + 1).toDouble(&ok);
+            ok = ok && equals > 0 && value >= 0;
+            if (!ok) {
+                break;
+            } else if (key == "basal") {
+                action->basalRate = value;
+            } else if (key == "carb-ratio") {
+                action->carbRatio = value;
+            } else if (key == "correction") {
+                action->correctionFactor = value;
+            } else if (key == "target") {
+                action->targetGlucose = value;
+            } else {
+                ok = false;
+            }
+        }
+        if (!ok) *error = "expected profile basal=, carb-ratio=, correction= or target= values";
+    } else if (name == "cgm-error" || name == "pump-error" || name == "battery-error") {
+        action->type = (name == "cgm-error") ? ScenarioAction::CGMFault
+                     : (name == "pump-error") ? ScenarioAction::PumpFault : ScenarioAction::BatteryFault;
+        ok = args.size() == 1 && parseOnOff(args[0], &action->active);
+        if (!ok) *error = "expected " + name + " on|off";
+    } else if (name == "refill" || name == "charge") {
+        action->type = (name == "refill") ? ScenarioAction::Refill : ScenarioAction::Charge;
+        ok = args.isEmpty();
+        if (!ok) *error = name + " takes no arguments";
+    } else {
+        ok = false;
+        *error = "unknown action " + name;
+    }
+    return ok ? 1 : -1;
+}
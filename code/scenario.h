@@ -0,0 +1,170 @@
+/**
+ * @file scenario.h
+ * @brief Defines the Scenario class, which streams timed actions from a scenario file.
+ *
+ * A scenario file is a timeline of the actions a user would otherwise take by hand: meals,
+ * boluses, basal rate and profile changes, sensor and pump faults, refills and charges.
+ * One action per line, at a time relative to the start of the scenario:
+ *
+ * @code
+ * # Comments and blank lines are ignored
+ * 08:00     meal 60                 # grams
+ * 08:00     meal 45 linear:120      # grams, absorption shape:minutes
+ * 08:05     bolus 4.5               # units [rate in units/hour]
+ * 12:30     bolus 6 extended:2      # units spread over hours
+ * 19:00     bolus 8 dual-wave:40:3  # units, % now, hours for the rest [rate in units/hour]
+ * 19:00     bolus 2 split:50:0.5    # units, % now, hours until the rest [rate in units/hour]
+ * 10:00     cgm-error on
+ * 10:30     cgm-error off
+ * 11:00     pump-error on
+ * 12:00     battery-error on
+ * 2d 00:00  basal 0.9               # units/hour
+ * 2d 00:00  profile basal=0.9 carb-ratio=1.1 correction=2 target=6
+ * 3d 09:00  refill
+ * 3d 09:00  charge
+ * @endcode
+ *
+ * Times are [Nd] HH:MM[:SS] and must not go backwards. The file is read one action ahead
+ * of the simulation, so a scenario of any length costs the same memory and no loading
+ * time; a SimulationEngine schedules only the next due action.
+ */
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include <QFile>
+#include <QString>
+#include "carbabsorption.h"
+#include "deliveryplan.h"
+
+/**
+ * @brief One action of a scenario.
+ */
+struct ScenarioAction {
+    enum Type {
+        Meal,          ///< Carbs eaten (amount in grams, optional absorption profile).
+        Bolus,         ///< Bolus (amount in units, rate in units/hour or 0 for the default, bolusKind); blocked while suspended.
+        BasalRate,     ///< Basal segment started (amount in units/hour).
+        ProfileChange, ///< Profile settings changed (the fields that are not negative).
+        CGMFault,      ///< Sensor error set or cleared (active).
+        PumpFault,     ///< Pump occlusion set or cleared (active).
+        BatteryFault,  ///< Battery failure set or cleared (active).
+        Refill,        ///< Insulin reservoir refilled.
+        Charge         ///< Battery charged.
+    };
+
+    qint64 offsetMSecs = 0;       ///< Time after the scenario start (ms).
+    Type type = Meal;
+    double amount = 0;            ///< Grams, units or units/hour, see Type.
+    double rate = 0;              ///< Bolus delivery rate (units/hour), 0 for the bolus calculator's.
+    DeliveryPlan::Kind bolusKind = DeliveryPlan::Normal; ///< Kind of bolus.
+    double bolusNowPercent = 100; ///< Part of a dual-wave or split bolus delivered at once (%).
+    double bolusHours = 0;        ///< Duration of an extended or dual-wave bolus, delay of a split bolus's second part.
+    bool active = false;          ///< Whether a fault is set or cleared.
+    bool hasAbsorption = false;   ///< Whether the meal has its own absorption profile.
+    CarbAbsorption::Profile absorption; ///< Meal absorption profile.
+    double basalRate = -1;        ///< New profile basal rate, or negative to keep it.
+    double carbRatio = -1;        ///< New profile carb ratio, or negative to keep it.
+    double correctionFactor = -1; ///< New profile correction factor, or negative to keep it.
+    double targetGlucose = -1;    ///< New profile target glucose, or negative to keep it.
+    int line = 0;                 ///< Line of the file the action is on.
+
+    /**
+     * @brief Compiles a Bolus action into the plan the pump runs.
+     * @param defaultRate Delivery rate used when the action gives none (units/hour).
+     */
+    DeliveryPlan bolusPlan(double defaultRate) const;
+};
+
+/**
+ * @class Scenario
+ * @brief Reads a scenario file lazily, one action ahead.
+ */
+class Scenario
+{
+public:
+    Scenario();
+
+    /**
+     * @brief Opens a scenario file and reads its first action.
+     * @param path Scenario file.
+     * @param error Optional; receives a description of the problem on failure.
+     * @return False if the file cannot be opened or its first action is invalid.
+     */
+    bool open(const QString &path, QString *error = nullptr);
+
+    /**
+     * @brief Returns the path of the open scenario file.
+     */
+    QString path() const;
+
+    /**
+     * @brief Returns true while an action is left to take.
+     */
+    bool hasNext() const;
+
+    /**
+     * @brief Returns the next action without taking it. Only valid if hasNext().
+     */
+    const ScenarioAction &peekNext() const;
+
+    /**
+     * @brief Takes the next action and reads the one after it. Only valid if hasNext().
+     * @return The action.
+     */
+    ScenarioAction takeNext();
+
+    /**
+     * @brief Returns the problem that ended the scenario early, or an empty string.
+     */
+    QString errorString() const;
+
+    /**
+     * @brief Returns the file position of the next action, for seek().
+     */
+    qint64 position() const;
+
+    /**
+     * @brief Returns the line of the next action, for seek().
+     */
+    int lineNumber() const;
+
+    /**
+     * @brief Moves to an action found with position() and lineNumber() (used to restore a saved state).
+     * @param position File position.
+     * @param line Line at that position.
+     * @param previousOffsetMSecs Offset of the action before it, so ordering is still checked.
+     * @return False if the action there cannot be read.
+     */
+    bool seek(qint64 position, int line, qint64 previousOffsetMSecs);
+
+    /**
+     * @brief Returns the offset of the last action taken (0 before the first).
+     */
+    qint64 previousOffset() const;
+
+    /**
+     * @brief Parses one line of a scenario file.
+     * @param text Line, without its newline.
+     * @param action Receives the action.
+     * @param error Receives a description of the problem if the line is invalid.
+     * @return 1 for an action, 0 for a blank or comment line, -1 if the line is invalid.
+     */
+    static int parseLine(const QString &text, ScenarioAction *action, QString *error);
+
+private:
+    /**
+     * @brief Reads up to the next action into pending.
+     */
+    void readAhead();
+
+    QFile file;
+    ScenarioAction pending;  ///< Next action, valid if havePending.
+    bool havePending;
+    qint64 pendingPosition;  ///< File position of the pending action's line.
+    int pendingLine;         ///< Line of the pending action.
+    int line;                ///< Lines read so far.
+    qint64 lastOffset;       ///< Offset of the last action taken.
+    QString error;
+};
+
+#endif // SCENARIO_H
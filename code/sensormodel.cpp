@@ -0,0 +1,118 @@
+#include "sensormodel.h"
+#include "glucosemodel.h"
+#include <QDataStream>
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+
+bool SensorParameters::isIdeal() const {
+    return lagMinutes <= 0 && noiseSd <= 0 && driftPerDay == 0 && dropoutRate <= 0;
+}
+
+SensorParameters SensorParameters::typical() {
+    SensorParameters parameters;
+    parameters.lagMinutes = 10;
+    parameters.noiseSd = 0.4;
+    parameters.noiseCorrelation = 0.7;
+    parameters.driftPerDay = 0.01;
+    parameters.dropoutRate = 0.002;
+    parameters.dropoutMinutes = 30;
+    return parameters;
+}
+
+SensorParameters SensorParameters::fromString(const QString &text, bool *ok) {
+    SensorParameters parameters;
+    bool valid = true;
+    if (text == "typical") {
+        parameters = typical();
+    } else if (text != "ideal") {
+        QStringList parts = text.split(':');
+        double *fields[] = {&parameters.lagMinutes, &parameters.noiseSd, &parameters.driftPerDay,
+                            &parameters.dropoutRate};
+        valid = parts.size() >= 2 && parts.size() <= 4;
+        for (int i = 0; valid && i < parts.size(); i++) {
+            *fields[i] = parts[i].toDouble(&valid);
+        }
+        valid = valid && parameters.lagMinutes >= 0 && parameters.noiseSd >= 0
+                && parameters.dropoutRate >= 0 && parameters.dropoutRate <= 1;
+        if (!valid) {
+            parameters = SensorParameters();
+        }
+    }
+    if (ok) *ok = valid;
+    return parameters;
+}
+
+SensorCoefficients SensorCoefficients::of(const SensorParameters &parameters, double sampleMinutes) {
+    SensorCoefficients coefficients;
+    coefficients.lagCarry = (parameters.lagMinutes > 0) ? std::exp(-sampleMinutes / parameters.lagMinutes) : 0;
+    coefficients.lagWeight = 1 - coefficients.lagCarry;
+    coefficients.noiseCarry = (parameters.noiseSd > 0) ? parameters.noiseCorrelation : 0;
+    coefficients.noiseScale = (parameters.noiseSd > 0)
+            ? parameters.noiseSd * std::sqrt(1 - parameters.noiseCorrelation * parameters.noiseCorrelation)
+            : 0; // Stationary standard deviation noiseSd
+    coefficients.gainStep = parameters.driftPerDay * sampleMinutes / (24 * 60);
+    coefficients.dropoutStart = parameters.dropoutRate;
+    coefficients.dropoutEnd = (parameters.dropoutMinutes > 0) ? std::min(1.0, sampleMinutes / parameters.dropoutMinutes) : 1;
+    return coefficients;
+}
+
+SensorModel::SensorModel()
+{
+    configure(SensorParameters(), 5);
+}
+
+void SensorModel::configure(const SensorParameters &parameters, double sampleMinutes) {
+    this->parameters = parameters;
+    this->sampleMinutes = sampleMinutes;
+    coefficients = SensorCoefficients::of(parameters, sampleMinutes);
+    started = false;
+    interstitial = 0;
+    noise = 0;
+    gain = 1;
+    dropped = false;
+}
+
+SensorParameters SensorModel::getParameters() const {
+    return parameters;
+}
+
+const SensorCoefficients &SensorModel::getCoefficients() const {
+    return coefficients;
+}
+
+double SensorModel::sample(double glucose, SimRandom &random) {
+    // BatchEngine::sampleSensors() mirrors these operations for a whole batch
+    if (!started) {
+        interstitial = glucose;
+        started = true;
+    }
+    interstitial = GlucoseModel::lagged(coefficients.lagWeight, coefficients.lagCarry, glucose, interstitial);
+    if (coefficients.noiseScale > 0) {
+        noise = coefficients.noiseCarry * noise + coefficients.noiseScale * random.nextGaussian();
+    }
+    gain += coefficients.gainStep;
+    if (coefficients.dropoutStart > 0) {
+        dropped = random.nextDouble() < (dropped ? 1 - coefficients.dropoutEnd : coefficients.dropoutStart);
+    }
+    return dropped ? -1 : GlucoseModel::sensorReading(interstitial, gain, noise);
+}
+
+void SensorModel::calibrate() {
+    gain = 1;
+}
+
+void SensorModel::saveState(QDataStream &out) const {
+    out << parameters.lagMinutes << parameters.noiseSd << parameters.noiseCorrelation << parameters.driftPerDay
+        << parameters.dropoutRate << parameters.dropoutMinutes << sampleMinutes;
+    out << started << interstitial << noise << gain << dropped;
+}
+
+void SensorModel::restoreState(QDataStream &in) {
+    SensorParameters saved;
+    double savedSampleMinutes = 5;
+    in >> saved.lagMinutes >> saved.noiseSd >> saved.noiseCorrelation >> saved.driftPerDay
+       >> saved.dropoutRate >> saved.dropoutMinutes >> savedSampleMinutes;
+    configure(saved, savedSampleMinutes);
+    in >> started >> interstitial >> noise >> gain >> dropped;
+}
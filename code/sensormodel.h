@@ -0,0 +1,138 @@
+/**
+ * @file sensormodel.h
+ * @brief Defines the SensorModel class, which turns blood glucose into CGM sensor readings.
+ *
+ * A CGM measures interstitial glucose, which trails blood glucose by several minutes, and
+ * its error is correlated from one sample to the next rather than independent. The model
+ * is a first-order lag for the interstitial glucose, AR(1) noise, a calibration gain that
+ * drifts over the sensor's life and dropouts that last several samples.
+ *
+ * Sensors are sampled at a fixed interval, so every filter coefficient is computed once
+ * per configuration (SensorCoefficients) and a sample costs a few multiply-adds besides
+ * the random draws. BatchEngine applies the same coefficients to a batch of patients with
+ * its SIMD kernels.
+ */
+
+#ifndef SENSORMODEL_H
+#define SENSORMODEL_H
+
+#include <QString>
+#include "simrandom.h"
+
+class QDataStream;
+
+/**
+ * @brief Configuration of a CGM sensor. The defaults are an ideal sensor.
+ */
+struct SensorParameters {
+    double lagMinutes = 0;         ///< Time constant of the interstitial lag (minutes).
+    double noiseSd = 0;            ///< Standard deviation of the sensor noise (mmol/L).
+    double noiseCorrelation = 0.7; ///< Correlation of the noise between consecutive samples.
+    double driftPerDay = 0;        ///< Change of the calibration gain per day (e.g. 0.02 reads 2% higher each day).
+    double dropoutRate = 0;        ///< Probability that a dropout starts at a sample.
+    double dropoutMinutes = 30;    ///< Mean length of a dropout (minutes).
+
+    /**
+     * @brief Returns true if the sensor reads blood glucose exactly.
+     */
+    bool isIdeal() const;
+
+    /**
+     * @brief Returns a sensor with typical lag, noise and dropouts.
+     */
+    static SensorParameters typical();
+
+    /**
+     * @brief Parses "ideal", "typical" or "lag:noise[:drift[:dropout]]".
+     *
+     * lag is in minutes, noise in mmol/L, drift a fraction per day and dropout a
+     * probability per sample, e.g. "10:0.5:0.02:0.005".
+     *
+     * @param text Sensor description.
+     * @param ok Optional; set to false if @p text is not valid.
+     * @return The parameters, ideal if @p text is not valid.
+     */
+    static SensorParameters fromString(const QString &text, bool *ok = nullptr);
+};
+
+/**
+ * @brief Per-sample coefficients of a sensor configuration.
+ */
+struct SensorCoefficients {
+    double lagWeight;    ///< Weight of the new blood glucose in the interstitial glucose.
+    double lagCarry;     ///< Weight of the previous interstitial glucose (1 - lagWeight).
+    double noiseCarry;   ///< Share of the previous noise kept.
+    double noiseScale;   ///< Standard deviation of the noise innovation.
+    double gainStep;     ///< Calibration gain change per sample.
+    double dropoutStart; ///< Probability that a dropout starts.
+    double dropoutEnd;   ///< Probability that a dropout ends.
+
+    /**
+     * @brief Computes the coefficients of a sensor sampled every @p sampleMinutes.
+     */
+    static SensorCoefficients of(const SensorParameters &parameters, double sampleMinutes);
+};
+
+/**
+ * @class SensorModel
+ * @brief Sensor state of one patient: interstitial glucose, noise, gain and dropout.
+ */
+class SensorModel
+{
+public:
+    /**
+     * @brief Constructs an ideal sensor.
+     */
+    SensorModel();
+
+    /**
+     * @brief Configures the sensor and restarts it.
+     * @param parameters Sensor configuration.
+     * @param sampleMinutes Interval between samples (minutes).
+     */
+    void configure(const SensorParameters &parameters, double sampleMinutes);
+
+    SensorParameters getParameters() const;
+    const SensorCoefficients &getCoefficients() const;
+
+    /**
+     * @brief Takes a sample.
+     *
+     * An ideal sensor returns @p glucose unchanged and draws no random numbers.
+     *
+     * @param glucose Blood glucose (mmol/L).
+     * @param random Stream of the sensor's random numbers.
+     * @return Sensor reading (mmol/L), or -1 during a dropout.
+     */
+    double sample(double glucose, SimRandom &random);
+
+    /**
+     * @brief Recalibrates the sensor: the gain returns to 1.
+     */
+    void calibrate();
+
+    /**
+     * @brief Writes the configuration and the sensor state to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores the state written by saveState().
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
+private:
+    SensorParameters parameters;
+    double sampleMinutes;
+    SensorCoefficients coefficients;
+
+    bool started;        ///< Whether a sample was taken; the first one starts the lag at the blood glucose.
+    double interstitial; ///< Lagged glucose (mmol/L).
+    double noise;        ///< Current noise (mmol/L).
+    double gain;         ///< Calibration gain.
+    bool dropped;        ///< Whether the sensor is in a dropout.
+};
+
+#endif // SENSORMODEL_H
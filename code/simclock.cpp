@@ -0,0 +1,63 @@
+#include "simclock.h"
+
+SimClock::SimClock(Mode mode, const QDateTime &start)
+    : mode(mode)
+    , scale(1.0)
+    , anchorMSecs(0)
+{
+    anchorAt(start.toMSecsSinceEpoch());
+}
+
+QDateTime SimClock::now() const {
+    return QDateTime::fromMSecsSinceEpoch(nowMSecs());
+}
+
+qint64 SimClock::nowMSecs() const {
+    switch (mode) {
+        case RealTime:
+            return QDateTime::currentMSecsSinceEpoch();
+        case Scaled:
+            return anchorMSecs + qRound64(wallSinceAnchor.elapsed() * scale);
+        case FreeRunning:
+            break;
+    }
+    return anchorMSecs;
+}
+
+void SimClock::advance(qint64 msecs) {
+    if (mode == FreeRunning) {
+        anchorMSecs += msecs;
+    }
+}
+
+void SimClock::setTime(const QDateTime &time) {
+    if (mode == RealTime) {
+        return; // Real time cannot be moved
+    }
+    anchorAt(time.toMSecsSinceEpoch());
+}
+
+void SimClock::setMode(Mode mode) {
+    qint64 current = nowMSecs();
+    this->mode = mode;
+    anchorAt(current);
+}
+
+SimClock::Mode SimClock::getMode() const {
+    return mode;
+}
+
+void SimClock::setScale(double scale) {
+    qint64 current = nowMSecs();
+    this->scale = scale;
+    anchorAt(current);
+}
+
+double SimClock::getScale() const {
+    return scale;
+}
+
+void SimClock::anchorAt(qint64 msecs) {
+    anchorMSecs = msecs;
+    wallSinceAnchor.start();
+}
@@ -0,0 +1,92 @@
+/**
+ * @file simclock.h
+ * @brief Defines the SimClock class, the source of "now" for the whole simulator.
+ *
+ * Every timestamp in the simulator (log entries, glucose and insulin readings, the
+ * bolus countdown and the home screen clock) comes from a SimClock, so accelerated
+ * and batch runs produce time series in simulated time rather than wall-clock time.
+ */
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+
+/**
+ * @class SimClock
+ * @brief Simulated clock with real-time, scaled and free-running modes.
+ *
+ * - RealTime: now() is the wall-clock time.
+ * - Scaled: now() advances with the wall clock, multiplied by a scale factor.
+ * - FreeRunning: now() only moves when the simulation calls advance(), so it runs
+ *   exactly as fast as the simulation does (used by the engine, fast-forward and batch runs).
+ *
+ * Switching modes or changing the scale never makes the clock jump.
+ */
+class SimClock
+{
+public:
+    enum Mode {
+        RealTime,
+        Scaled,
+        FreeRunning
+    };
+
+    /**
+     * @brief Constructs a clock.
+     * @param mode Initial mode.
+     * @param start Initial time (defaults to the current wall-clock time).
+     */
+    explicit SimClock(Mode mode = FreeRunning, const QDateTime &start = QDateTime::currentDateTime());
+
+    /**
+     * @brief Returns the current simulated time.
+     * @return Current time.
+     */
+    QDateTime now() const;
+
+    /**
+     * @brief Returns the current simulated time in milliseconds since the epoch.
+     * @return Current time in ms.
+     */
+    qint64 nowMSecs() const;
+
+    /**
+     * @brief Moves a free-running clock forward. Ignored in the other modes.
+     * @param msecs Simulated milliseconds to advance by.
+     */
+    void advance(qint64 msecs);
+
+    /**
+     * @brief Sets the time, keeping the current mode.
+     * @param time New current time.
+     */
+    void setTime(const QDateTime &time);
+
+    /**
+     * @brief Switches mode, continuing from the current time.
+     * @param mode New mode.
+     */
+    void setMode(Mode mode);
+    Mode getMode() const;
+
+    /**
+     * @brief Sets the scale of Scaled mode, continuing from the current time.
+     * @param scale Simulated seconds per wall-clock second.
+     */
+    void setScale(double scale);
+    double getScale() const;
+
+private:
+    Mode mode;
+    double scale; ///< Simulated seconds per wall-clock second (Scaled mode).
+    qint64 anchorMSecs; ///< Simulated time at the anchor point (Scaled and FreeRunning modes).
+    QElapsedTimer wallSinceAnchor; ///< Wall time since the anchor point (Scaled mode).
+
+    /**
+     * @brief Re-anchors Scaled/FreeRunning time at the given simulated time.
+     */
+    void anchorAt(qint64 msecs);
+};
+
+#endif // SIMCLOCK_H
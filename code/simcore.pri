@@ -0,0 +1,80 @@
+# Widget-free simulation core, shared by the GUI (insulinPump.pro),
+# the static library (simcore/simcore.pro) and the CLI runners.
+# Only depends on QtCore.
+
+CONFIG += c++17
+
+# The batch engine's SIMD kernels reproduce the scalar model bit for bit, which needs
+# a*b+c to stay two roundings everywhere (no fused multiply-add contraction)
+*-g++*|*-clang*: QMAKE_CXXFLAGS += -ffp-contract=off
+
+# qmake CONFIG+=fixed_dosing does the dosing arithmetic (pump, reservoir, bolus formulas)
+# in integer micro-units instead of double, for targets without an FPU (see fixedpoint.h)
+fixed_dosing: DEFINES += FIXED_POINT_DOSING
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+SOURCES += \
+    $$PWD/alertmonitor.cpp \
+    $$PWD/batchengine.cpp \
+    $$PWD/batterymanager.cpp \
+    $$PWD/bloodstream.cpp \
+    $$PWD/carbabsorption.cpp \
+    $$PWD/cgmreader.cpp \
+    $$PWD/controliqalgorithm.cpp \
+    $$PWD/controllerregistry.cpp \
+    $$PWD/datalogger.cpp \
+    $$PWD/deliveryaudit.cpp \
+    $$PWD/deliveryplan.cpp \
+    $$PWD/eventscheduler.cpp \
+    $$PWD/faultinjector.cpp \
+    $$PWD/glucoseforecaster.cpp \
+    $$PWD/insulinreserve.cpp \
+    $$PWD/mpccontroller.cpp \
+    $$PWD/populationrunner.cpp \
+    $$PWD/profile.cpp \
+    $$PWD/profileoptimizer.cpp \
+    $$PWD/profilesensitivity.cpp \
+    $$PWD/simclock.cpp \
+    $$PWD/simrandom.cpp \
+    $$PWD/pumpcontroller.cpp \
+    $$PWD/replayengine.cpp \
+    $$PWD/scenario.cpp \
+    $$PWD/sensormodel.cpp \
+    $$PWD/simulationengine.cpp \
+    $$PWD/workstealingpool.cpp
+
+HEADERS += \
+    $$PWD/alertmonitor.h \
+    $$PWD/batchengine.h \
+    $$PWD/batterymanager.h \
+    $$PWD/bloodstream.h \
+    $$PWD/carbabsorption.h \
+    $$PWD/cgmreader.h \
+    $$PWD/controliqalgorithm.h \
+    $$PWD/controllerpolicies.h \
+    $$PWD/controllerregistry.h \
+    $$PWD/datalogger.h \
+    $$PWD/deliveryaudit.h \
+    $$PWD/deliveryplan.h \
+    $$PWD/dual.h \
+    $$PWD/eventscheduler.h \
+    $$PWD/faultinjector.h \
+    $$PWD/fixedpoint.h \
+    $$PWD/glucoseforecaster.h \
+    $$PWD/glucosemodel.h \
+    $$PWD/insulinreserve.h \
+    $$PWD/mpccontroller.h \
+    $$PWD/populationrunner.h \
+    $$PWD/profile.h \
+    $$PWD/profileoptimizer.h \
+    $$PWD/profilesensitivity.h \
+    $$PWD/simclock.h \
+    $$PWD/simrandom.h \
+    $$PWD/pumpcontroller.h \
+    $$PWD/replayengine.h \
+    $$PWD/scenario.h \
+    $$PWD/sensormodel.h \
+    $$PWD/simulationengine.h \
+    $$PWD/workstealingpool.h
@@ -0,0 +1,8 @@
+# Static library with the headless simulation core (no widgets).
+QT = core
+
+TEMPLATE = lib
+CONFIG += staticlib
+TARGET = simcore
+
+include(../simcore.pri)
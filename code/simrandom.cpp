@@ -0,0 +1,71 @@
+#include "simrandom.h"
+#include <QDataStream>
+#include <QtAlgorithms>
+#include <QtMath>
+
+namespace {
+const quint64 goldenGamma = 0x9e3779b97f4a7c15ULL; // 2^64 / golden ratio, odd
+}
+
+SimRandom::SimRandom(quint64 seed)
+    : seed(seed)
+    , key(mix64(seed))
+    , gamma(mixGamma(seed + goldenGamma))
+    , counter(0)
+{
+}
+
+quint64 SimRandom::next() {
+    counter++;
+    return mix64(key + counter * gamma);
+}
+
+double SimRandom::nextDouble() {
+    return (next() >> 11) * (1.0 / 9007199254740992.0); // 53 random bits / 2^53
+}
+
+double SimRandom::nextGaussian() {
+    double radius = std::sqrt(-2 * std::log(1 - nextDouble())); // 1 - u is in (0, 1]
+    return radius * std::cos(2 * M_PI * nextDouble());
+}
+
+SimRandom SimRandom::split(quint64 stream) const {
+    SimRandom child(seed);
+    child.key = mix64(key ^ mix64(stream + goldenGamma));
+    child.gamma = mixGamma(gamma ^ mix64(~stream));
+    return child;
+}
+
+quint64 SimRandom::getSeed() const {
+    return seed;
+}
+
+quint64 SimRandom::getCounter() const {
+    return counter;
+}
+
+void SimRandom::setCounter(quint64 counter) {
+    this->counter = counter;
+}
+
+quint64 SimRandom::mix64(quint64 z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+quint64 SimRandom::mixGamma(quint64 z) {
+    z = mix64(z) | 1;
+    if (qPopulationCount(z ^ (z >> 1)) < 24) {
+        z ^= 0xaaaaaaaaaaaaaaaaULL; // Avoid increments with long runs of equal bits
+    }
+    return z;
+}
+
+void SimRandom::saveState(QDataStream &out) const {
+    out << seed << key << gamma << counter;
+}
+
+void SimRandom::restoreState(QDataStream &in) {
+    in >> seed >> key >> gamma >> counter;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file simrandom.h
+ * @brief Defines the SimRandom class, the seeded random number generator of a simulated patient.
+ *
+ * Each simulated patient owns its own SimRandom instead of sharing a global generator, so
+ * a run is reproducible from its seed and parallel runs share no state.
+ */
+#ifndef SIMRANDOM_H
+#define SIMRANDOM_H
+
+#include <QtGlobal>
+
+class QDataStream;
+
+/**
+ * @class SimRandom
+ * @brief Counter-based, splittable random number generator (SplitMix64 style).
+ *
+ * The n-th number of a stream is a pure function of the stream's key, its gamma and n,
+ * so a generator is fully described by (seed, stream path, counter). split() derives an
+ * independent child stream, e.g. one per subsystem or one per patient of a population.
+ */
+class SimRandom
+{
+public:
+    /**
+     * @brief Constructs the root stream of a seed.
+     * @param seed Seed; the same seed always gives the same numbers.
+     */
+    explicit SimRandom(quint64 seed = 0);
+
+    /**
+     * @brief Returns the next 64 random bits and advances the counter.
+     * @return Random 64-bit value.
+     */
+    quint64 next();
+
+    /**
+     * @brief Returns a random double and advances the counter.
+     * @return Uniform value in [0, 1).
+     */
+    double nextDouble();
+
+    /**
+     * @brief Returns a standard normal value (Box-Muller) and advances the counter by two.
+     * @return Normal value with mean 0 and standard deviation 1.
+     */
+    double nextGaussian();
+
+    /**
+     * @brief Derives an independent child stream. Does not advance this stream.
+     * @param stream Child stream number; different numbers give independent streams.
+     * @return The child generator, starting at counter 0.
+     */
+    SimRandom split(quint64 stream) const;
+
+    /**
+     * @brief Returns the seed the root stream was created with.
+     */
+    quint64 getSeed() const;
+
+    /**
+     * @brief Returns how many numbers this stream has produced.
+     */
+    quint64 getCounter() const;
+
+    /**
+     * @brief Moves the stream to any position (used to restore a saved state).
+     * @param counter Number of values already produced.
+     */
+    void setCounter(quint64 counter);
+
+    /**
+     * @brief Writes the full stream state (not just the seed) to a checkpoint.
+     * @param out Checkpoint stream.
+     */
+    void saveState(QDataStream &out) const;
+
+    /**
+     * @brief Restores a stream written by saveState(); it continues exactly where it was saved.
+     * @param in Checkpoint stream.
+     */
+    void restoreState(QDataStream &in);
+
+private:
+    quint64 seed;    ///< Seed of the root stream.
+    quint64 key;     ///< Start point of this stream.
+    quint64 gamma;   ///< Odd increment of this stream.
+    quint64 counter; ///< Number of values produced.
+
+    /**
+     * @brief SplitMix64 finalizer: a bijective 64-bit mixing function.
+     */
+    static quint64 mix64(quint64 z);
+
+    /**
+     * @brief Derives an odd increment with well-spread bits from a value.
+     */
+    static quint64 mixGamma(quint64 z);
+};
+
+#endif // SIMRANDOM_H
@@ -0,0 +1,336 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QFile>
+#include <QTextStream>
+#include <QList>
+#include <QPair>
+#include <QElapsedTimer>
+#include <QTime>
+#include <cstdio>
+#include "simulationengine.h"
+
+// Headless simulation runner.
+// Runs the SimulationEngine for a number of simulated days with a fixed profile, daily
+// meals and basal segments scheduled as events, acting as an attentive user (charges the
+// battery and refills the reservoir when the device asks for it), and prints a summary
+// of the run. A run can start from a checkpoint saved by an earlier run (--resume), so
+// variants of a long scenario can share one warm-up; options given explicitly then
+// override the checkpoint's profile and settings.
+
+// Parses "HH:value" or "HH:MM:value" into a time of day and a value.
+static bool parseDailyEvent(const QString &text, QTime *time, double *value)
+{
+    QStringList parts = text.split(':');
+    if (parts.size() != 2 && parts.size() != 3) {
+        return false;
+    }
+    bool okHour = false, okMinute = true, okValue = false;
+    int hour = parts.first().toInt(&okHour);
+    int minute = parts.size() == 3 ? parts.at(1).toInt(&okMinute) : 0;
+    *value = parts.last().toDouble(&okValue);
+    *time = QTime(hour, minute);
+    return okHour && okMinute && okValue && time->isValid();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("simrunner");
+
+    Profile defaults = Profile::defaultProfile();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs the insulin pump simulation without a GUI.");
+    parser.addHelpOption();
+    parser.addOption({"days", "Simulated days to run (default 1).", "days", "1"});
+    parser.addOption({"basal", "Profile basal rate (units/hour).", "rate", QString::number(defaults.getBasalRate())});
+    parser.addOption({"carb-ratio", "Profile carb ratio.", "ratio", QString::number(defaults.getCarbRatio())});
+    parser.addOption({"correction", "Profile correction factor.", "factor", QString::number(defaults.getCorrectionFactor())});
+    parser.addOption({"target", "Profile target glucose (mmol/L).", "glucose", QString::number(defaults.getTargetGlucose())});
+    parser.addOption({"meal", "Daily meal as HH[:MM]:grams, may be repeated (e.g. 08:30:45).", "meal"});
+    parser.addOption({"basal-segment", "Daily basal segment as HH[:MM]:rate, may be repeated. "
+                                       "--basal applies until the first segment starts.", "segment"});
+    parser.addOption({"csv", "Write every tick to a CSV file.", "path"});
+    parser.addOption({"log", "Log events and readings to ./data/logs.json."});
+    parser.addOption({"step", "Fine integration step in minutes (default 1).", "minutes", "1"});
+    parser.addOption({"max-step", "Coarse integration step at steady state in minutes (default 5).", "minutes", "5"});
+    parser.addOption({"fixed-step", "Always integrate with the fine step (no adaptive stepping)."});
+    parser.addOption({"insulin-action", "Absorb insulin along an action curve instead of at the patient's constant rate: "
+                                        "duration of action in minutes, optionally with the peak (e.g. 360:75; peak 0 is exponential).",
+                      "minutes[:peak]"});
+    parser.addOption({"sensor", "CGM sensor: ideal, typical or lag:noise[:drift[:dropout]] (minutes, mmol/L, fraction per day, "
+                      "probability per sample; default ideal).", "sensor"});
+    parser.addOption({"carb-absorption", "How meals are absorbed: instant, linear or triangular, optionally with the "
+                                         "absorption time in minutes (default triangular:180).", "shape[:minutes]"});
+    parser.addOption({"fault", "Random fault as kind:perDay[:minutes], kind sensor, occlusion or battery (mean onsets per day, "
+                      "mean duration; default 30 minutes), may be repeated (e.g. occlusion:2:45).", "fault"});
+    parser.addOption({"controller", "Basal controller: threshold (suspend on lows, otherwise the profile rate) or mpc "
+                                    "(model-predictive; default threshold).", "controller"});
+    parser.addOption({"scenario", "Scenario file of timed meals, boluses, faults and profile changes, started with the run.", "file"});
+    parser.addOption({"seed", "Seed of the simulated patient (default: random). Runs with the same seed and options are identical.", "seed"});
+    parser.addOption({"start", "Simulated start time, ISO 8601 (default: now).", "datetime"});
+    parser.addOption({"resume", "Start from a checkpoint saved with --save-checkpoint.", "path"});
+    parser.addOption({"save-checkpoint", "Save a checkpoint of the simulation state at the end of the run.", "path"});
+    parser.process(app);
+
+    bool ok = true;
+    int days = parser.value("days").toInt(&ok);
+    if (!ok || days <= 0) {
+        fprintf(stderr, "Invalid --days value\n");
+        return 1;
+    }
+
+    double fineStep = parser.value("step").toDouble(&ok);
+    double coarseStep = ok ? parser.value("max-step").toDouble(&ok) : 0;
+    if (!ok || fineStep <= 0 || coarseStep < fineStep) {
+        fprintf(stderr, "Invalid --step/--max-step values\n");
+        return 1;
+    }
+
+    // Daily events as (time of day, grams or units/hour)
+    QList<QPair<QTime, double>> meals, segments;
+    for (const QString &meal : parser.values("meal")) {
+        QTime time;
+        double carbs = 0;
+        if (!parseDailyEvent(meal, &time, &carbs)) {
+            fprintf(stderr, "Invalid --meal value: %s\n", qPrintable(meal));
+            return 1;
+        }
+        meals.append(qMakePair(time, carbs));
+    }
+    for (const QString &segment : parser.values("basal-segment")) {
+        QTime time;
+        double rate = 0;
+        if (!parseDailyEvent(segment, &time, &rate) || rate < 0) {
+            fprintf(stderr, "Invalid --basal-segment value: %s\n", qPrintable(segment));
+            return 1;
+        }
+        segments.append(qMakePair(time, rate));
+    }
+
+    QFile csvFile;
+    QTextStream csv;
+    if (parser.isSet("csv")) {
+        csvFile.setFileName(parser.value("csv"));
+        if (!csvFile.open(QIODevice::WriteOnly | QIODevice::Text)) {
+            fprintf(stderr, "Could not open %s for writing\n", qPrintable(parser.value("csv")));
+            return 1;
+        }
+        csv.setDevice(&csvFile);
+        csv << "time,glucose,iob,insulin,battery,activity,cob,forecast30,forecast60\n";
+    }
+
+    DataLogger *logger = nullptr;
+    if (parser.isSet("log")) {
+        logger = DataLogger::instance();
+        logger->loadLogs();
+        logger->setDeferredWrites(true); // Saved once at the end of the run
+    }
+
+    SimulationEngine engine(logger);
+    const bool resumed = parser.isSet("resume");
+    if (resumed) {
+        QFile checkpointFile(parser.value("resume"));
+        if (!checkpointFile.open(QIODevice::ReadOnly) || !engine.restoreCheckpoint(checkpointFile.readAll())) {
+            fprintf(stderr, "Could not restore a checkpoint from %s\n", qPrintable(parser.value("resume")));
+            return 1;
+        }
+        if (parser.isSet("start")) {
+            fprintf(stderr, "--start cannot be combined with --resume\n");
+            return 1;
+        }
+    } else if (parser.isSet("start")) {
+        QDateTime start = QDateTime::fromString(parser.value("start"), Qt::ISODate);
+        if (!start.isValid()) {
+            fprintf(stderr, "Invalid --start value\n");
+            return 1;
+        }
+        engine.setTime(start);
+    }
+    if (logger) {
+        logger->setClock(engine.getClock());
+    }
+    if (parser.isSet("seed")) {
+        quint64 seed = parser.value("seed").toULongLong(&ok);
+        if (!ok) {
+            fprintf(stderr, "Invalid --seed value\n");
+            return 1;
+        }
+        engine.setSeed(seed);
+    }
+
+    // A resumed run keeps the checkpoint's settings unless an option is given
+    auto useOption = [&](const QString &name) { return !resumed || parser.isSet(name); };
+    Profile profile = resumed ? engine.getProfile() : Profile("Headless", 0, 0, 0, 0, 1);
+    if (useOption("basal")) profile.setBasalRate(parser.value("basal").toDouble());
+    if (useOption("carb-ratio")) profile.setCarbRatio(parser.value("carb-ratio").toDouble());
+    if (useOption("correction")) profile.setCorrectionFactor(parser.value("correction").toDouble());
+    if (useOption("target")) profile.setTargetGlucose(parser.value("target").toDouble());
+    engine.setProfile(profile);
+    if (useOption("step") || useOption("max-step")) {
+        engine.setIntegrationStep(fineStep, coarseStep);
+    }
+    if (useOption("fixed-step")) {
+        engine.setAdaptiveStepping(!parser.isSet("fixed-step"));
+    }
+    if (parser.isSet("insulin-action")) {
+        QStringList parts = parser.value("insulin-action").split(':');
+        double duration = parts.value(0).toDouble(&ok);
+        double peak = ok && parts.size() > 1 ? parts.value(1).toDouble(&ok) : 75;
+        if (!ok || parts.size() > 2 || duration <= 0 || peak < 0) {
+            fprintf(stderr, "Invalid --insulin-action value\n");
+            return 1;
+        }
+        engine.getBloodstream()->setActionCurve(duration, peak);
+    }
+    if (parser.isSet("sensor")) {
+        SensorParameters sensor = SensorParameters::fromString(parser.value("sensor"), &ok);
+        if (!ok) {
+            fprintf(stderr, "Invalid --sensor value\n");
+            return 1;
+        }
+        engine.getCGM()->setSensor(sensor, SimulationEngine::sampleMinutes);
+    }
+    if (parser.isSet("carb-absorption")) {
+        const QStringList shapes = {"instant", "linear", "triangular"};
+        QStringList parts = parser.value("carb-absorption").split(':');
+        int shape = shapes.indexOf(parts.value(0).toLower());
+        CarbAbsorption::Profile absorption;
+        if (parts.size() > 1) absorption.minutes = parts.value(1).toDouble(&ok);
+        if (shape < 0 || !ok || parts.size() > 2 || absorption.minutes <= 0) {
+            fprintf(stderr, "Invalid --carb-absorption value\n");
+            return 1;
+        }
+        absorption.shape = CarbAbsorption::Shape(shape);
+        engine.getCarbAbsorption()->setDefaultProfile(absorption);
+    }
+    if (parser.isSet("controller")) {
+        const QStringList controllers = {"threshold", "mpc"}; // ControlIQAlgorithm::Strategy order
+        int strategy = controllers.indexOf(parser.value("controller").toLower());
+        if (strategy < 0) {
+            fprintf(stderr, "Invalid --controller value\n");
+            return 1;
+        }
+        engine.getController()->setStrategy(ControlIQAlgorithm::Strategy(strategy));
+    }
+    engine.setMonitoring(true);
+    for (const QString &fault : parser.values("fault")) {
+        int separator = fault.indexOf(':');
+        int kind = FaultInjector::faultNamed(fault.left(separator));
+        FaultProfile profile = FaultProfile::fromString(fault.mid(separator + 1), &ok);
+        if (separator < 0 || kind < 0 || !ok) {
+            fprintf(stderr, "Invalid --fault value: %s\n", qPrintable(fault));
+            return 1;
+        }
+        engine.setFaultProfile(SimulationEngine::FaultType(kind), profile);
+    }
+    if (parser.isSet("scenario")) {
+        QString error;
+        if (!engine.loadScenario(parser.value("scenario"), &error)) {
+            fprintf(stderr, "%s\n", qPrintable(error));
+            return 1;
+        }
+    }
+
+    const QDateTime start = engine.currentTime();
+    const QDateTime end = start.addDays(days);
+    for (int day = 0; day <= days; day++) {
+        QDate date = start.date().addDays(day);
+        for (const QPair<QTime, double> &meal : meals) {
+            QDateTime time(date, meal.first);
+            if (time >= start && time < end) engine.scheduleMeal(time, meal.second);
+        }
+        for (const QPair<QTime, double> &segment : segments) {
+            QDateTime time(date, segment.first);
+            if (time >= start && time < end) engine.scheduleBasalRate(time, segment.second);
+        }
+    }
+
+    int samples = 0, readings = 0, inRange = 0, belowRange = 0, aboveRange = 0;
+    int charges = 0, refills = 0;
+    double glucoseSum = 0, minGlucose = 0, maxGlucose = 0;
+
+    QObject::connect(&engine, &SimulationEngine::sampled, [&](const SimulationSample &sample) {
+        samples++;
+        if (sample.glucose != -1) {
+            if (readings == 0 || sample.glucose < minGlucose) minGlucose = sample.glucose;
+            if (readings == 0 || sample.glucose > maxGlucose) maxGlucose = sample.glucose;
+            readings++;
+            glucoseSum += sample.glucose;
+            if (sample.glucose < 3.9) belowRange++;
+            else if (sample.glucose > 10.0) aboveRange++;
+            else inRange++;
+        }
+
+        if (csvFile.isOpen()) {
+            csv << engine.currentTime().toString(Qt::ISODate) << ',' << sample.glucose << ',' << sample.iob << ','
+                << sample.insulin << ',' << sample.battery << ',' << sample.activity << ',' << sample.cob << ','
+                << sample.forecast30 << ',' << sample.forecast60 << '\n';
+        }
+
+        // Attentive user: charge and refill as soon as the device asks for it
+        if (engine.getBattery()->isBatteryCritical()) {
+            engine.getBattery()->chargeBattery();
+            engine.getAlerts()->reset(AlertMonitor::BATTERY_LOW);
+            charges++;
+        }
+        if (engine.getInsulinReserve()->isInsulinLow()) {
+            engine.getInsulinReserve()->refillInsulin();
+            engine.getAlerts()->reset(AlertMonitor::INSULIN_LOW);
+            refills++;
+        }
+    });
+
+    QElapsedTimer wallClock;
+    wallClock.start();
+
+    int events = engine.runUntil(end);
+
+    qint64 wallNs = wallClock.nsecsElapsed();
+    if (logger) {
+        logger->flush();
+    }
+
+    printf("Simulated %d day(s), %d events, %d sensor samples (seed %llu)\n", days, events, samples,
+           (unsigned long long)engine.getSeed());
+    printf("Wall time:         %.3f s (%.0f simulated s per wall s)\n", wallNs / 1e9,
+           wallNs > 0 ? start.secsTo(engine.currentTime()) / (wallNs / 1e9) : 0.0);
+    IntegrationStats integration = engine.getIntegrationStats();
+    printf("Integration:       %lld steps (%lld fine), estimated error %.4f mmol/L total, %.4f max per step\n",
+           (long long)integration.steps, (long long)integration.fineSteps, integration.estimatedError, integration.maxLocalError);
+    if (readings > 0) {
+        printf("Mean glucose:      %.2f mmol/L (min %.2f, max %.2f)\n", glucoseSum / readings, minGlucose, maxGlucose);
+        printf("Time in range:     %.1f%%\n", 100.0 * inRange / readings);
+        printf("Time below 3.9:    %.1f%%\n", 100.0 * belowRange / readings);
+        printf("Time above 10.0:   %.1f%%\n", 100.0 * aboveRange / readings);
+    }
+    printf("Insulin on board:  %.2f units\n", engine.getBloodstream()->getIOB());
+    printf("Reservoir:         %.1f units (%d refill(s))\n", engine.getInsulinReserve()->getInsulinRemaining(), refills);
+    printf("Battery charges:   %d\n", charges);
+    if (parser.isSet("fault")) {
+        printf("Random faults:     %d sensor, %d occlusion, %d battery\n", engine.getFaults()->getOnsets(SimulationEngine::SensorFault),
+               engine.getFaults()->getOnsets(SimulationEngine::OcclusionFault), engine.getFaults()->getOnsets(SimulationEngine::BatteryFault));
+    }
+
+    printf("Basal suspended:   %d time(s), %.1f h total\n", engine.getController()->getSuspensions(),
+           engine.getController()->getSuspendedMSecs() / 3600000.0);
+    if (engine.getController()->getStrategy() == ControlIQAlgorithm::MPCStrategy) {
+        MPCTiming timing = engine.getController()->getMPC()->getTiming();
+        printf("MPC decisions:     %lld, %.0f ns mean, %lld ns max; %lld gain rebuild(s), %.0f ns mean\n",
+               (long long)timing.decisions, timing.decisions ? double(timing.decisionNs) / timing.decisions : 0.0,
+               (long long)timing.maxDecisionNs, (long long)timing.rebuilds,
+               timing.rebuilds ? double(timing.rebuildNs) / timing.rebuilds : 0.0);
+    }
+
+    if (parser.isSet("save-checkpoint")) {
+        QFile checkpointFile(parser.value("save-checkpoint"));
+        QByteArray checkpoint = engine.saveCheckpoint();
+        if (!checkpointFile.open(QIODevice::WriteOnly) || checkpointFile.write(checkpoint) != checkpoint.size()) {
+            fprintf(stderr, "Could not save a checkpoint to %s\n", qPrintable(parser.value("save-checkpoint")));
+            return 1;
+        }
+        printf("Checkpoint:        %s (%d bytes)\n", qPrintable(parser.value("save-checkpoint")), int(checkpoint.size()));
+    }
+
+    return 0;
+}
@@ -0,0 +1,858 @@
+#include "simulationengine.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include "glucosemodel.h"
+#include <cmath>
+
+SimulationEngine::SimulationEngine(DataLogger *logger, QObject *parent)
+    : QObject(parent)
+    , monitoring(false)
+    , replayMode(false)
+    , profile(Profile::defaultProfile())
+    , measuredSimMSecs(0)
+    , measuredWallNs(0)
+    , lastGlucose(-1)
+    , bolusCompleteEvent(0)
+    , fineStepMSecs(qint64(fineStepMinutes) * 60 * 1000)
+    , coarseStepMSecs(qint64(sampleMinutes) * 60 * 1000)
+    , adaptiveStepping(true)
+    , integrationStats()
+    , clock(new SimClock(SimClock::FreeRunning))
+    , random(QRandomGenerator::global()->generate64())
+    , logger(logger)
+    , battery(new BatteryManager)
+    , insulin(new InsulinReserve)
+    , bloodstream(new Bloodstream(this))
+    , cgm(new CGMReader)
+    , carbAbsorption(new CarbAbsorption)
+    , controlIQ(new ControlIQAlgorithm())
+    , pump(new PumpController(insulin, logger, this))
+    , alerts(new AlertMonitor(logger, this))
+    , faults(new FaultInjector)
+    , appliedFaults(0)
+    , faultEvents{}
+    , scenario(nullptr)
+    , scenarioStartMSecs(0)
+    , scenarioEvent(0)
+    , decisionLatencies(nullptr)
+{
+    simMSecs = clock->nowMSecs();
+    pump->setClock(clock); // Audit records follow simulated time
+    cgm->setRandom(random.split(GlucoseDriftStream));
+    cgm->setSensorRandom(random.split(SensorNoiseStream));
+    faultRandom = random.split(FaultStream);
+    scheduler.schedule(makeEvent(simMSecs + qint64(sampleMinutes) * 60 * 1000, SimEvent::SensorSample));
+
+    // Every bolus, whoever starts it, steps the integration to each start and end of its pulses
+    connect(pump, &PumpController::bolusDeliveryStarted, this, [this](){ scheduleBolusCompletion(); });
+}
+
+SimulationEngine::~SimulationEngine()
+{
+    delete scenario;
+    delete faults;
+    delete controlIQ;
+    delete carbAbsorption;
+    delete cgm;
+    delete insulin;
+    delete battery;
+    delete clock;
+}
+
+SimulationSample SimulationEngine::tick(){ // Each tick represents 5 minutes
+    qint64 target = clock->getMode() == SimClock::FreeRunning
+            ? simMSecs + qint64(tickMinutes) * 60 * 1000
+            : clock->nowMSecs();
+    processUntil(target, nullptr);
+    return currentSample(lastGlucose);
+}
+
+int SimulationEngine::runFor(int wallBudgetMs, QVector<SimulationSample> *samples){
+    QElapsedTimer timer;
+    timer.start();
+    qint64 simStart = simMSecs;
+    const qint64 budgetNs = qint64(wallBudgetMs) * 1000000;
+
+    int events = 0;
+    do {
+        if (!processNextEvent(samples)) {
+            break;
+        }
+        events++;
+        if (battery->getBatteryLevel() <= 0) {
+            break; // The device is dead until it is charged
+        }
+    } while (timer.nsecsElapsed() < budgetNs);
+
+    measuredSimMSecs += simMSecs - simStart;
+    measuredWallNs += timer.nsecsElapsed();
+    return events;
+}
+
+int SimulationEngine::runUntil(const QDateTime &time, QVector<SimulationSample> *samples){
+    QElapsedTimer timer;
+    timer.start();
+    qint64 simStart = simMSecs;
+
+    int events = processUntil(time.toMSecsSinceEpoch(), samples);
+
+    measuredSimMSecs += simMSecs - simStart;
+    measuredWallNs += timer.nsecsElapsed();
+    return events;
+}
+
+int SimulationEngine::processUntil(qint64 msecs, QVector<SimulationSample> *samples){
+    int events = 0;
+    qint64 next = scheduler.nextTime();
+    while (next != -1 && next <= msecs) {
+        processNextEvent(samples);
+        events++;
+        if (battery->getBatteryLevel() <= 0) {
+            return events; // The device is dead until it is charged
+        }
+        next = scheduler.nextTime();
+    }
+    integrateTo(msecs);
+    return events;
+}
+
+bool SimulationEngine::processNextEvent(QVector<SimulationSample> *samples){
+    SimEvent event;
+    if (!scheduler.takeNext(&event)) {
+        return false;
+    }
+    integrateTo(event.time);
+    applyFaults(); // Manual faults may have been set from another thread
+
+    switch (event.type) {
+        case SimEvent::SensorSample:
+            if (replayMode) {
+                break; // Recorded readings take over; setReplayMode(false) restarts sampling
+            }
+            cgm->varyDrift();
+            scheduler.schedule(makeEvent(event.time + qint64(sampleMinutes) * 60 * 1000, SimEvent::SensorSample));
+            takeSample(samples);
+            break;
+        case SimEvent::RecordedReading:
+            if (replayMode) {
+                if (event.active) { // Recorded IOB: resyncs with boluses the replay did not see
+                    double drift = event.rate - bloodstream->getIOB();
+                    if (drift > 0) {
+                        bloodstream->injectUnits(drift);
+                    } else {
+                        bloodstream->absorbUnits(-drift);
+                    }
+                }
+                cgm->setReading(event.amount);
+                takeSample(samples);
+            }
+            break;
+        case SimEvent::BasalChange:
+            startBasalSegment(event.rate);
+            break;
+        case SimEvent::BolusComplete:
+            bolusCompleteEvent = 0;
+            if (pump->hoursUntilBolusComplete() > 0) {
+                scheduleBolusCompletion(); // More pulses to come, or delivery stalled (occlusion or no CGM)
+            }
+            break;
+        case SimEvent::ExtendedDoseRelease: // Legacy: only restored from checkpoints written before delivery plans
+            pump->startPlan(DeliveryPlan::normal(event.amount, event.rate), /*suppressTime=*/true);
+            break;
+        case SimEvent::Meal:
+            if (event.active) {
+                intakeCarbs(event.amount, {CarbAbsorption::Shape(event.fault), event.rate});
+            } else {
+                intakeCarbs(event.amount);
+            }
+            break;
+        case SimEvent::Fault:
+            if (event.fault >= 0 && event.fault < FaultInjector::faultCount) {
+                faults->setFault(event.fault, event.active);
+                applyFaults();
+            }
+            break;
+        case SimEvent::FaultTransition: {
+            faultEvents[event.fault] = 0;
+            qint64 delay = faults->transition(event.fault, faultRandom);
+            applyFaults();
+            if (delay >= 0) {
+                SimEvent next = makeEvent(simMSecs + delay, SimEvent::FaultTransition);
+                next.fault = event.fault;
+                faultEvents[event.fault] = scheduler.schedule(next);
+            }
+            break;
+        }
+        case SimEvent::ScenarioStep:
+            scenarioEvent = 0;
+            takeScenarioActions();
+            break;
+    }
+    return true;
+}
+
+void SimulationEngine::applyFaults(){
+    int active = faults->activeFaults();
+    if (active == appliedFaults) {
+        return;
+    }
+    cgm->setSensorError(active & (1 << SensorFault));
+    pump->setOccluded(active & (1 << OcclusionFault));
+    bool batteryFailing = active & (1 << BatteryFault);
+    if (batteryFailing != battery->isFailing() && logger) {
+        logger->logEvent("Warning", batteryFailing ? "Battery failure." : "Battery failure cleared.");
+    }
+    battery->setFailing(batteryFailing);
+    appliedFaults = active;
+}
+
+void SimulationEngine::setFaultProfile(FaultType fault, const FaultProfile &profile){
+    scheduler.cancel(faultEvents[fault]);
+    faultEvents[fault] = 0;
+    faults->setProfile(fault, profile);
+    applyFaults();
+
+    qint64 delay = faults->firstTransition(fault, faultRandom);
+    if (delay >= 0) {
+        SimEvent event = makeEvent(simMSecs + delay, SimEvent::FaultTransition);
+        event.fault = fault;
+        faultEvents[fault] = scheduler.schedule(event);
+    }
+}
+
+void SimulationEngine::startBasalSegment(double rate){
+    profile.setBasalRate(rate);
+    if (monitoring && controlIQ->getCurrentRate() != 0) {
+        controlIQ->adjustBasalRate(pump, rate); // Not while delivery is suspended for a low
+    }
+    if (logger) logger->logEvent("Info", "Basal segment started at " + QString::number(rate) + " units/hour.");
+}
+
+void SimulationEngine::takeScenarioActions(){
+    while (scenario && scenario->hasNext() && scenarioStartMSecs + scenario->peekNext().offsetMSecs <= simMSecs) {
+        applyScenarioAction(scenario->takeNext());
+    }
+    if (!scenario) {
+        return;
+    }
+    if (scenario->hasNext()) {
+        scenarioEvent = scheduler.schedule(makeEvent(scenarioStartMSecs + scenario->peekNext().offsetMSecs,
+                                                     SimEvent::ScenarioStep));
+    } else {
+        if (!scenario->errorString().isEmpty() && logger) {
+            logger->logEvent("Error", "Scenario stopped: " + scenario->errorString());
+        }
+        clearScenario();
+    }
+}
+
+void SimulationEngine::applyScenarioAction(const ScenarioAction &action){
+    switch (action.type) {
+        case ScenarioAction::Meal:
+            if (action.hasAbsorption) {
+                intakeCarbs(action.amount, action.absorption);
+            } else {
+                intakeCarbs(action.amount);
+            }
+            break;
+        case ScenarioAction::Bolus: // Blocked (and logged) while the pump is suspended, like a bolus from the UI
+            startBolus(action.bolusPlan(GlucoseModel::bolusRate));
+            break;
+        case ScenarioAction::BasalRate:
+            startBasalSegment(action.amount);
+            break;
+        case ScenarioAction::ProfileChange:
+            if (action.carbRatio >= 0) profile.setCarbRatio(action.carbRatio);
+            if (action.correctionFactor >= 0) profile.setCorrectionFactor(action.correctionFactor);
+            if (action.targetGlucose >= 0) profile.setTargetGlucose(action.targetGlucose);
+            if (action.basalRate >= 0) {
+                startBasalSegment(action.basalRate);
+            }
+            if (logger) logger->logEvent("Info", "Profile changed by scenario line " + QString::number(action.line) + ".");
+            break;
+        case ScenarioAction::CGMFault:
+            setCGMError(action.active);
+            break;
+        case ScenarioAction::PumpFault:
+            setPumpError(action.active);
+            break;
+        case ScenarioAction::BatteryFault:
+            setBatteryError(action.active);
+            break;
+        case ScenarioAction::Refill:
+            insulin->refillInsulin();
+            alerts->reset(AlertMonitor::INSULIN_LOW);
+            break;
+        case ScenarioAction::Charge:
+            battery->chargeBattery();
+            alerts->reset(AlertMonitor::BATTERY_LOW);
+            break;
+    }
+}
+
+bool SimulationEngine::loadScenario(const QString &path, QString *error){
+    Scenario *loaded = new Scenario;
+    if (!loaded->open(path, error)) {
+        delete loaded;
+        return false;
+    }
+    clearScenario();
+    scenario = loaded;
+    scenarioStartMSecs = simMSecs;
+    scenarioEvent = scheduler.schedule(makeEvent(scenarioStartMSecs + scenario->peekNext().offsetMSecs,
+                                                 SimEvent::ScenarioStep));
+    return true;
+}
+
+void SimulationEngine::clearScenario(){
+    scheduler.cancel(scenarioEvent);
+    scenarioEvent = 0;
+    delete scenario;
+    scenario = nullptr;
+}
+
+bool SimulationEngine::hasScenario() const{
+    return scenario != nullptr;
+}
+
+void SimulationEngine::takeSample(QVector<SimulationSample> *samples){
+    if (!monitoring) {
+        controlIQ->observe(simMSecs, -1, ForecastEffects());
+    }
+    lastGlucose = monitoring ? monitor() : -1;
+    SimulationSample sample = currentSample(lastGlucose);
+    if (samples) {
+        samples->append(sample);
+    }
+    emit sampled(sample);
+}
+
+void SimulationEngine::integrateTo(qint64 msecs){
+    if (msecs <= simMSecs) {
+        return;
+    }
+    battery->drainBattery((msecs - simMSecs) / 3600000.0);
+
+    if (monitoring) {
+        while (simMSecs < msecs) {
+            qint64 step = stepMSecs();
+            if (step == fineStepMSecs) {
+                integrationStats.fineSteps++;
+            }
+            step = qMin(step, msecs - simMSecs); // Never step past the next event
+            integrateStep(step);
+            simMSecs += step;
+        }
+    }
+
+    simMSecs = msecs;
+    if (clock->getMode() == SimClock::FreeRunning) {
+        clock->advance(simMSecs - clock->nowMSecs());
+    }
+}
+
+void SimulationEngine::integrateStep(qint64 elapsedMSecs){
+    double elapsedHours = elapsedMSecs / 3600000.0;
+    bool delivering = lastGlucose != -1; // Delivery follows the latest valid reading
+    double correctionFactor = profile.getCorrectionFactor();
+
+    // Step-doubling error estimate: one full step against two half steps. An action curve
+    // is propagated exactly, so the estimate only applies to the linear model.
+    double error = 0;
+    if (bloodstream->getModel() == Bloodstream::LinearModel) {
+        double iob = bloodstream->getIOB();
+        double rate = delivering ? pump->getDeliveryRate() : 0;
+        double half = elapsedHours / 2;
+        double midIOB = iob - cgm->absorption(iob, half) + rate * half;
+        error = std::fabs(cgm->glucoseChange(iob, correctionFactor, elapsedHours)
+                          - cgm->glucoseChange(iob, correctionFactor, half)
+                          - cgm->glucoseChange(midIOB, correctionFactor, half));
+    }
+    integrationStats.steps++;
+    integrationStats.estimatedError += error;
+    integrationStats.maxLocalError = qMax(integrationStats.maxLocalError, error);
+
+    if (carbAbsorption->activeMeals() > 0) {
+        cgm->intakeGlucose(profile.getCarbRatio() * carbAbsorption->absorb(elapsedHours));
+    }
+    cgm->advance(bloodstream, correctionFactor, elapsedHours);
+    if (delivering) {
+        pump->pump(bloodstream, elapsedMSecs, simMSecs); // Milliseconds, so fixed-point dosing needs no floating point
+    }
+}
+
+qint64 SimulationEngine::stepMSecs() const{
+    bool active = pump->hoursUntilBolusComplete() > 0 || bloodstream->getIOB() > activeIOB;
+    return (active || !adaptiveStepping) ? fineStepMSecs : coarseStepMSecs;
+}
+
+void SimulationEngine::setIntegrationStep(double fineMinutes, double coarseMinutes){
+    if (fineMinutes <= 0 || coarseMinutes <= 0) {
+        return;
+    }
+    fineStepMSecs = qMax(qint64(1), qRound64(fineMinutes * 60 * 1000));
+    coarseStepMSecs = qMax(fineStepMSecs, qRound64(coarseMinutes * 60 * 1000));
+}
+
+void SimulationEngine::setAdaptiveStepping(bool adaptive){
+    adaptiveStepping = adaptive;
+}
+
+bool SimulationEngine::isAdaptiveStepping() const{
+    return adaptiveStepping;
+}
+
+IntegrationStats SimulationEngine::getIntegrationStats() const{
+    return integrationStats;
+}
+
+void SimulationEngine::resetIntegrationStats(){
+    integrationStats = IntegrationStats();
+}
+
+SimEvent SimulationEngine::makeEvent(qint64 msecs, SimEvent::Type type) const{
+    SimEvent event;
+    event.time = qMax(msecs, simMSecs);
+    event.type = type;
+    event.amount = 0;
+    event.rate = 0;
+    event.fault = 0;
+    event.active = false;
+    event.id = 0;
+    return event;
+}
+
+void SimulationEngine::scheduleBolusCompletion(){
+    scheduler.cancel(bolusCompleteEvent);
+    bolusCompleteEvent = 0;
+
+    double hours = pump->hoursUntilDeliveryChange();
+    if (hours > 0) {
+        // Rounded up so the pulse has started or been delivered when the event fires
+        qint64 due = simMSecs + qMax(qint64(1), qint64(std::ceil(hours * 3600000.0)));
+        bolusCompleteEvent = scheduler.schedule(makeEvent(due, SimEvent::BolusComplete));
+    }
+}
+
+SimulationSample SimulationEngine::currentSample(double glucose) const{
+    SimulationSample sample;
+    sample.glucose = glucose;
+    sample.battery = battery->getBatteryLevel();
+    sample.insulin = insulin->getInsulinRemaining();
+    sample.iob = bloodstream->getIOB();
+    sample.activity = bloodstream->getActivity();
+    sample.cob = carbAbsorption->getCOB();
+    const Forecast &forecast = controlIQ->getForecast();
+    sample.forecast30 = forecast.valid ? forecast.in30 : -1;
+    sample.forecast60 = forecast.valid ? forecast.in60 : -1;
+    return sample;
+}
+
+QDateTime SimulationEngine::currentTime() const{
+    return QDateTime::fromMSecsSinceEpoch(simMSecs);
+}
+
+QByteArray SimulationEngine::saveCheckpoint() const{
+    QByteArray checkpoint;
+    QDataStream out(&checkpoint, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_12);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    out << checkpointMagic << checkpointVersion;
+    out << simMSecs << monitoring << replayMode << lastGlucose << bolusCompleteEvent;
+    out << fineStepMSecs << coarseStepMSecs << adaptiveStepping;
+    out << integrationStats.steps << integrationStats.fineSteps << integrationStats.estimatedError
+        << integrationStats.maxLocalError;
+    out << qint32(profile.getId()) << profile.getName() << profile.getBasalRate() << profile.getCarbRatio()
+        << profile.getCorrectionFactor() << profile.getTargetGlucose();
+
+    random.saveState(out);
+    scheduler.saveState(out);
+    battery->saveState(out);
+    insulin->saveState(out);
+    bloodstream->saveState(out);
+    cgm->saveState(out);
+    carbAbsorption->saveState(out);
+    controlIQ->saveState(out);
+    pump->saveState(out);
+    alerts->saveState(out);
+
+    out << (scenario != nullptr);
+    if (scenario) {
+        out << scenario->path() << scenarioStartMSecs << scenarioEvent << scenario->position()
+            << qint32(scenario->lineNumber()) << scenario->previousOffset();
+    }
+
+    faults->saveState(out);
+    faultRandom.saveState(out);
+    out << qint32(appliedFaults);
+    for (quint64 id : faultEvents) {
+        out << id;
+    }
+    return checkpoint;
+}
+
+bool SimulationEngine::restoreCheckpoint(const QByteArray &checkpoint){
+    QByteArray previous = saveCheckpoint();
+    if (!readCheckpoint(checkpoint)) {
+        readCheckpoint(previous);
+        return false;
+    }
+    clock->setTime(QDateTime::fromMSecsSinceEpoch(simMSecs));
+    resetSpeedMeasurement();
+    return true;
+}
+
+bool SimulationEngine::readCheckpoint(const QByteArray &checkpoint){
+    QDataStream in(checkpoint);
+    in.setVersion(QDataStream::Qt_5_12);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    quint32 magic = 0;
+    quint16 version = 0;
+    in >> magic >> version;
+    if (in.status() != QDataStream::Ok || magic != checkpointMagic || version < 1 || version > checkpointVersion) {
+        return false;
+    }
+
+    in >> simMSecs >> monitoring;
+    replayMode = false;
+    if (version >= 2) {
+        in >> replayMode;
+    }
+    in >> lastGlucose >> bolusCompleteEvent;
+    in >> fineStepMSecs >> coarseStepMSecs >> adaptiveStepping;
+    in >> integrationStats.steps >> integrationStats.fineSteps >> integrationStats.estimatedError
+       >> integrationStats.maxLocalError;
+    qint32 profileId = 0;
+    QString profileName;
+    double basalRate = 0, carbRatio = 0, correctionFactor = 0, targetGlucose = 0;
+    in >> profileId >> profileName >> basalRate >> carbRatio >> correctionFactor >> targetGlucose;
+    profile = Profile(profileName, basalRate, carbRatio, correctionFactor, targetGlucose, profileId);
+
+    random.restoreState(in);
+    scheduler.restoreState(in, &SimulationEngine::isRestorableEvent);
+    if (in.status() != QDataStream::Ok) {
+        return false; // Truncated, or an event the engine cannot run
+    }
+    battery->restoreState(in);
+    insulin->restoreState(in);
+    bloodstream->restoreState(in, version);
+    cgm->restoreState(in, version);
+    if (version < 5) {
+        cgm->setSensorRandom(random.split(SensorNoiseStream));
+    }
+    if (version >= 4) {
+        carbAbsorption->restoreState(in);
+    } else {
+        carbAbsorption->clear(); // Meals were absorbed at once
+        carbAbsorption->setDefaultProfile({CarbAbsorption::Instant, 0});
+    }
+    controlIQ->restoreState(in, version);
+    pump->restoreState(in, version);
+    alerts->restoreState(in);
+
+    bool hasScenario = false;
+    if (version >= 6) {
+        in >> hasScenario;
+    }
+    delete scenario;
+    scenario = nullptr;
+    scenarioEvent = 0;
+    if (hasScenario) {
+        QString path;
+        qint64 position = 0, previousOffset = 0;
+        qint32 line = 0;
+        in >> path >> scenarioStartMSecs >> scenarioEvent >> position >> line >> previousOffset;
+        scenario = new Scenario;
+        if (in.status() != QDataStream::Ok || !scenario->open(path) || !scenario->seek(position, line, previousOffset)) {
+            return false; // The scenario file is gone or changed
+        }
+    }
+
+    if (version >= 7) {
+        faults->restoreState(in);
+        faultRandom.restoreState(in);
+        qint32 applied = 0;
+        in >> applied;
+        appliedFaults = applied;
+        for (quint64 &id : faultEvents) {
+            in >> id;
+        }
+    } else {
+        faults->clear(); // Only the manual sensor and pump faults existed
+        faults->setFault(SensorFault, cgm->hasSensorError());
+        faults->setFault(OcclusionFault, pump->isOccluded());
+        faultRandom = random.split(FaultStream);
+        appliedFaults = faults->activeFaults();
+        for (quint64 &id : faultEvents) {
+            id = 0;
+        }
+    }
+    battery->setFailing(appliedFaults & (1 << BatteryFault));
+
+    if (version >= 8 && version < 10) {
+        controlIQ->restoreHistory(in); // Kept outside the controller by these versions
+    }
+    return in.status() == QDataStream::Ok && in.atEnd();
+}
+
+bool SimulationEngine::isRestorableEvent(const SimEvent &event){
+    switch (event.type) {
+        case SimEvent::Fault:
+        case SimEvent::FaultTransition:
+            return event.fault >= 0 && event.fault < FaultInjector::faultCount; // Indexes faultEvents
+        case SimEvent::Meal:
+            return !event.active || (event.fault >= CarbAbsorption::Instant && event.fault <= CarbAbsorption::Triangular);
+        default:
+            return true;
+    }
+}
+
+void SimulationEngine::setTime(const QDateTime &time){
+    qint64 msecs = time.toMSecsSinceEpoch();
+    scheduler.shift(msecs - simMSecs);
+    scenarioStartMSecs += msecs - simMSecs;
+    simMSecs = msecs;
+    clock->setTime(time);
+}
+
+quint64 SimulationEngine::scheduleMeal(const QDateTime &time, double carbs){
+    SimEvent event = makeEvent(time.toMSecsSinceEpoch(), SimEvent::Meal);
+    event.amount = carbs;
+    return scheduler.schedule(event);
+}
+
+quint64 SimulationEngine::scheduleMeal(const QDateTime &time, double carbs, const CarbAbsorption::Profile &absorption){
+    SimEvent event = makeEvent(time.toMSecsSinceEpoch(), SimEvent::Meal);
+    event.amount = carbs;
+    event.rate = absorption.minutes;
+    event.fault = absorption.shape;
+    event.active = true;
+    return scheduler.schedule(event);
+}
+
+quint64 SimulationEngine::scheduleRecordedReading(const QDateTime &time, double glucose, double iob){
+    SimEvent event = makeEvent(time.toMSecsSinceEpoch(), SimEvent::RecordedReading);
+    event.amount = glucose;
+    event.rate = iob;
+    event.active = iob >= 0;
+    return scheduler.schedule(event);
+}
+
+quint64 SimulationEngine::scheduleBasalRate(const QDateTime &time, double rate){
+    SimEvent event = makeEvent(time.toMSecsSinceEpoch(), SimEvent::BasalChange);
+    event.rate = rate;
+    return scheduler.schedule(event);
+}
+
+quint64 SimulationEngine::scheduleFault(const QDateTime &time, FaultType fault, bool active){
+    SimEvent event = makeEvent(time.toMSecsSinceEpoch(), SimEvent::Fault);
+    event.fault = fault;
+    event.active = active;
+    return scheduler.schedule(event);
+}
+
+void SimulationEngine::cancelEvent(quint64 id){
+    scheduler.cancel(id);
+}
+
+double SimulationEngine::getSimulationSpeed() const{
+    if (measuredWallNs <= 0) {
+        return 0;
+    }
+    return (measuredSimMSecs / 1e3) / (measuredWallNs / 1e9);
+}
+
+void SimulationEngine::resetSpeedMeasurement(){
+    measuredSimMSecs = 0;
+    measuredWallNs = 0;
+}
+
+double SimulationEngine::monitor(){
+    QDateTime time = currentTime();
+
+    double glucose = replayMode ? cgm->getCurrentGlucoseLevel() : cgm->sampleSensor(); // Recorded readings already went through a sensor
+    double target = profile.getTargetGlucose();
+
+    QElapsedTimer timer;
+    if (decisionLatencies) {
+        timer.start();
+    }
+
+    controlIQ->observe(simMSecs, glucose, glucose != -1 ? forecastEffects() : ForecastEffects());
+
+    safetyChecks(glucose, target);
+
+    // Pump logic; delivery itself is integrated between events
+    if (glucose != -1){
+        controlIQ->analyzeGlucoseData(glucose, profile, logger, pump, bloodstream->getIOB());
+    }
+    if (decisionLatencies) {
+        decisionLatencies->append(timer.nsecsElapsed());
+    }
+
+    if (glucose != -1 && logger) {
+        logger->logGlucose(time, glucose);
+        logger->logInsulin(time, bloodstream->getIOB());
+    }
+    return glucose;
+}
+
+void SimulationEngine::safetyChecks(double glucose, double target){
+    if (battery->isBatteryCritical()){
+        alerts->raise(AlertMonitor::BATTERY_LOW);
+    }
+
+    if (insulin->isInsulinLow()){
+        alerts->raise(AlertMonitor::INSULIN_LOW);
+    }
+
+    if (cgm->isCGMConnected()) {
+        alerts->reset(AlertMonitor::CGM_DISCONNECTED);
+    } else {
+        alerts->raise(AlertMonitor::CGM_DISCONNECTED);
+    }
+
+    if (not pump->isOccluded()) {
+        alerts->reset(AlertMonitor::PUMP_OCCLUSION);
+    } else {
+        alerts->raise(AlertMonitor::PUMP_OCCLUSION);
+    }
+
+    if (glucose == -1){
+        pump->suspendBolus();  // Stop insulin delivery temporarily
+    } else if (glucose < 3.9) {
+        pump->suspendBolus();  // Stop insulin delivery temporarily
+        alerts->raise(AlertMonitor::GLUCOSE_LOW);
+    } else if (glucose > target + 2.0) {
+        alerts->raise(AlertMonitor::GLUCOSE_HIGH);
+    } else if (glucose <= target + 0.5 and glucose >= target -0.5) {
+        alerts->reset(AlertMonitor::GLUCOSE_HIGH);
+        alerts->reset(AlertMonitor::GLUCOSE_LOW);
+    }
+
+    const Forecast &forecast = controlIQ->getForecast();
+    if (forecast.valid and glucose >= 3.9 and forecast.in30 < 3.9) {
+        alerts->raise(AlertMonitor::GLUCOSE_PREDICTED_LOW);
+    } else if (not forecast.valid or forecast.in30 >= 4.4) {
+        alerts->reset(AlertMonitor::GLUCOSE_PREDICTED_LOW);
+    }
+}
+
+ForecastEffects SimulationEngine::forecastEffects() const{
+    double correctionFactor = profile.getCorrectionFactor();
+    double carbRatio = profile.getCarbRatio();
+    double usageRate = cgm->getPatient().insulinUsageRate;
+
+    ForecastEffects effects;
+    effects.rate = (carbRatio * carbAbsorption->getAbsorptionRate()
+                    - correctionFactor * bloodstream->getActivity()) / 60;
+    effects.in30 = carbRatio * carbAbsorption->absorbedWithin(0.5) - correctionFactor * bloodstream->absorption(usageRate, 0.5);
+    effects.in60 = carbRatio * carbAbsorption->absorbedWithin(1) - correctionFactor * bloodstream->absorption(usageRate, 1);
+    return effects;
+}
+
+Forecast SimulationEngine::getForecast() const{
+    return controlIQ->getForecast();
+}
+
+void SimulationEngine::setSeed(quint64 seed){
+    random = SimRandom(seed);
+    cgm->setRandom(random.split(GlucoseDriftStream));
+    cgm->setSensorRandom(random.split(SensorNoiseStream));
+    faultRandom = random.split(FaultStream);
+}
+
+quint64 SimulationEngine::getSeed() const{
+    return random.getSeed();
+}
+
+void SimulationEngine::setPatient(const PatientParameters &parameters){
+    cgm->setPatient(parameters);
+}
+
+PatientParameters SimulationEngine::getPatient() const{
+    return cgm->getPatient();
+}
+
+void SimulationEngine::setReplayMode(bool replay){
+    if (replayMode && !replay) {
+        scheduler.schedule(makeEvent(simMSecs + qint64(sampleMinutes) * 60 * 1000, SimEvent::SensorSample));
+    }
+    replayMode = replay;
+}
+
+bool SimulationEngine::isReplayMode() const{
+    return replayMode;
+}
+
+void SimulationEngine::setMonitoring(bool monitoring){
+    this->monitoring = monitoring;
+}
+
+bool SimulationEngine::isMonitoring() const{
+    return monitoring;
+}
+
+void SimulationEngine::setProfile(const Profile &profile){
+    this->profile = profile;
+}
+
+Profile SimulationEngine::getProfile() const{
+    return profile;
+}
+
+void SimulationEngine::intakeCarbs(double carbs){
+    intakeCarbs(carbs, carbAbsorption->getDefaultProfile());
+}
+
+void SimulationEngine::intakeCarbs(double carbs, const CarbAbsorption::Profile &absorption){
+    double absorbed = carbAbsorption->addMeal(carbs, absorption);
+    if (absorbed > 0) {
+        cgm->intakeGlucose(profile.getCarbRatio() * absorbed);
+    }
+}
+
+quint64 SimulationEngine::startBolus(const DeliveryPlan &plan){
+    return pump->startPlan(plan, /*suppressTime=*/true);
+}
+
+void SimulationEngine::setCGMError(bool error){
+    faults->setFault(SensorFault, error);
+    applyFaults();
+}
+
+void SimulationEngine::setPumpError(bool error){
+    faults->setFault(OcclusionFault, error);
+    applyFaults();
+}
+
+void SimulationEngine::setBatteryError(bool error){
+    faults->setFault(BatteryFault, error);
+    applyFaults();
+}
+
+BatteryManager *SimulationEngine::getBattery() const { return battery; }
+InsulinReserve *SimulationEngine::getInsulinReserve() const { return insulin; }
+Bloodstream *SimulationEngine::getBloodstream() const { return bloodstream; }
+CGMReader *SimulationEngine::getCGM() const { return cgm; }
+CarbAbsorption *SimulationEngine::getCarbAbsorption() const { return carbAbsorption; }
+FaultInjector *SimulationEngine::getFaults() const { return faults; }
+PumpController *SimulationEngine::getPump() const { return pump; }
+ControlIQAlgorithm *SimulationEngine::getController() const { return controlIQ; }
+
+void SimulationEngine::setDecisionLatencies(QVector<qint64> *latencies){
+    decisionLatencies = latencies;
+}
+
+void SimulationEngine::setController(ControlIQAlgorithm *controller){
+    if (controller && controller != controlIQ) {
+        delete controlIQ;
+        controlIQ = controller;
+    }
+}
+AlertMonitor *SimulationEngine::getAlerts() const { return alerts; }
+DataLogger *SimulationEngine::getLogger() const { return logger; }
+SimClock *SimulationEngine::getClock() const { return clock; }
@@ -0,0 +1,641 @@
+/**
+ * @file simulationengine.h
+ * @brief Defines the SimulationEngine class, the widget-free core of the insulin pump simulator.
+ *
+ * The SimulationEngine owns the simulated patient and pump hardware (bloodstream, CGM,
+ * pump controller, insulin reservoir, battery), the Control-IQ controller and the alert
+ * state, and advances them one tick at a time. It depends only on QtCore so it can be
+ * driven by the Device window, the command-line runner or any other headless client.
+ */
+#ifndef SIMULATIONENGINE_H
+#define SIMULATIONENGINE_H
+
+#include <QObject>
+#include <QMetaType>
+#include <QVector>
+#include "alertmonitor.h"
+#include "batterymanager.h"
+#include "bloodstream.h"
+#include "carbabsorption.h"
+#include "cgmreader.h"
+#include "controliqalgorithm.h"
+#include "datalogger.h"
+#include "faultinjector.h"
+#include "glucoseforecaster.h"
+#include "insulinreserve.h"
+#include "profile.h"
+#include "pumpcontroller.h"
+#include "scenario.h"
+#include "simclock.h"
+#include "eventscheduler.h"
+#include "simrandom.h"
+
+/**
+ * @brief Snapshot of the device readings produced by one simulation tick.
+ */
+struct SimulationSample {
+    double glucose; ///< CGM reading in mmol/L, or -1 if the CGM is disconnected.
+    double battery; ///< Battery level between 0.0 and 1.0.
+    double insulin; ///< Insulin remaining in the reservoir (units).
+    double iob;      ///< Insulin on board (units).
+    double activity; ///< Insulin activity (units/hour), see Bloodstream::getActivity().
+    double cob;      ///< Carbs on board (grams).
+    double forecast30; ///< Glucose predicted in 30 minutes (mmol/L), or -1 without a forecast.
+    double forecast60; ///< Glucose predicted in 60 minutes (mmol/L), or -1 without a forecast.
+};
+Q_DECLARE_METATYPE(SimulationSample)
+
+/**
+ * @brief Counters describing the integration of the continuous model.
+ */
+struct IntegrationStats {
+    qint64 steps;          ///< Integration steps taken.
+    qint64 fineSteps;      ///< Steps taken at the fine step size.
+    double estimatedError; ///< Sum of the step-doubling local glucose error estimates (mmol/L).
+    double maxLocalError;  ///< Largest local glucose error estimate of a single step (mmol/L).
+};
+
+/**
+ * @class SimulationEngine
+ * @brief Headless discrete-event simulation of the insulin pump and the simulated patient.
+ *
+ * The engine keeps an EventScheduler of timed events and jumps from one event to the
+ * next. Between two events the battery drains and, while monitoring is active, insulin
+ * is delivered and the glucose model drifts and absorbs insulin, integrated over the gap
+ * in steps that are independent of the CGM sampling interval. With adaptive stepping
+ * the engine takes fine steps while a bolus is delivered or absorbed and coarse steps
+ * at steady state. A sensor sample event every 5 simulated minutes reads the CGM, runs the safety
+ * checks and Control-IQ and logs the readings; each reading also updates the controller's
+ * GlucoseForecaster, whose 30-minute prediction the controller and the safety checks act on. Meals, basal segment changes
+ * and faults fire at their exact times, and each start and end of a bolus pulse is an
+ * event of its own. A loaded Scenario is streamed in the same way: only its next action
+ * is ever scheduled.
+ *
+ * The engine owns the simulated patient's random generator: every random draw comes
+ * from a stream split off its seed, so a run is bit-reproducible from the seed and
+ * engines running in parallel share no state.
+ *
+ * The engine owns the SimClock that all timestamps come from. The clock is free-running
+ * by default and is moved to each event as it fires; in RealTime or Scaled mode tick()
+ * instead catches up with whatever simulated time has passed.
+ */
+class SimulationEngine : public QObject
+{
+    Q_OBJECT
+public:
+    static constexpr int tickMinutes = 5; ///< Simulated minutes per tick().
+    static constexpr int sampleMinutes = 5; ///< Simulated minutes between CGM samples.
+    static constexpr int fineStepMinutes = 1; ///< Default fine integration step, used while insulin is active (see setIntegrationStep()).
+    static constexpr double activeIOB = 0.5; ///< Insulin on board (units) above which a bolus counts as being absorbed.
+    static constexpr quint32 checkpointMagic = 0x49505343; ///< "IPSC", first bytes of every checkpoint.
+    static constexpr quint16 checkpointVersion = 11; ///< Checkpoint format written by saveCheckpoint() (1 lacks replay mode, 2 the action curve, 3 carb absorption, 4 the sensor model, 5 the scenario, 6 random faults, 7 the forecaster, 8 the controller strategy, 9 the suspension timer, 10 delivery plans).
+
+    /**
+     * @brief Faults that can be scheduled with scheduleFault().
+     */
+    enum FaultType {
+        SensorFault,    ///< CGM sensor error (disconnects the CGM).
+        OcclusionFault, ///< Pump occlusion (halts delivery).
+        BatteryFault    ///< Battery failure (drains the battery many times faster).
+    };
+
+    /**
+     * @brief Streams split off the patient generator, one per consumer of random numbers.
+     */
+    enum RandomStream {
+        GlucoseDriftStream = 1, ///< Natural glucose drift variations (CGMReader).
+        SensorNoiseStream = 2,  ///< Sensor noise and dropouts (CGMReader's SensorModel).
+        FaultStream = 3         ///< Random fault onsets and durations (FaultInjector).
+    };
+
+    /**
+     * @brief Constructs an engine with a full battery and reservoir and the default profile.
+     *
+     * The simulation clock starts free-running at the current wall-clock time, and the
+     * patient generator gets a random seed (see setSeed()).
+     *
+     * @param logger Logger for events and readings, or nullptr to run without logging.
+     * @param parent Optional parent QObject.
+     */
+    explicit SimulationEngine(DataLogger *logger = nullptr, QObject *parent = nullptr);
+
+    /**
+     * @brief Destroys the engine and the subsystems it owns.
+     */
+    ~SimulationEngine();
+
+    /**
+     * @brief Advances the simulation by one tick (5 simulated minutes), firing every event due.
+     *
+     * When the clock is not free-running, advances to the clock's current time instead.
+     *
+     * @return The device readings after the tick, with the latest CGM reading.
+     */
+    SimulationSample tick();
+
+    /**
+     * @brief Fires events back-to-back, without any timer, until the wall-clock budget is spent.
+     *
+     * Used by fast-forward mode with a free-running clock: the caller refreshes its view
+     * once per budget instead of once per sample. Stops early if the battery dies.
+     *
+     * @param wallBudgetMs Wall-clock time budget in milliseconds.
+     * @param samples Optional vector that receives every sensor sample produced.
+     * @return Number of events fired.
+     */
+    int runFor(int wallBudgetMs, QVector<SimulationSample> *samples = nullptr);
+
+    /**
+     * @brief Fires every event up to the given simulated time, then advances to it.
+     *
+     * Quiet periods cost nothing: the engine jumps straight from one event to the next.
+     * Stops early if the battery dies.
+     *
+     * @param time Simulated time to run to.
+     * @param samples Optional vector that receives every sensor sample produced.
+     * @return Number of events fired.
+     */
+    int runUntil(const QDateTime &time, QVector<SimulationSample> *samples = nullptr);
+
+    /**
+     * @brief Returns the simulated time the engine has advanced to.
+     * @return Current simulated time.
+     */
+    QDateTime currentTime() const;
+
+    /**
+     * @brief Moves the simulation to a new start time, shifting every pending event with it.
+     * @param time New current simulated time.
+     */
+    void setTime(const QDateTime &time);
+
+    /**
+     * @brief Schedules a meal.
+     * @param time When the meal is eaten.
+     * @param carbs Carbohydrates eaten (grams).
+     * @return Event id, for cancelEvent().
+     */
+    quint64 scheduleMeal(const QDateTime &time, double carbs);
+
+    /**
+     * @brief Schedules a meal absorbed along its own profile.
+     * @param time When the meal is eaten.
+     * @param carbs Carbohydrates eaten (grams).
+     * @param absorption How the meal is absorbed.
+     * @return Event id, for cancelEvent().
+     */
+    quint64 scheduleMeal(const QDateTime &time, double carbs, const CarbAbsorption::Profile &absorption);
+
+    /**
+     * @brief Schedules the start of a basal segment: the profile basal rate changes at that time.
+     * @param time When the segment starts.
+     * @param rate New basal rate (units/hour).
+     * @return Event id, for cancelEvent().
+     */
+    quint64 scheduleBasalRate(const QDateTime &time, double rate);
+
+    /**
+     * @brief Schedules a fault being set or cleared.
+     * @param time When the fault changes.
+     * @param fault Which fault, see FaultType.
+     * @param active True to set the fault, false to clear it.
+     * @return Event id, for cancelEvent().
+     */
+    quint64 scheduleFault(const QDateTime &time, FaultType fault, bool active);
+
+    /**
+     * @brief Schedules a recorded CGM reading, used in replay mode.
+     *
+     * When the recorded insulin on board is given, the bloodstream is brought to it before
+     * the reading is acted on, so boluses given during the recording reach the replay.
+     *
+     * @param time When the reading was taken.
+     * @param glucose Recorded glucose (mmol/L).
+     * @param iob Recorded insulin on board at the reading (units), or -1 to keep the model's.
+     * @return Event id, for cancelEvent().
+     */
+    quint64 scheduleRecordedReading(const QDateTime &time, double glucose, double iob = -1);
+
+    /**
+     * @brief Loads a scenario file and starts it at the current simulated time.
+     *
+     * The file is streamed: the next action is read from it only when the previous one
+     * fires, so scenarios spanning months cost no loading time. A scenario replaces the
+     * previous one. An invalid line further on ends the scenario there with an error in
+     * the log.
+     *
+     * @param path Scenario file, see scenario.h for the format.
+     * @param error Optional; receives a description of the problem on failure.
+     * @return False if the file cannot be opened or its first action is invalid.
+     */
+    bool loadScenario(const QString &path, QString *error = nullptr);
+
+    /**
+     * @brief Stops the loaded scenario; its remaining actions are dropped.
+     */
+    void clearScenario();
+
+    /**
+     * @brief Checks whether a scenario still has actions to take.
+     * @return True while a loaded scenario is running.
+     */
+    bool hasScenario() const;
+
+    /**
+     * @brief Cancels a scheduled event.
+     * @param id Id returned by one of the schedule functions.
+     */
+    void cancelEvent(quint64 id);
+
+    /**
+     * @brief Sets the integration step sizes.
+     *
+     * Invalid values are ignored; the coarse step is raised to at least the fine step.
+     *
+     * @param fineMinutes Step used while a bolus is delivered or absorbed (or always, without adaptive stepping).
+     * @param coarseMinutes Step used at steady state with adaptive stepping.
+     */
+    void setIntegrationStep(double fineMinutes, double coarseMinutes);
+
+    /**
+     * @brief Enables or disables adaptive stepping.
+     * @param adaptive True to switch between fine and coarse steps, false to always use the fine step.
+     */
+    void setAdaptiveStepping(bool adaptive);
+    bool isAdaptiveStepping() const;
+
+    /**
+     * @brief Returns the integration counters and accuracy estimate since the last reset.
+     * @return Integration statistics.
+     */
+    IntegrationStats getIntegrationStats() const;
+
+    /**
+     * @brief Clears the integration counters.
+     */
+    void resetIntegrationStats();
+
+    /**
+     * @brief Returns the measured simulation speed of back-to-back runs.
+     *
+     * Measured over all runFor() and runUntil() calls since the last reset.
+     *
+     * @return Simulated seconds per wall-clock second, or 0 if nothing was measured yet.
+     */
+    double getSimulationSpeed() const;
+
+    /**
+     * @brief Clears the simulation speed measurement.
+     */
+    void resetSpeedMeasurement();
+
+    /**
+     * @brief Serialises the complete simulation state into a compact, versioned binary checkpoint.
+     *
+     * The checkpoint holds the simulated time, the patient model (glucose, IOB, drift),
+     * the reservoir, battery, pump and active bolus, the controller rate, the raised
+     * alerts, every pending event (sensor samples, meals, basal changes, bolus pulses, faults),
+     * the state of every random stream and the position in the loaded scenario, whose
+     * file is reopened on restore. A restored engine continues bit for bit like
+     * the one that was saved. The logger, the clock mode and signal connections are not
+     * part of the checkpoint.
+     *
+     * @return The checkpoint.
+     */
+    QByteArray saveCheckpoint() const;
+
+    /**
+     * @brief Replaces the simulation state with a checkpoint written by saveCheckpoint().
+     *
+     * Event ids are kept, so ids returned by the schedule functions before the checkpoint
+     * was saved stay valid for cancelEvent(). The clock is moved to the checkpoint's time.
+     *
+     * @param checkpoint Checkpoint data.
+     * @return False, leaving the engine unchanged, if the data is not a checkpoint, comes
+     *         from a newer version or is truncated.
+     */
+    bool restoreCheckpoint(const QByteArray &checkpoint);
+
+    /**
+     * @brief Reseeds the simulated patient's random generator.
+     *
+     * Call before running: two engines with the same seed, settings and inputs produce
+     * identical runs.
+     *
+     * @param seed Seed of the patient generator.
+     */
+    void setSeed(quint64 seed);
+
+    /**
+     * @brief Returns the seed of the simulated patient's random generator.
+     * @return The seed.
+     */
+    quint64 getSeed() const;
+
+    /**
+     * @brief Sets the simulated patient's physiological parameters.
+     *
+     * Call before running; glucose restarts at the patient's start glucose.
+     *
+     * @param parameters Patient parameters.
+     */
+    void setPatient(const PatientParameters &parameters);
+
+    /**
+     * @brief Returns the simulated patient's physiological parameters.
+     * @return Patient parameters.
+     */
+    PatientParameters getPatient() const;
+
+    /**
+     * @brief Switches the CGM between the patient model and recorded readings.
+     *
+     * In replay mode the model's own sensor samples stop; each reading scheduled with
+     * scheduleRecordedReading() replaces the modelled glucose and runs the safety checks,
+     * Control-IQ and logging exactly as a sensor sample would. Delivery, the reservoir and
+     * the battery are still integrated between readings. Leaving replay mode restarts the
+     * model's sensor samples.
+     *
+     * @param replay True to replay recorded readings.
+     */
+    void setReplayMode(bool replay);
+    bool isReplayMode() const;
+
+    /**
+     * @brief Enables or disables the monitoring loop (CGM reading, control and delivery).
+     * @param monitoring True while the device is unlocked and monitoring.
+     */
+    void setMonitoring(bool monitoring);
+
+    /**
+     * @brief Checks whether the monitoring loop is active.
+     * @return True if monitoring.
+     */
+    bool isMonitoring() const;
+
+    /**
+     * @brief Sets the profile used by the controller and the glucose model.
+     * @param profile Profile to simulate with.
+     */
+    void setProfile(const Profile &profile);
+
+    /**
+     * @brief Returns the profile the engine simulates with.
+     * @return The current profile.
+     */
+    Profile getProfile() const;
+
+    /**
+     * @brief Simulates carbohydrate intake using the profile carb ratio.
+     *
+     * The meal is absorbed with the default profile of getCarbAbsorption(); each gram
+     * raises glucose by the carb ratio as it is absorbed.
+     *
+     * @param carbs Carbohydrates eaten (grams).
+     */
+    void intakeCarbs(double carbs);
+
+    /**
+     * @brief Simulates carbohydrate intake absorbed along its own profile.
+     * @param carbs Carbohydrates eaten (grams).
+     * @param absorption How the meal is absorbed.
+     */
+    void intakeCarbs(double carbs, const CarbAbsorption::Profile &absorption);
+
+    /**
+     * @brief Starts a bolus of any kind (normal, extended, dual-wave or split) now.
+     *
+     * The plan runs alongside the plans already running; a normal bolus replaces a normal
+     * bolus still being delivered (see PumpController::startPlan()). The engine steps to
+     * the start and end of each of its pulses.
+     * @param plan Bolus compiled into pulses, e.g. DeliveryPlan::dualWave().
+     * @return Pump plan id, for PumpController::cancelPlan(); 0 if delivery is blocked.
+     */
+    quint64 startBolus(const DeliveryPlan &plan);
+
+    /**
+     * @brief Simulates a CGM sensor error.
+     * @param error True to disconnect the sensor, false to reconnect it.
+     */
+    void setCGMError(bool error);
+
+    /**
+     * @brief Simulates a pump occlusion.
+     * @param error True to occlude the pump, false to clear the occlusion.
+     */
+    void setPumpError(bool error);
+
+    /**
+     * @brief Simulates a failing battery.
+     * @param error True to fail the battery, false to clear the failure.
+     */
+    void setBatteryError(bool error);
+
+    /**
+     * @brief Makes a fault strike at random.
+     *
+     * Onsets and recoveries are drawn from the engine's fault stream and fire as events,
+     * so runs stay reproducible from the seed. A disabled profile stops the random fault.
+     *
+     * @param fault Which fault.
+     * @param profile How often it strikes and how long it lasts.
+     */
+    void setFaultProfile(FaultType fault, const FaultProfile &profile);
+
+    /**
+     * @brief Returns the glucose forecast made at the latest sensor sample.
+     *
+     * Computed once per sample, so the controller, the alerts and any client share it at
+     * no extra cost. Invalid until enough consecutive readings were taken.
+     *
+     * @return The forecast.
+     */
+    Forecast getForecast() const;
+
+    /**
+     * @brief Replaces the controller, e.g. with a clone() of another engine's to compare strategies from one state.
+     * @param controller New controller; the engine takes ownership. Ignored if nullptr.
+     */
+    void setController(ControlIQAlgorithm *controller);
+
+    /**
+     * @brief Records the wall-clock time of every controller decision, for benchmarks.
+     *
+     * A decision is the forecast update, the safety checks and the basal decision on one
+     * sensor sample, without the logging. Not part of the checkpoint.
+     *
+     * @param latencies Vector receiving one entry per sample (ns), or nullptr to stop recording.
+     */
+    void setDecisionLatencies(QVector<qint64> *latencies);
+
+    // Subsystem accessors:
+    BatteryManager *getBattery() const;
+    InsulinReserve *getInsulinReserve() const;
+    Bloodstream *getBloodstream() const;
+    CGMReader *getCGM() const;
+    CarbAbsorption *getCarbAbsorption() const;
+    FaultInjector *getFaults() const; ///< Thread-safe manual faults; the engine applies them at its next event.
+    PumpController *getPump() const;
+    ControlIQAlgorithm *getController() const;
+    AlertMonitor *getAlerts() const;
+    DataLogger *getLogger() const;
+    SimClock *getClock() const;
+
+signals:
+    /**
+     * @brief Emitted after each sensor sample with the new device readings.
+     * @param sample Readings at the sample.
+     */
+    void sampled(const SimulationSample &sample);
+
+private:
+    bool monitoring; ///< Whether the monitoring loop is active.
+    bool replayMode; ///< Whether recorded readings replace the model's sensor samples.
+    Profile profile; ///< Profile used for control and correction.
+    qint64 measuredSimMSecs; ///< Simulated time run back-to-back since the last speed reset (ms).
+    qint64 measuredWallNs; ///< Wall-clock time spent on those ticks (ns).
+    qint64 simMSecs; ///< Simulated time the model has been integrated to (ms since epoch).
+    double lastGlucose; ///< Latest CGM reading, or -1 if the CGM was disconnected or not monitoring.
+    quint64 bolusCompleteEvent; ///< Pending BolusComplete event id, or 0.
+    qint64 fineStepMSecs; ///< Fine integration step (ms).
+    qint64 coarseStepMSecs; ///< Coarse integration step (ms).
+    bool adaptiveStepping; ///< Whether coarse steps are used at steady state.
+    IntegrationStats integrationStats; ///< Counters since the last reset.
+
+    SimClock *clock; ///< Source of simulated time for every timestamp
+    SimRandom random; ///< Root stream of the simulated patient's random numbers
+    EventScheduler scheduler; ///< Pending timed events
+
+    DataLogger *logger; ///< Logs events, glucose, and insulin data (not owned, may be nullptr).
+    BatteryManager *battery; ///< Manages battery level and drain
+    InsulinReserve *insulin; ///< Tracks insulin reservoir
+    Bloodstream *bloodstream; ///< Receives insulin injections
+    CGMReader *cgm; ///< Simulates CGM readings
+    CarbAbsorption *carbAbsorption; ///< Meals being absorbed
+    ControlIQAlgorithm *controlIQ; ///< Automated basal adjustment algorithm
+    PumpController *pump; ///< Executes insulin delivery logic
+    AlertMonitor *alerts; ///< Tracks raised alerts
+    FaultInjector *faults; ///< Manual and random faults
+    SimRandom faultRandom; ///< Stream of the random fault draws
+    int appliedFaults; ///< Faults applied to the hardware, one bit per FaultType
+    quint64 faultEvents[FaultInjector::faultCount]; ///< Pending FaultTransition event ids, or 0.
+    Scenario *scenario; ///< Loaded scenario, or nullptr
+    qint64 scenarioStartMSecs; ///< Simulated time the scenario started at (ms since epoch).
+    quint64 scenarioEvent; ///< Pending ScenarioStep event id, or 0.
+    QVector<qint64> *decisionLatencies; ///< Receives decision times (ns), or nullptr (not owned).
+
+    /**
+     * @brief Reads a checkpoint over the current state.
+     * @param checkpoint Checkpoint data.
+     * @return False if the checkpoint was rejected or truncated; the state is then partly overwritten.
+     */
+    bool readCheckpoint(const QByteArray &checkpoint);
+
+    /**
+     * @brief Checks the payload of an event read from a checkpoint.
+     * @param event Restored event.
+     * @return False if its fault kind or absorption shape is out of range.
+     */
+    static bool isRestorableEvent(const SimEvent &event);
+
+    /**
+     * @brief Fires every event up to the given time, then integrates up to it.
+     * @param msecs Simulated time to run to (ms since epoch).
+     * @param samples Optional vector that receives every sensor sample produced.
+     * @return Number of events fired.
+     */
+    int processUntil(qint64 msecs, QVector<SimulationSample> *samples);
+
+    /**
+     * @brief Integrates up to the next event and fires it.
+     * @param samples Optional vector that receives the sample if it is a sensor sample.
+     * @return False if no event is pending.
+     */
+    bool processNextEvent(QVector<SimulationSample> *samples);
+
+    /**
+     * @brief Integrates the continuous processes (battery, delivery, glucose) up to the given time.
+     * @param msecs Simulated time to integrate to (ms since epoch).
+     */
+    void integrateTo(qint64 msecs);
+
+    /**
+     * @brief Advances the glucose model and insulin delivery by one integration step.
+     * @param elapsedMSecs Step length in milliseconds.
+     */
+    void integrateStep(qint64 elapsedMSecs);
+
+    /**
+     * @brief Returns the integration step to use from the current state.
+     * @return Step length in ms.
+     */
+    qint64 stepMSecs() const;
+
+    /**
+     * @brief Runs a monitoring cycle on the current CGM reading and reports the sample.
+     * @param samples Optional vector that receives the sample.
+     */
+    void takeSample(QVector<SimulationSample> *samples);
+
+    /**
+     * @brief Builds an event with an empty payload.
+     * @param msecs Simulated time of the event (clamped to the current time).
+     * @param type Kind of event.
+     * @return The event, for the caller to fill in and schedule.
+     */
+    SimEvent makeEvent(qint64 msecs, SimEvent::Type type) const;
+
+    /**
+     * @brief Starts a basal segment: sets the profile basal rate and, unless delivery is suspended, the pump's.
+     * @param rate New basal rate (units/hour).
+     */
+    void startBasalSegment(double rate);
+
+    /**
+     * @brief Applies the active faults to the CGM, pump and battery if they changed.
+     */
+    void applyFaults();
+
+    /**
+     * @brief Takes every scenario action due and schedules the next one.
+     */
+    void takeScenarioActions();
+
+    /**
+     * @brief Applies one scenario action.
+     * @param action Action to take.
+     */
+    void applyScenarioAction(const ScenarioAction &action);
+
+    /**
+     * @brief (Re)schedules the BolusComplete event for the next pulse of the pump's plans to start or finish.
+     */
+    void scheduleBolusCompletion();
+
+    /**
+     * @brief Returns the device readings at the current time.
+     * @param glucose CGM reading to report.
+     */
+    SimulationSample currentSample(double glucose) const;
+
+    /**
+     * @brief Returns what insulin on board and carbs on board do to glucose from now on.
+     * @return Effects for GlucoseForecaster::forecast().
+     */
+    ForecastEffects forecastEffects() const;
+
+    /**
+     * @brief Executes one monitoring cycle: read sensors, run safety checks, run the controller and log data.
+     * @return The CGM reading, or -1 if the CGM is disconnected.
+     */
+    double monitor();
+
+    /**
+     * @brief Evaluates safety conditions and raises or resets alerts as needed.
+     * @param glucose Current glucose reading from CGM
+     * @param target  Profile target glucose level
+     */
+    void safetyChecks(double glucose, double target);
+};
+
+#endif // SIMULATIONENGINE_H
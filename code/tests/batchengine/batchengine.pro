@@ -0,0 +1,7 @@
+# BatchEngine: the SIMD kernels against the scalar kernel and the scalar model objects.
+TARGET = tst_batchengine
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_batchengine.cpp
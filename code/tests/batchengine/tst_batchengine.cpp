@@ -0,0 +1,129 @@
+#include <QDateTime>
+#include <QtTest>
+#include <cstring>
+#include "batchengine.h"
+#include "populationrunner.h"
+
+class TestBatchEngine : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void kernelsMatchScalarModel();
+    void kernelsMatchScalarKernel();
+    void populationOutcomesMatchAcrossKernels();
+    void unsupportedKernelFallsBack();
+
+private:
+    static QList<BatchEngine::Kernel> kernels();
+    static bool sameBits(double a, double b);
+};
+
+// Every kernel this build and CPU can run, the scalar one first
+QList<BatchEngine::Kernel> TestBatchEngine::kernels() {
+    QList<BatchEngine::Kernel> kernels;
+    for (int kernel = BatchEngine::ScalarKernel; kernel <= BatchEngine::bestKernel(); kernel++) {
+        kernels.append(BatchEngine::Kernel(kernel));
+    }
+    return kernels;
+}
+
+bool TestBatchEngine::sameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+void TestBatchEngine::kernelsMatchScalarModel() {
+    if (!BatchEngine::matchesScalarDosing()) {
+        QSKIP("The scalar objects dose in fixed point in this build");
+    }
+    for (BatchEngine::Kernel kernel : kernels()) {
+        // An odd batch, so the vector kernels also leave patients to the scalar loop
+        QCOMPARE(BatchEngine::compareWithScalarModel(kernel, 37, 400, 7), 0);
+    }
+}
+
+void TestBatchEngine::kernelsMatchScalarKernel() {
+    const int patients = 37;
+    PopulationRunner population(patients, 11);
+    SensorParameters sensor = SensorParameters::typical();
+    sensor.dropoutRate = 0.02;
+
+    QList<BatchEngine::Kernel> available = kernels();
+    std::vector<std::unique_ptr<BatchEngine>> batches;
+    for (BatchEngine::Kernel kernel : available) {
+        std::unique_ptr<BatchEngine> batch(new BatchEngine(patients));
+        batch->setKernel(kernel);
+        QCOMPARE(batch->getKernel(), kernel);
+        for (int i = 0; i < patients; i++) {
+            batch->setPatient(i, population.patient(i).parameters, population.patient(i).seed);
+            batch->setSensor(i, sensor);
+        }
+        batches.push_back(std::move(batch));
+    }
+
+    for (int step = 1; step <= 24 * 60; step++) {
+        for (auto &batch : batches) {
+            if (step % 180 == 0) {
+                for (int i = 0; i < patients; i += 3) {
+                    batch->intakeCarbs(i, 40);
+                    batch->deliverBolus(i, 4, 10);
+                }
+            }
+            if (step % 5 == 0) {
+                batch->sample();
+            }
+            batch->step(1 / 60.0);
+        }
+
+        const BatchEngine &scalar = *batches.front();
+        for (size_t k = 1; k < batches.size(); k++) {
+            const BatchEngine &batch = *batches[k];
+            for (int i = 0; i < patients; i++) {
+                QVERIFY(sameBits(batch.getGlucose(i), scalar.getGlucose(i)));
+                QVERIFY(sameBits(batch.getSensorGlucose(i), scalar.getSensorGlucose(i)));
+                QVERIFY(sameBits(batch.getIOB(i), scalar.getIOB(i)));
+                QVERIFY(sameBits(batch.getInsulinRemaining(i), scalar.getInsulinRemaining(i)));
+                QVERIFY(sameBits(batch.getBolusRemaining(i), scalar.getBolusRemaining(i)));
+                QVERIFY(sameBits(batch.getBasalRate(i), scalar.getBasalRate(i)));
+            }
+        }
+    }
+}
+
+void TestBatchEngine::populationOutcomesMatchAcrossKernels() {
+    PopulationRunner population(21, 5);
+    QVector<VirtualPatient> patients;
+    for (int i = 0; i < 21; i++) {
+        patients.append(population.patient(i));
+    }
+    const QDateTime start(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC);
+    const QVector<PatientOutcome> scalar =
+            PopulationRunner::simulateBatch(patients, Profile::defaultProfile(), start, 2, BatchEngine::ScalarKernel);
+
+    for (BatchEngine::Kernel kernel : kernels()) {
+        const QVector<PatientOutcome> outcomes =
+                PopulationRunner::simulateBatch(patients, Profile::defaultProfile(), start, 2, kernel);
+        QCOMPARE(outcomes.size(), scalar.size());
+        for (int i = 0; i < outcomes.size(); i++) {
+            QCOMPARE(outcomes[i].readings, scalar[i].readings);
+            QVERIFY(sameBits(outcomes[i].meanGlucose, scalar[i].meanGlucose));
+            QVERIFY(sameBits(outcomes[i].minGlucose, scalar[i].minGlucose));
+            QVERIFY(sameBits(outcomes[i].maxGlucose, scalar[i].maxGlucose));
+            QVERIFY(sameBits(outcomes[i].timeInRange, scalar[i].timeInRange));
+            QVERIFY(sameBits(outcomes[i].insulinDelivered, scalar[i].insulinDelivered));
+        }
+    }
+}
+
+void TestBatchEngine::unsupportedKernelFallsBack() {
+    BatchEngine batch(4);
+    QCOMPARE(batch.getKernel(), BatchEngine::bestKernel());
+    batch.setKernel(BatchEngine::AVX2Kernel);
+    QVERIFY(batch.getKernel() <= BatchEngine::bestKernel());
+    batch.setKernel(BatchEngine::ScalarKernel);
+    QCOMPARE(batch.getKernel(), BatchEngine::ScalarKernel);
+}
+
+QTEST_APPLESS_MAIN(TestBatchEngine)
+
+#include "tst_batchengine.moc"
@@ -0,0 +1,7 @@
+# SimulationEngine checkpoints: round trip, bit-for-bit continuation and corrupt input.
+TARGET = tst_checkpoint
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_checkpoint.cpp
@@ -0,0 +1,115 @@
+#include <QDateTime>
+#include <QtTest>
+#include <cstring>
+#include "deliveryplan.h"
+#include "simulationengine.h"
+
+class TestCheckpoint : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTripIsByteIdentical();
+    void restoredEngineContinuesBitForBit();
+    void corruptCheckpointIsRejected();
+    void unknownFaultIsRejected();
+
+private:
+    static const QDateTime start;
+
+    // Runs two days of meals, basal changes, boluses and faults up to the middle of an extended bolus
+    static void runToCheckpoint(SimulationEngine &engine);
+};
+
+const QDateTime TestCheckpoint::start(QDate(2024, 1, 1), QTime(0, 0), Qt::UTC);
+
+void TestCheckpoint::runToCheckpoint(SimulationEngine &engine) {
+    engine.setTime(start);
+    engine.setSeed(42);
+    engine.setMonitoring(true);
+    engine.setPatient(PatientParameters());
+    for (int day = 0; day < 3; day++) {
+        engine.scheduleMeal(start.addDays(day).addSecs(8 * 3600), 50);
+        engine.scheduleMeal(start.addDays(day).addSecs(13 * 3600), 70);
+        engine.scheduleBasalRate(start.addDays(day).addSecs(22 * 3600), 0.8);
+        engine.scheduleBasalRate(start.addDays(day).addSecs(6 * 3600), 1.1);
+    }
+    engine.scheduleFault(start.addDays(2).addSecs(2 * 3600), SimulationEngine::SensorFault, true);
+    engine.scheduleFault(start.addDays(2).addSecs(3 * 3600), SimulationEngine::SensorFault, false);
+
+    engine.runUntil(start.addDays(1).addSecs(13 * 3600));
+    engine.startBolus(DeliveryPlan::dualWave(3, 4, 2, 10));
+    engine.runUntil(start.addDays(1).addSecs(14 * 3600 + 7 * 60 + 30)); // Between samples, mid-plan
+}
+
+void TestCheckpoint::roundTripIsByteIdentical() {
+    SimulationEngine original;
+    runToCheckpoint(original);
+    const QByteArray checkpoint = original.saveCheckpoint();
+    QVERIFY(!checkpoint.isEmpty());
+
+    SimulationEngine restored;
+    restored.setSeed(7);
+    QVERIFY(restored.restoreCheckpoint(checkpoint));
+    QCOMPARE(restored.saveCheckpoint(), checkpoint);
+    QCOMPARE(restored.currentTime(), original.currentTime());
+    QCOMPARE(restored.getSeed(), original.getSeed());
+}
+
+void TestCheckpoint::restoredEngineContinuesBitForBit() {
+    SimulationEngine original;
+    runToCheckpoint(original);
+    SimulationEngine restored;
+    QVERIFY(restored.restoreCheckpoint(original.saveCheckpoint()));
+
+    QVector<SimulationSample> expected, actual;
+    original.runUntil(start.addDays(3), &expected);
+    restored.runUntil(start.addDays(3), &actual);
+
+    QVERIFY(expected.size() > 300);
+    QCOMPARE(actual.size(), expected.size());
+    for (int i = 0; i < expected.size(); i++) {
+        QVERIFY(std::memcmp(&actual[i], &expected[i], sizeof(SimulationSample)) == 0);
+    }
+    QCOMPARE(restored.saveCheckpoint(), original.saveCheckpoint());
+}
+
+void TestCheckpoint::corruptCheckpointIsRejected() {
+    SimulationEngine original;
+    runToCheckpoint(original);
+    const QByteArray checkpoint = original.saveCheckpoint();
+
+    SimulationEngine engine;
+    engine.setSeed(7);
+    const QByteArray before = engine.saveCheckpoint();
+
+    QVERIFY(!engine.restoreCheckpoint(checkpoint.left(checkpoint.size() - 3)));
+    QCOMPARE(engine.saveCheckpoint(), before);
+
+    QByteArray badMagic = checkpoint;
+    badMagic[0] = 'X';
+    QVERIFY(!engine.restoreCheckpoint(badMagic));
+    QCOMPARE(engine.saveCheckpoint(), before);
+
+    QVERIFY(!engine.restoreCheckpoint(QByteArray()));
+    QCOMPARE(engine.saveCheckpoint(), before);
+}
+
+void TestCheckpoint::unknownFaultIsRejected() {
+    SimulationEngine original;
+    original.setTime(start);
+    original.setSeed(42);
+    original.scheduleMeal(start.addSecs(8 * 3600), 50);
+    const QByteArray good = original.saveCheckpoint();
+    original.scheduleFault(start.addSecs(2 * 3600), SimulationEngine::FaultType(7), true);
+    const QByteArray bad = original.saveCheckpoint();
+
+    SimulationEngine engine;
+    QVERIFY(engine.restoreCheckpoint(good));
+    QVERIFY(!engine.restoreCheckpoint(bad));
+    QCOMPARE(engine.saveCheckpoint(), good);
+}
+
+QTEST_GUILESS_MAIN(TestCheckpoint)
+
+#include "tst_checkpoint.moc"
@@ -0,0 +1,9 @@
+# Delivery audit trail: the ring buffer wrapping and filling up, and the hand-over to the logger.
+TARGET = tst_deliveryaudit
+
+CONFIG += thread
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_deliveryaudit.cpp
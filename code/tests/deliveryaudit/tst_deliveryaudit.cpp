@@ -0,0 +1,151 @@
+#include <QThread>
+#include <QtTest>
+#include "bloodstream.h"
+#include "datalogger.h"
+#include "deliveryaudit.h"
+#include "deliveryplan.h"
+#include "insulinreserve.h"
+#include "pumpcontroller.h"
+#include "simclock.h"
+
+class TestDeliveryAudit : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void ringKeepsOrderAcrossWraps();
+    void fullRingWaitsForConsumer();
+    void auditorHandsOverEveryRecord();
+    void delayedPulseHasItsOwnTime();
+
+private:
+    static DeliveryRecord record(qint64 msecs);
+    static constexpr qint64 startMSecs = 1000000000000LL;
+};
+
+DeliveryRecord TestDeliveryAudit::record(qint64 msecs) {
+    DeliveryRecord record = {};
+    record.msecs = msecs;
+    record.kind = DeliveryRecord::BolusStarted;
+    record.units = msecs * 0.5;
+    return record;
+}
+
+void TestDeliveryAudit::ringKeepsOrderAcrossWraps() {
+    DeliveryAuditLog log;
+    DeliveryRecord taken;
+    QVERIFY(!log.take(&taken));
+
+    // Batches of every size up to full, so head and tail wrap at every offset
+    qint64 next = 0, expected = 0;
+    for (int batch = 1; batch < 3 * DeliveryAuditLog::capacity; batch += 97) {
+        int size = batch % DeliveryAuditLog::capacity;
+        for (int i = 0; i < size; i++) {
+            log.record(record(next++));
+        }
+        for (int i = 0; i < size; i++) {
+            QVERIFY(log.take(&taken));
+            QCOMPARE(taken.msecs, expected);
+            QCOMPARE(taken.units, expected * 0.5);
+            expected++;
+        }
+        QVERIFY(!log.take(&taken));
+    }
+    QCOMPARE(expected, next);
+    QCOMPARE(log.fullWaits(), 0);
+}
+
+void TestDeliveryAudit::fullRingWaitsForConsumer() {
+    DeliveryAuditLog log;
+    const qint64 count = 5 * DeliveryAuditLog::capacity;
+    QList<qint64> received;
+
+    // The consumer starts late, so the producer fills the ring and has to wait for it
+    QThread *consumer = QThread::create([&log, &received, count]() {
+        QThread::msleep(50);
+        DeliveryRecord taken;
+        while (received.size() < count) {
+            if (log.take(&taken)) {
+                received.append(taken.msecs);
+            } else {
+                QThread::yieldCurrentThread();
+            }
+        }
+    });
+    consumer->start();
+    for (qint64 i = 0; i < count; i++) {
+        log.record(record(i));
+    }
+    QVERIFY(consumer->wait(30000));
+    delete consumer;
+
+    QVERIFY(log.fullWaits() > 0);
+    QCOMPARE(qint64(received.size()), count);
+    for (qint64 i = 0; i < count; i++) {
+        QCOMPARE(received[int(i)], i);
+    }
+}
+
+void TestDeliveryAudit::auditorHandsOverEveryRecord() {
+    DataLogger logger;
+    logger.setDeferredWrites(true); // Nothing is written to disk: the test never flushes
+    SimClock clock(SimClock::FreeRunning, QDateTime::fromMSecsSinceEpoch(startMSecs));
+    InsulinReserve insulin;
+    const int suspensions = 3 * DeliveryAuditLog::capacity;
+    {
+        PumpController pump(&insulin, &logger);
+        PumpController other(&insulin, &logger);
+        pump.setClock(&clock);
+        other.setClock(&clock);
+        QCOMPARE(DeliveryAuditor::of(&logger), DeliveryAuditor::of(&logger));
+
+        for (int i = 0; i < suspensions; i++) {
+            pump.suspendBolus(); // Several times around the ring
+        }
+        other.triggerEmergencyStop();
+        DeliveryAuditor::of(&logger)->deliver();
+        QCOMPARE(logger.retrieveHistory().size(), suspensions + 1);
+
+        pump.triggerEmergencyStop(); // Handed over when the pump detaches
+    }
+
+    const QList<LogEntry> history = logger.retrieveHistory();
+    QCOMPARE(history.size(), suspensions + 2);
+    int stops = 0;
+    for (const LogEntry &entry : history) {
+        QCOMPARE(entry.timestamp.toMSecsSinceEpoch(), startMSecs);
+        if (entry.description == "Emergency stop activated.") {
+            stops++;
+        }
+    }
+    QCOMPARE(stops, 2);
+}
+
+void TestDeliveryAudit::delayedPulseHasItsOwnTime() {
+    DataLogger logger;
+    logger.setDeferredWrites(true);
+    SimClock clock(SimClock::FreeRunning, QDateTime::fromMSecsSinceEpoch(startMSecs));
+    InsulinReserve insulin;
+    Bloodstream blood;
+    {
+        PumpController pump(&insulin, &logger);
+        pump.setClock(&clock);
+        pump.startPlan(DeliveryPlan::split(1, 1, 0.1, 6)); // Second half starts 6 minutes in
+        for (int minute = 0; minute < 20; minute++) {
+            pump.pump(&blood, 60000, startMSecs + minute * 60000); // The clock stays at the start
+        }
+    }
+
+    int delayed = 0;
+    for (const LogEntry &entry : logger.retrieveHistory()) {
+        if (entry.eventType == "Extended Bolus") {
+            QCOMPARE(entry.timestamp.toMSecsSinceEpoch(), startMSecs + 6 * 60000);
+            delayed++;
+        }
+    }
+    QCOMPARE(delayed, 1);
+}
+
+QTEST_GUILESS_MAIN(TestDeliveryAudit)
+
+#include "tst_deliveryaudit.moc"
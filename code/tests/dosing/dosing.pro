@@ -0,0 +1,7 @@
+# Fixed-point dosing (fixedpoint.h) against the double formulas, in either dosing build.
+TARGET = tst_dosing
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_dosing.cpp
@@ -0,0 +1,103 @@
+#include <QtTest>
+#include <cmath>
+#include "bloodstream.h"
+#include "fixedpoint.h"
+#include "glucosemodel.h"
+#include "insulinreserve.h"
+#include "pumpcontroller.h"
+
+typedef Fixed<1000000> MicroUnits;
+
+class TestDosing : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fixedRoundsToNearestStep();
+    void bolusFormulasMatchDouble();
+    void unitsOverMatchesDouble();
+    void fixedBolusDeliversExactDose();
+    void pumpDosesAsDouble();
+
+private:
+    static constexpr double step = 1e-6; ///< One micro-unit.
+};
+
+void TestDosing::fixedRoundsToNearestStep() {
+    QCOMPARE((MicroUnits(1) / MicroUnits(3)).steps(), qint64(333333));
+    QCOMPARE((MicroUnits(2) / MicroUnits(3)).steps(), qint64(666667));
+    QCOMPARE((MicroUnits::fromRaw(1) * MicroUnits(0.5)).steps(), qint64(1)); // Halves away from zero
+    QCOMPARE((MicroUnits::fromRaw(-1) * MicroUnits(0.5)).steps(), qint64(-1));
+    QCOMPARE(MicroUnits(0.1234564).steps(), qint64(123456));
+    QCOMPARE(double(MicroUnits(2.5) + MicroUnits(0.25)), 2.75);
+}
+
+void TestDosing::bolusFormulasMatchDouble() {
+    for (double glucose = 2; glucose <= 25; glucose += 0.7) {
+        for (double correctionFactor = 0.5; correctionFactor <= 5; correctionFactor += 0.45) {
+            const double target = 6.1;
+            double exact = GlucoseModel::correctionBolus(glucose, target, correctionFactor);
+            double fixed = double(GlucoseModel::correctionBolus(MicroUnits(glucose), MicroUnits(target),
+                                                                MicroUnits(correctionFactor)));
+            QVERIFY(std::fabs(fixed - exact) <= 2 * step);
+
+            for (double carbs = 0; carbs <= 120; carbs += 15) {
+                const double carbRatio = 0.25;
+                exact = GlucoseModel::carbBolus(carbs, carbRatio, correctionFactor);
+                fixed = double(GlucoseModel::carbBolus(carbs, MicroUnits(carbRatio), MicroUnits(correctionFactor)));
+                QVERIFY(std::fabs(fixed - exact) <= 2 * step);
+            }
+        }
+    }
+}
+
+void TestDosing::unitsOverMatchesDouble() {
+    const double rates[] = {0, 0.05, 0.8, 1.25, 10, 37.5};
+    const qint64 intervals[] = {1, 999, 60000, 150000, 300000, 3600000};
+    for (double rate : rates) {
+        for (qint64 msecs : intervals) {
+            double exact = unitsOver(rate, msecs);
+            double fixed = double(unitsOver(MicroUnits(rate), msecs));
+            QVERIFY(std::fabs(fixed - exact) <= step / 2);
+        }
+    }
+}
+
+void TestDosing::fixedBolusDeliversExactDose() {
+    // 5 units at 7 units/hour in 37-second ticks: every tick rounds, the total does not drift
+    const MicroUnits dose(5.0);
+    const MicroUnits rate(7.0);
+    MicroUnits remaining = dose;
+    MicroUnits delivered;
+    int ticks = 0;
+    while (remaining > MicroUnits()) {
+        MicroUnits tick = GlucoseModel::bolusDelivered(remaining, rate, qint64(37000));
+        remaining -= tick;
+        delivered += tick;
+        ticks++;
+    }
+    QCOMPARE(delivered, dose);
+    QCOMPARE(ticks, int(std::ceil(5.0 / (7.0 * 37000 / 3600000))));
+}
+
+void TestDosing::pumpDosesAsDouble() {
+    // The pump in this build (double or fixed point) against the dose worked out in double
+    InsulinReserve insulin;
+    Bloodstream blood;
+    PumpController pump(&insulin, nullptr);
+    const double before = insulin.getInsulinRemaining();
+
+    pump.adjustBasalRate(1.3);
+    pump.deliverBolus(4.35, 10);
+    for (int tick = 0; tick < 120; tick++) {
+        pump.pump(&blood, 60000);
+    }
+
+    const double expected = 4.35 + 1.3 * 2;
+    QVERIFY(std::fabs((before - insulin.getInsulinRemaining()) - expected) <= 120 * step);
+    QVERIFY(std::fabs(blood.getIOB() - expected) <= 120 * step);
+}
+
+QTEST_GUILESS_MAIN(TestDosing)
+
+#include "tst_dosing.moc"
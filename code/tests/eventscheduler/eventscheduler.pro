@@ -0,0 +1,7 @@
+# EventScheduler: event order, cancellation and checkpointing.
+TARGET = tst_eventscheduler
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_eventscheduler.cpp
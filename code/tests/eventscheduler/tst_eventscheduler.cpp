@@ -0,0 +1,160 @@
+#include <QByteArray>
+#include <QDataStream>
+#include <QtTest>
+#include "eventscheduler.h"
+
+class TestEventScheduler : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void firesInTimeOrder();
+    void equalTimesFireInSchedulingOrder();
+    void cancelledEventsAreSkipped();
+    void cancellingUnknownOrFiredIdsIsIgnored();
+    void shiftMovesEveryEvent();
+    void checkpointKeepsOrderAndDropsCancelled();
+    void restoreRejectsUnknownType();
+
+private:
+    static SimEvent event(qint64 time, SimEvent::Type type = SimEvent::Meal, double amount = 0);
+    static QList<double> drain(EventScheduler &scheduler);
+};
+
+SimEvent TestEventScheduler::event(qint64 time, SimEvent::Type type, double amount) {
+    SimEvent event = {};
+    event.time = time;
+    event.type = type;
+    event.amount = amount;
+    return event;
+}
+
+// Amounts of the remaining events, in firing order
+QList<double> TestEventScheduler::drain(EventScheduler &scheduler) {
+    QList<double> amounts;
+    SimEvent next;
+    while (scheduler.takeNext(&next)) {
+        amounts.append(next.amount);
+    }
+    return amounts;
+}
+
+void TestEventScheduler::firesInTimeOrder() {
+    EventScheduler scheduler;
+    QVERIFY(scheduler.isEmpty());
+    QCOMPARE(scheduler.nextTime(), qint64(-1));
+
+    scheduler.schedule(event(3000, SimEvent::Meal, 3));
+    scheduler.schedule(event(1000, SimEvent::SensorSample, 1));
+    scheduler.schedule(event(2000, SimEvent::BasalChange, 2));
+    QCOMPARE(scheduler.nextTime(), qint64(1000));
+
+    SimEvent next;
+    QVERIFY(scheduler.takeNext(&next));
+    QCOMPARE(next.time, qint64(1000));
+    QCOMPARE(next.type, SimEvent::SensorSample);
+    QCOMPARE(drain(scheduler), QList<double>({2, 3}));
+    QVERIFY(scheduler.isEmpty());
+    QVERIFY(!scheduler.takeNext(&next));
+}
+
+void TestEventScheduler::equalTimesFireInSchedulingOrder() {
+    EventScheduler scheduler;
+    for (int i = 0; i < 50; i++) {
+        scheduler.schedule(event(i % 2 ? 500 : 100, SimEvent::Meal, i));
+    }
+
+    QList<double> expected;
+    for (int i = 0; i < 50; i += 2) expected.append(i);
+    for (int i = 1; i < 50; i += 2) expected.append(i);
+    QCOMPARE(drain(scheduler), expected);
+}
+
+void TestEventScheduler::cancelledEventsAreSkipped() {
+    EventScheduler scheduler;
+    quint64 first = scheduler.schedule(event(100, SimEvent::Meal, 1));
+    scheduler.schedule(event(200, SimEvent::Meal, 2));
+    quint64 last = scheduler.schedule(event(300, SimEvent::Meal, 3));
+    QVERIFY(first != last);
+
+    scheduler.cancel(first);
+    QCOMPARE(scheduler.nextTime(), qint64(200));
+    scheduler.cancel(last);
+    QCOMPARE(drain(scheduler), QList<double>({2}));
+    QVERIFY(scheduler.isEmpty());
+}
+
+void TestEventScheduler::cancellingUnknownOrFiredIdsIsIgnored() {
+    EventScheduler scheduler;
+    quint64 fired = scheduler.schedule(event(100, SimEvent::Meal, 1));
+    SimEvent next;
+    QVERIFY(scheduler.takeNext(&next));
+    QCOMPARE(next.id, fired);
+
+    scheduler.cancel(fired);
+    scheduler.cancel(fired + 1000);
+    scheduler.schedule(event(200, SimEvent::Meal, 2));
+    scheduler.schedule(event(300, SimEvent::Meal, 3));
+    QCOMPARE(drain(scheduler), QList<double>({2, 3}));
+}
+
+void TestEventScheduler::shiftMovesEveryEvent() {
+    EventScheduler scheduler;
+    scheduler.schedule(event(100, SimEvent::Meal, 1));
+    scheduler.schedule(event(100, SimEvent::Meal, 2));
+    scheduler.schedule(event(400, SimEvent::Meal, 3));
+    scheduler.shift(-50);
+
+    QList<qint64> times;
+    QList<double> amounts;
+    SimEvent next;
+    while (scheduler.takeNext(&next)) {
+        times.append(next.time);
+        amounts.append(next.amount);
+    }
+    QCOMPARE(times, QList<qint64>({50, 50, 350}));
+    QCOMPARE(amounts, QList<double>({1, 2, 3}));
+}
+
+void TestEventScheduler::checkpointKeepsOrderAndDropsCancelled() {
+    EventScheduler scheduler;
+    scheduler.schedule(event(300, SimEvent::Meal, 3));
+    quint64 cancelled = scheduler.schedule(event(200, SimEvent::Meal, 99));
+    scheduler.schedule(event(100, SimEvent::SensorSample, 1));
+    scheduler.schedule(event(300, SimEvent::BasalChange, 4));
+    scheduler.cancel(cancelled);
+
+    QByteArray checkpoint;
+    {
+        QDataStream out(&checkpoint, QIODevice::WriteOnly);
+        scheduler.saveState(out);
+    }
+    EventScheduler restored;
+    restored.schedule(event(50, SimEvent::Meal, -1)); // Replaced by the restore
+    QDataStream in(checkpoint);
+    restored.restoreState(in);
+    QCOMPARE(in.status(), QDataStream::Ok);
+
+    // Ids continue after the checkpoint, so new events still fire after older ones at the same time
+    quint64 added = restored.schedule(event(300, SimEvent::Meal, 5));
+    QVERIFY(added > cancelled);
+    QCOMPARE(drain(restored), QList<double>({1, 3, 4, 5}));
+}
+
+void TestEventScheduler::restoreRejectsUnknownType() {
+    QByteArray checkpoint;
+    {
+        QDataStream out(&checkpoint, QIODevice::WriteOnly);
+        out << quint64(3) << quint32(1);
+        out << qint64(100) << qint32(SimEvent::FaultTransition + 1) << 0.0 << 0.0 << qint32(0) << false << quint64(1);
+    }
+    EventScheduler scheduler;
+    QDataStream in(checkpoint);
+    scheduler.restoreState(in);
+    QCOMPARE(in.status(), QDataStream::ReadCorruptData);
+    QVERIFY(scheduler.isEmpty());
+}
+
+QTEST_APPLESS_MAIN(TestEventScheduler)
+
+#include "tst_eventscheduler.moc"
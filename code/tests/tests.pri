@@ -0,0 +1,15 @@
+# Shared settings of the unit tests: each test is an app linked against the simcore library.
+QT = core testlib
+
+TEMPLATE = app
+CONFIG += console c++17 testcase
+CONFIG -= app_bundle
+
+INCLUDEPATH += $$PWD/..
+DEPENDPATH += $$PWD/..
+
+# The simcore headers must see the same dosing type as the library (see simcore.pri)
+fixed_dosing: DEFINES += FIXED_POINT_DOSING
+
+LIBS += -L$$OUT_PWD/../../simcore -lsimcore
+PRE_TARGETDEPS += $$OUT_PWD/../../simcore/libsimcore.a
@@ -0,0 +1,9 @@
+# Unit tests of the simulation core (QtTest); "make check" builds and runs them all.
+TEMPLATE = subdirs
+
+SUBDIRS = \
+    eventscheduler \
+    batchengine \
+    checkpoint \
+    dosing \
+    deliveryaudit
@@ -13,16 +13,19 @@
 #include <QDebug>
 #include "alert.h"
 
-UserInterface::UserInterface(PumpController* pump, QWidget *parent)
+UserInterface::UserInterface(SimulationEngine* engine, QWidget *parent)
     : QWidget(parent)
     , ui(new Ui::UserInterface)
-    , pumpController(pump)
+    , pumpController(engine->getPump())
+    , cgmReader(engine->getCGM())
+    , insulinReserve(engine->getInsulinReserve())
 {
     ui->setupUi(this);
 
     loginScreen = new Login();
     logger = DataLogger::instance(this);
     homeScreen = new Home();
+    homeScreen->setClock(engine->getClock());
     bolusCalculator = new BolusCalculator(pumpController, logger, cgmReader, insulinReserve, this);
     settingsScreen = new Settings();
     historyScreen = new History();
@@ -70,10 +73,18 @@ void UserInterface::displayHomeScreen() {
 void UserInterface::refresh(double glucose, double battery, double insulin, double iob) {
     homeScreen->updateStatus(glucose, battery, insulin);
     homeScreen->updateIOB(iob);
-    bolusCalculator->updateCountdown();
     this->updateGlucoseForChart(glucose);
 }
 
+void UserInterface::refreshBatch(const QVector<double> &glucoseReadings, double battery, double insulin, double iob) {
+    if (glucoseReadings.isEmpty()) {
+        return;
+    }
+    homeScreen->updateStatus(glucoseReadings.last(), battery, insulin);
+    homeScreen->updateIOB(iob);
+    homeScreen->addGlucoseReadings(glucoseReadings);
+}
+
 void UserInterface::updateGlucoseForChart(double glucose) {
     homeScreen->addGlucoseReading(glucose);
 }
@@ -121,6 +132,10 @@ void UserInterface::updateIOB(double iob){
     homeScreen->updateIOB(iob);
 }
 
+void UserInterface::updateForecast(double glucose, double predicted){
+    homeScreen->updateForecast(glucose, predicted);
+}
+
 void UserInterface::handleBolusCancelled(){
     homeScreen->updateBolusStatus("Bolus Cancelled");
 }
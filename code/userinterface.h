@@ -12,6 +12,7 @@
 
 #include <QWidget>
 #include <QStackedWidget>
+#include <QVector>
 #include "login.h"
 #include "home.h"
 #include "pumpcontroller.h"
@@ -20,9 +21,9 @@
 #include "batterymanager.h"
 #include "insulinreserve.h"
 #include "datalogger.h"
-#include "controliqalgorithm.h"
 #include "settings.h"
 #include "history.h"
+#include "simulationengine.h"
 
 class Alert;
 
@@ -42,11 +43,10 @@ class UserInterface : public QWidget {
 public:
   /**
      * @brief Constructs the UserInterface.
-     * @param pump Pointer to the PumpController.
-     * @param iob Pointer to the IOBTracker.
+     * @param engine Simulation engine providing the pump, the sensors and the clock.
      * @param parent Optional parent QWidget.
      */
-    explicit UserInterface(PumpController* pump, QWidget *parent = nullptr);
+    explicit UserInterface(SimulationEngine* engine, QWidget *parent = nullptr);
     
   /**
      * @brief Destructor for UserInterface.
@@ -72,12 +72,28 @@ public:
      */
     void refresh(double glucose, double battery, double insulin, double iob);
 
+    /**
+     * @brief Updates the UI once after several ticks were simulated back-to-back.
+     * @param glucoseReadings Glucose readings of every tick, oldest first (-1 when disconnected).
+     * @param battery Latest battery level (0.0 to 1.0).
+     * @param insulin Latest amount of insulin remaining.
+     * @param iob Latest insulin on board.
+     */
+    void refreshBatch(const QVector<double> &glucoseReadings, double battery, double insulin, double iob);
+
     /**
      * @brief Updates the IOB display.
      * @param iob New IOB value to show.
      */
     void updateIOB(double iob);
 
+    /**
+     * @brief Updates the glucose prediction display.
+     * @param glucose Current glucose reading (-1 if disconnected).
+     * @param predicted Glucose predicted in 30 minutes, or -1 without a forecast.
+     */
+    void updateForecast(double glucose, double predicted);
+
     /**
      * @brief Displays an alert on the screen.
      * @param alert Pointer to the Alert object.
@@ -140,7 +156,6 @@ private:
     BatteryManager *batteryManager;
     InsulinReserve *insulinReserve;
     DataLogger *logger;
-    ControlIQAlgorithm *controlIQ;
     Settings *settingsScreen;
     History *historyScreen;
     QTimer *pumpTimer;
@@ -0,0 +1,120 @@
+#include "workstealingpool.h"
+#include <QMutexLocker>
+
+namespace {
+// Lets submit() find the calling worker's own deque
+thread_local WorkStealingPool *currentPool = nullptr;
+thread_local int currentWorker = -1;
+}
+
+WorkStealingPool::WorkStealingPool(int threadCount)
+    : queued(0)
+    , unfinished(0)
+    , nextWorker(0)
+    , stopping(false)
+{
+    int count = qMax(1, threadCount);
+    for (int i = 0; i < count; i++) {
+        workers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    for (int i = 0; i < count; i++) {
+        QThread *thread = QThread::create([this, i]() { work(i); });
+        threads.push_back(thread);
+        thread->start();
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    waitForDone();
+    {
+        QMutexLocker locker(&stateMutex);
+        stopping = true;
+        workAvailable.wakeAll();
+    }
+    for (QThread *thread : threads) {
+        thread->wait();
+        delete thread;
+    }
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    int index = currentPool == this
+            ? currentWorker
+            : int(quint32(nextWorker.fetchAndAddRelaxed(1)) % workers.size());
+
+    unfinished.fetchAndAddOrdered(1);
+    queued.fetchAndAddOrdered(1);
+    {
+        QMutexLocker locker(&workers[index]->mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+
+    // Taking the lock orders this wake-up after an idle worker's last check of `queued`
+    QMutexLocker locker(&stateMutex);
+    workAvailable.wakeOne();
+}
+
+void WorkStealingPool::waitForDone()
+{
+    QMutexLocker locker(&stateMutex);
+    while (unfinished.loadAcquire() != 0) {
+        allDone.wait(&stateMutex);
+    }
+}
+
+int WorkStealingPool::threadCount() const
+{
+    return int(workers.size());
+}
+
+void WorkStealingPool::work(int index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    for (;;) {
+        Task task;
+        if (take(index, &task)) {
+            task();
+            task = nullptr; // Release captured state before reporting completion
+            if (unfinished.fetchAndAddOrdered(-1) == 1) {
+                QMutexLocker locker(&stateMutex);
+                allDone.wakeAll();
+            }
+            continue;
+        }
+
+        QMutexLocker locker(&stateMutex);
+        while (queued.loadAcquire() == 0 && !stopping) {
+            workAvailable.wait(&stateMutex);
+        }
+        if (stopping && queued.loadAcquire() == 0) {
+            return;
+        }
+    }
+}
+
+bool WorkStealingPool::take(int index, Task *task)
+{
+    const int count = int(workers.size());
+    for (int i = 0; i < count; i++) {
+        int victim = (index + i) % count;
+        Worker *worker = workers[victim].get();
+        QMutexLocker locker(&worker->mutex);
+        if (worker->tasks.empty()) {
+            continue;
+        }
+        if (victim == index) {
+            *task = std::move(worker->tasks.back()); // Own deque: newest first
+            worker->tasks.pop_back();
+        } else {
+            *task = std::move(worker->tasks.front()); // Steal: oldest first
+            worker->tasks.pop_front();
+        }
+        queued.fetchAndAddOrdered(-1);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file workstealingpool.h
+ * @brief Defines the WorkStealingPool class, a thread pool for independent simulation runs.
+ *
+ * Each worker thread owns a task deque. A worker takes its own newest task first and,
+ * when its deque is empty, steals the oldest task of another worker, so uneven task
+ * lengths (e.g. patients with many boluses) balance out without a shared queue.
+ */
+#ifndef WORKSTEALINGPOOL_H
+#define WORKSTEALINGPOOL_H
+
+#include <QAtomicInt>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @class WorkStealingPool
+ * @brief Fixed-size thread pool with one task deque per worker and work stealing.
+ *
+ * Tasks must not depend on each other. Tasks submitted from a worker go to that
+ * worker's own deque.
+ */
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void()>;
+
+    /**
+     * @brief Starts the worker threads.
+     * @param threadCount Number of workers (at least 1), one per core by default.
+     */
+    explicit WorkStealingPool(int threadCount = QThread::idealThreadCount());
+
+    /**
+     * @brief Finishes every submitted task, then stops the workers.
+     */
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    /**
+     * @brief Queues a task. Tasks submitted from outside the pool are spread round-robin.
+     * @param task Task to run on one of the workers.
+     */
+    void submit(Task task);
+
+    /**
+     * @brief Blocks until every submitted task has finished.
+     */
+    void waitForDone();
+
+    /**
+     * @brief Returns the number of worker threads.
+     */
+    int threadCount() const;
+
+private:
+    struct Worker {
+        QMutex mutex;
+        std::deque<Task> tasks; ///< Owner takes from the back, thieves from the front.
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<QThread *> threads;
+
+    QAtomicInt queued;     ///< Tasks waiting in some deque.
+    QAtomicInt unfinished; ///< Tasks submitted and not finished yet.
+    QAtomicInt nextWorker; ///< Round-robin position for external submits.
+
+    QMutex stateMutex;            ///< Guards sleeping and stopping.
+    QWaitCondition workAvailable; ///< Wakes idle workers.
+    QWaitCondition allDone;       ///< Wakes waitForDone().
+    bool stopping;
+
+    /**
+     * @brief Main loop of a worker thread.
+     * @param index Worker index.
+     */
+    void work(int index);
+
+    /**
+     * @brief Takes a task from the worker's own deque, or steals one from another worker.
+     * @param index Worker index.
+     * @param task Receives the task.
+     * @return False if every deque is empty.
+     */
+    bool take(int index, Task *task);
+};
+
+#endif // WORKSTEALINGPOOL_H